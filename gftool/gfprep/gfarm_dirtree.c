@@ -96,10 +96,27 @@ gfarm_fifo_simple_next(gfarm_fifo_simple_t *fifo, void **pp)
 	return (GFARM_ERR_NO_ERROR);
 }
 
+/*
+ * DIRTREE_CMD_GET_FINFO carries up to this number of entries,
+ * to save round trips between the parent and a child per entry.
+ */
+#define DIRTREE_FINFO_BATCH_MAX 64
+
+struct dirtree_finfo_batch {
+	int n_ents;
+	gfarm_dirtree_entry_t *ents[DIRTREE_FINFO_BATCH_MAX];
+};
+
+/* not MT-safe */
+static unsigned int
+gfarm_fifo_simple_count(gfarm_fifo_simple_t *fifo)
+{
+	return (fifo->in - fifo->out);
+}
+
 struct gfarm_dirtree {
 	pthread_mutex_t mutex;
 	pthread_cond_t free_procs;
-	pthread_cond_t get_ents;
 	gfpara_t *gfpara_handle;
 	const char *src_dir;
 	const char *dst_dir;
@@ -107,12 +124,15 @@ struct gfarm_dirtree {
 	int dst_type; /* url type */
 	int n_parallel;
 	int n_free_procs;
-	unsigned int n_get_ents;
 	int started;
 	int is_recursive;
 	gfarm_fifo_simple_t *fifo_dirs;
 	gfarm_fifo_simple_t *fifo_ents;
 	gfarm_fifo_t *fifo_handle;
+	int (*is_unchanged)(void *, gfarm_dirtree_entry_t *);
+	void *is_unchanged_closure;
+	struct dirtree_finfo_batch *finfo_batches; /* for each child */
+	int n_finfo_batches;
 };
 
 enum url_type {
@@ -176,6 +196,8 @@ struct my_stat {
 	gfarm_int64_t size;
 	gfarm_int64_t mtime_sec;
 	gfarm_int32_t mtime_nsec;
+	gfarm_uint64_t ino;
+	gfarm_uint64_t gen;
 };
 
 static void
@@ -186,6 +208,8 @@ dirtree_convert_stat(struct stat *from_st, struct my_stat *to_st)
 	to_st->size = from_st->st_size;
 	to_st->mtime_sec = from_st->st_mtime;
 	to_st->mtime_nsec = gfarm_stat_mtime_nsec(from_st);
+	to_st->ino = from_st->st_ino;
+	to_st->gen = 0;
 }
 
 static void
@@ -196,6 +220,8 @@ dirtree_convert_gfs_stat(struct gfs_stat *from_st, struct my_stat *to_st)
 	to_st->size = from_st->st_size;
 	to_st->mtime_sec = from_st->st_mtimespec.tv_sec;
 	to_st->mtime_nsec = from_st->st_mtimespec.tv_nsec;
+	to_st->ino = from_st->st_ino;
+	to_st->gen = from_st->st_gen;
 }
 
 static gfarm_error_t
@@ -369,20 +395,152 @@ dirtree_gfarm_lstat(const char *path, struct my_stat *stp)
 	return (GFARM_ERR_NO_ERROR);
 }
 
+/* reply the information of an entry to DIRTREE_CMD_GET_FINFO */
+static void
+dirtree_child_finfo(gfarm_dirtree_t *handle,
+	gfarm_error_t (*func_lstat)(const char *, struct my_stat *),
+	const char *subpath, int is_file, FILE *to_parent)
+{
+	gfarm_error_t e;
+	char *src_path, *dst_path;
+	struct my_stat dst_st;
+	int ncopy, i, retv, is_retry;
+	char **copy;
+
+	retv = gfprep_asprintf(&src_path, "%s/%s", handle->src_dir, subpath);
+	if (retv == -1) {
+		fprintf(stderr, "ERROR: no memory\n");
+		gfpara_send_int(to_parent, 0); /* 1: src_ncopy */
+		gfpara_send_int(to_parent, 0); /* 3: dst_exist */
+		return;
+	}
+	/* ----- src ----- */
+	if (handle->src_type == URL_TYPE_LOCAL || is_file == 0) {
+		/* 1: src_ncopy */
+		gfpara_send_int(to_parent, 0);
+		goto finfo_dst;
+	}
+	assert(handle->src_type == URL_TYPE_GFARM);
+	is_retry = 0;
+finfo_retry1:
+	e = gfs_replica_list_by_name(src_path, &ncopy, &copy);
+	if (e != GFARM_ERR_NO_ERROR) {
+		if (!is_retry && gfm_client_is_connection_error(e)) {
+			is_retry = 1;
+			goto finfo_retry1;
+		}
+		/* 1: src_ncopy */
+		gfpara_send_int(to_parent, 0);
+		fprintf(stderr,
+			"ERROR: gfs_replica_list_by_name(%s): %s\n",
+			src_path, gfarm_error_string(e));
+		goto finfo_dst;
+	}
+	if (is_retry)
+		fprintf(stderr,
+			"INFO: retry gfs_replica_list_by_name(%s) OK\n",
+			src_path);
+	/* 1: src_ncopy */
+	gfpara_send_int(to_parent, ncopy);
+	for (i = 0; i < ncopy; i++) /* 2: src_copy */
+		gfpara_send_string(to_parent, "%s", copy[i]);
+	gfarm_strings_free_deeply(ncopy, copy);
+finfo_dst:	/* ----- dst ----- */
+	free(src_path);
+	if (handle->dst_type == URL_TYPE_UNUSED) {
+		/* dst is unused */
+		gfpara_send_int(to_parent, 0); /* 3: dst_exist */
+		return;
+	}
+	assert(handle->dst_dir);
+	retv = gfprep_asprintf(&dst_path, "%s/%s", handle->dst_dir, subpath);
+	if (retv == -1) {
+		fprintf(stderr, "FATAL: no memory\n");
+		gfpara_send_int(to_parent, 0); /* 3: dst_exist */
+		return;
+	}
+	is_retry = 0;
+finfo_retry2:
+	e = func_lstat(dst_path, &dst_st);
+	if (e != GFARM_ERR_NO_ERROR) {
+		if (!is_retry && gfm_client_is_connection_error(e)) {
+			is_retry = 1;
+			goto finfo_retry2;
+		}
+		/* dst does not exist */
+		gfpara_send_int(to_parent, 0); /* 3: dst_exist */
+		free(dst_path);
+		return;
+	}
+	if (is_retry)
+		fprintf(stderr, "INFO: retry lstat(%s) OK\n", dst_path);
+
+	/* 3: dst_exist */
+	gfpara_send_int(to_parent, 1);
+	/* 4: dst_m_sec */
+	gfpara_send_int64(to_parent, dst_st.mtime_sec);
+	/* 5: dst_m_nsec */
+	gfpara_send_int(to_parent, dst_st.mtime_nsec);
+	if (S_ISREG(dst_st.mode)) {
+		/* 6: dst_d_type */
+		gfpara_send_int(to_parent, GFS_DT_REG);
+		/* 7: dst_size */
+		gfpara_send_int64(to_parent, dst_st.size);
+		if (handle->dst_type == URL_TYPE_GFARM) {
+			is_retry = 0;
+finfo_retry3:
+			e = gfs_replica_list_by_name(dst_path, &ncopy, &copy);
+			if (e == GFARM_ERR_NO_ERROR) {
+				if (is_retry)
+					fprintf(stderr, "INFO: retry "
+					    "gfs_replica_list_by_name(%s) "
+					    "OK\n", dst_path);
+				/* 8: dst_ncopy */
+				gfpara_send_int(to_parent, ncopy);
+				for (i = 0; i < ncopy; i++)
+					/* 9: dst_copy */
+					gfpara_send_string(to_parent,
+					    "%s", copy[i]);
+				gfarm_strings_free_deeply(ncopy, copy);
+			} else { /* no replica: ncopy == 0 */
+				if (!is_retry &&
+				    gfm_client_is_connection_error(e)) {
+					is_retry = 1;
+					goto finfo_retry3;
+				}
+				fprintf(stderr,
+				    "INFO: gfs_replica_list_by_name(%s): %s\n",
+				    dst_path, gfarm_error_string(e));
+				/* 8: dst_ncopy */
+				gfpara_send_int(to_parent, 0);
+			}
+		} else /* URL_TYPE_LOCAL: ncopy == 0 */
+			/* 8: dst_ncopy */
+			gfpara_send_int(to_parent, 0);
+	} else if (S_ISDIR(dst_st.mode)) /* 6: dst_d_type */
+		gfpara_send_int(to_parent, GFS_DT_DIR);
+	else if (S_ISLNK(dst_st.mode)) /* 6: dst_d_type */
+		gfpara_send_int(to_parent, GFS_DT_LNK);
+	else /* 6: dst_d_type */
+		gfpara_send_int(to_parent, GFS_DT_UNKNOWN);
+	free(dst_path);
+}
+
 static int
 dirtree_child(void *param, FILE *from_parent, FILE *to_parent)
 {
-	int command, is_file;
+	int command;
 	gfarm_error_t e;
-	char *subpath, *src_dir, *src_path, *dst_path;
+	char *subpath, *src_dir;
 	char *name;
 	struct dirtree_dir_handle dh;
 	struct gfs_dirent dent;
-	struct my_stat src_st, dst_st;
-	int ncopy, i, retv, is_retry;
-	char **copy;
+	struct my_stat src_st;
+	int n_ents, i, retv, is_retry;
+	char *subpaths[DIRTREE_FINFO_BATCH_MAX];
+	int is_files[DIRTREE_FINFO_BATCH_MAX];
 	FILE *tmpfp;
-	char buf[64];
+	char buf[8192];
 	gfarm_dirtree_t *handle = param;
 	gfarm_error_t (*func_opendir)(const char *path,
 				      struct dirtree_dir_handle *dh);
@@ -417,6 +575,7 @@ dirtree_child(void *param, FILE *from_parent, FILE *to_parent)
 	}
 	/* -------------------------------------------------------- */
 next_command: /* instead of "for (;;)" */
+	gfpara_send_flush(to_parent); /* reply to the previous command */
 	gfpara_recv_int(from_parent, &command);
 	switch (command) {
 	case DIRTREE_CMD_GET_DENTS:
@@ -510,7 +669,6 @@ dents_loop:
 					break; /* EOF */
 			}
 			fclose(tmpfp);
-			fflush(to_parent);
 			gfpara_send_int(to_parent, DIRTREE_ENTRY_END);
 			if (is_retry)
 				fprintf(stderr, "INFO: retry opendir(%s) OK\n",
@@ -551,152 +709,41 @@ dents_error:
 		if (dent.d_type == GFS_DT_REG) /* src is file */
 			/* 7: src_size */
 			gfpara_send_int64(tmpfp, src_st.size);
+		/* 8: src_ino */
+		gfpara_send_int64(tmpfp, src_st.ino);
+		/* 9: src_gen */
+		gfpara_send_int64(tmpfp, src_st.gen);
 		goto dents_loop; /* loop */
 		/* ---------------------------------- */
 	case DIRTREE_CMD_GET_FINFO:
-		subpath = NULL;
-		src_path = NULL;
-		dst_path = NULL;
-		gfpara_recv_string(from_parent, &subpath);
-		gfpara_recv_int(from_parent, &is_file);
-		if (subpath[0] == '\0') {
+		gfpara_recv_int(from_parent, &n_ents);
+		if (n_ents <= 0 || n_ents > DIRTREE_FINFO_BATCH_MAX) {
 			fprintf(stderr, "FATAL: unexpected message\n");
+			gfpara_recv_purge(from_parent);
 			gfpara_send_int(to_parent, DIRTREE_STAT_NG);
 			goto term;
 		}
-		retv = gfprep_asprintf(&src_path, "%s/%s",
-				       handle->src_dir, subpath);
-		if (retv == -1) {
-			fprintf(stderr, "FATAL: no memory\n");
+		for (i = 0; i < n_ents; i++) {
+			gfpara_recv_string(from_parent, &subpaths[i]);
+			gfpara_recv_int(from_parent, &is_files[i]);
+		}
+		for (i = 0; i < n_ents; i++) {
+			if (subpaths[i][0] == '\0')
+				break;
+		}
+		if (i < n_ents) {
+			fprintf(stderr, "FATAL: unexpected message\n");
 			gfpara_send_int(to_parent, DIRTREE_STAT_NG);
-			src_dir = NULL;
-			free(subpath);
+			for (i = 0; i < n_ents; i++)
+				free(subpaths[i]);
 			goto term;
 		}
 		gfpara_send_int(to_parent, DIRTREE_STAT_GET_FINFO_OK);
-		/* ----- src ----- */
-		if (handle->src_type == URL_TYPE_LOCAL || is_file == 0) {
-			/* 1: src_ncopy */
-			gfpara_send_int(to_parent, 0);
-			goto finfo_dst;
+		for (i = 0; i < n_ents; i++) {
+			dirtree_child_finfo(handle, func_lstat,
+			    subpaths[i], is_files[i], to_parent);
+			free(subpaths[i]);
 		}
-		assert(handle->src_type == URL_TYPE_GFARM);
-		is_retry = 0;
-finfo_retry1:
-		e = gfs_replica_list_by_name(src_path, &ncopy, &copy);
-		if (e != GFARM_ERR_NO_ERROR) {
-			if (!is_retry && gfm_client_is_connection_error(e)) {
-				is_retry = 1;
-				goto finfo_retry1;
-			}
-			/* 1: src_ncopy */
-			gfpara_send_int(to_parent, 0);
-			fprintf(stderr,
-				"ERROR: gfs_replica_list_by_name(%s): %s\n",
-				src_path, gfarm_error_string(e));
-			goto finfo_dst;
-		}
-		if (is_retry)
-			fprintf(stderr,
-				"INFO: retry gfs_replica_list_by_name(%s)"
-				" OK\n", src_dir);
-		/* 1: src_ncopy */
-		gfpara_send_int(to_parent, ncopy);
-		for (i = 0; i < ncopy; i++) /* 2: src_copy */
-			gfpara_send_string(to_parent, "%s", copy[i]);
-		gfarm_strings_free_deeply(ncopy, copy);
-finfo_dst:	/* ----- dst ----- */
-		if (handle->dst_type == URL_TYPE_UNUSED) {
-			/* dst is unused */
-			gfpara_send_int(to_parent, 0); /* 3: dst_exist */
-			free(subpath);
-			free(src_path);
-			goto next_command;
-		}
-		assert(handle->dst_dir);
-		retv = gfprep_asprintf(&dst_path, "%s/%s",
-				       handle->dst_dir, subpath);
-		if (retv == -1) {
-			fprintf(stderr, "FATAL: no memory\n");
-			gfpara_send_int(to_parent, 0); /* 3: dst_exist */
-			free(subpath);
-			free(src_path);
-			goto next_command;
-		}
-		is_retry = 0;
-finfo_retry2:
-		e = func_lstat(dst_path, &dst_st);
-		if (e != GFARM_ERR_NO_ERROR) {
-			if (!is_retry && gfm_client_is_connection_error(e)) {
-				is_retry = 1;
-				goto finfo_retry2;
-			}
-			/* dst does not exist */
-			gfpara_send_int(to_parent, 0); /* 3: dst_exist */
-			free(subpath);
-			free(src_path);
-			free(dst_path);
-			goto next_command;
-		}
-		if (is_retry)
-			fprintf(stderr, "INFO: retry lstat(%s) OK\n", src_dir);
-
-		/* 3: dst_exist */
-		gfpara_send_int(to_parent, 1);
-		/* 4: dst_m_sec */
-		gfpara_send_int64(to_parent, dst_st.mtime_sec);
-		/* 5: dst_m_nsec */
-		gfpara_send_int(to_parent, dst_st.mtime_nsec);
-		if (S_ISREG(dst_st.mode)) {
-			/* 6: dst_d_type */
-			gfpara_send_int(to_parent, GFS_DT_REG);
-			/* 7: dst_size */
-			gfpara_send_int64(to_parent, dst_st.size);
-			if (handle->dst_type == URL_TYPE_GFARM) {
-				is_retry = 0;
-finfo_retry3:
-				e = gfs_replica_list_by_name(
-					dst_path, &ncopy, &copy);
-				if (e == GFARM_ERR_NO_ERROR) {
-					if (is_retry)
-						fprintf(stderr,
-						"INFO: retry "
-						"gfs_replica_list_by_name(%s) "
-						"OK\n", src_dir);
-					/* 8: dst_ncopy */
-					gfpara_send_int(to_parent, ncopy);
-					for (i = 0; i < ncopy; i++)
-						/* 9: dst_copy */
-						gfpara_send_string(
-							to_parent,
-							"%s", copy[i]);
-					gfarm_strings_free_deeply(ncopy, copy);
-				} else { /* no replica: ncopy == 0 */
-					if (!is_retry &&
-					    gfm_client_is_connection_error(e)
-						) {
-						is_retry = 1;
-						goto finfo_retry3;
-					}
-					fprintf(stderr,
-					"INFO: gfs_replica_list_by_name(%s):"
-					" %s\n", dst_path,
-					gfarm_error_string(e));
-					/* 8: dst_ncopy */
-					gfpara_send_int(to_parent, 0);
-				}
-			} else /* URL_TYPE_LOCAL: ncopy == 0 */
-				/* 8: dst_ncopy */
-				gfpara_send_int(to_parent, 0);
-		} else if (S_ISDIR(dst_st.mode)) /* 6: dst_d_type */
-			gfpara_send_int(to_parent, GFS_DT_DIR);
-		else if (S_ISLNK(dst_st.mode)) /* 6: dst_d_type */
-			gfpara_send_int(to_parent, GFS_DT_LNK);
-		else /* 6: dst_d_type */
-			gfpara_send_int(to_parent, GFS_DT_UNKNOWN);
-		free(subpath);
-		free(src_path);
-		free(dst_path);
 		goto next_command;
 		 /* ---------------------------------- */
 	case DIRTREE_CMD_TERMINATE:
@@ -720,14 +767,26 @@ term: /* -------------------------------------------------------- */
 	return (0);
 }
 
+/*
+ * directories are expanded by all children concurrently.
+ * the entries read from directories wait in fifo_ents for
+ * DIRTREE_CMD_GET_FINFO, and a directory is put into fifo_dirs only after
+ * its own entry is passed to the caller, thus a directory always appears
+ * before its children.
+ * directories are preferred to keep all children busy, unless the number
+ * of the pending entries exceeds the high water mark.
+ */
+#define DIRTREE_ENTS_HIGH_WATER(handle) \
+	((handle)->n_parallel * DIRTREE_FINFO_BATCH_MAX * 2)
+
 static int
 dirtree_send(FILE *child_in, gfpara_proc_t *proc, void *param, int stop)
 {
 	static const char diag[] = "dirtree_send";
 	gfarm_dirtree_t *handle = param;
 	char *subdir;
-	gfarm_error_t e;
-	gfarm_dirtree_entry_t *ent;
+	struct dirtree_finfo_batch *batch;
+	int n, i;
 	void *p;
 
 	if (stop) {
@@ -739,35 +798,21 @@ dirtree_send(FILE *child_in, gfpara_proc_t *proc, void *param, int stop)
 		return (GFPARA_NEXT);
 	}
 	gfarm_mutex_lock(&handle->mutex, diag, "mutex");
-retry:
-	/* Don't read fifo_dirs before fifo_ents */
-	e = gfarm_fifo_simple_next(handle->fifo_ents, &p); /* nonblock */
-	if (e == GFARM_ERR_NO_ERROR) {
-		handle->n_get_ents++;
-		gfarm_mutex_unlock(&handle->mutex, diag, "mutex");
-		ent = p;
-		gfpara_send_int(child_in, DIRTREE_CMD_GET_FINFO);
-		gfpara_send_string(child_in, "%s", ent->subpath);
-		gfpara_send_int(child_in,
-				ent->src_d_type == GFS_DT_REG ? 1 : 0);
-		gfpara_data_set(proc, ent);
-		return (GFPARA_NEXT);
-	}
-	if (handle->n_get_ents > 0) { /* wait all dirtree_recv_finfo() */
-		gfarm_cond_wait(&handle->get_ents, &handle->mutex, diag,
-				"get_ents");
-		goto retry;
-	}
-	e = gfarm_fifo_simple_next(handle->fifo_dirs, &p); /* nonblock */
-	if (e == GFARM_ERR_NO_ERROR) {
-		gfarm_cond_broadcast(&handle->free_procs, diag, "free_prpcs");
-		gfarm_mutex_unlock(&handle->mutex, diag, "mutex");
-		subdir = p;
-		gfpara_send_int(child_in, DIRTREE_CMD_GET_DENTS);
-		gfpara_send_string(child_in, "%s", subdir);
-		free(subdir);
-		return (GFPARA_NEXT);
-	} else if (e == GFARM_ERR_NO_SUCH_OBJECT) {
+	for (;;) {
+		n = gfarm_fifo_simple_count(handle->fifo_ents);
+		if (n < DIRTREE_ENTS_HIGH_WATER(handle) &&
+		    gfarm_fifo_simple_next(handle->fifo_dirs, &p)
+		    == GFARM_ERR_NO_ERROR) {
+			gfarm_mutex_unlock(&handle->mutex, diag, "mutex");
+			subdir = p;
+			gfpara_send_int(child_in, DIRTREE_CMD_GET_DENTS);
+			gfpara_send_string(child_in, "%s", subdir);
+			free(subdir);
+			return (GFPARA_NEXT);
+		}
+		if (n > 0)
+			break;
+		/* no work, wait for others */
 		handle->n_free_procs++;
 		if (handle->n_free_procs >= handle->n_parallel) { /* done */
 			gfarm_cond_broadcast(&handle->free_procs, diag,
@@ -786,16 +831,48 @@ retry:
 			return (GFPARA_NEXT);
 		}
 		handle->n_free_procs--;
-		goto retry;
-	} else { /* never reach */
-		handle->n_free_procs++;
-		fprintf(stderr, "FATAL: gfarm_fifo_simple_next: %s\n",
-			gfarm_error_string(e));
-		gfarm_cond_broadcast(&handle->free_procs, diag, "free_procs");
-		gfarm_mutex_unlock(&handle->mutex, diag, "mutex");
-		gfpara_send_int(child_in, DIRTREE_CMD_TERMINATE);
-		return (GFPARA_NEXT);
 	}
+
+	/* share the entries among all children */
+	n = (n + handle->n_parallel - 1) / handle->n_parallel;
+	if (n > DIRTREE_FINFO_BATCH_MAX)
+		n = DIRTREE_FINFO_BATCH_MAX;
+	batch = gfpara_data_get(proc);
+	if (batch == NULL) {
+		batch = &handle->finfo_batches[handle->n_finfo_batches++];
+		gfpara_data_set(proc, batch);
+	}
+	for (i = 0; i < n && gfarm_fifo_simple_next(
+	    handle->fifo_ents, &p) == GFARM_ERR_NO_ERROR; i++)
+		batch->ents[i] = p;
+	n = i;
+	batch->n_ents = n;
+	gfarm_mutex_unlock(&handle->mutex, diag, "mutex");
+	gfpara_send_int(child_in, DIRTREE_CMD_GET_FINFO);
+	gfpara_send_int(child_in, n);
+	for (i = 0; i < n; i++) {
+		gfpara_send_string(child_in, "%s", batch->ents[i]->subpath);
+		gfpara_send_int(child_in,
+		    batch->ents[i]->src_d_type == GFS_DT_REG ? 1 : 0);
+	}
+	return (GFPARA_NEXT);
+}
+
+/*
+ * the destination of an unchanged entry is assumed to be the same as
+ * the source, without asking it.
+ */
+static void
+dirtree_entry_set_unchanged(gfarm_dirtree_entry_t *ent)
+{
+	ent->src_copy = NULL;
+	ent->dst_exist = 1;
+	ent->dst_d_type = ent->src_d_type;
+	ent->dst_size = ent->src_size;
+	ent->dst_m_sec = ent->src_m_sec;
+	ent->dst_m_nsec = ent->src_m_nsec;
+	ent->dst_copy = NULL;
+	ent->n_pending = 0;
 }
 
 static int
@@ -805,6 +882,7 @@ dirtree_recv_dents(FILE *child_out, gfpara_proc_t *proc, void *param)
 	gfarm_error_t e;
 	gfarm_dirtree_t *handle = param;
 	int type, d_type_int;
+	gfarm_int64_t i64;
 	gfarm_dirtree_entry_t *ent;
 	char *subpath;
 
@@ -831,33 +909,23 @@ dirtree_recv_dents(FILE *child_out, gfpara_proc_t *proc, void *param)
 			gfpara_recv_int(child_out, &ent->src_nlink); /* 5 */
 			gfpara_recv_int(child_out, &d_type_int); /* 6 */
 			ent->src_d_type = (unsigned char) d_type_int;
-			gfarm_mutex_lock(&handle->mutex, diag, "mutex");
-			if (handle->is_recursive &&
-			    ent->src_d_type == GFS_DT_DIR) {
-				char *subpath_copy = strdup(subpath);
-				if (subpath_copy == NULL) {
-					gfarm_mutex_unlock(&handle->mutex,
-							   diag, "mutex");
-					fprintf(stderr, "FATAL: no memory\n");
-					gfpara_recv_purge(child_out);
-					return (GFPARA_FATAL);
-				}
-				e = gfarm_fifo_simple_enter(handle->fifo_dirs,
-							    subpath_copy);
-				if (e != GFARM_ERR_NO_ERROR) {
-					gfarm_mutex_unlock(&handle->mutex,
-							   diag, "mutex");
-					fprintf(stderr,
-					"FATAL: gfarm_fifo_simple_enter: "
-					"%s\n", gfarm_error_string(e));
-					gfpara_recv_purge(child_out);
-					return (GFPARA_FATAL);
-				}
-			}
 			if (ent->src_d_type == GFS_DT_REG) /* 7 */
 				gfpara_recv_int64(child_out, &ent->src_size);
 			else
 				ent->src_size = 0;
+			gfpara_recv_int64(child_out, &i64); /* 8 */
+			ent->src_ino = i64;
+			gfpara_recv_int64(child_out, &i64); /* 9 */
+			ent->src_gen = i64;
+			if (handle->is_unchanged != NULL &&
+			    handle->is_unchanged(handle->is_unchanged_closure,
+			    ent)) {
+				/* skip DIRTREE_CMD_GET_FINFO */
+				dirtree_entry_set_unchanged(ent);
+				gfarm_fifo_enter(handle->fifo_handle, &ent);
+				continue;
+			}
+			gfarm_mutex_lock(&handle->mutex, diag, "mutex");
 			e = gfarm_fifo_simple_enter(handle->fifo_ents, ent);
 			gfarm_mutex_unlock(&handle->mutex, diag, "mutex");
 			if (e != GFARM_ERR_NO_ERROR) {
@@ -879,13 +947,14 @@ dirtree_recv_dents(FILE *child_out, gfpara_proc_t *proc, void *param)
 }
 
 static int
-dirtree_recv_finfo(FILE *child_out, gfpara_proc_t *proc, void *param)
+dirtree_recv_finfo_one(FILE *child_out, gfarm_dirtree_t *handle,
+	gfarm_dirtree_entry_t *ent)
 {
-	gfarm_dirtree_t *handle = param;
+	static const char diag[] = "dirtree_recv_finfo_one";
+	gfarm_error_t e;
 	int d_type_int, i;
-	gfarm_dirtree_entry_t *ent;
+	char *subdir = NULL;
 
-	ent = gfpara_data_get(proc);
 	gfpara_recv_int(child_out, &ent->src_ncopy); /* 1 */
 	if (ent->src_ncopy > 0) {
 		GFARM_MALLOC_ARRAY(ent->src_copy, ent->src_ncopy);
@@ -947,10 +1016,44 @@ dirtree_recv_finfo(FILE *child_out, gfpara_proc_t *proc, void *param)
 		ent->dst_copy = NULL; /* 9 */
 	}
 	ent->n_pending = 0;
+	/* ent may be freed by the caller after gfarm_fifo_enter() */
+	if (handle->is_recursive && ent->src_d_type == GFS_DT_DIR &&
+	    (subdir = strdup(ent->subpath)) == NULL) {
+		fprintf(stderr, "FATAL: no memory\n");
+		gfpara_recv_purge(child_out);
+		return (GFPARA_FATAL);
+	}
 	gfarm_fifo_enter(handle->fifo_handle, &ent);
+	if (subdir == NULL)
+		return (GFPARA_NEXT);
+
+	/* the directory has been passed to the caller, expand it */
+	gfarm_mutex_lock(&handle->mutex, diag, "mutex");
+	e = gfarm_fifo_simple_enter(handle->fifo_dirs, subdir);
+	gfarm_mutex_unlock(&handle->mutex, diag, "mutex");
+	if (e != GFARM_ERR_NO_ERROR) {
+		free(subdir);
+		fprintf(stderr, "FATAL: gfarm_fifo_simple_enter: %s\n",
+			gfarm_error_string(e));
+		gfpara_recv_purge(child_out);
+		return (GFPARA_FATAL);
+	}
 	return (GFPARA_NEXT);
 }
 
+static int
+dirtree_recv_finfo(FILE *child_out, gfpara_proc_t *proc, void *param)
+{
+	gfarm_dirtree_t *handle = param;
+	struct dirtree_finfo_batch *batch = gfpara_data_get(proc);
+	int i, retv = GFPARA_NEXT;
+
+	for (i = 0; i < batch->n_ents && retv == GFPARA_NEXT; i++)
+		retv = dirtree_recv_finfo_one(child_out, handle,
+		    batch->ents[i]);
+	return (retv);
+}
+
 static int
 dirtree_recv(FILE *child_out, gfpara_proc_t *proc, void *param)
 {
@@ -961,12 +1064,14 @@ dirtree_recv(FILE *child_out, gfpara_proc_t *proc, void *param)
 	gfpara_recv_int(child_out, &status);
 	switch (status) {
 	case DIRTREE_STAT_GET_DENTS_OK:
-		return (dirtree_recv_dents(child_out, proc, param));
 	case DIRTREE_STAT_GET_FINFO_OK:
-		retv = dirtree_recv_finfo(child_out, proc, param);
+		if (status == DIRTREE_STAT_GET_DENTS_OK)
+			retv = dirtree_recv_dents(child_out, proc, param);
+		else
+			retv = dirtree_recv_finfo(child_out, proc, param);
+		/* wake up idle children for new entries or directories */
 		gfarm_mutex_lock(&handle->mutex, diag, "mutex");
-		handle->n_get_ents--;
-		gfarm_cond_broadcast(&handle->get_ents, diag, "get_ents");
+		gfarm_cond_broadcast(&handle->free_procs, diag, "free_procs");
 		gfarm_mutex_unlock(&handle->mutex, diag, "mutex");
 		return (retv);
 	case DIRTREE_STAT_IGNORE:
@@ -1090,8 +1195,12 @@ gfarm_dirtree_init_fork(
 		return (e);
 	}
 	handle->n_parallel = n_parallel;
+	GFARM_MALLOC_ARRAY(handle->finfo_batches, n_parallel);
+	handle->n_finfo_batches = 0;
 	startdir = strdup(dirtree_startdir);
-	if (startdir == NULL) {
+	if (startdir == NULL || handle->finfo_batches == NULL) {
+		free(startdir);
+		free(handle->finfo_batches);
 		gfpara_join(handle->gfpara_handle);
 		gfarm_fifo_free(handle->fifo_handle);
 		gfarm_fifo_simple_free(handle->fifo_dirs);
@@ -1102,6 +1211,7 @@ gfarm_dirtree_init_fork(
 	e = gfarm_fifo_simple_enter(handle->fifo_dirs, startdir);
 	if (e != GFARM_ERR_NO_ERROR) {
 		free(startdir);
+		free(handle->finfo_batches);
 		gfpara_join(handle->gfpara_handle);
 		gfarm_fifo_free(handle->fifo_handle);
 		gfarm_fifo_simple_free(handle->fifo_dirs);
@@ -1113,16 +1223,29 @@ gfarm_dirtree_init_fork(
 	}
 	gfarm_mutex_init(&handle->mutex, diag, "mutex");
 	gfarm_cond_init(&handle->free_procs, diag, "free_procs");
-	gfarm_cond_init(&handle->get_ents, diag, "get_ents");
 	handle->n_free_procs = 0;
-	handle->n_get_ents = 0;
 	handle->is_recursive = is_recursive;
+	handle->is_unchanged = NULL;
+	handle->is_unchanged_closure = NULL;
 	handle->started = 0;
 
 	*handlep = handle;
 	return (e);
 }
 
+/*
+ * the entries for which is_unchanged() returns true are passed to the
+ * caller without checking their destination.
+ * must be called before gfarm_dirtree_open().
+ */
+void
+gfarm_dirtree_set_unchanged_func(gfarm_dirtree_t *handle,
+	int (*is_unchanged)(void *, gfarm_dirtree_entry_t *), void *closure)
+{
+	handle->is_unchanged = is_unchanged;
+	handle->is_unchanged_closure = closure;
+}
+
 gfarm_error_t
 gfarm_dirtree_open(gfarm_dirtree_t *handle)
 {
@@ -1215,7 +1338,7 @@ gfarm_dirtree_close(gfarm_dirtree_t *handle)
 	gfarm_fifo_simple_free(handle->fifo_ents);
 	gfarm_mutex_destroy(&handle->mutex, diag, "mutex");
 	gfarm_cond_destroy(&handle->free_procs, diag, "free_procs");
-	gfarm_cond_destroy(&handle->get_ents, diag, "get_ents");
+	free(handle->finfo_batches);
 	free(handle);
 
 	return (e);
@@ -11,6 +11,8 @@ typedef struct gfarm_dirtree_entry {
 	gfarm_int64_t dst_m_sec;
 	gfarm_int32_t src_m_nsec;
 	gfarm_int32_t dst_m_nsec;
+	gfarm_uint64_t src_ino;
+	gfarm_uint64_t src_gen; /* 0 for a local file */
 	gfarm_uint64_t n_pending;
 	char *subpath; /* src and dst */
 	char **src_copy;
@@ -26,6 +28,8 @@ typedef struct gfarm_dirtree_entry {
 
 gfarm_error_t gfarm_dirtree_init_fork(gfarm_dirtree_t **, const char *,
 	const char *, int, int, int);
+void gfarm_dirtree_set_unchanged_func(gfarm_dirtree_t *,
+	int (*)(void *, gfarm_dirtree_entry_t *), void *);
 gfarm_error_t gfarm_dirtree_open(gfarm_dirtree_t *);
 
 gfarm_error_t gfarm_dirtree_checknext(gfarm_dirtree_t *,
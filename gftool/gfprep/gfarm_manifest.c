@@ -0,0 +1,268 @@
+/*
+ * $Id$
+ */
+
+/*
+ * a manifest file consists of a header, the source and destination URLs,
+ * and fixed size records of struct gfarm_manifest_entry.
+ * it is written in the host byte order, and it is ignored when it is read
+ * on a host of another byte order, or for other URLs.
+ *
+ * in memory, the entries are kept in an open addressing hash table
+ * indexed by the hash value of the subpath, and the subpath itself is
+ * not kept, to keep the table compact for a huge directory tree.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <gfarm/gfarm.h>
+
+#include "gfarm_manifest.h"
+
+#define MANIFEST_MAGIC		"GFPCMANI"
+#define MANIFEST_BYTE_ORDER	0x01020304
+#define MANIFEST_VERSION	1
+
+#define MANIFEST_INIT_SIZE	1024 /* must be a power of 2 */
+
+struct manifest_header {
+	char magic[8];
+	gfarm_uint32_t byte_order;
+	gfarm_uint32_t version;
+	gfarm_uint32_t entry_size;
+	gfarm_uint32_t src_url_len;
+	gfarm_uint32_t dst_url_len;
+	gfarm_uint32_t reserved;
+	gfarm_uint64_t n_ents;
+};
+
+struct gfarm_manifest {
+	struct gfarm_manifest_entry *ents; /* key == 0: unused */
+	size_t size; /* a power of 2 */
+	size_t n_ents;
+};
+
+/* FNV-1a, 0 is reserved for unused entries */
+gfarm_uint64_t
+gfarm_manifest_key(const char *subpath)
+{
+	gfarm_uint64_t h = 0xcbf29ce484222325ULL;
+	const unsigned char *p;
+
+	for (p = (const unsigned char *)subpath; *p != '\0'; p++) {
+		h ^= *p;
+		h *= 0x100000001b3ULL;
+	}
+	return (h == 0 ? 1 : h);
+}
+
+gfarm_error_t
+gfarm_manifest_init(gfarm_manifest_t **manifestp)
+{
+	gfarm_manifest_t *manifest;
+
+	GFARM_MALLOC(manifest);
+	if (manifest == NULL)
+		return (GFARM_ERR_NO_MEMORY);
+	manifest->ents = gfarm_calloc_array(MANIFEST_INIT_SIZE,
+	    sizeof(*manifest->ents));
+	if (manifest->ents == NULL) {
+		free(manifest);
+		return (GFARM_ERR_NO_MEMORY);
+	}
+	manifest->size = MANIFEST_INIT_SIZE;
+	manifest->n_ents = 0;
+	*manifestp = manifest;
+	return (GFARM_ERR_NO_ERROR);
+}
+
+void
+gfarm_manifest_free(gfarm_manifest_t *manifest)
+{
+	if (manifest == NULL)
+		return;
+	free(manifest->ents);
+	free(manifest);
+}
+
+static struct gfarm_manifest_entry *
+manifest_slot(struct gfarm_manifest_entry *ents, size_t size,
+	gfarm_uint64_t key)
+{
+	size_t i;
+
+	for (i = key & (size - 1); ents[i].key != 0 && ents[i].key != key;
+	    i = (i + 1) & (size - 1))
+		;
+	return (&ents[i]);
+}
+
+static gfarm_error_t
+manifest_grow(gfarm_manifest_t *manifest)
+{
+	struct gfarm_manifest_entry *ents;
+	size_t i, size = manifest->size * 2;
+
+	ents = gfarm_calloc_array(size, sizeof(*ents));
+	if (ents == NULL)
+		return (GFARM_ERR_NO_MEMORY);
+	for (i = 0; i < manifest->size; i++) {
+		if (manifest->ents[i].key != 0)
+			*manifest_slot(ents, size, manifest->ents[i].key) =
+			    manifest->ents[i];
+	}
+	free(manifest->ents);
+	manifest->ents = ents;
+	manifest->size = size;
+	return (GFARM_ERR_NO_ERROR);
+}
+
+/* not MT-safe */
+gfarm_error_t
+gfarm_manifest_enter(gfarm_manifest_t *manifest,
+	const struct gfarm_manifest_entry *ent)
+{
+	struct gfarm_manifest_entry *slot;
+	gfarm_error_t e;
+
+	/* keep the load factor less than 1/2 */
+	if ((manifest->n_ents + 1) * 2 > manifest->size &&
+	    (e = manifest_grow(manifest)) != GFARM_ERR_NO_ERROR)
+		return (e);
+	slot = manifest_slot(manifest->ents, manifest->size, ent->key);
+	if (slot->key == 0)
+		manifest->n_ents++;
+	*slot = *ent;
+	return (GFARM_ERR_NO_ERROR);
+}
+
+/* MT-safe unless gfarm_manifest_enter() is called concurrently */
+const struct gfarm_manifest_entry *
+gfarm_manifest_lookup(gfarm_manifest_t *manifest, gfarm_uint64_t key)
+{
+	struct gfarm_manifest_entry *slot;
+
+	slot = manifest_slot(manifest->ents, manifest->size, key);
+	return (slot->key == 0 ? NULL : slot);
+}
+
+int
+gfarm_manifest_count(gfarm_manifest_t *manifest)
+{
+	return (manifest->n_ents);
+}
+
+static int
+manifest_url_is_same(FILE *fp, size_t len, const char *url)
+{
+	char buf[1024];
+	size_t n;
+
+	if (len != strlen(url))
+		return (0);
+	while (len > 0) {
+		n = len < sizeof(buf) ? len : sizeof(buf);
+		if (fread(buf, 1, n, fp) != n || memcmp(buf, url, n) != 0)
+			return (0);
+		url += n;
+		len -= n;
+	}
+	return (1);
+}
+
+/*
+ * GFARM_ERR_NO_SUCH_FILE_OR_DIRECTORY: the manifest does not exist yet.
+ * GFARM_ERR_INVALID_ARGUMENT: the manifest is for other URLs.
+ */
+gfarm_error_t
+gfarm_manifest_load(gfarm_manifest_t *manifest, const char *file,
+	const char *src_url, const char *dst_url)
+{
+	FILE *fp;
+	struct manifest_header hdr;
+	struct gfarm_manifest_entry ent;
+	gfarm_uint64_t i;
+	gfarm_error_t e = GFARM_ERR_NO_ERROR;
+
+	if ((fp = fopen(file, "r")) == NULL)
+		return (gfarm_errno_to_error(errno));
+	if (fread(&hdr, sizeof(hdr), 1, fp) != 1)
+		e = GFARM_ERR_UNEXPECTED_EOF;
+	else if (memcmp(hdr.magic, MANIFEST_MAGIC, sizeof(hdr.magic)) != 0)
+		e = GFARM_ERR_PROTOCOL;
+	else if (hdr.byte_order != MANIFEST_BYTE_ORDER ||
+	    hdr.version != MANIFEST_VERSION ||
+	    hdr.entry_size != sizeof(ent))
+		e = GFARM_ERR_PROTOCOL_NOT_SUPPORTED;
+	else if (!manifest_url_is_same(fp, hdr.src_url_len, src_url) ||
+	    !manifest_url_is_same(fp, hdr.dst_url_len, dst_url))
+		e = GFARM_ERR_INVALID_ARGUMENT;
+	for (i = 0; e == GFARM_ERR_NO_ERROR && i < hdr.n_ents; i++) {
+		if (fread(&ent, sizeof(ent), 1, fp) != 1)
+			e = GFARM_ERR_UNEXPECTED_EOF;
+		else if (ent.key == 0)
+			e = GFARM_ERR_PROTOCOL;
+		else
+			e = gfarm_manifest_enter(manifest, &ent);
+	}
+	fclose(fp);
+	return (e);
+}
+
+/* written into a temporary file, and renamed to keep the old one on error */
+gfarm_error_t
+gfarm_manifest_save(gfarm_manifest_t *manifest, const char *file,
+	const char *src_url, const char *dst_url)
+{
+	FILE *fp;
+	struct manifest_header hdr;
+	char *tmp;
+	size_t i, len = strlen(file) + sizeof(".tmp");
+	int save_errno;
+
+	GFARM_MALLOC_ARRAY(tmp, len);
+	if (tmp == NULL)
+		return (GFARM_ERR_NO_MEMORY);
+	snprintf(tmp, len, "%s.tmp", file);
+	if ((fp = fopen(tmp, "w")) == NULL) {
+		save_errno = errno;
+		free(tmp);
+		return (gfarm_errno_to_error(save_errno));
+	}
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, MANIFEST_MAGIC, sizeof(hdr.magic));
+	hdr.byte_order = MANIFEST_BYTE_ORDER;
+	hdr.version = MANIFEST_VERSION;
+	hdr.entry_size = sizeof(struct gfarm_manifest_entry);
+	hdr.src_url_len = strlen(src_url);
+	hdr.dst_url_len = strlen(dst_url);
+	hdr.n_ents = manifest->n_ents;
+	fwrite(&hdr, sizeof(hdr), 1, fp);
+	fwrite(src_url, 1, hdr.src_url_len, fp);
+	fwrite(dst_url, 1, hdr.dst_url_len, fp);
+	for (i = 0; i < manifest->size; i++) {
+		if (manifest->ents[i].key != 0)
+			fwrite(&manifest->ents[i], sizeof(manifest->ents[i]),
+			    1, fp);
+	}
+	if (fflush(fp) == EOF || ferror(fp) || fsync(fileno(fp)) == -1) {
+		save_errno = errno != 0 ? errno : EIO;
+		fclose(fp);
+		unlink(tmp);
+		free(tmp);
+		return (gfarm_errno_to_error(save_errno));
+	}
+	fclose(fp);
+	if (rename(tmp, file) == -1) {
+		save_errno = errno;
+		unlink(tmp);
+		free(tmp);
+		return (gfarm_errno_to_error(save_errno));
+	}
+	free(tmp);
+	return (GFARM_ERR_NO_ERROR);
+}
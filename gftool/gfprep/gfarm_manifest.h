@@ -0,0 +1,33 @@
+/*
+ * $Id$
+ */
+
+/*
+ * the manifest of gfpcopy, which remembers the source files which had
+ * been copied to (or had already existed in) the destination.
+ */
+
+typedef struct gfarm_manifest gfarm_manifest_t;
+
+struct gfarm_manifest_entry {
+	gfarm_uint64_t key; /* gfarm_manifest_key(subpath) */
+	gfarm_int64_t size;
+	gfarm_int64_t m_sec; /* mtime */
+	gfarm_int32_t m_nsec;
+	gfarm_int32_t d_type;
+	gfarm_uint64_t ino;
+	gfarm_uint64_t gen;
+};
+
+gfarm_uint64_t gfarm_manifest_key(const char *);
+gfarm_error_t gfarm_manifest_init(gfarm_manifest_t **);
+void gfarm_manifest_free(gfarm_manifest_t *);
+gfarm_error_t gfarm_manifest_load(gfarm_manifest_t *, const char *,
+	const char *, const char *);
+gfarm_error_t gfarm_manifest_save(gfarm_manifest_t *, const char *,
+	const char *, const char *);
+gfarm_error_t gfarm_manifest_enter(gfarm_manifest_t *,
+	const struct gfarm_manifest_entry *);
+const struct gfarm_manifest_entry *gfarm_manifest_lookup(gfarm_manifest_t *,
+	gfarm_uint64_t);
+int gfarm_manifest_count(gfarm_manifest_t *);
@@ -27,6 +27,11 @@
 #include "gfarm_parallel.h"
 
 #define GFPARA_HANDLE_LIST_MAX 32
+/*
+ * messages are buffered, and flushed by gfpara_send_flush() at the end
+ * of each request/reply, so that a message costs only one write(2).
+ */
+#define GFPARA_BUFSIZE 65536
 static int is_parent = 1;
 static int n_handle_list = 0;
 static gfpara_t *handle_list[GFPARA_HANDLE_LIST_MAX];
@@ -263,10 +268,12 @@ gfpara_init(gfpara_t **handlep, int n_procs,
 			to_parent = fdopen(pipe_out[1], "w");
 			dup2(pipe_stderr[1], 2);
 			close(pipe_stderr[1]);
-			setvbuf(to_parent, (char *) NULL, _IOLBF, 0);
+			setvbuf(to_parent, (char *) NULL, _IOFBF,
+			    GFPARA_BUFSIZE);
 			setvbuf(stderr, (char *) NULL, _IOLBF, 0);
 
 			func_child(param_child, from_parent, to_parent);
+			fflush(to_parent); /* _exit() doesn't flush */
 
 			close(pipe_in[0]);
 			close(pipe_out[1]);
@@ -286,7 +293,7 @@ gfpara_init(gfpara_t **handlep, int n_procs,
 		procs[i].err = fdopen(pipe_stderr[0], "r");
 		if (procs[i].err == NULL)
 			gfpara_fatal("fdopen: %s", strerror(errno));
-		setvbuf(procs[i].in, (char *) NULL, _IOLBF, 0);
+		setvbuf(procs[i].in, (char *) NULL, _IOFBF, GFPARA_BUFSIZE);
 		procs[i].data = NULL;
 		procs[i].working = 0;
 		procs[i].handle = handle;
@@ -337,7 +344,6 @@ is_available(int fd, int pid, int is_readable)
 }
 
 #define IS_READABLE(fd, pid) is_available(fd, pid, 1)
-#define IS_WRITABLE(fd, pid) is_available(fd, pid, 0)
 
 void
 gfpara_recv_purge(FILE *in)
@@ -399,7 +405,7 @@ void
 gfpara_send_int(FILE *out, gfarm_int32_t i)
 {
 	size_t retv = fwrite(&i, sizeof(gfarm_int32_t), 1, out);
-	fflush(out);
+
 	if (retv != 1)
 		gfpara_fatal("cannot send message (int32)");
 }
@@ -408,7 +414,7 @@ void
 gfpara_send_int64(FILE *out, gfarm_int64_t i)
 {
 	size_t retv = fwrite(&i, sizeof(gfarm_int64_t), 1, out);
-	fflush(out);
+
 	if (retv != 1)
 		gfpara_fatal("cannot send message (int64)");
 }
@@ -433,10 +439,17 @@ gfpara_send_string(FILE *out, const char *format, ...)
 			gfpara_fatal("cannot send message (string): "
 				     "fwrite=%ld", (long) retv);
 	}
-	fflush(out);
 	free(str);
 }
 
+/* send the buffered messages, called at the end of a request or a reply */
+void
+gfpara_send_flush(FILE *out)
+{
+	if (fflush(out) != 0)
+		gfpara_fatal("cannot send message: %s", strerror(errno));
+}
+
 static void *
 gfpara_thread(void *param)
 {
@@ -450,16 +463,12 @@ gfpara_thread(void *param)
 	fd_set fdset_tmp, fdset_orig;
 	struct timeval tv;
 	int retv;
-	int fd_in = fileno(proc->in);
 	int fd_out = fileno(proc->out);
 
 	FD_ZERO(&fdset_orig);
 	/* watch output of child */
 	FD_SET(fd_out, &fdset_orig);
 	for (;;) {
-		if (!IS_WRITABLE(fd_in, proc->pid))
-			gfpara_fatal("no child process: pid=%ld\n",
-				(long int) proc->pid);
 		retv = func_send(proc->in, proc, param_send,
 		    handle->interrupt != GFPARA_INTR_RUN ? 1 : 0);
 		if (retv == GFPARA_END)
@@ -467,6 +476,10 @@ gfpara_thread(void *param)
 		else if (retv == GFPARA_FATAL)
 			gfpara_fatal("gfpara error in func_send");
 		assert(retv == GFPARA_NEXT);
+		/* SIGPIPE is ignored, thus EPIPE means the child exited */
+		if (fflush(proc->in) != 0)
+			gfpara_fatal("no child process: pid=%ld: %s\n",
+				(long int) proc->pid, strerror(errno));
 		for (;;) {
 			if (handle->interrupt == GFPARA_INTR_TERM) {
 				tv.tv_sec = handle->timeout_msec / 1000;
@@ -35,6 +35,7 @@ void gfpara_recv_purge(FILE *);
 void gfpara_send_int(FILE *t, gfarm_int32_t);
 void gfpara_send_int64(FILE *, gfarm_int64_t);
 void gfpara_send_string(FILE *, const char *, ...) GFLOG_PRINTF_ARG(2, 3);
+void gfpara_send_flush(FILE *);
 
 pid_t gfpara_pid_get(gfpara_proc_t *);
 void *gfpara_data_get(gfpara_proc_t *);
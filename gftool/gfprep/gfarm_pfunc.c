@@ -32,6 +32,32 @@
 
 static mode_t mask;
 
+/*
+ * a file larger than stripe_size is copied by multiple children.
+ * each PFUNC_CMD_COPY_RANGE copies a part of the file to the temporary
+ * file, and PFUNC_CMD_COPY_FINISH renames it after all parts are copied.
+ * PFUNC_CMD_COPY_FINISH is sent by the thread which received the result
+ * of the last part, before it takes a next command from the fifo.
+ */
+struct pfunc_stripe {
+	struct pfunc_stripe *next; /* in stripes_done */
+	struct pfunc_stripe *all_next, *all_prev; /* in stripes_all */
+	char *src_url;
+	char *dst_url;
+	gfarm_off_t src_size;
+	gfarm_off_t n_refs;
+	int n_ng;
+	int started;
+	void *cb_data;
+};
+
+/* for each child */
+struct pfunc_proc_data {
+	int command;
+	void *cb_data;
+	struct pfunc_stripe *stripe;
+};
+
 struct gfarm_pfunc {
 	gfpara_t *gfpara_handle;
 	gfarm_fifo_t *fifo_handle;
@@ -46,6 +72,12 @@ struct gfarm_pfunc {
 	int skip_existing;
 	int is_end;
 	pthread_mutex_t is_end_mutex;
+	gfarm_off_t stripe_size;
+	pthread_mutex_t stripe_mutex;
+	struct pfunc_stripe *stripes_done;
+	struct pfunc_stripe *stripes_all; /* not freed yet */
+	struct pfunc_proc_data *procs;
+	int n_procs;
 };
 
 struct gfarm_pfunc_cmd {
@@ -57,6 +89,9 @@ struct gfarm_pfunc_cmd {
 	int src_port;
 	int dst_port;
 	gfarm_off_t src_size;
+	gfarm_off_t offset; /* PFUNC_CMD_COPY_RANGE */
+	gfarm_off_t length; /* PFUNC_CMD_COPY_RANGE */
+	struct pfunc_stripe *stripe; /* PFUNC_CMD_COPY_RANGE */
 	int check_disk_avail;
 	void *cb_data;
 };
@@ -68,6 +103,8 @@ enum pfunc_cmdnum {
 	PFUNC_CMD_COPY,
 	PFUNC_CMD_MOVE,
 	PFUNC_CMD_REMOVE_REPLICA,
+	PFUNC_CMD_COPY_RANGE,
+	PFUNC_CMD_COPY_FINISH,
 	PFUNC_CMD_TERMINATE
 };
 
@@ -343,6 +380,46 @@ pfunc_write(struct pfunc_file *fp, void *buf, int bufsize, int *wsize)
 	return (GFARM_ERR_NO_ERROR);
 }
 
+static gfarm_error_t
+pfunc_pread(struct pfunc_file *fp, void *buf, int bufsize, gfarm_off_t off,
+	int *rsize)
+{
+	ssize_t len;
+
+	if (fp->gfarm)
+		return (gfs_pio_pread(fp->gfarm, buf, bufsize, off, rsize));
+	len = pread(fp->fd, buf, bufsize, off);
+	if (len == -1)
+		return (gfarm_errno_to_error(errno));
+	*rsize = len;
+	return (GFARM_ERR_NO_ERROR);
+}
+
+static gfarm_error_t
+pfunc_pwrite(struct pfunc_file *fp, void *buf, int bufsize, gfarm_off_t off,
+	int *wsize)
+{
+	ssize_t len;
+
+	if (fp->gfarm)
+		return (gfs_pio_pwrite(fp->gfarm, buf, bufsize, off, wsize));
+	len = pwrite(fp->fd, buf, bufsize, off);
+	if (len == -1)
+		return (gfarm_errno_to_error(errno));
+	*wsize = len;
+	return (GFARM_ERR_NO_ERROR);
+}
+
+static gfarm_error_t
+pfunc_truncate(struct pfunc_file *fp, gfarm_off_t size)
+{
+	if (fp->gfarm)
+		return (gfs_pio_truncate(fp->gfarm, size));
+	if (ftruncate(fp->fd, size) == -1)
+		return (gfarm_errno_to_error(errno));
+	return (GFARM_ERR_NO_ERROR);
+}
+
 static gfarm_error_t
 pfunc_close(struct pfunc_file *fp)
 {
@@ -634,6 +711,217 @@ end:
 	free(dst_host);
 }
 
+/* PFUNC_CMD_COPY_RANGE: copy a part of a file into the temporary file */
+static void
+pfunc_copy_range_main(gfarm_pfunc_t *handle,
+		      FILE *from_parent, FILE *to_parent)
+{
+	gfarm_error_t e;
+	int result = PFUNC_RESULT_NG, retv;
+	char *tmp_url, *src_url, *dst_url, *src_host, *dst_host;
+	int src_port, dst_port;
+	int rsize, wsize, size;
+	struct pfunc_file src_fp, dst_fp;
+	struct pfunc_stat src_st;
+	gfarm_off_t src_size, offset, length, off, end;
+	int check_disk_avail;
+
+	gfpara_recv_string(from_parent, &src_url);
+	gfpara_recv_int64(from_parent, &src_size);
+	gfpara_recv_string(from_parent, &src_host);
+	gfpara_recv_int(from_parent, &src_port);
+	gfpara_recv_string(from_parent, &dst_url);
+	gfpara_recv_string(from_parent, &dst_host);
+	gfpara_recv_int(from_parent, &dst_port);
+	gfpara_recv_int(from_parent, &check_disk_avail);
+	gfpara_recv_int64(from_parent, &offset);
+	gfpara_recv_int64(from_parent, &length);
+
+	retv = gfprep_asprintf(&tmp_url, "%s%s", dst_url, tmp_url_suffix);
+	if (retv == -1) {
+		fprintf(stderr, "ERROR: copy failed (no memory): %s\n",
+			src_url);
+		tmp_url = NULL;
+		goto end;
+	}
+	if (check_disk_avail && dst_port > 0) { /* dst is gfarm */
+		e = pfunc_check_disk_avail(
+		    dst_url, dst_host, dst_port, src_size);
+		if (e != GFARM_ERR_NO_ERROR) {
+			fprintf(stderr,
+				"ERROR: copy failed: checking disk_avail: "
+				"%s (%s:%d, %s:%d): %s\n",
+				src_url, src_host, src_port,
+				dst_host, dst_port, gfarm_error_string(e));
+			goto end;
+		}
+	}
+	e = pfunc_open(src_url, O_RDONLY, 0, &src_fp);
+	if (e != GFARM_ERR_NO_ERROR) {
+		fprintf(stderr, "ERROR: copy failed: open(%s): %s\n",
+			src_url, gfarm_error_string(e));
+		goto end;
+	}
+	e = pfunc_lstat(src_url, &src_st);
+	if (e != GFARM_ERR_NO_ERROR || src_st.size != src_size) {
+		(void)pfunc_close(&src_fp);
+		fprintf(stderr, "ERROR: copy failed: lstat(%s): %s\n",
+		    src_url, e != GFARM_ERR_NO_ERROR ?
+		    gfarm_error_string(e) : "size changed");
+		goto end;
+	}
+	/* the other parts may have created it */
+	e = pfunc_open(tmp_url, O_CREAT | O_WRONLY,
+	    src_st.mode & 0777 & ~mask, &dst_fp);
+	if (e != GFARM_ERR_NO_ERROR) {
+		(void)pfunc_close(&src_fp);
+		fprintf(stderr, "ERROR: copy failed: open(%s): %s\n",
+		    tmp_url, gfarm_error_string(e));
+		goto end;
+	}
+	if (src_fp.gfarm && strcmp(src_host, "") != 0) {
+		/* XXX FIXME: INTERNAL FUNCTION SHOULD NOT BE USED */
+		e = gfs_pio_internal_set_view_section(src_fp.gfarm, src_host);
+		if (e != GFARM_ERR_NO_ERROR) {
+			fprintf(stderr,
+				"ERROR: copy failed: set_view(%s, %s): %s\n",
+				src_url, src_host, gfarm_error_string(e));
+			goto close;
+		}
+	}
+	if (dst_fp.gfarm && strcmp(dst_host, "") != 0) {
+		/* XXX FIXME: INTERNAL FUNCTION SHOULD NOT BE USED */
+		e = gfs_pio_internal_set_view_section(dst_fp.gfarm, dst_host);
+		if (e != GFARM_ERR_NO_ERROR) {
+			fprintf(stderr,
+				"ERROR: copy failed: set_view(%s, %s): %s\n",
+				tmp_url, dst_host, gfarm_error_string(e));
+			goto close;
+		}
+	}
+	end = offset + length;
+	for (off = offset; off < end; off += rsize) {
+		size = end - off < handle->copy_bufsize ?
+		    end - off : handle->copy_bufsize;
+		e = pfunc_pread(&src_fp, handle->copy_buf, size, off, &rsize);
+		if (e != GFARM_ERR_NO_ERROR || rsize == 0) {
+			fprintf(stderr, "ERROR: copy failed: read(%s): %s\n",
+				src_url, e != GFARM_ERR_NO_ERROR ?
+				gfarm_error_string(e) : "unexpected EOF");
+			goto close;
+		}
+		e = pfunc_pwrite(&dst_fp, handle->copy_buf, rsize, off,
+		    &wsize);
+		if (e != GFARM_ERR_NO_ERROR || rsize != wsize) {
+			fprintf(stderr, "ERROR: copy failed: write(%s): %s\n",
+				tmp_url, e != GFARM_ERR_NO_ERROR ?
+				gfarm_error_string(e) : "rsize!=wsize");
+			goto close;
+		}
+	}
+	/* the temporary file may be left by a previous failure */
+	if (end == src_size) {
+		e = pfunc_truncate(&dst_fp, src_size);
+		if (e != GFARM_ERR_NO_ERROR) {
+			fprintf(stderr,
+				"ERROR: copy failed: truncate(%s): %s\n",
+				tmp_url, gfarm_error_string(e));
+			goto close;
+		}
+	}
+	result = PFUNC_RESULT_OK;
+close:
+	e = pfunc_close(&src_fp);
+	if (e != GFARM_ERR_NO_ERROR) {
+		fprintf(stderr, "ERROR: copy failed: close(%s): %s\n",
+			src_url, gfarm_error_string(e));
+		result = PFUNC_RESULT_NG;
+	}
+	e = pfunc_close(&dst_fp);
+	if (e != GFARM_ERR_NO_ERROR) {
+		fprintf(stderr, "ERROR: copy failed: close(%s): %s\n",
+			tmp_url, gfarm_error_string(e));
+		result = PFUNC_RESULT_NG;
+	}
+	/* the temporary file is removed by PFUNC_CMD_COPY_FINISH */
+end:
+	gfpara_send_int(to_parent, result);
+	free(tmp_url);
+	free(src_url);
+	free(dst_url);
+	free(src_host);
+	free(dst_host);
+}
+
+/* PFUNC_CMD_COPY_FINISH: rename the temporary file after all parts */
+static void
+pfunc_copy_finish_main(gfarm_pfunc_t *handle,
+		       FILE *from_parent, FILE *to_parent)
+{
+	gfarm_error_t e;
+	int result = PFUNC_RESULT_NG, retv, n_ng;
+	char *tmp_url, *src_url, *dst_url;
+	struct pfunc_stat src_st, tmp_st;
+	gfarm_off_t src_size;
+
+	gfpara_recv_string(from_parent, &src_url);
+	gfpara_recv_int64(from_parent, &src_size);
+	gfpara_recv_string(from_parent, &dst_url);
+	gfpara_recv_int(from_parent, &n_ng);
+
+	retv = gfprep_asprintf(&tmp_url, "%s%s", dst_url, tmp_url_suffix);
+	if (retv == -1) {
+		fprintf(stderr, "ERROR: copy failed (no memory): %s\n",
+			src_url);
+		gfpara_send_int(to_parent, result);
+		free(src_url);
+		free(dst_url);
+		return;
+	}
+	if (n_ng > 0) /* already reported */
+		goto end;
+	e = pfunc_lstat(tmp_url, &tmp_st);
+	if (e != GFARM_ERR_NO_ERROR || tmp_st.size != src_size) {
+		fprintf(stderr, "ERROR: copy failed: lstat(%s): %s\n",
+		    tmp_url, e != GFARM_ERR_NO_ERROR ?
+		    gfarm_error_string(e) : "size mismatch");
+		goto end;
+	}
+	e = pfunc_lstat(src_url, &src_st);
+	if (e != GFARM_ERR_NO_ERROR || src_st.size != src_size) {
+		fprintf(stderr, "ERROR: copy failed: lstat(%s): %s\n",
+		    src_url, e != GFARM_ERR_NO_ERROR ?
+		    gfarm_error_string(e) : "size changed");
+		goto end;
+	}
+	e = pfunc_lutimens(tmp_url, &src_st);
+	if (e != GFARM_ERR_NO_ERROR) {
+		fprintf(stderr, "ERROR: copy failed: utime(%s): %s\n",
+			tmp_url, gfarm_error_string(e));
+		goto end;
+	}
+	e = pfunc_rename(tmp_url, dst_url);
+	if (e != GFARM_ERR_NO_ERROR) {
+		fprintf(stderr, "ERROR: copy failed: rename(%s -> %s): %s\n",
+			tmp_url, dst_url, gfarm_error_string(e));
+		goto end;
+	}
+	result = PFUNC_RESULT_OK;
+end:
+	if (result == PFUNC_RESULT_NG) {
+		e = pfunc_unlink(tmp_url);
+		if (e != GFARM_ERR_NO_ERROR &&
+		    e != GFARM_ERR_NO_SUCH_FILE_OR_DIRECTORY)
+			fprintf(stderr,
+				"ERROR: cannot remove tmp-file: %s: %s\n",
+			tmp_url, gfarm_error_string(e));
+	}
+	gfpara_send_int(to_parent, result);
+	free(tmp_url);
+	free(src_url);
+	free(dst_url);
+}
+
 static void
 pfunc_remove_replica_main(gfarm_pfunc_t *handle,
 			  FILE *from_parent, FILE *to_parent)
@@ -682,6 +970,8 @@ pfunc_child(void *param, FILE *from_parent, FILE *to_parent)
 		return (0);
 	}
 	for (;;) {
+		/* send the result of the previous command */
+		gfpara_send_flush(to_parent);
 		gfpara_recv_int(from_parent, &command);
 		switch (command) {
 		case PFUNC_CMD_REPLICATE:
@@ -704,6 +994,12 @@ pfunc_child(void *param, FILE *from_parent, FILE *to_parent)
 			pfunc_remove_replica_main(handle,
 						  from_parent, to_parent);
 			continue;
+		case PFUNC_CMD_COPY_RANGE:
+			pfunc_copy_range_main(handle, from_parent, to_parent);
+			continue;
+		case PFUNC_CMD_COPY_FINISH:
+			pfunc_copy_finish_main(handle, from_parent, to_parent);
+			continue;
 		case PFUNC_CMD_TERMINATE:
 			result = PFUNC_RESULT_END;
 			goto term;
@@ -761,27 +1057,114 @@ pfunc_set_end(gfarm_pfunc_t *handle)
 	gfarm_mutex_unlock(&handle->is_end_mutex, diag, "is_end_mutex");
 }
 
+static void
+pfunc_stripe_free(gfarm_pfunc_t *handle, struct pfunc_stripe *stripe)
+{
+	static const char diag[] = "pfunc_stripe_free";
+
+	gfarm_mutex_lock(&handle->stripe_mutex, diag, "stripe_mutex");
+	if (stripe->all_prev != NULL)
+		stripe->all_prev->all_next = stripe->all_next;
+	else
+		handle->stripes_all = stripe->all_next;
+	if (stripe->all_next != NULL)
+		stripe->all_next->all_prev = stripe->all_prev;
+	gfarm_mutex_unlock(&handle->stripe_mutex, diag, "stripe_mutex");
+
+	if (handle->cb_free != NULL && stripe->cb_data != NULL)
+		handle->cb_free(stripe->cb_data);
+	free(stripe->src_url);
+	free(stripe->dst_url);
+	free(stripe);
+}
+
+/* the result of PFUNC_CMD_COPY_RANGE */
+static void
+pfunc_stripe_part_done(gfarm_pfunc_t *handle, struct pfunc_stripe *stripe,
+	int result)
+{
+	static const char diag[] = "pfunc_stripe_part_done";
+
+	gfarm_mutex_lock(&handle->stripe_mutex, diag, "stripe_mutex");
+	if (result != PFUNC_RESULT_OK)
+		stripe->n_ng++;
+	if (--stripe->n_refs == 0) {
+		stripe->next = handle->stripes_done;
+		handle->stripes_done = stripe;
+	}
+	gfarm_mutex_unlock(&handle->stripe_mutex, diag, "stripe_mutex");
+}
+
+static struct pfunc_stripe *
+pfunc_stripe_done_next(gfarm_pfunc_t *handle)
+{
+	static const char diag[] = "pfunc_stripe_done_next";
+	struct pfunc_stripe *stripe;
+
+	gfarm_mutex_lock(&handle->stripe_mutex, diag, "stripe_mutex");
+	stripe = handle->stripes_done;
+	if (stripe != NULL)
+		handle->stripes_done = stripe->next;
+	gfarm_mutex_unlock(&handle->stripe_mutex, diag, "stripe_mutex");
+	return (stripe);
+}
+
+static struct pfunc_proc_data *
+pfunc_proc_data(gfarm_pfunc_t *handle, gfpara_proc_t *proc)
+{
+	static const char diag[] = "pfunc_proc_data";
+	struct pfunc_proc_data *pd = gfpara_data_get(proc);
+
+	if (pd == NULL) {
+		gfarm_mutex_lock(&handle->stripe_mutex, diag, "stripe_mutex");
+		pd = &handle->procs[handle->n_procs++];
+		gfarm_mutex_unlock(&handle->stripe_mutex, diag,
+		    "stripe_mutex");
+		gfpara_data_set(proc, pd);
+	}
+	return (pd);
+}
+
 static int
 pfunc_send(FILE *child_in, gfpara_proc_t *proc, void *param, int stop)
 {
+	static const char diag[] = "pfunc_send";
 	gfarm_pfunc_t *handle = param;
 	gfarm_error_t e;
 	gfarm_pfunc_cmd_t cmd;
+	struct pfunc_proc_data *pd = pfunc_proc_data(handle, proc);
+	struct pfunc_stripe *stripe;
+	int started;
 
-	if (stop || pfunc_is_end(handle)) {
-		gfpara_data_set(proc, NULL);
+	pd->command = PFUNC_CMD_TERMINATE;
+	pd->cb_data = NULL;
+	pd->stripe = NULL;
+	if (stop) {
+		gfpara_send_int(child_in, PFUNC_CMD_TERMINATE);
+		return (GFPARA_NEXT);
+	}
+	/* all parts of a file have been copied, even after the end */
+	if ((stripe = pfunc_stripe_done_next(handle)) != NULL) {
+		pd->command = PFUNC_CMD_COPY_FINISH;
+		pd->stripe = stripe;
+		gfpara_send_int(child_in, PFUNC_CMD_COPY_FINISH);
+		gfpara_send_string(child_in, "%s", stripe->src_url);
+		gfpara_send_int64(child_in, stripe->src_size);
+		gfpara_send_string(child_in, "%s", stripe->dst_url);
+		gfpara_send_int(child_in, stripe->n_ng);
+		return (GFPARA_NEXT);
+	}
+	if (pfunc_is_end(handle)) {
 		gfpara_send_int(child_in, PFUNC_CMD_TERMINATE);
 		return (GFPARA_NEXT);
 	}
 	e = gfarm_fifo_delete(handle->fifo_handle, &cmd); /* block */
 	if (e == GFARM_ERR_NO_SUCH_OBJECT) { /* finish and empty */
-		gfpara_data_set(proc, NULL);
 		gfpara_send_int(child_in, PFUNC_CMD_TERMINATE);
 		pfunc_set_end(handle);
 		return (GFPARA_NEXT);
 	} else if (e != GFARM_ERR_NO_ERROR) {
 		fprintf(stderr, "ERROR: fifo: %s\n", gfarm_error_string(e));
-		gfpara_data_set(proc, NULL);
 		gfpara_send_int(child_in, PFUNC_CMD_TERMINATE);
 		pfunc_set_end(handle);
 		return (GFPARA_NEXT);
@@ -809,6 +1192,18 @@ pfunc_send(FILE *child_in, gfpara_proc_t *proc, void *param, int stop)
 		gfpara_send_int(child_in, cmd.dst_port);
 		gfpara_send_int(child_in, cmd.check_disk_avail);
 		break;
+	case PFUNC_CMD_COPY_RANGE:
+		gfpara_send_string(child_in, "%s", cmd.src_url);
+		gfpara_send_int64(child_in, cmd.src_size);
+		gfpara_send_string(child_in, "%s", cmd.src_host);
+		gfpara_send_int(child_in, cmd.src_port);
+		gfpara_send_string(child_in, "%s", cmd.dst_url);
+		gfpara_send_string(child_in, "%s", cmd.dst_host);
+		gfpara_send_int(child_in, cmd.dst_port);
+		gfpara_send_int(child_in, cmd.check_disk_avail);
+		gfpara_send_int64(child_in, cmd.offset);
+		gfpara_send_int64(child_in, cmd.length);
+		break;
 	case PFUNC_CMD_REMOVE_REPLICA:
 		gfpara_send_string(child_in, "%s", cmd.src_url);
 		gfpara_send_string(child_in, "%s", cmd.src_host);
@@ -819,9 +1214,22 @@ pfunc_send(FILE *child_in, gfpara_proc_t *proc, void *param, int stop)
 			"ERROR: unexpected command: %d\n", cmd.command);
 		gfpara_send_int(child_in, PFUNC_CMD_TERMINATE);
 	}
-	gfpara_data_set(proc, cmd.cb_data);
-	if (handle->cb_start != NULL && cmd.cb_data != NULL)
-		handle->cb_start(cmd.cb_data); /* success */
+	pd->command = cmd.command;
+	if (cmd.stripe != NULL) {
+		stripe = pd->stripe = cmd.stripe;
+		gfarm_mutex_lock(&handle->stripe_mutex, diag, "stripe_mutex");
+		started = stripe->started;
+		stripe->started = 1;
+		gfarm_mutex_unlock(&handle->stripe_mutex, diag,
+		    "stripe_mutex");
+		if (!started && handle->cb_start != NULL &&
+		    stripe->cb_data != NULL)
+			handle->cb_start(stripe->cb_data); /* first part */
+	} else {
+		pd->cb_data = cmd.cb_data;
+		if (handle->cb_start != NULL && cmd.cb_data != NULL)
+			handle->cb_start(cmd.cb_data); /* success */
+	}
 	pfunc_entry_free(&cmd);
 	return (GFPARA_NEXT);
 }
@@ -831,7 +1239,8 @@ pfunc_recv(FILE *child_out, gfpara_proc_t *proc, void *param)
 {
 	int result;
 	gfarm_pfunc_t *handle = param;
-	void *data = gfpara_data_get(proc);
+	struct pfunc_proc_data *pd = gfpara_data_get(proc);
+	void *data = pd->cb_data;
 
 	gfpara_recv_int(child_out, &result);
 	switch (result) {
@@ -839,10 +1248,20 @@ pfunc_recv(FILE *child_out, gfpara_proc_t *proc, void *param)
 	case PFUNC_RESULT_NG:
 	case PFUNC_RESULT_SKIP:
 	case PFUNC_RESULT_BUSY_REMOVE_REPLICA:
+		if (pd->command == PFUNC_CMD_COPY_RANGE) {
+			pfunc_stripe_part_done(handle, pd->stripe, result);
+			return (GFPARA_NEXT);
+		}
+		if (pd->command == PFUNC_CMD_COPY_FINISH)
+			data = pd->stripe->cb_data;
 		if (handle->cb_end != NULL && data != NULL) {
 			handle->cb_end(result, data);
 			handle->cb_free(data);
 		}
+		if (pd->command == PFUNC_CMD_COPY_FINISH) {
+			pd->stripe->cb_data = NULL;
+			pfunc_stripe_free(handle, pd->stripe);
+		}
 		return (GFPARA_NEXT);
 	case PFUNC_RESULT_END:
 		return (GFPARA_END);
@@ -856,13 +1275,40 @@ pfunc_recv(FILE *child_out, gfpara_proc_t *proc, void *param)
 static void
 pfunc_cmd_clear(gfarm_pfunc_t *handle)
 {
+	gfarm_error_t e;
 	gfarm_pfunc_cmd_t cmd;
+	struct pfunc_stripe *stripe;
+	char *tmp_url;
 
 	while (gfarm_fifo_delete(handle->fifo_handle, &cmd)
 	    == GFARM_ERR_NO_ERROR) {
-		handle->cb_free(cmd.cb_data);
+		if (cmd.stripe != NULL)
+			pfunc_stripe_part_done(handle, cmd.stripe,
+			    PFUNC_RESULT_NG);
+		else
+			handle->cb_free(cmd.cb_data);
 		pfunc_entry_free(&cmd);
 	}
+	/*
+	 * all children have exited here, thus the stripes left are
+	 * interrupted, and their temporary files are removed.
+	 */
+	handle->stripes_done = NULL;
+	while ((stripe = handle->stripes_all) != NULL) {
+		if (gfprep_asprintf(&tmp_url, "%s%s",
+		    stripe->dst_url, tmp_url_suffix) == -1)
+			fprintf(stderr, "ERROR: no memory\n");
+		else {
+			e = pfunc_unlink(tmp_url);
+			if (e != GFARM_ERR_NO_ERROR &&
+			    e != GFARM_ERR_NO_SUCH_FILE_OR_DIRECTORY)
+				fprintf(stderr,
+				    "ERROR: cannot remove tmp-file: %s: %s\n",
+				    tmp_url, gfarm_error_string(e));
+			free(tmp_url);
+		}
+		pfunc_stripe_free(handle, stripe);
+	}
 }
 
 static void *
@@ -893,6 +1339,13 @@ gfarm_pfunc_init_fork(
 		free(buf);
 		return (GFARM_ERR_NO_MEMORY);
 	}
+	GFARM_MALLOC_ARRAY(handle->procs, n_parallel);
+	if (handle->procs == NULL) {
+		free(handle);
+		free(buf);
+		return (GFARM_ERR_NO_MEMORY);
+	}
+	handle->n_procs = 0;
 	handle->queue_size = queue_size;
 	handle->simulate_KBs = simulate_KBs;
 	handle->copy_buf = buf;
@@ -905,11 +1358,17 @@ gfarm_pfunc_init_fork(
 	handle->is_end = 0;
 	gfarm_mutex_init(&handle->is_end_mutex, "gfarm_pfunc_start",
 	    "is_end_mutex");
+	handle->stripe_size = 0;
+	gfarm_mutex_init(&handle->stripe_mutex, "gfarm_pfunc_start",
+	    "stripe_mutex");
+	handle->stripes_done = NULL;
+	handle->stripes_all = NULL;
 
 	e = gfarm_fifo_init(&handle->fifo_handle,
 	    handle->queue_size, sizeof(gfarm_pfunc_cmd_t),
 	    pfunc_fifo_set, pfunc_fifo_get);
 	if (e != GFARM_ERR_NO_ERROR) {
+		free(handle->procs);
 		free(handle->copy_buf);
 		free(handle);
 		return (e);
@@ -919,6 +1378,7 @@ gfarm_pfunc_init_fork(
 	    pfunc_send, handle, pfunc_recv, handle, pfunc_end, handle);
 	if (e != GFARM_ERR_NO_ERROR) {
 		gfarm_fifo_free(handle->fifo_handle);
+		free(handle->procs);
 		free(handle->copy_buf);
 		free(handle);
 		return (e);
@@ -976,6 +1436,9 @@ gfarm_pfunc_join(gfarm_pfunc_t *handle)
 		e = GFARM_ERR_NO_ERROR;
 	e2 = gfpara_join(handle->gfpara_handle);
 	gfarm_fifo_free(handle->fifo_handle);
+	gfarm_mutex_destroy(&handle->stripe_mutex, "gfarm_pfunc_join",
+	    "stripe_mutex");
+	free(handle->procs);
 	free(handle->copy_buf);
 	free(handle);
 	if (e2 == GFARM_ERR_NO_ERROR)
@@ -1009,6 +1472,7 @@ gfarm_pfunc_replicate(
 	cmd.dst_port = dst_port;
 	cmd.src_size = src_size;
 	cmd.check_disk_avail = check_disk_avail;
+	cmd.stripe = NULL;
 	cmd.cb_data = cb_data;
 	gfarm_pfunc_cmd_add(pfunc_handle, &cmd);
 	return (GFARM_ERR_NO_ERROR);
@@ -1032,6 +1496,7 @@ gfarm_pfunc_remove_replica(
 	cmd.src_port = port;
 	cmd.dst_port = 0;
 	cmd.src_size = src_size;
+	cmd.stripe = NULL;
 	cmd.cb_data = cb_data;
 	gfarm_pfunc_cmd_add(pfunc_handle, &cmd);
 	return (GFARM_ERR_NO_ERROR);
@@ -1039,6 +1504,82 @@ gfarm_pfunc_remove_replica(
 
 static const char no_host[] = "";
 
+/* 0: disabled */
+void
+gfarm_pfunc_set_stripe_size(gfarm_pfunc_t *handle, gfarm_off_t stripe_size)
+{
+	handle->stripe_size = stripe_size;
+}
+
+static gfarm_error_t
+pfunc_copy_stripe(
+	gfarm_pfunc_t *pfunc_handle,
+	const char *src_url, const char *src_host, int src_port,
+	gfarm_off_t src_size,
+	const char *dst_url, const char *dst_host, int dst_port,
+	void *cb_data, int check_disk_avail)
+{
+	gfarm_pfunc_cmd_t cmd;
+	struct pfunc_stripe *stripe;
+	gfarm_off_t offset, stripe_size = pfunc_handle->stripe_size;
+	gfarm_off_t i, n_parts = (src_size + stripe_size - 1) / stripe_size;
+	static const char diag[] = "pfunc_copy_stripe";
+
+	GFARM_MALLOC(stripe);
+	if (stripe == NULL)
+		return (GFARM_ERR_NO_MEMORY);
+	stripe->src_url = strdup(src_url);
+	stripe->dst_url = strdup(dst_url);
+	if (stripe->src_url == NULL || stripe->dst_url == NULL) {
+		free(stripe->src_url);
+		free(stripe->dst_url);
+		free(stripe);
+		return (GFARM_ERR_NO_MEMORY);
+	}
+	stripe->next = NULL;
+	stripe->src_size = src_size;
+	stripe->n_refs = n_parts;
+	stripe->n_ng = 0;
+	stripe->started = 0;
+	stripe->cb_data = cb_data;
+	gfarm_mutex_lock(&pfunc_handle->stripe_mutex, diag, "stripe_mutex");
+	stripe->all_prev = NULL;
+	stripe->all_next = pfunc_handle->stripes_all;
+	if (stripe->all_next != NULL)
+		stripe->all_next->all_prev = stripe;
+	pfunc_handle->stripes_all = stripe;
+	gfarm_mutex_unlock(&pfunc_handle->stripe_mutex, diag, "stripe_mutex");
+
+	for (i = 0, offset = 0; i < n_parts; i++, offset += stripe_size) {
+		cmd.command = PFUNC_CMD_COPY_RANGE;
+		cmd.src_url = strdup(src_url);
+		cmd.dst_url = strdup(dst_url);
+		if (cmd.src_url == NULL || cmd.dst_url == NULL) {
+			free(cmd.src_url);
+			free(cmd.dst_url);
+			/* PFUNC_CMD_COPY_FINISH reports the error */
+			for (; i < n_parts; i++)
+				pfunc_stripe_part_done(pfunc_handle, stripe,
+				    PFUNC_RESULT_NG);
+			break;
+		}
+		cmd.src_host = src_host ? src_host : no_host;
+		cmd.dst_host = dst_host ? dst_host : no_host;
+		cmd.src_port = src_host ? src_port : -1;
+		cmd.dst_port = dst_host ? dst_port : -1;
+		cmd.src_size = src_size;
+		cmd.offset = offset;
+		cmd.length = src_size - offset < stripe_size ?
+		    src_size - offset : stripe_size;
+		cmd.stripe = stripe;
+		/* the whole size is checked only once */
+		cmd.check_disk_avail = i == 0 ? check_disk_avail : 0;
+		cmd.cb_data = NULL;
+		gfarm_pfunc_cmd_add(pfunc_handle, &cmd);
+	}
+	return (GFARM_ERR_NO_ERROR);
+}
+
 /* NOTE: src_host and dst_host is not free()ed (see pfunc_entry_free()) */
 gfarm_error_t
 gfarm_pfunc_copy(
@@ -1053,7 +1594,13 @@ gfarm_pfunc_copy(
 	if (is_move) { /* not supported yet */
 		/* cmd.command = PFUNC_CMD_MOVE; */
 		return (GFARM_ERR_OPERATION_NOT_SUPPORTED);
-	} else
+	} else if (pfunc_handle->stripe_size > 0 &&
+	    src_size > pfunc_handle->stripe_size &&
+	    !pfunc_handle->skip_existing && pfunc_handle->simulate_KBs <= 0)
+		return (pfunc_copy_stripe(pfunc_handle, src_url,
+		    src_host, src_port, src_size, dst_url, dst_host, dst_port,
+		    cb_data, check_disk_avail));
+	else
 		cmd.command = PFUNC_CMD_COPY;
 	cmd.src_url = strdup(src_url);
 	cmd.dst_url = strdup(dst_url);
@@ -1068,6 +1615,7 @@ gfarm_pfunc_copy(
 	cmd.dst_port = dst_host ? dst_port : -1;
 	cmd.src_size = src_size;
 	cmd.check_disk_avail = check_disk_avail;
+	cmd.stripe = NULL;
 	cmd.cb_data = cb_data;
 	gfarm_pfunc_cmd_add(pfunc_handle, &cmd);
 	return (GFARM_ERR_NO_ERROR);
@@ -22,6 +22,7 @@ gfarm_error_t gfarm_pfunc_cmd_add(gfarm_pfunc_t *, gfarm_pfunc_cmd_t *);
 gfarm_error_t gfarm_pfunc_terminate(gfarm_pfunc_t *);
 gfarm_error_t gfarm_pfunc_stop(gfarm_pfunc_t *);
 gfarm_error_t gfarm_pfunc_join(gfarm_pfunc_t *);
+void gfarm_pfunc_set_stripe_size(gfarm_pfunc_t *, gfarm_off_t);
 
 gfarm_error_t gfarm_pfunc_replicate(
 	gfarm_pfunc_t *, const char *, const char *, int, gfarm_off_t,
@@ -39,6 +39,7 @@
 #include "gfarm_parallel.h"
 #include "gfarm_dirtree.h"
 #include "gfarm_pfunc.h"
+#include "gfarm_manifest.h"
 
 #define GFPREP_PARALLEL_DIRTREE 8
 
@@ -80,6 +81,10 @@ static gfarm_uint64_t removed_replica_ng_num = 0;
 static gfarm_uint64_t removed_replica_ok_filesize = 0;
 static gfarm_uint64_t removed_replica_ng_filesize = 0;
 
+/* -I: the manifest of the previous run, and the one of this run */
+static gfarm_manifest_t *manifest_prev = NULL;
+static gfarm_manifest_t *manifest_next = NULL; /* locked by cb_mutex */
+
 /* -------------------------------------------------------------- */
 
 const char GFPREP_FILE_URL_PREFIX[] = "file:";
@@ -159,6 +164,9 @@ gfpcopy_usage()
 "\t[-f (force copy)(overwrite)] [-b <#bufsize to copy>]\n"
 "\t[-e (skip existing files\n"
 "\t     in order to execute multiple gfpcopy simultaneously)]\n"
+"\t[-I <manifest file to skip unchanged files>]\n"
+"\t[-T <#byte(K|M|G|T)(copy a larger file by multiple processes\n"
+"\t     per the size)(default: disabled)>]\n"
 "\t<src_url(gfarm:///... or file:///...) or relative-path>\n"
 "\t<dst_dir(gfarm:///... or file:///...) or relative-path>\n");
 }
@@ -176,7 +184,7 @@ gfprep_usage_common(int error)
 "\t[-H <destination hostfile>]\n"
 "\t[-j <#parallel(to copy files)(connections)(default: %d)>]\n"
 "\t[-J <#parallel(to read directories)(default: %d)>]\n"
-"\t[-w <scheduling way (noplan,greedy)(default: noplan)>]\n"
+"\t[-w <scheduling way (noplan,greedy,cost)(default: noplan)>]\n"
 "\t[-W <#KB> (threshold size to flat connections cost)(for -w greedy)]\n"
 "\t[-p (report total performance) | -P (report each and total performance)]\n"
 "\t[-n (not execute)] [-s <#KB/s(simulate)>]\n"
@@ -354,11 +362,14 @@ struct gfprep_host_info {
 
 	/* locked by cb_mutex */
 	int n_using; /* src:n_reading, dst:n_writing */
+	gfarm_int64_t size_using; /* total size of n_using */
 	gfarm_int64_t failed_size; /* for dst */
+	double rate; /* bytes/sec per connection, 0: unknown (for -w cost) */
 };
 
 static void
-gfprep_update_n_using(struct gfprep_host_info *info, int add_using)
+gfprep_update_n_using(struct gfprep_host_info *info, int add_using,
+	gfarm_off_t add_size)
 {
 	static const char diag[] = "gfprep_update_n_using";
 
@@ -366,6 +377,7 @@ gfprep_update_n_using(struct gfprep_host_info *info, int add_using)
 		return;
 	gfarm_mutex_lock(&cb_mutex, diag, CB_MUTEX_DIAG);
 	info->n_using += add_using;
+	info->size_using += add_size;
 	gfarm_mutex_unlock(&cb_mutex, diag, CB_MUTEX_DIAG);
 }
 
@@ -469,7 +481,9 @@ gfprep_create_hostinfohash_all(const char *path, int *nhost_infos_p,
 		hi->max_rw = opt.max_rw > 0 ? opt.max_rw : hi->ncpu;
 		hi->disk_avail = hsis[i].disk_avail * 1024; /* KB -> Byte */
 		hi->n_using = 0;
+		hi->size_using = 0;
 		hi->failed_size = 0;
+		hi->rate = 0;
 		*hip = hi;
 	}
 	gfarm_host_sched_info_free(nhsis, hsis);
@@ -1401,6 +1415,115 @@ gfprep_copy_symlink(
 	return (e);
 }
 
+static void
+gfprep_manifest_entry_set(struct gfarm_manifest_entry *ment,
+	const gfarm_dirtree_entry_t *entry)
+{
+	ment->key = gfarm_manifest_key(entry->subpath);
+	ment->size = entry->src_size;
+	ment->m_sec = entry->src_m_sec;
+	ment->m_nsec = entry->src_m_nsec;
+	ment->d_type = entry->src_d_type;
+	ment->ino = entry->src_ino;
+	ment->gen = entry->src_gen;
+}
+
+/* called by threads of gfarm_dirtree, manifest_prev is not modified */
+static int
+gfprep_manifest_is_unchanged(void *closure, gfarm_dirtree_entry_t *entry)
+{
+	const struct gfarm_manifest_entry *ment;
+
+	/* entries under a directory may be changed without its mtime */
+	if (entry->src_d_type != GFS_DT_REG &&
+	    entry->src_d_type != GFS_DT_LNK)
+		return (0);
+	ment = gfarm_manifest_lookup(manifest_prev,
+	    gfarm_manifest_key(entry->subpath));
+	return (ment != NULL &&
+	    ment->d_type == entry->src_d_type &&
+	    ment->size == entry->src_size &&
+	    ment->m_sec == entry->src_m_sec &&
+	    ment->m_nsec == entry->src_m_nsec &&
+	    ment->ino == entry->src_ino &&
+	    ment->gen == entry->src_gen);
+}
+
+/* must be locked by cb_mutex */
+static void
+gfprep_manifest_enter(const struct gfarm_manifest_entry *ment)
+{
+	gfarm_error_t e;
+
+	e = gfarm_manifest_enter(manifest_next, ment);
+	gfprep_fatal_e(e, "gfarm_manifest_enter");
+}
+
+/* the destination of the entry is up to date */
+static void
+gfprep_manifest_add(const gfarm_dirtree_entry_t *entry)
+{
+	static const char diag[] = "gfprep_manifest_add";
+	struct gfarm_manifest_entry ment;
+
+	if (manifest_next == NULL)
+		return;
+	gfprep_manifest_entry_set(&ment, entry);
+	gfarm_mutex_lock(&cb_mutex, diag, CB_MUTEX_DIAG);
+	gfprep_manifest_enter(&ment);
+	gfarm_mutex_unlock(&cb_mutex, diag, CB_MUTEX_DIAG);
+}
+
+static void
+gfprep_manifest_init(gfarm_dirtree_t *dirtree_handle, const char *file,
+	const char *src_dir, const char *dst_dir, int save)
+{
+	gfarm_error_t e;
+
+	e = gfarm_manifest_init(&manifest_prev);
+	gfprep_fatal_e(e, "gfarm_manifest_init");
+	e = gfarm_manifest_load(manifest_prev, file, src_dir, dst_dir);
+	if (e == GFARM_ERR_NO_ERROR)
+		gfprep_verbose("manifest %s: %d entries", file,
+		    gfarm_manifest_count(manifest_prev));
+	else {
+		if (e == GFARM_ERR_INVALID_ARGUMENT)
+			gfprep_warn("manifest %s: not for %s and %s, ignored",
+			    file, src_dir, dst_dir);
+		else if (e != GFARM_ERR_NO_SUCH_FILE_OR_DIRECTORY)
+			gfprep_warn_e(e, "manifest %s: ignored", file);
+		/* discard the entries which may be loaded partially */
+		gfarm_manifest_free(manifest_prev);
+		e = gfarm_manifest_init(&manifest_prev);
+		gfprep_fatal_e(e, "gfarm_manifest_init");
+	}
+	gfarm_dirtree_set_unchanged_func(dirtree_handle,
+	    gfprep_manifest_is_unchanged, NULL);
+	if (save) {
+		e = gfarm_manifest_init(&manifest_next);
+		gfprep_fatal_e(e, "gfarm_manifest_init");
+	}
+}
+
+/* after all copies are finished, even if interrupted */
+static void
+gfprep_manifest_final(const char *file,
+	const char *src_dir, const char *dst_dir)
+{
+	gfarm_error_t e;
+
+	if (manifest_next != NULL) {
+		e = gfarm_manifest_save(manifest_next, file, src_dir, dst_dir);
+		gfprep_error_e(e, "cannot save manifest %s", file);
+		if (e == GFARM_ERR_NO_ERROR)
+			gfprep_verbose("manifest %s: %d entries saved", file,
+			    gfarm_manifest_count(manifest_next));
+	}
+	gfarm_manifest_free(manifest_prev);
+	gfarm_manifest_free(manifest_next);
+	manifest_prev = manifest_next = NULL;
+}
+
 /* callback functions and data (locked by cb_mutex) */
 struct pfunc_cb_data {
 	int migrate;
@@ -1411,6 +1534,7 @@ struct pfunc_cb_data {
 	struct timeval start;
 	gfarm_off_t filesize;
 	char *done_p;
+	struct gfarm_manifest_entry manifest_ent; /* key == 0: unused */
 
 	void (*func_timer_begin)(struct pfunc_cb_data *);
 	void (*func_timer_end)(struct pfunc_cb_data *, enum pfunc_result);
@@ -1548,14 +1672,59 @@ pfunc_cb_timer_end_remove_replica_main(
 	    RESULT, cbd->src_url, cbd->src_hi->hostname, cbd->src_hi->port);
 }
 
+/* for -w cost: the throughput of a connection is learned per host */
+#define GFPREP_COST_MIN_SAMPLE_SIZE	(1024 * 1024)
+#define GFPREP_COST_DEFAULT_RATE	(10.0 * 1024 * 1024) /* bytes/sec */
+
+static double gfprep_cost_rate_all = 0; /* locked by cb_mutex */
+
 static void
-pfunc_cb_update_default(struct pfunc_cb_data *cbd, enum pfunc_result result)
+gfprep_cost_rate_update(double *ratep, double rate)
 {
+	/* exponentially weighted moving average */
+	if (*ratep <= 0)
+		*ratep = rate;
+	else
+		*ratep = *ratep * 0.75 + rate * 0.25;
+}
+
+static void
+pfunc_cb_rate_update(struct pfunc_cb_data *cbd)
+{
+	struct timeval end;
+	double sec;
+
+	if (cbd->func_timer_begin == NULL ||
+	    cbd->filesize < GFPREP_COST_MIN_SAMPLE_SIZE)
+		return; /* unknown or dominated by the cost to open */
+	gettimeofday(&end, NULL);
+	gfarm_timeval_sub(&end, &cbd->start);
+	sec = (double)end.tv_sec +
+	    (double)end.tv_usec / GFARM_SECOND_BY_MICROSEC;
+	if (sec <= 0)
+		return;
+	gfprep_cost_rate_update(&gfprep_cost_rate_all, cbd->filesize / sec);
 	if (cbd->src_hi)
+		gfprep_cost_rate_update(&cbd->src_hi->rate,
+		    cbd->filesize / sec);
+	if (cbd->dst_hi && cbd->dst_hi != cbd->src_hi)
+		gfprep_cost_rate_update(&cbd->dst_hi->rate,
+		    cbd->filesize / sec);
+}
+
+static void
+pfunc_cb_update_default(struct pfunc_cb_data *cbd, enum pfunc_result result)
+{
+	if (cbd->src_hi) {
 		cbd->src_hi->n_using--;
-	if (cbd->dst_hi)
+		cbd->src_hi->size_using -= cbd->filesize;
+	}
+	if (cbd->dst_hi) {
 		cbd->dst_hi->n_using--;
+		cbd->dst_hi->size_using -= cbd->filesize;
+	}
 	if (result == PFUNC_RESULT_OK) {
+		pfunc_cb_rate_update(cbd);
 		total_ok_filesize += cbd->filesize;
 		total_ok_filenum++;
 	} else if (result == PFUNC_RESULT_SKIP) {
@@ -1569,6 +1738,8 @@ pfunc_cb_update_default(struct pfunc_cb_data *cbd, enum pfunc_result result)
 	}
 	if (cbd->done_p)
 		*cbd->done_p = 1;
+	if (result == PFUNC_RESULT_OK && cbd->manifest_ent.key != 0)
+		gfprep_manifest_enter(&cbd->manifest_ent);
 
 	if (cbd->migrate && result == PFUNC_RESULT_BUSY_REMOVE_REPLICA)
 		gfprep_remove_replica_deferred_add(
@@ -2271,6 +2442,7 @@ gfprep_cb_data_init(
 	cbd->filesize = size;
 	cbd->done_p = done_p;
 	cbd->migrate = migrate;
+	cbd->manifest_ent.key = 0;
 
 	cbd->func_timer_begin = func_timer_begin;
 	cbd->func_timer_end = func_timer_end;
@@ -2282,7 +2454,7 @@ gfprep_cb_data_init(
 static void
 gfprep_do_copy(
 	gfarm_pfunc_t *pfunc_handle, char *done_p,
-	int opt_migrate, gfarm_off_t size,
+	const gfarm_dirtree_entry_t *entry, int opt_migrate, gfarm_off_t size,
 	const char *src_url, struct gfprep_host_info *src_hi,
 	const char *dst_url, struct gfprep_host_info *dst_hi)
 {
@@ -2295,13 +2467,15 @@ gfprep_do_copy(
 	    done_p, opt_migrate, size, src_url, src_hi, dst_url, dst_hi,
 	    pfunc_cb_timer_begin, pfunc_cb_timer_end_copy,
 	    pfunc_cb_start_copy, pfunc_cb_update_default);
+	if (manifest_next != NULL)
+		gfprep_manifest_entry_set(&cbd->manifest_ent, entry);
 	if (src_hi) { /* src is gfarm */
-		gfprep_update_n_using(src_hi, 1);
+		gfprep_update_n_using(src_hi, 1, size);
 		src_hostname = src_hi->hostname;
 		src_port = src_hi->port;
 	}
 	if (dst_hi) { /* dst is gfarm */
-		gfprep_update_n_using(dst_hi, 1);
+		gfprep_update_n_using(dst_hi, 1, size);
 		dst_hostname = dst_hi->hostname;
 		dst_port = dst_hi->port;
 
@@ -2332,8 +2506,8 @@ gfprep_do_replicate(
 	    done_p, opt_migrate, size, src_url, src_hi, NULL, dst_hi,
 	    pfunc_cb_timer_begin, pfunc_cb_timer_end_replicate,
 	    pfunc_cb_start_replicate, pfunc_cb_update_default);
-	gfprep_update_n_using(src_hi, 1);
-	gfprep_update_n_using(dst_hi, 1);
+	gfprep_update_n_using(src_hi, 1, size);
+	gfprep_update_n_using(dst_hi, 1, size);
 	e = gfarm_pfunc_replicate(
 	    pfunc_handle, src_url,
 	    src_hi->hostname, src_hi->port, size,
@@ -2524,7 +2698,7 @@ next:
 			done[i] = 0;
 			if (is_gfpcopy)
 				gfprep_do_copy(
-				    pfunc_handle, &done[i], migrate,
+				    pfunc_handle, &done[i], job.file, migrate,
 				    job.file->src_size,
 				    src_url, src_hi, tmp_url, dst_hi);
 			else
@@ -2566,6 +2740,227 @@ end:
 	return (e);
 }
 
+/*
+ * WAY_COST: files are dispatched while they are copied, and each file is
+ * assigned to a pair of a source and a destination host which is expected
+ * to finish it earliest.  A host is expected to finish its transfers in
+ * (size_using + size) / (rate * max_rw) seconds, where rate is the
+ * throughput of a connection learned from the finished transfers, thus
+ * it reflects the bottleneck of the disk, the network and the load of
+ * the host.  The larger files are dispatched first, and the next files
+ * are looked ahead within GFPREP_COST_WINDOW not to wait for busy hosts.
+ */
+#define GFPREP_COST_WINDOW	64
+
+enum gfprep_cost_select {
+	GFPREP_COST_FOUND,
+	GFPREP_COST_BUSY,
+	GFPREP_COST_NO_SOURCE,
+	GFPREP_COST_NO_SPACE
+};
+
+/* locked by cb_mutex */
+static double
+gfprep_cost_host(struct gfprep_host_info *hi, gfarm_off_t size)
+{
+	double rate;
+
+	if (hi == NULL) /* local */
+		return (0);
+	rate = hi->rate > 0 ? hi->rate :
+	    gfprep_cost_rate_all > 0 ? gfprep_cost_rate_all :
+	    GFPREP_COST_DEFAULT_RATE;
+	return ((double)(hi->size_using + size + opt.openfile_cost) /
+	    (rate * (hi->max_rw > 0 ? hi->max_rw : 1)));
+}
+
+/* locked by cb_mutex */
+static int
+gfprep_cost_is_available(struct gfprep_host_info *hi)
+{
+	/* at least one connection even if max_rw is 0 */
+	return (hi == NULL || hi->n_using < hi->max_rw || hi->n_using == 0);
+}
+
+/* locked by cb_mutex, *idxp: in/out */
+static enum gfprep_cost_select
+gfprep_cost_select(int n_ents, gfarm_dirtree_entry_t **ents, int *idxp,
+	struct gfarm_hash_table *target_hash_src,
+	int n_array_dst, struct gfprep_host_info **array_dst,
+	struct gfprep_host_info **src_hi_p, struct gfprep_host_info **dst_hi_p)
+{
+	int i, j, k, n_scan, has_src, has_space;
+	gfarm_dirtree_entry_t *ent;
+	struct gfprep_host_info *src_hi, *dst_hi;
+	double cost, src_cost, min_cost = 0;
+	enum gfprep_cost_select sel = GFPREP_COST_BUSY;
+
+	for (i = *idxp, n_scan = 0; i < n_ents && n_scan < GFPREP_COST_WINDOW;
+	    i++) {
+		if ((ent = ents[i]) == NULL) /* dispatched */
+			continue;
+		n_scan++;
+		has_src = 0;
+		has_space = array_dst == NULL;
+		for (j = 0; j < ent->src_ncopy; j++) {
+			src_hi = gfprep_from_hostinfohash(
+			    target_hash_src, ent->src_copy[j]);
+			if (src_hi == NULL)
+				continue;
+			has_src = 1;
+			src_cost = gfprep_cost_host(src_hi, ent->src_size);
+			for (k = 0; k < n_array_dst || k == 0; k++) {
+				dst_hi = array_dst ? array_dst[k] : NULL;
+				if (dst_hi != NULL && (dst_hi->disk_avail
+				    < ent->src_size || dst_hi->disk_avail
+				    < gfarm_get_minimum_free_disk_space()))
+					continue;
+				has_space = 1;
+				if (!gfprep_cost_is_available(src_hi) ||
+				    !gfprep_cost_is_available(dst_hi))
+					continue;
+				cost = gfprep_cost_host(dst_hi, ent->src_size);
+				if (cost < src_cost)
+					cost = src_cost;
+				if (sel != GFPREP_COST_FOUND ||
+				    cost < min_cost) {
+					sel = GFPREP_COST_FOUND;
+					min_cost = cost;
+					*idxp = i;
+					*src_hi_p = src_hi;
+					*dst_hi_p = dst_hi;
+				}
+			}
+		}
+		if (!has_src || !has_space) {
+			*idxp = i;
+			return (has_src ?
+			    GFPREP_COST_NO_SPACE : GFPREP_COST_NO_SOURCE);
+		}
+		/* the larger file has priority over the cheaper one */
+		if (sel == GFPREP_COST_FOUND)
+			break;
+	}
+	return (sel);
+}
+
+static gfarm_error_t
+gfprep_cost_exec(gfarm_pfunc_t *pfunc_handle, int is_gfpcopy,
+	int migrate, const char *src_dir, const char *dst_dir,
+	int n_conns, int n_ents, gfarm_dirtree_entry_t **ents,
+	struct gfarm_hash_table *target_hash_src,
+	int n_array_dst, struct gfprep_host_info **array_dst)
+{
+	static const char diag[] = "gfprep_cost_exec";
+	char *src_url = NULL, *dst_url = NULL;
+	int i, idx, head, slot, n_running, src_url_size = 0, dst_url_size = 0;
+	char *done; /* 0:doing, 1:done, locked by cb_mutex */
+	gfarm_dirtree_entry_t *ent;
+	struct gfprep_host_info *src_hi = NULL, *dst_hi = NULL;
+	gfarm_int64_t failed_size;
+	enum gfprep_cost_select sel;
+	struct timespec timeout;
+
+	GFARM_MALLOC_ARRAY(done, n_conns);
+	if (done == NULL)
+		gfprep_fatal("no memory");
+	/* to learn the throughput */
+	pfunc_cb_timer_begin = pfunc_cb_timer_begin_main;
+	gfprep_file_sort(n_ents, ents); /* big to small */
+	for (i = 0; i < n_conns; i++)
+		done[i] = 1;
+	head = 0;
+	for (;;) {
+		for (; head < n_ents && ents[head] == NULL; head++)
+			;
+		for (i = 0; i < n_array_dst; i++) {
+			gfprep_get_and_reset_failed_size(array_dst[i],
+			    &failed_size);
+			array_dst[i]->disk_avail += failed_size;
+		}
+
+		gfarm_mutex_lock(&cb_mutex, diag, CB_MUTEX_DIAG);
+		slot = -1;
+		n_running = 0;
+		for (i = 0; i < n_conns; i++) {
+			if (done[i] == 0)
+				n_running++;
+			else if (slot == -1)
+				slot = i;
+		}
+		if (gfprep_is_term() || (head >= n_ents && n_running == 0)) {
+			gfarm_mutex_unlock(&cb_mutex, diag, CB_MUTEX_DIAG);
+			break;
+		}
+		idx = head;
+		if (slot == -1 || head >= n_ents)
+			sel = GFPREP_COST_BUSY;
+		else
+			sel = gfprep_cost_select(n_ents, ents, &idx,
+			    target_hash_src, n_array_dst, array_dst,
+			    &src_hi, &dst_hi);
+		if (sel == GFPREP_COST_BUSY) {
+			gfarm_gettime(&timeout);
+			timeout.tv_sec += 2;
+			if (!gfarm_cond_timedwait(
+			    &cb_cond, &cb_mutex, &timeout, diag, CB_COND_DIAG))
+				gfprep_debug("cb_cond timeout");
+			gfarm_mutex_unlock(&cb_mutex, diag, CB_MUTEX_DIAG);
+			continue;
+		}
+		if (sel == GFPREP_COST_FOUND)
+			done[slot] = 0;
+		gfarm_mutex_unlock(&cb_mutex, diag, CB_MUTEX_DIAG);
+
+		ent = ents[idx];
+		ents[idx] = NULL;
+		gfprep_url_realloc(&src_url, &src_url_size, src_dir,
+		    ent->subpath);
+		if (is_gfpcopy)
+			gfprep_url_realloc(&dst_url, &dst_url_size, dst_dir,
+			    ent->subpath);
+		if (sel == GFPREP_COST_NO_SOURCE) {
+			/* same as -w greedy */
+			gfprep_debug("no replica to schedule: %s", src_url);
+		} else if (sel == GFPREP_COST_NO_SPACE) {
+			gfprep_error_e(GFARM_ERR_NO_SPACE, "%s", src_url);
+			gfprep_count_ng_file(ent->src_size);
+		} else {
+			gfprep_debug("schedule: %s (%s -> %s)", src_url,
+			    src_hi->hostname,
+			    dst_hi ? dst_hi->hostname : "local");
+			if (is_gfpcopy)
+				gfprep_do_copy(
+				    pfunc_handle, &done[slot], ent, migrate,
+				    ent->src_size, src_url, src_hi,
+				    dst_url, dst_hi);
+			else
+				gfprep_do_replicate(
+				    pfunc_handle, &done[slot], migrate,
+				    ent->src_size, src_url, src_hi, dst_hi);
+		}
+		gfarm_dirtree_entry_free(ent);
+	}
+	/* done[] is referred until the all callbacks finish */
+	gfarm_mutex_lock(&cb_mutex, diag, CB_MUTEX_DIAG);
+	for (;;) {
+		for (i = 0; i < n_conns && done[i] != 0; i++)
+			;
+		if (i >= n_conns || gfprep_is_term())
+			break;
+		gfarm_gettime(&timeout);
+		timeout.tv_sec += 2;
+		gfarm_cond_timedwait(&cb_cond, &cb_mutex, &timeout,
+		    diag, CB_COND_DIAG);
+	}
+	gfarm_mutex_unlock(&cb_mutex, diag, CB_MUTEX_DIAG);
+	if (i >= n_conns) /* otherwise, interrupted and left to exit */
+		free(done);
+	free(src_url);
+	free(dst_url);
+	return (GFARM_ERR_NO_ERROR);
+}
+
 static void
 gfprep_check_dirurl_filename(int is_gfarm, const char *url,
 	char **dir_urlp, char **file_namep, int *dir_modep, int *file_modep,
@@ -3013,7 +3408,7 @@ main(int argc, char *argv[])
 	struct gfprep_host_info **array_dst = NULL;
 	char *src_url = NULL, *dst_url = NULL;
 	int src_url_size = 0, dst_url_size = 0;
-	enum way { WAY_NOPLAN, WAY_GREEDY, WAY_BAD };
+	enum way { WAY_NOPLAN, WAY_GREEDY, WAY_BAD, WAY_COST };
 	enum way way = WAY_NOPLAN;
 	gfarm_list list_to_schedule;
 	struct timeval time_start, time_end;
@@ -3040,6 +3435,8 @@ main(int argc, char *argv[])
 	int opt_dirtree_n_para = -1; /* -J */
 	int opt_dirtree_n_fifo = 10000; /* -F */
 	int opt_list_only = 0; /* -l */
+	const char *opt_manifest = NULL; /* -I */
+	gfarm_int64_t opt_stripe_size = 0; /* -T */
 
 	if (argc == 0)
 		gfprep_fatal("no argument");
@@ -3050,7 +3447,7 @@ main(int argc, char *argv[])
 
 	while ((ch = getopt(
 			argc, argv,
-			"N:h:j:w:W:s:S:D:H:R:M:b:J:F:C:c:LexmnpPqvdfUZl?"))
+			"N:h:j:w:W:s:S:D:H:R:M:b:J:F:C:c:I:T:LexmnpPqvdfUZl?"))
 	       != -1) {
 		switch (ch) {
 		case 'w':
@@ -3152,6 +3549,18 @@ main(int argc, char *argv[])
 		case 'e': /* gfpcopy */
 			opt_skip_existing = 1;
 			break;
+		case 'I': /* gfpcopy */
+			opt_manifest = optarg;
+			break;
+		case 'T': /* gfpcopy */
+			e = gfarm_humanize_number_to_int64(
+			    &opt_stripe_size, optarg);
+			if (e != GFARM_ERR_NO_ERROR || opt_stripe_size < 0) {
+				gfprep_error("-T %s: invalid number",
+				    optarg);
+				exit(EXIT_FAILURE);
+			}
+			break;
 		case '?':
 		default:
 			gfprep_usage_common(0);
@@ -3208,6 +3617,8 @@ main(int argc, char *argv[])
 			way = WAY_GREEDY;
 		else if (strcmp(opt_way, "bad") == 0)
 			way = WAY_BAD;
+		else if (strcmp(opt_way, "cost") == 0)
+			way = WAY_COST;
 		else {
 			gfprep_error("unknown scheduling way: %s", opt_way);
 			exit(EXIT_FAILURE);
@@ -3231,7 +3642,9 @@ main(int argc, char *argv[])
 			exit(EXIT_FAILURE);
 		}
 	} else { /* gfprep */
-		if (opt_force_copy || opt_skip_existing) /* -f or -e */
+		/* -f or -e or -I or -T */
+		if (opt_force_copy || opt_skip_existing || opt_manifest ||
+		    opt_stripe_size > 0)
 			gfprep_usage_common(1);
 		if (opt_migrate) {
 			if (opt_n_desire > 1) { /* -m and -N */
@@ -3309,6 +3722,12 @@ main(int argc, char *argv[])
 		gfprep_usage_common(1);
 	if (opt_copy_bufsize <= 0)
 		gfprep_usage_common(1);
+	/* too many parts for the file */
+	if (opt_stripe_size > 0 && opt_stripe_size < opt_copy_bufsize) {
+		gfprep_error("-T %lld: must be %d (-b) or more",
+		    (long long)opt_stripe_size, opt_copy_bufsize);
+		exit(EXIT_FAILURE);
+	}
 	if (opt_dirtree_n_fifo <= 0)
 		gfprep_usage_common(1);
 
@@ -3463,12 +3882,21 @@ main(int argc, char *argv[])
 	    &pfunc_handle, opt_n_para, 1, opt_simulate_KBs, opt_copy_bufsize,
 	    opt_skip_existing, pfunc_cb_start, pfunc_cb_end, pfunc_cb_free);
 	gfprep_fatal_e(e, "gfarm_pfunc_init_fork");
+	if (opt_stripe_size > 0) {
+		if (opt_skip_existing)
+			gfprep_warn("-T is ignored with -e");
+		gfarm_pfunc_set_stripe_size(pfunc_handle, opt_stripe_size);
+	}
 
 	e = gfarm_dirtree_init_fork(
 	    &dirtree_handle, src_dir, is_gfpcopy ? dst_dir : NULL,
 	    opt_dirtree_n_para, opt_dirtree_n_fifo, src_base_name ? 0 : 1);
 	gfprep_fatal_e(e, "gfarm_dirtree_init_fork");
 
+	if (opt_manifest)
+		gfprep_manifest_init(dirtree_handle, opt_manifest,
+		    src_dir, dst_dir, opt_simulate_KBs <= 0);
+
 	pfunc_cb_func_init();
 
 	/* create threads */
@@ -3612,7 +4040,8 @@ main(int argc, char *argv[])
 		e = gfarm_list_init(&list_to_schedule);
 		gfprep_fatal_e(e, "gfarm_list_init");
 	}
-	gfprep_verbose("way = %s", way == WAY_NOPLAN ? "noplan" : "greedy");
+	gfprep_verbose("way = %s", way == WAY_NOPLAN ? "noplan" :
+	    way == WAY_COST ? "cost" : "greedy");
 
 	n_entry = n_file = 0;
 	n_target = 0;
@@ -3674,6 +4103,8 @@ main(int argc, char *argv[])
 							gfprep_verbose(
 							  "already exists: %s",
 							  dst_url);
+							gfprep_manifest_add(
+							    entry);
 							goto next_entry;
 						}
 						/* overwrite, not unlink */
@@ -3717,6 +4148,7 @@ main(int argc, char *argv[])
 						gfprep_verbose(
 						    "already exists: %s",
 						    dst_url);
+						gfprep_manifest_add(entry);
 						goto next_entry;
 					}
 					if (opt_simulate_KBs <= 0) {
@@ -3743,6 +4175,7 @@ main(int argc, char *argv[])
 					mtime.tv_nsec = entry->src_m_nsec;
 					(void)gfprep_set_mtime(
 					    dst_is_gfarm, dst_url, &mtime);
+					gfprep_manifest_add(entry);
 				} else if (e != GFARM_ERR_NO_ERROR)
 					gfprep_error_e(e,
 					    "cannot create a symlink: %s",
@@ -3814,7 +4247,8 @@ main(int argc, char *argv[])
 			if (is_gfpcopy) {
 				/* not specified src/dst host */
 				gfprep_do_copy(
-				    pfunc_handle, NULL, 0, entry->src_size,
+				    pfunc_handle, NULL, entry, 0,
+				    entry->src_size,
 				    src_url, NULL, dst_url, NULL);
 				goto next_entry;
 			} else {
@@ -4079,7 +4513,7 @@ main(int argc, char *argv[])
 				src_hi = NULL;
 			if (is_gfpcopy)
 				gfprep_do_copy(pfunc_handle,
-				    NULL, opt_migrate, entry->src_size,
+				    NULL, entry, opt_migrate, entry->src_size,
 				    src_url, src_hi, dst_url, dst_hi);
 			else
 				gfprep_do_replicate(pfunc_handle,
@@ -4104,8 +4538,27 @@ next_entry:
 	e = gfarm_dirtree_close(dirtree_handle);
 	gfprep_warn_e(e, "gfarm_dirtree_close");
 
+	/* ----- WAY_COST ----- */
+	if (way == WAY_COST) {
+		gfarm_dirtree_entry_t **ents;
+		int n_ents;
+
+		assert(src_is_gfarm);
+		assert(target_hash_src);
+
+		ents = gfarm_array_alloc_from_list(&list_to_schedule);
+		if (ents == NULL)
+			gfprep_fatal("no memory");
+		n_ents = gfarm_list_length(&list_to_schedule);
+		gfprep_verbose("target file num = %d", n_ents);
+
+		e = gfprep_cost_exec(pfunc_handle, is_gfpcopy, opt_migrate,
+		    src_dir, dst_dir, opt_n_para, n_ents, ents,
+		    target_hash_src, n_array_dst, array_dst);
+		gfprep_fatal_e(e, "gfprep_cost_exec");
+		free(ents); /* each entry is freed after it is dispatched */
 	/* ----- WAY_GREEDY or WAY_BAD ----- */
-	if (way != WAY_NOPLAN) {
+	} else if (way != WAY_NOPLAN) {
 		struct gfarm_hash_table *hash_host_to_nodes;
 		gfarm_dirtree_entry_t **ents;
 		int n_ents, n_connections;
@@ -4195,6 +4648,9 @@ next_entry:
 	e = gfarm_pfunc_join(pfunc_handle);
 	gfprep_error_e(e, "gfarm_pfunc_join");
 
+	if (opt_manifest)
+		gfprep_manifest_final(opt_manifest, src_dir, dst_dir);
+
 	/* set mode and mtime for directories */
 	gfprep_dirstat_final();
 
@@ -12,6 +12,12 @@
 #define GFARM_IOSTAT_IO_WBYTES	3
 #define GFARM_IOSTAT_IO_NITEM	4
 
+#define GFARM_IOSTAT_HIST_QUEUED	0
+#define GFARM_IOSTAT_HIST_DROPPED	1
+#define GFARM_IOSTAT_HIST_EVENTS	2
+#define GFARM_IOSTAT_HIST_FLUSHED	3
+#define GFARM_IOSTAT_HIST_NITEM	4
+
 struct gfarm_iostat_head {
 	unsigned int	s_magic;	/* GFARM_IOSTAT_MAGIC */
 	unsigned int	s_nitem;
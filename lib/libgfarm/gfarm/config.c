@@ -838,6 +838,8 @@ gfarm_set_local_user_for_this_uid(uid_t uid)
 /* GFS dependent */
 int gfarm_spool_server_listen_backlog = GFARM_CONFIG_MISC_DEFAULT;
 char *gfarm_spool_server_listen_address = NULL;
+int gfarm_spool_server_event_threads = GFARM_CONFIG_MISC_DEFAULT;
+int gfarm_spool_server_sendfile = GFARM_CONFIG_MISC_DEFAULT;
 char *gfarm_spool_root = NULL;
 static struct {
 	enum gfarm_spool_check_level level;
@@ -851,6 +853,12 @@ static struct {
 static enum gfarm_spool_check_level gfarm_spool_check_level =
 	GFARM_SPOOL_CHECK_LEVEL_DEFAULT;
 static const char *gfarm_spool_check_level_name = NULL;
+int gfarm_spool_histgram_size = GFARM_CONFIG_MISC_DEFAULT;
+char *gfarm_spool_histgram_db = NULL;
+int gfarm_spool_histgram_flush_interval = GFARM_CONFIG_MISC_DEFAULT;
+int gfarm_spool_histgram_queue_length = GFARM_CONFIG_MISC_DEFAULT;
+char *gfarm_spool_histgram_cache_policy = NULL;
+gfarm_off_t gfarm_spool_histgram_cache_size = GFARM_CONFIG_MISC_DEFAULT;
 
 /* GFM dependent */
 enum gfarm_backend_db_type gfarm_backend_db_type =
@@ -902,6 +910,7 @@ int	gfarm_iostat_max_client = GFARM_CONFIG_MISC_DEFAULT;
 #define GFARM_GFMD_RECONNECTION_TIMEOUT_DEFAULT 30 /* 30 seconds */
 #define GFARM_ATTR_CACHE_LIMIT_DEFAULT		40000 /* 40,000 entries */
 #define GFARM_ATTR_CACHE_TIMEOUT_DEFAULT	1000 /* 1,000 milli second */
+#define GFARM_ATTR_CACHE_NEGATIVE_TIMEOUT_DEFAULT 0 /* disable */
 #define GFARM_PAGE_CACHE_TIMEOUT_DEFAULT	1000 /* 1,000 milli second */
 #define GFARM_SCHEDULE_CACHE_TIMEOUT_DEFAULT 600 /* 10 minutes */
 #define GFARM_SCHEDULE_CONCURRENCY_DEFAULT	10
@@ -920,10 +929,15 @@ int	gfarm_iostat_max_client = GFARM_CONFIG_MISC_DEFAULT;
 #define GFS_PROTO_FHREMOVE_REQUEST_WINDOW_DEFAULT		50
 #define GFS_PROTO_REPLICATION_REQUEST_WINDOW_DEFAULT		20
 #define GFARM_OUTSTANDING_FILE_REPLICATION_LIMIT_DEFAULT	4194304 /* 512MB / (sizeof(file_replication), i.e. 128B) */
+#define GFARM_REPLICATION_CHAIN_DEFAULT				0 /* disable */
 #define GFARM_GFSD_CONNECTION_CACHE_DEFAULT 16 /* 16 free connections */
 #define GFARM_GFMD_CONNECTION_CACHE_DEFAULT  8 /*  8 free connections */
 #define GFARM_METADB_MAX_DESCRIPTORS_DEFAULT	(2*65536)
 #define GFARM_CLIENT_FILE_BUFSIZE_DEFAULT	(1048576 - 8) /* 1MB - 8B */
+#define GFARM_CLIENT_FILE_IO_WINDOW_DEFAULT	4 /* requests */
+#define GFARM_CLIENT_FILE_WRITE_IO_WINDOW_DEFAULT	1 /* not pipelined */
+#define GFARM_CLIENT_FILE_ASYNC_IO_BUDGET_DEFAULT	(16 * 1048576) /* 16MB */
+#define GFARM_CLIENT_FILE_WRITE_BEHIND_DEFAULT	0 /* disable */
 #define GFARM_CLIENT_PARALLEL_COPY_DEFAULT	4
 #define GFARM_PROFILE_DEFAULT 0 /* disable */
 #define GFARM_METADB_REPLICATION_ENABLED_DEFAULT	0
@@ -931,9 +945,15 @@ int	gfarm_iostat_max_client = GFARM_CONFIG_MISC_DEFAULT;
 #define GFARM_JOURNAL_RECVQ_SIZE_DEFAULT	100000
 #define GFARM_JOURNAL_SYNC_FILE_DEFAULT		1
 #define GFARM_JOURNAL_SYNC_SLAVE_TIMEOUT_DEFAULT 10 /* 10 second */
+#define GFARM_JOURNAL_SYNC_GROUP_DELAY_DEFAULT 1000 /* 1 millisecond */
+#define GFARM_METADB_SNAPSHOT_DEFAULT		0 /* disable */
+#define GFARM_XMLATTR_INDEX_DEFAULT		0 /* disable */
 #define GFARM_METADB_SERVER_SLAVE_MAX_SIZE_DEFAULT	16
 #define GFARM_METADB_SERVER_FORCE_SLAVE_DEFAULT		0
 #define GFARM_METADB_SERVER_SLAVE_LISTEN_DEFAULT	0
+#define GFARM_METADB_SERVER_SLAVE_READ_SERVICE_DEFAULT	0
+#define GFARM_METADB_SERVER_SLAVE_READ_DEFAULT	0
+#define GFARM_METADB_SERVER_SLAVE_READ_STALENESS_DEFAULT 1000 /* 1 second */
 #define GFARM_NETWORK_RECEIVE_TIMEOUT_DEFAULT  60 /* 60 seconds */
 #define GFARM_FILE_TRACE_DEFAULT 0 /* disable */
 #define GFARM_FATAL_ACTION_DEFAULT GFLOG_FATAL_ACTION_ABORT_BACKTRACE
@@ -941,33 +961,49 @@ int	gfarm_iostat_max_client = GFARM_CONFIG_MISC_DEFAULT;
 #define GFARM_REPLICA_CHECK_HOST_DOWN_THRESH_DEFAULT 10800 /* 3 hours */
 #define GFARM_REPLICA_CHECK_SLEEP_TIME_DEFAULT 100000 /* nanosec. */
 #define GFARM_REPLICA_CHECK_MINIMUM_INTERVAL_DEFAULT 10 /* 10 sec. */
+#define GFARM_REPLICA_CHECK_INCREMENTAL_DEFAULT 1 /* enable */
+#define GFARM_SPOOL_SERVER_EVENT_THREADS_DEFAULT 0 /* fork per client */
+#define GFARM_SPOOL_SERVER_SENDFILE_DEFAULT 1 /* enable */
+#define GFARM_SPOOL_HISTGRAM_SIZE_DEFAULT	1048576 /* entries */
+#define GFARM_SPOOL_HISTGRAM_FLUSH_INTERVAL_DEFAULT 60 /* 60 seconds */
+#define GFARM_SPOOL_HISTGRAM_QUEUE_LENGTH_DEFAULT 65536 /* events */
+#define GFARM_SPOOL_HISTGRAM_CACHE_SIZE_DEFAULT \
+	(10LL * 1024 * 1024 * 1024) /* 10GB */
 #ifdef not_def_REPLY_QUEUE
 int gfm_proto_reply_to_gfsd_window = GFARM_CONFIG_MISC_DEFAULT;
 #endif
 int gfs_proto_fhremove_request_window = GFARM_CONFIG_MISC_DEFAULT;
 int gfs_proto_replication_request_window = GFARM_CONFIG_MISC_DEFAULT;
 int gfarm_outstanding_file_replication_limit = GFARM_CONFIG_MISC_DEFAULT;
+int gfarm_replication_chain = GFARM_CONFIG_MISC_DEFAULT;
 int gfarm_xattr_size_limit = GFARM_CONFIG_MISC_DEFAULT;
 int gfarm_xmlattr_size_limit = GFARM_CONFIG_MISC_DEFAULT;
+int gfarm_xmlattr_index = GFARM_CONFIG_MISC_DEFAULT;
 int gfarm_metadb_max_descriptors = GFARM_CONFIG_MISC_DEFAULT;
 int gfarm_metadb_stack_size = GFARM_CONFIG_MISC_DEFAULT;
 int gfarm_metadb_thread_pool_size = GFARM_CONFIG_MISC_DEFAULT;
 int gfarm_metadb_job_queue_length = GFARM_CONFIG_MISC_DEFAULT;
 int gfarm_metadb_heartbeat_interval = GFARM_CONFIG_MISC_DEFAULT;
 int gfarm_metadb_dbq_size = GFARM_CONFIG_MISC_DEFAULT;
+int gfarm_metadb_dbq_group_commit_size = GFARM_CONFIG_MISC_DEFAULT;
+int gfarm_metadb_dbq_group_commit_interval = GFARM_CONFIG_MISC_DEFAULT;
+int gfarm_metadb_snapshot = GFARM_CONFIG_MISC_DEFAULT;
 static int metadb_replication_enabled = GFARM_CONFIG_MISC_DEFAULT;
 static char *journal_dir = NULL;
 static int journal_max_size = GFARM_CONFIG_MISC_DEFAULT;
 static int journal_recvq_size = GFARM_CONFIG_MISC_DEFAULT;
 static int journal_sync_file = GFARM_CONFIG_MISC_DEFAULT;
 static int journal_sync_slave_timeout = GFARM_CONFIG_MISC_DEFAULT;
+static int journal_sync_group_delay = GFARM_CONFIG_MISC_DEFAULT;
 static int metadb_server_slave_max_size = GFARM_CONFIG_MISC_DEFAULT;
 static int metadb_server_force_slave = GFARM_CONFIG_MISC_DEFAULT;
 static int metadb_server_slave_listen = GFARM_CONFIG_MISC_DEFAULT;
+static int metadb_server_slave_read_service = GFARM_CONFIG_MISC_DEFAULT;
 int gfarm_replica_check = GFARM_CONFIG_MISC_DEFAULT;
 int gfarm_replica_check_host_down_thresh = GFARM_CONFIG_MISC_DEFAULT;
 int gfarm_replica_check_sleep_time = GFARM_CONFIG_MISC_DEFAULT;
 int gfarm_replica_check_minimum_interval = GFARM_CONFIG_MISC_DEFAULT;
+int gfarm_replica_check_incremental = GFARM_CONFIG_MISC_DEFAULT;
 
 void
 gfarm_config_clear(void)
@@ -975,6 +1011,8 @@ gfarm_config_clear(void)
 	static char **vars[] = {
 		&gfarm_spool_server_listen_address,
 		&gfarm_spool_root,
+		&gfarm_spool_histgram_db,
+		&gfarm_spool_histgram_cache_policy,
 		&gfarm_ldap_server_name,
 		&gfarm_ldap_server_port,
 		&gfarm_ldap_base_dn,
@@ -1237,6 +1275,12 @@ gfarm_get_journal_sync_slave_timeout(void)
 	return (journal_sync_slave_timeout);
 }
 
+int
+gfarm_get_journal_sync_group_delay(void)
+{
+	return (journal_sync_group_delay);
+}
+
 int
 gfarm_get_metadb_server_slave_max_size(void)
 {
@@ -1261,6 +1305,12 @@ gfarm_get_metadb_server_slave_listen(void)
 	return (metadb_server_slave_listen);
 }
 
+int
+gfarm_get_metadb_server_slave_read_service(void)
+{
+	return (metadb_server_slave_read_service);
+}
+
 char *
 gfarm_get_shared_key_file()
 {
@@ -2732,6 +2782,10 @@ parse_one_line(char *s, char *p, char **op)
 		e = parse_set_var(p, &gfarm_spool_server_listen_address);
 	} else if (strcmp(s, o = "spool_server_listen_backlog") == 0) {
 		e = parse_set_misc_int(p, &gfarm_spool_server_listen_backlog);
+	} else if (strcmp(s, o = "spool_server_event_threads") == 0) {
+		e = parse_set_misc_int(p, &gfarm_spool_server_event_threads);
+	} else if (strcmp(s, o = "spool_server_sendfile") == 0) {
+		e = parse_set_misc_enabled(p, &gfarm_spool_server_sendfile);
 	} else if (strcmp(s, o = "spool_server_cred_type") == 0) {
 		e = parse_cred_config(p, GFS_SERVICE_TAG,
 		    gfarm_auth_server_cred_type_set_by_string);
@@ -2743,6 +2797,18 @@ parse_one_line(char *s, char *p, char **op)
 		    gfarm_auth_server_cred_name_set);
 	} else if (strcmp(s, o = "spool_check_level") == 0) {
 		e = parse_spool_check_level(p);
+	} else if (strcmp(s, o = "spool_histgram_size") == 0) {
+		e = parse_set_misc_int(p, &gfarm_spool_histgram_size);
+	} else if (strcmp(s, o = "spool_histgram_db") == 0) {
+		e = parse_set_var(p, &gfarm_spool_histgram_db);
+	} else if (strcmp(s, o = "spool_histgram_flush_interval") == 0) {
+		e = parse_set_misc_int(p, &gfarm_spool_histgram_flush_interval);
+	} else if (strcmp(s, o = "spool_histgram_queue_length") == 0) {
+		e = parse_set_misc_int(p, &gfarm_spool_histgram_queue_length);
+	} else if (strcmp(s, o = "spool_histgram_cache_policy") == 0) {
+		e = parse_set_var(p, &gfarm_spool_histgram_cache_policy);
+	} else if (strcmp(s, o = "spool_histgram_cache_size") == 0) {
+		e = parse_set_misc_offset(p, &gfarm_spool_histgram_cache_size);
 
 	} else if (strcmp(s, o = "metadb_server_host") == 0) {
 		e = parse_set_var(p, &gfarm_ctxp->metadb_server_name);
@@ -2882,6 +2948,9 @@ parse_one_line(char *s, char *p, char **op)
 		e = parse_set_misc_int(p, &gfarm_ctxp->attr_cache_limit);
 	} else if (strcmp(s, o = "attr_cache_timeout") == 0) {
 		e = parse_set_misc_int(p, &gfarm_ctxp->attr_cache_timeout);
+	} else if (strcmp(s, o = "attr_cache_negative_timeout") == 0) {
+		e = parse_set_misc_int(
+		    p, &gfarm_ctxp->attr_cache_negative_timeout);
 	} else if (strcmp(s, o = "page_cache_timeout") == 0) {
 		e = parse_set_misc_int(p, &gfarm_ctxp->page_cache_timeout);
 	} else if (strcmp(s, o = "schedule_cache_timeout") == 0) {
@@ -2935,6 +3004,8 @@ parse_one_line(char *s, char *p, char **op)
 	} else if (strcmp(s, o = "outstanding_file_replication_limit") == 0) {
 		e = parse_set_misc_int(p,
 		    &gfarm_outstanding_file_replication_limit);
+	} else if (strcmp(s, o = "replication_chain") == 0) {
+		e = parse_set_misc_enabled(p, &gfarm_replication_chain);
 	} else if (strcmp(s, o = "gfsd_connection_cache") == 0) {
 		e = parse_set_misc_int(p, &gfarm_ctxp->gfsd_connection_cache);
 	} else if (strcmp(s, o = "gfmd_connection_cache") == 0) {
@@ -2953,6 +3024,8 @@ parse_one_line(char *s, char *p, char **op)
 			e = GFARM_ERR_VALUE_TOO_LARGE_TO_BE_STORED_IN_DATA_TYPE;
 			gfarm_xmlattr_size_limit = GFARM_CONFIG_MISC_DEFAULT;
 		}
+	} else if (strcmp(s, o = "xmlattr_index") == 0) {
+		e = parse_set_misc_enabled(p, &gfarm_xmlattr_index);
 	} else if (strcmp(s, o = "metadb_server_max_descriptors") == 0) {
 		e = parse_set_misc_int(p, &gfarm_metadb_max_descriptors);
 	} else if (strcmp(s, o = "metadb_server_stack_size") == 0) {
@@ -2965,6 +3038,12 @@ parse_one_line(char *s, char *p, char **op)
 		e = parse_set_misc_int(p, &gfarm_metadb_heartbeat_interval);
 	} else if (strcmp(s, o = "metadb_server_dbq_size") == 0) {
 		e = parse_set_misc_int(p, &gfarm_metadb_dbq_size);
+	} else if (strcmp(s, o = "metadb_server_dbq_group_commit_size") == 0) {
+		e = parse_set_misc_int(p, &gfarm_metadb_dbq_group_commit_size);
+	} else if (strcmp(s, o = "metadb_server_dbq_group_commit_interval")
+	    == 0) {
+		e = parse_set_misc_int(p,
+		    &gfarm_metadb_dbq_group_commit_interval);
 	} else if (strcmp(s, o = "record_atime") == 0) {
 		int record_atime;
 
@@ -2975,6 +3054,17 @@ parse_one_line(char *s, char *p, char **op)
 		e = parse_atime_type(p);
 	} else if (strcmp(s, o = "client_file_bufsize") == 0) {
 		e = parse_set_misc_int(p, &gfarm_ctxp->client_file_bufsize);
+	} else if (strcmp(s, o = "client_file_io_window") == 0) {
+		e = parse_set_misc_int(p, &gfarm_ctxp->client_file_io_window);
+	} else if (strcmp(s, o = "client_file_write_io_window") == 0) {
+		e = parse_set_misc_int(p,
+		    &gfarm_ctxp->client_file_write_io_window);
+	} else if (strcmp(s, o = "client_file_async_io_budget") == 0) {
+		e = parse_set_misc_int(p,
+		    &gfarm_ctxp->client_file_async_io_budget);
+	} else if (strcmp(s, o = "client_file_write_behind") == 0) {
+		e = parse_set_misc_enabled(p,
+		    &gfarm_ctxp->client_file_write_behind);
 	} else if (strcmp(s, o = "client_parallel_copy") == 0) {
 		e = parse_set_misc_int(p,
 		    &gfarm_ctxp->client_parallel_copy);
@@ -2994,8 +3084,12 @@ parse_one_line(char *s, char *p, char **op)
 		e = parse_set_misc_int(p, &journal_max_size);
 	} else if (strcmp(s, o = "metadb_journal_recvq_size") == 0) {
 		e = parse_set_misc_int(p, &journal_recvq_size);
+	} else if (strcmp(s, o = "metadb_snapshot") == 0) {
+		e = parse_set_misc_enabled(p, &gfarm_metadb_snapshot);
 	} else if (strcmp(s, o = "synchronous_journaling") == 0) {
 		e = parse_set_misc_enabled(p, &journal_sync_file);
+	} else if (strcmp(s, o = "synchronous_journaling_group_delay") == 0) {
+		e = parse_set_misc_int(p, &journal_sync_group_delay);
 	} else if (strcmp(s, o = "synchronous_replication_timeout") == 0) {
 		e = parse_set_misc_int(p, &journal_sync_slave_timeout);
 	} else if (strcmp(s, o = "metadb_server_slave_max_size") == 0) {
@@ -3004,6 +3098,15 @@ parse_one_line(char *s, char *p, char **op)
 		e = parse_set_misc_enabled(p, &metadb_server_force_slave);
 	} else if (strcmp(s, o = "metadb_server_slave_listen") == 0) {
 		e = parse_set_misc_enabled(p, &metadb_server_slave_listen);
+	} else if (strcmp(s, o = "metadb_server_slave_read_service") == 0) {
+		e = parse_set_misc_enabled(p,
+		    &metadb_server_slave_read_service);
+	} else if (strcmp(s, o = "metadb_server_slave_read") == 0) {
+		e = parse_set_misc_enabled(p,
+		    &gfarm_ctxp->metadb_server_slave_read);
+	} else if (strcmp(s, o = "metadb_server_slave_read_staleness") == 0) {
+		e = parse_set_misc_int(p,
+		    &gfarm_ctxp->metadb_server_slave_read_staleness);
 	} else if (strcmp(s, o = "network_receive_timeout") == 0) {
 		e = parse_set_misc_int(p, &gfarm_ctxp->network_receive_timeout);
 	} else if (strcmp(s, o = "file_trace") == 0) {
@@ -3024,6 +3127,8 @@ parse_one_line(char *s, char *p, char **op)
 	} else if (strcmp(s, o = "replica_check_minimum_interval") == 0) {
 		e = parse_set_misc_int(
 		    p, &gfarm_replica_check_minimum_interval);
+	} else if (strcmp(s, o = "replica_check_incremental") == 0) {
+		e = parse_set_misc_enabled(p, &gfarm_replica_check_incremental);
 
 	} else {
 		o = s;
@@ -3175,6 +3280,23 @@ gfarm_config_set_default_misc(void)
 
 	if (gfarm_spool_server_listen_backlog == GFARM_CONFIG_MISC_DEFAULT)
 		gfarm_spool_server_listen_backlog = LISTEN_BACKLOG_DEFAULT;
+	if (gfarm_spool_server_event_threads == GFARM_CONFIG_MISC_DEFAULT)
+		gfarm_spool_server_event_threads =
+		    GFARM_SPOOL_SERVER_EVENT_THREADS_DEFAULT;
+	if (gfarm_spool_server_sendfile == GFARM_CONFIG_MISC_DEFAULT)
+		gfarm_spool_server_sendfile =
+		    GFARM_SPOOL_SERVER_SENDFILE_DEFAULT;
+	if (gfarm_spool_histgram_size == GFARM_CONFIG_MISC_DEFAULT)
+		gfarm_spool_histgram_size = GFARM_SPOOL_HISTGRAM_SIZE_DEFAULT;
+	if (gfarm_spool_histgram_flush_interval == GFARM_CONFIG_MISC_DEFAULT)
+		gfarm_spool_histgram_flush_interval =
+		    GFARM_SPOOL_HISTGRAM_FLUSH_INTERVAL_DEFAULT;
+	if (gfarm_spool_histgram_queue_length == GFARM_CONFIG_MISC_DEFAULT)
+		gfarm_spool_histgram_queue_length =
+		    GFARM_SPOOL_HISTGRAM_QUEUE_LENGTH_DEFAULT;
+	if (gfarm_spool_histgram_cache_size == GFARM_CONFIG_MISC_DEFAULT)
+		gfarm_spool_histgram_cache_size =
+		    GFARM_SPOOL_HISTGRAM_CACHE_SIZE_DEFAULT;
 	if (gfarm_metadb_server_listen_backlog == GFARM_CONFIG_MISC_DEFAULT)
 		gfarm_metadb_server_listen_backlog = LISTEN_BACKLOG_DEFAULT;
 
@@ -3198,6 +3320,10 @@ gfarm_config_set_default_misc(void)
 	if (gfarm_ctxp->attr_cache_timeout == GFARM_CONFIG_MISC_DEFAULT)
 		gfarm_ctxp->attr_cache_timeout =
 		    GFARM_ATTR_CACHE_TIMEOUT_DEFAULT;
+	if (gfarm_ctxp->attr_cache_negative_timeout ==
+	    GFARM_CONFIG_MISC_DEFAULT)
+		gfarm_ctxp->attr_cache_negative_timeout =
+		    GFARM_ATTR_CACHE_NEGATIVE_TIMEOUT_DEFAULT;
 	if (gfarm_ctxp->page_cache_timeout == GFARM_CONFIG_MISC_DEFAULT)
 		gfarm_ctxp->page_cache_timeout =
 				GFARM_PAGE_CACHE_TIMEOUT_DEFAULT;
@@ -3251,6 +3377,8 @@ gfarm_config_set_default_misc(void)
 	    GFARM_CONFIG_MISC_DEFAULT)
 		gfarm_outstanding_file_replication_limit =
 		    GFARM_OUTSTANDING_FILE_REPLICATION_LIMIT_DEFAULT;
+	if (gfarm_replication_chain == GFARM_CONFIG_MISC_DEFAULT)
+		gfarm_replication_chain = GFARM_REPLICATION_CHAIN_DEFAULT;
 	if (gfarm_ctxp->gfsd_connection_cache == GFARM_CONFIG_MISC_DEFAULT)
 		gfarm_ctxp->gfsd_connection_cache =
 		    GFARM_GFSD_CONNECTION_CACHE_DEFAULT;
@@ -3261,6 +3389,8 @@ gfarm_config_set_default_misc(void)
 		gfarm_xattr_size_limit = GFARM_XATTR_SIZE_MAX_DEFAULT;
 	if (gfarm_xmlattr_size_limit == GFARM_CONFIG_MISC_DEFAULT)
 		gfarm_xmlattr_size_limit = GFARM_XMLATTR_SIZE_MAX_DEFAULT;
+	if (gfarm_xmlattr_index == GFARM_CONFIG_MISC_DEFAULT)
+		gfarm_xmlattr_index = GFARM_XMLATTR_INDEX_DEFAULT;
 	if (gfarm_metadb_max_descriptors == GFARM_CONFIG_MISC_DEFAULT)
 		gfarm_metadb_max_descriptors =
 		    GFARM_METADB_MAX_DESCRIPTORS_DEFAULT;
@@ -3277,11 +3407,32 @@ gfarm_config_set_default_misc(void)
 		    GFARM_METADB_HEARTBEAT_INTERVAL_DEFAULT;
 	if (gfarm_metadb_dbq_size == GFARM_CONFIG_MISC_DEFAULT)
 		gfarm_metadb_dbq_size = GFARM_METADB_DBQ_SIZE_DEFAULT;
+	if (gfarm_metadb_dbq_group_commit_size == GFARM_CONFIG_MISC_DEFAULT)
+		gfarm_metadb_dbq_group_commit_size =
+		    GFARM_METADB_DBQ_GROUP_COMMIT_SIZE_DEFAULT;
+	if (gfarm_metadb_dbq_group_commit_interval ==
+	    GFARM_CONFIG_MISC_DEFAULT)
+		gfarm_metadb_dbq_group_commit_interval =
+		    GFARM_METADB_DBQ_GROUP_COMMIT_INTERVAL_DEFAULT;
 	if (gfarm_atime_type == GFARM_ATIME_DEFAULT)
 		(void)gfarm_atime_type_set(GFARM_ATIME_RELATIVE);
 	if (gfarm_ctxp->client_file_bufsize == GFARM_CONFIG_MISC_DEFAULT)
 		gfarm_ctxp->client_file_bufsize =
 		    GFARM_CLIENT_FILE_BUFSIZE_DEFAULT;
+	if (gfarm_ctxp->client_file_io_window == GFARM_CONFIG_MISC_DEFAULT)
+		gfarm_ctxp->client_file_io_window =
+		    GFARM_CLIENT_FILE_IO_WINDOW_DEFAULT;
+	if (gfarm_ctxp->client_file_write_io_window ==
+	    GFARM_CONFIG_MISC_DEFAULT)
+		gfarm_ctxp->client_file_write_io_window =
+		    GFARM_CLIENT_FILE_WRITE_IO_WINDOW_DEFAULT;
+	if (gfarm_ctxp->client_file_async_io_budget ==
+	    GFARM_CONFIG_MISC_DEFAULT)
+		gfarm_ctxp->client_file_async_io_budget =
+		    GFARM_CLIENT_FILE_ASYNC_IO_BUDGET_DEFAULT;
+	if (gfarm_ctxp->client_file_write_behind == GFARM_CONFIG_MISC_DEFAULT)
+		gfarm_ctxp->client_file_write_behind =
+		    GFARM_CLIENT_FILE_WRITE_BEHIND_DEFAULT;
 	if (gfarm_ctxp->client_parallel_copy == GFARM_CONFIG_MISC_DEFAULT)
 		gfarm_ctxp->client_parallel_copy =
 		    GFARM_CLIENT_PARALLEL_COPY_DEFAULT;
@@ -3296,9 +3447,14 @@ gfarm_config_set_default_misc(void)
 		journal_recvq_size = GFARM_JOURNAL_RECVQ_SIZE_DEFAULT;
 	if (journal_sync_file == GFARM_CONFIG_MISC_DEFAULT)
 		journal_sync_file = GFARM_JOURNAL_SYNC_FILE_DEFAULT;
+	if (gfarm_metadb_snapshot == GFARM_CONFIG_MISC_DEFAULT)
+		gfarm_metadb_snapshot = GFARM_METADB_SNAPSHOT_DEFAULT;
 	if (journal_sync_slave_timeout == GFARM_CONFIG_MISC_DEFAULT)
 		journal_sync_slave_timeout =
 		    GFARM_JOURNAL_SYNC_SLAVE_TIMEOUT_DEFAULT;
+	if (journal_sync_group_delay == GFARM_CONFIG_MISC_DEFAULT)
+		journal_sync_group_delay =
+		    GFARM_JOURNAL_SYNC_GROUP_DELAY_DEFAULT;
 	if (metadb_server_slave_max_size == GFARM_CONFIG_MISC_DEFAULT)
 		metadb_server_slave_max_size =
 		    GFARM_METADB_SERVER_SLAVE_MAX_SIZE_DEFAULT;
@@ -3308,6 +3464,16 @@ gfarm_config_set_default_misc(void)
 	if (metadb_server_slave_listen == GFARM_CONFIG_MISC_DEFAULT)
 		metadb_server_slave_listen =
 		    GFARM_METADB_SERVER_SLAVE_LISTEN_DEFAULT;
+	if (metadb_server_slave_read_service == GFARM_CONFIG_MISC_DEFAULT)
+		metadb_server_slave_read_service =
+		    GFARM_METADB_SERVER_SLAVE_READ_SERVICE_DEFAULT;
+	if (gfarm_ctxp->metadb_server_slave_read == GFARM_CONFIG_MISC_DEFAULT)
+		gfarm_ctxp->metadb_server_slave_read =
+		    GFARM_METADB_SERVER_SLAVE_READ_DEFAULT;
+	if (gfarm_ctxp->metadb_server_slave_read_staleness ==
+	    GFARM_CONFIG_MISC_DEFAULT)
+		gfarm_ctxp->metadb_server_slave_read_staleness =
+		    GFARM_METADB_SERVER_SLAVE_READ_STALENESS_DEFAULT;
 	if (gfarm_ctxp->network_receive_timeout == GFARM_CONFIG_MISC_DEFAULT)
 		gfarm_ctxp->network_receive_timeout =
 		    GFARM_NETWORK_RECEIVE_TIMEOUT_DEFAULT;
@@ -3326,6 +3492,9 @@ gfarm_config_set_default_misc(void)
 	if (gfarm_replica_check_minimum_interval == GFARM_CONFIG_MISC_DEFAULT)
 		gfarm_replica_check_minimum_interval =
 		    GFARM_REPLICA_CHECK_MINIMUM_INTERVAL_DEFAULT;
+	if (gfarm_replica_check_incremental == GFARM_CONFIG_MISC_DEFAULT)
+		gfarm_replica_check_incremental =
+		    GFARM_REPLICA_CHECK_INCREMENTAL_DEFAULT;
 
 	if (gfarm_iostat_max_client == GFARM_CONFIG_MISC_DEFAULT)
 		gfarm_iostat_max_client = GFARM_IOSTAT_MAX_CLIENT;
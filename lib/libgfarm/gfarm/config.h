@@ -6,6 +6,8 @@
 /* GFS dependent */
 extern int gfarm_spool_server_listen_backlog;
 extern char *gfarm_spool_server_listen_address;
+extern int gfarm_spool_server_event_threads;
+extern int gfarm_spool_server_sendfile;
 extern char *gfarm_spool_root;
 enum gfarm_spool_check_level {
 	GFARM_SPOOL_CHECK_LEVEL_DEFAULT,
@@ -18,6 +20,12 @@ enum gfarm_spool_check_level gfarm_spool_check_level_get(void);
 const char *gfarm_spool_check_level_get_by_name(void);
 gfarm_error_t gfarm_spool_check_level_set(enum gfarm_spool_check_level);
 gfarm_error_t gfarm_spool_check_level_set_by_name(const char *);
+extern int gfarm_spool_histgram_size;
+extern char *gfarm_spool_histgram_db;
+extern int gfarm_spool_histgram_flush_interval;
+extern int gfarm_spool_histgram_queue_length;
+extern char *gfarm_spool_histgram_cache_policy;
+extern gfarm_off_t gfarm_spool_histgram_cache_size;
 
 /* GFM dependent */
 enum gfarm_atime_type {
@@ -42,23 +50,29 @@ extern enum gfarm_backend_db_type gfarm_backend_db_type;
 extern int gfarm_metadb_server_listen_backlog;
 extern int gfarm_xattr_size_limit;
 extern int gfarm_xmlattr_size_limit;
+extern int gfarm_xmlattr_index;
 extern int gfarm_metadb_max_descriptors;
 extern int gfarm_metadb_stack_size;
 extern int gfarm_metadb_thread_pool_size;
 extern int gfarm_metadb_job_queue_length;
 extern int gfarm_metadb_heartbeat_interval;
 extern int gfarm_metadb_dbq_size;
+extern int gfarm_metadb_dbq_group_commit_size;
+extern int gfarm_metadb_dbq_group_commit_interval;
+extern int gfarm_metadb_snapshot;
 #ifdef not_def_REPLY_QUEUE
 extern int gfm_proto_reply_to_gfsd_window;
 #endif
 extern int gfs_proto_fhremove_request_window;
 extern int gfs_proto_replication_request_window;
 extern int gfarm_outstanding_file_replication_limit;
+extern int gfarm_replication_chain;
 extern int gfarm_relatime;
 extern int gfarm_replica_check;
 extern int gfarm_replica_check_host_down_thresh;
 extern int gfarm_replica_check_sleep_time;
 extern int gfarm_replica_check_minimum_interval;
+extern int gfarm_replica_check_incremental;
 #define GFARM_METADB_STACK_SIZE_DEFAULT 0 /* use OS default */
 #define GFARM_METADB_THREAD_POOL_SIZE_DEFAULT	16  /* quadcore, quadsocket */
 #if 0
@@ -68,6 +82,8 @@ extern int gfarm_replica_check_minimum_interval;
 #endif
 #define GFARM_METADB_HEARTBEAT_INTERVAL_DEFAULT 180 /* 3 min */
 #define GFARM_METADB_DBQ_SIZE_DEFAULT	65536
+#define GFARM_METADB_DBQ_GROUP_COMMIT_SIZE_DEFAULT	1024
+#define GFARM_METADB_DBQ_GROUP_COMMIT_INTERVAL_DEFAULT	100 /* msec */
 #define GFARM_SYMLINK_LEVEL_MAX			20
 
 /* LDAP dependent */
@@ -118,10 +134,12 @@ int gfarm_get_journal_max_size(void);
 int gfarm_get_journal_recvq_size(void);
 int gfarm_get_journal_sync_file(void);
 int gfarm_get_journal_sync_slave_timeout(void);
+int gfarm_get_journal_sync_group_delay(void);
 int gfarm_get_metadb_server_slave_max_size(void);
 int gfarm_get_metadb_server_force_slave(void);
 void gfarm_set_metadb_server_force_slave(int);
 int gfarm_get_metadb_server_slave_listen(void);
+int gfarm_get_metadb_server_slave_read_service(void);
 
 /* miscellaneous */
 extern int gfarm_network_receive_timeout;
@@ -116,6 +116,7 @@ gfarm_context_init(void)
 	ctxp->gfmd_reconnection_timeout = GFARM_CONFIG_MISC_DEFAULT;
 	ctxp->attr_cache_limit = GFARM_CONFIG_MISC_DEFAULT;
 	ctxp->attr_cache_timeout = GFARM_CONFIG_MISC_DEFAULT;
+	ctxp->attr_cache_negative_timeout = GFARM_CONFIG_MISC_DEFAULT;
 	ctxp->page_cache_timeout = GFARM_CONFIG_MISC_DEFAULT;
 	ctxp->schedule_cache_timeout = GFARM_CONFIG_MISC_DEFAULT;
 	ctxp->schedule_concurrency = GFARM_CONFIG_MISC_DEFAULT;
@@ -131,7 +132,13 @@ gfarm_context_init(void)
 	ctxp->gfsd_connection_cache = GFARM_CONFIG_MISC_DEFAULT;
 	ctxp->gfmd_connection_cache = GFARM_CONFIG_MISC_DEFAULT;
 	ctxp->client_file_bufsize = GFARM_CONFIG_MISC_DEFAULT;
+	ctxp->client_file_io_window = GFARM_CONFIG_MISC_DEFAULT;
+	ctxp->client_file_write_io_window = GFARM_CONFIG_MISC_DEFAULT;
+	ctxp->client_file_async_io_budget = GFARM_CONFIG_MISC_DEFAULT;
+	ctxp->client_file_write_behind = GFARM_CONFIG_MISC_DEFAULT;
 	ctxp->client_parallel_copy = GFARM_CONFIG_MISC_DEFAULT;
+	ctxp->metadb_server_slave_read = GFARM_CONFIG_MISC_DEFAULT;
+	ctxp->metadb_server_slave_read_staleness = GFARM_CONFIG_MISC_DEFAULT;
 	ctxp->network_receive_timeout = GFARM_CONFIG_MISC_DEFAULT;
 	ctxp->file_trace = GFARM_CONFIG_MISC_DEFAULT;
 	ctxp->on_demand_replication = 0;
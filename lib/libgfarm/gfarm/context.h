@@ -11,6 +11,7 @@ struct gfarm_context {
 	int gfmd_reconnection_timeout;
 	int attr_cache_limit;
 	int attr_cache_timeout;
+	int attr_cache_negative_timeout;
 	int page_cache_timeout;
 	int schedule_cache_timeout;
 	int schedule_concurrency;
@@ -26,7 +27,13 @@ struct gfarm_context {
 	int gfmd_connection_cache;
 	int gfsd_connection_cache;
 	int client_file_bufsize;
+	int client_file_io_window;
+	int client_file_write_io_window;
+	int client_file_async_io_budget;
+	int client_file_write_behind;
 	int client_parallel_copy;
+	int metadb_server_slave_read;
+	int metadb_server_slave_read_staleness;
 	int on_demand_replication;
 	int call_rpc_instead_syscall;
 	int network_receive_timeout;
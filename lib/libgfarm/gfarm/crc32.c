@@ -19,8 +19,10 @@
  *  v2.0.0: rewrote to use memory buffer & static table, 2006-04-29.
 \*----------------------------------------------------------------------------*/
 
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <gfarm/error.h>
 #include <gfarm/gfarm_misc.h>
@@ -91,8 +93,9 @@ static const unsigned long crcTable[256] = {
     0xB40BBE37, 0xC30C8EA1, 0x5A05DF1B, 0x2D02EF8D
 };
 
+/* the original byte-at-a-time implementation, used as the reference */
 gfarm_uint32_t
-gfarm_crc32(gfarm_uint32_t inCrc32, const void *buf, size_t bufLen)
+gfarm_crc32_bytewise(gfarm_uint32_t inCrc32, const void *buf, size_t bufLen)
 {
 	gfarm_uint32_t crc32;
 	unsigned char *byteBuf;
@@ -107,6 +110,266 @@ gfarm_crc32(gfarm_uint32_t inCrc32, const void *buf, size_t bufLen)
 	return (crc32 ^ 0xFFFFFFFF);
 }
 
+/*
+ * slicing-by-8:
+ * crcSliceTable[k][n] is the CRC of the byte n followed by k zero bytes,
+ * thus 8 bytes are processed by 8 independent table lookups.
+ * the input is loaded byte by byte, so this works on any byte order.
+ */
+
+static gfarm_uint32_t crcSliceTable[8][256];
+
+static void
+crc32_slice_table_init(void)
+{
+	int i, k;
+
+	for (i = 0; i < 256; i++)
+		crcSliceTable[0][i] = crcTable[i];
+	for (k = 1; k < 8; k++) {
+		for (i = 0; i < 256; i++)
+			crcSliceTable[k][i] = (crcSliceTable[k - 1][i] >> 8) ^
+			    crcTable[crcSliceTable[k - 1][i] & 0xFF];
+	}
+}
+
+/* "crc" is not inverted */
+static gfarm_uint32_t
+crc32_sliced8_raw(gfarm_uint32_t crc, const unsigned char *p, size_t len)
+{
+	gfarm_uint32_t lo, hi;
+
+	for (; len >= 8; p += 8, len -= 8) {
+		lo = crc ^ ((gfarm_uint32_t)p[0] |
+		    ((gfarm_uint32_t)p[1] << 8) |
+		    ((gfarm_uint32_t)p[2] << 16) |
+		    ((gfarm_uint32_t)p[3] << 24));
+		hi = (gfarm_uint32_t)p[4] |
+		    ((gfarm_uint32_t)p[5] << 8) |
+		    ((gfarm_uint32_t)p[6] << 16) |
+		    ((gfarm_uint32_t)p[7] << 24);
+		crc =	crcSliceTable[7][lo & 0xFF] ^
+			crcSliceTable[6][(lo >> 8) & 0xFF] ^
+			crcSliceTable[5][(lo >> 16) & 0xFF] ^
+			crcSliceTable[4][lo >> 24] ^
+			crcSliceTable[3][hi & 0xFF] ^
+			crcSliceTable[2][(hi >> 8) & 0xFF] ^
+			crcSliceTable[1][(hi >> 16) & 0xFF] ^
+			crcSliceTable[0][hi >> 24];
+	}
+	for (; len > 0; p++, len--)
+		crc = (crc >> 8) ^ crcTable[(crc ^ *p) & 0xFF];
+	return (crc);
+}
+
+static gfarm_uint32_t
+crc32_sliced8(gfarm_uint32_t inCrc32, const void *buf, size_t bufLen)
+{
+	return (crc32_sliced8_raw(inCrc32 ^ 0xFFFFFFFF, buf, bufLen) ^
+	    0xFFFFFFFF);
+}
+
+/*
+ * carry-less multiplication (PCLMULQDQ) folding, described in
+ * "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ
+ * Instruction" by Intel, with the bit-reflected constants for the
+ * CRC-32 polynomial 0x04C11DB7.
+ * NOTE: the SSE4.2 CRC32 instruction is not usable here,
+ * because it computes CRC-32C, whose polynomial is different.
+ */
+#if (defined(__x86_64__) || defined(__i386__)) && \
+	(defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5))
+#define CRC32_PCLMUL
+
+#include <cpuid.h>
+#include <immintrin.h>
+
+#define CRC32_PCLMUL_MIN_LEN	64
+
+__attribute__((target("pclmul,sse4.1")))
+static gfarm_uint32_t
+crc32_pclmul_raw(gfarm_uint32_t crc, const unsigned char *p, size_t len)
+{
+	static const gfarm_uint64_t __attribute__((aligned(16)))
+		k1k2[] = { 0x0154442bd4ULL, 0x01c6e41596ULL },
+		k3k4[] = { 0x01751997d0ULL, 0x00ccaa009eULL },
+		k5k0[] = { 0x0163cd6124ULL, 0x0000000000ULL },
+		poly[] = { 0x01db710641ULL, 0x01f7011641ULL };
+	__m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+	size_t rest = len & 15;
+
+	/* PREREQUISITE: len >= CRC32_PCLMUL_MIN_LEN */
+	len -= rest;
+
+	x1 = _mm_loadu_si128((const __m128i *)(p + 0x00));
+	x2 = _mm_loadu_si128((const __m128i *)(p + 0x10));
+	x3 = _mm_loadu_si128((const __m128i *)(p + 0x20));
+	x4 = _mm_loadu_si128((const __m128i *)(p + 0x30));
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+	x0 = _mm_load_si128((const __m128i *)k1k2);
+	p += 64;
+	len -= 64;
+
+	/* fold 4 x 128 bits in parallel */
+	for (; len >= 64; p += 64, len -= 64) {
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+		x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+		x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+		y5 = _mm_loadu_si128((const __m128i *)(p + 0x00));
+		y6 = _mm_loadu_si128((const __m128i *)(p + 0x10));
+		y7 = _mm_loadu_si128((const __m128i *)(p + 0x20));
+		y8 = _mm_loadu_si128((const __m128i *)(p + 0x30));
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+	}
+
+	/* fold into 128 bits */
+	x0 = _mm_load_si128((const __m128i *)k3k4);
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+	for (; len >= 16; p += 16, len -= 16) {
+		x2 = _mm_loadu_si128((const __m128i *)p);
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+	}
+
+	/* fold 128 bits into 64 bits */
+	x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+	x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+	x1 = _mm_srli_si128(x1, 8);
+	x1 = _mm_xor_si128(x1, x2);
+	x0 = _mm_loadl_epi64((const __m128i *)k5k0);
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, x3);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	/* Barrett reduction into 32 bits */
+	x0 = _mm_load_si128((const __m128i *)poly);
+	x2 = _mm_and_si128(x1, x3);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+	x2 = _mm_and_si128(x2, x3);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+	crc = (gfarm_uint32_t)_mm_extract_epi32(x1, 1);
+
+	return (crc32_sliced8_raw(crc, p, rest));
+}
+
+static gfarm_uint32_t
+crc32_pclmul(gfarm_uint32_t inCrc32, const void *buf, size_t bufLen)
+{
+	gfarm_uint32_t crc = inCrc32 ^ 0xFFFFFFFF;
+
+	if (bufLen < CRC32_PCLMUL_MIN_LEN)
+		crc = crc32_sliced8_raw(crc, buf, bufLen);
+	else
+		crc = crc32_pclmul_raw(crc, buf, bufLen);
+	return (crc ^ 0xFFFFFFFF);
+}
+
+static int
+crc32_pclmul_is_available(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return (0);
+	return ((ecx & bit_PCLMUL) != 0 && (ecx & bit_SSE4_1) != 0);
+}
+#endif /* CRC32_PCLMUL */
+
+static const struct crc32_implementation {
+	const char *name;
+	gfarm_uint32_t (*func)(gfarm_uint32_t, const void *, size_t);
+	int (*is_available)(void);
+} crc32_implementations[] = {
+#ifdef CRC32_PCLMUL
+	{ "pclmul", crc32_pclmul, crc32_pclmul_is_available },
+#endif
+	{ "sliced8", crc32_sliced8, NULL },
+	{ "bytewise", gfarm_crc32_bytewise, NULL },
+};
+
+#define CRC32_NIMPLEMENTATIONS \
+	(sizeof(crc32_implementations) / sizeof(crc32_implementations[0]))
+
+static const struct crc32_implementation *crc32_selected;
+
+static void
+crc32_initialize(void)
+{
+	int i;
+
+	crc32_slice_table_init();
+	for (i = 0; i < CRC32_NIMPLEMENTATIONS; i++) {
+		if (crc32_implementations[i].is_available == NULL ||
+		    crc32_implementations[i].is_available()) {
+			crc32_selected = &crc32_implementations[i];
+			break;
+		}
+	}
+}
+
+static void
+crc32_init_once(void)
+{
+	static pthread_once_t initialized = PTHREAD_ONCE_INIT;
+
+	pthread_once(&initialized, crc32_initialize);
+}
+
+gfarm_uint32_t
+gfarm_crc32(gfarm_uint32_t inCrc32, const void *buf, size_t bufLen)
+{
+	crc32_init_once();
+	return ((*crc32_selected->func)(inCrc32, buf, bufLen));
+}
+
+const char *
+gfarm_crc32_implementation(void)
+{
+	crc32_init_once();
+	return (crc32_selected->name);
+}
+
+/*
+ * for testing and benchmarking.
+ * returns NULL, if the implementation is unknown or not available
+ * on this CPU.
+ */
+gfarm_uint32_t (*gfarm_crc32_implementation_lookup(const char *name))(
+	gfarm_uint32_t, const void *, size_t)
+{
+	int i;
+	const struct crc32_implementation *impl;
+
+	crc32_init_once();
+	for (i = 0; i < CRC32_NIMPLEMENTATIONS; i++) {
+		impl = &crc32_implementations[i];
+		if (strcmp(impl->name, name) == 0)
+			return (impl->is_available == NULL ||
+			    impl->is_available() ? impl->func : NULL);
+	}
+	return (NULL);
+}
+
 /*----------------------------------------------------------------------------*\
  *  END OF MODULE: crc32.c
 \*----------------------------------------------------------------------------*/
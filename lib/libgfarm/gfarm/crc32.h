@@ -1 +1,5 @@
 gfarm_uint32_t gfarm_crc32(gfarm_uint32_t, const void *, size_t);
+gfarm_uint32_t gfarm_crc32_bytewise(gfarm_uint32_t, const void *, size_t);
+const char *gfarm_crc32_implementation(void);
+gfarm_uint32_t (*gfarm_crc32_implementation_lookup(const char *))(
+	gfarm_uint32_t, const void *, size_t);
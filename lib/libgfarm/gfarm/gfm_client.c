@@ -65,12 +65,28 @@ struct gfm_connection {
 	struct gfarm_metadb_server *real_server;
 
 	int failover_count;
+
+	/* a connection to a slave gfmd, for read-only requests */
+	int slave_read;
+	/* the slave has applied the journal at least until this */
+	gfarm_uint64_t slave_read_seqnum;
 };
 
 #define staticp	(gfarm_ctxp->gfm_client_static)
 
+struct gfm_client_slave_read;
+
 struct gfm_client_static {
 	struct gfp_conn_cache server_cache;
+
+	/*
+	 * connections for read-only requests to slave gfmds.
+	 * they are not mixed with server_cache, because gfmd refuses
+	 * any update request on them.
+	 */
+	struct gfp_conn_cache slave_read_cache;
+	struct gfm_client_slave_read *slave_read_list;
+	pthread_mutex_t slave_read_mutex;
 };
 
 #define SERVER_HASHTAB_SIZE	31	/* prime number */
@@ -79,6 +95,7 @@ struct gfm_client_static {
 #define CONNERR_RETRY_COUNT 3
 
 static gfarm_error_t gfm_client_connection_dispose(void *);
+static void gfm_client_slave_read_list_free(struct gfm_client_slave_read *);
 
 gfarm_error_t
 gfm_client_static_init(struct gfarm_context *ctxp)
@@ -94,6 +111,14 @@ gfm_client_static_init(struct gfarm_context *ctxp)
 		"gfm_connection",
 		SERVER_HASHTAB_SIZE,
 		&ctxp->gfmd_connection_cache);
+	gfp_conn_cache_init(&s->slave_read_cache,
+		gfm_client_connection_dispose,
+		"gfm_slave_read_connection",
+		SERVER_HASHTAB_SIZE,
+		&ctxp->gfmd_connection_cache);
+	s->slave_read_list = NULL;
+	gfarm_mutex_init(&s->slave_read_mutex, "gfm_client_static_init",
+	    "slave_read");
 
 	ctxp->gfm_client_static = s;
 	return (GFARM_ERR_NO_ERROR);
@@ -108,6 +133,10 @@ gfm_client_static_term(struct gfarm_context *ctxp)
 		return;
 
 	gfp_conn_cache_term(&s->server_cache);
+	gfp_conn_cache_term(&s->slave_read_cache);
+	gfm_client_slave_read_list_free(s->slave_read_list);
+	gfarm_mutex_destroy(&s->slave_read_mutex, "gfm_client_static_term",
+	    "slave_read");
 	free(s);
 }
 
@@ -220,16 +249,20 @@ gfm_client_process_is_set(struct gfm_connection *gfm_server)
 	return (gfm_server->pid != 0);
 }
 
+#define gfm_client_connection_cache(gfm_server) \
+	((gfm_server)->slave_read ? \
+	    &staticp->slave_read_cache : &staticp->server_cache)
+
 /* this interface is exported for a use from a private extension */
 void
 gfm_client_purge_from_cache(struct gfm_connection *gfm_server)
 {
-	gfp_cached_connection_purge_from_cache(&staticp->server_cache,
-	    gfm_server->cache_entry);
+	gfp_cached_connection_purge_from_cache(
+	    gfm_client_connection_cache(gfm_server), gfm_server->cache_entry);
 }
 
 #define gfm_client_connection_used(gfm_server) \
-	gfp_cached_connection_used(&staticp->server_cache, \
+	gfp_cached_connection_used(gfm_client_connection_cache(gfm_server), \
 	    (gfm_server)->cache_entry)
 
 int
@@ -243,6 +276,7 @@ void
 gfm_client_connection_gc(void)
 {
 	gfp_cached_connection_gc_all(&staticp->server_cache);
+	gfp_cached_connection_gc_all(&staticp->slave_read_cache);
 }
 
 #ifndef __KERNEL__	/* gfm_client_nonblock_sock_connect :: in user mode */
@@ -653,6 +687,8 @@ gfm_client_connection0(struct gfp_cached_connection *cache_entry,
 	gfm_server->real_server = ms != NULL ? ms :
 		gfarm_filesystem_get_metadb_server_first(fs);
 	gfm_server->failover_count = gfarm_filesystem_failover_count(fs);
+	gfm_server->slave_read = 0;
+	gfm_server->slave_read_seqnum = 0;
 	*gfm_serverp = gfm_server;
 end:
 	if (res)
@@ -867,6 +903,276 @@ gfm_client_connect_with_seteuid(const char *hostname, int port,
 }
 #endif /* __KERNEL__ */
 
+/*
+ * read-only requests to slave gfmd
+ *
+ * a slave gfmd which enables metadb_server_slave_read_service serves
+ * read-only requests by itself, instead of relaying them to the master,
+ * after GFM_PROTO_METADB_SERVER_READ_ONLY is accepted.
+ * the request makes the slave wait until it applies the journal up to
+ * the seqnum which the master returned at most
+ * metadb_server_slave_read_staleness milliseconds ago,
+ * thus a client never sees metadata older than that.
+ *
+ * the nearest slave is chosen by the round trip time of the request.
+ */
+
+#define GFM_CLIENT_SLAVE_READ_RETRY_INTERVAL	60 /* seconds */
+
+struct gfm_client_slave {
+	struct gfarm_metadb_server *ms;
+	long rtt;			/* microseconds, 0 if not measured */
+	struct timeval retry_time;	/* not used until this, if failed */
+};
+
+struct gfm_client_slave_read {
+	struct gfm_client_slave_read *next;
+	struct gfarm_filesystem *fs;
+
+	gfarm_uint64_t required_seqnum;
+	struct timeval required_seqnum_expiration;
+
+	int nslaves;
+	struct gfm_client_slave *slaves;
+};
+
+static const char SLAVE_READ_MUTEX_DIAG[] = "slave_read_mutex";
+
+static void
+gfm_client_slave_read_list_free(struct gfm_client_slave_read *list)
+{
+	struct gfm_client_slave_read *sr, *next;
+
+	for (sr = list; sr != NULL; sr = next) {
+		next = sr->next;
+		free(sr->slaves);
+		free(sr);
+	}
+}
+
+#ifndef __KERNEL__	/* gfm_client_connect_single :: in user mode */
+
+/* PREREQUISITE: slave_read_mutex */
+static struct gfm_client_slave_read *
+gfm_client_slave_read_lookup(struct gfarm_filesystem *fs)
+{
+	struct gfm_client_slave_read *sr;
+	struct gfarm_metadb_server **msl;
+	int i, nmsl;
+
+	for (sr = staticp->slave_read_list; sr != NULL; sr = sr->next) {
+		if (sr->fs == fs)
+			return (sr);
+	}
+
+	msl = gfarm_filesystem_get_metadb_server_list(fs, &nmsl);
+	GFARM_MALLOC(sr);
+	if (sr == NULL)
+		return (NULL);
+	GFARM_MALLOC_ARRAY(sr->slaves, nmsl > 0 ? nmsl : 1);
+	if (sr->slaves == NULL) {
+		free(sr);
+		return (NULL);
+	}
+	sr->fs = fs;
+	sr->required_seqnum = 0;
+	timerclear(&sr->required_seqnum_expiration);
+	sr->nslaves = 0;
+	for (i = 0; i < nmsl; i++) {
+		if (gfarm_metadb_server_is_self(msl[i]))
+			continue;
+		sr->slaves[sr->nslaves].ms = msl[i];
+		sr->slaves[sr->nslaves].rtt = 0;
+		timerclear(&sr->slaves[sr->nslaves].retry_time);
+		sr->nslaves++;
+	}
+	sr->next = staticp->slave_read_list;
+	staticp->slave_read_list = sr;
+	return (sr);
+}
+
+/* PREREQUISITE: slave_read_mutex */
+static struct gfm_client_slave *
+gfm_client_slave_read_choose(struct gfm_client_slave_read *sr,
+	struct gfarm_metadb_server *master)
+{
+	struct gfm_client_slave *s, *best = NULL;
+	struct timeval now;
+	int i;
+
+	gettimeofday(&now, NULL);
+	for (i = 0; i < sr->nslaves; i++) {
+		s = &sr->slaves[i];
+		if (s->ms == master ||
+		    gfarm_timeval_cmp(&now, &s->retry_time) < 0)
+			continue;
+		/* a slave which is not measured yet is tried first */
+		if (best == NULL || s->rtt < best->rtt)
+			best = s;
+	}
+	return (best);
+}
+
+static gfarm_error_t
+gfm_client_slave_read_connect(struct gfarm_metadb_server *ms,
+	const char *user, gfarm_uint64_t required_seqnum,
+	struct gfm_connection **gfm_serverp, long *rttp)
+{
+	gfarm_error_t e;
+	struct gfp_cached_connection *cache_entry;
+	struct gfm_connection *gfm_server;
+	struct timeval t1, t2;
+	gfarm_uint64_t applied;
+	int created;
+
+	e = gfp_cached_connection_acquire(&staticp->slave_read_cache,
+	    gfarm_metadb_server_get_name(ms),
+	    gfarm_metadb_server_get_port(ms), user, &cache_entry, &created);
+	if (e != GFARM_ERR_NO_ERROR)
+		return (e);
+	if (!created) {
+		gfm_server = gfp_cached_connection_get_data(cache_entry);
+		if (gfm_server == NULL) { /* being created by another thread */
+			gfp_cached_or_uncached_connection_free(
+			    &staticp->slave_read_cache, cache_entry);
+			return (GFARM_ERR_RESOURCE_TEMPORARILY_UNAVAILABLE);
+		}
+	} else {
+		e = gfm_client_connection0(cache_entry, &gfm_server, NULL,
+		    NULL, gfm_client_connect_single);
+		if (e != GFARM_ERR_NO_ERROR) {
+			gfp_cached_connection_purge_from_cache(
+			    &staticp->slave_read_cache, cache_entry);
+			gfp_uncached_connection_dispose(cache_entry);
+			return (e);
+		}
+		gfm_server->slave_read = 1;
+	}
+
+	*rttp = 0;
+	/* the connection may be shared, the state is updated under the lock */
+	gfm_client_connection_lock(gfm_server);
+	if (gfm_server->slave_read_seqnum < required_seqnum) {
+		gettimeofday(&t1, NULL);
+		e = gfm_client_metadb_server_read_only(gfm_server,
+		    required_seqnum,
+		    gfarm_ctxp->metadb_server_slave_read_staleness, &applied);
+		gettimeofday(&t2, NULL);
+		if (e != GFARM_ERR_NO_ERROR) {
+			gfm_client_connection_unlock(gfm_server);
+			gfm_client_connection_free(gfm_server);
+			return (e);
+		}
+		gfm_server->slave_read_seqnum = applied;
+		gfarm_timeval_sub(&t2, &t1);
+		*rttp = t2.tv_sec * GFARM_SECOND_BY_MICROSEC + t2.tv_usec;
+		if (*rttp <= 0)
+			*rttp = 1;
+	}
+
+	/* process is allocated in the slave, after the READ_ONLY request */
+	if (gfm_server->pid == 0) {
+		gfarm_auth_random(gfm_server->pid_key,
+		    GFM_PROTO_PROCESS_KEY_LEN_SHAREDSECRET);
+		if ((e = gfm_client_process_alloc(gfm_server,
+		    GFM_PROTO_PROCESS_KEY_TYPE_SHAREDSECRET,
+		    gfm_server->pid_key,
+		    GFM_PROTO_PROCESS_KEY_LEN_SHAREDSECRET,
+		    &gfm_server->pid)) != GFARM_ERR_NO_ERROR) {
+			gfm_client_connection_unlock(gfm_server);
+			gfm_client_connection_free(gfm_server);
+			return (e);
+		}
+	}
+	gfm_client_connection_unlock(gfm_server);
+	*gfm_serverp = gfm_server;
+	return (GFARM_ERR_NO_ERROR);
+}
+
+/*
+ * returns a connection to the nearest slave gfmd which is up-to-date
+ * enough to serve read-only requests instead of the master,
+ * or an error, if the request has to be sent to the master.
+ */
+gfarm_error_t
+gfm_client_slave_read_connection_acquire(struct gfm_connection *master,
+	struct gfm_connection **gfm_serverp)
+{
+	gfarm_error_t e;
+	struct gfarm_filesystem *fs;
+	struct gfm_client_slave_read *sr;
+	struct gfm_client_slave *s;
+	struct gfarm_metadb_server *ms;
+	struct timeval now;
+	gfarm_uint64_t seqnum;
+	long rtt;
+	static const char diag[] = "gfm_client_slave_read_connection_acquire";
+
+	if (!gfarm_ctxp->metadb_server_slave_read || master->slave_read ||
+	    (fs = gfarm_filesystem_get_by_connection(master)) == NULL)
+		return (GFARM_ERR_NO_SUCH_OBJECT);
+
+	gfarm_mutex_lock(&staticp->slave_read_mutex, diag,
+	    SLAVE_READ_MUTEX_DIAG);
+	if ((sr = gfm_client_slave_read_lookup(fs)) == NULL) {
+		gfarm_mutex_unlock(&staticp->slave_read_mutex, diag,
+		    SLAVE_READ_MUTEX_DIAG);
+		return (GFARM_ERR_NO_MEMORY);
+	}
+	gettimeofday(&now, NULL);
+	if (gfarm_timeval_cmp(&now, &sr->required_seqnum_expiration) >= 0) {
+		gfarm_mutex_unlock(&staticp->slave_read_mutex, diag,
+		    SLAVE_READ_MUTEX_DIAG);
+		if ((e = gfm_client_metadb_server_seqnum_get(master,
+		    &seqnum)) != GFARM_ERR_NO_ERROR)
+			return (e);
+		gfarm_mutex_lock(&staticp->slave_read_mutex, diag,
+		    SLAVE_READ_MUTEX_DIAG);
+		if (sr->required_seqnum < seqnum)
+			sr->required_seqnum = seqnum;
+		sr->required_seqnum_expiration = now;
+		gfarm_timeval_add_microsec(&sr->required_seqnum_expiration,
+		    (long)gfarm_ctxp->metadb_server_slave_read_staleness *
+		    GFARM_MILLISEC_BY_MICROSEC);
+	}
+	seqnum = sr->required_seqnum;
+	s = gfm_client_slave_read_choose(sr,
+	    gfm_client_connection_get_real_server(master));
+	ms = s == NULL ? NULL : s->ms;
+	gfarm_mutex_unlock(&staticp->slave_read_mutex, diag,
+	    SLAVE_READ_MUTEX_DIAG);
+	if (ms == NULL)
+		return (GFARM_ERR_NO_SUCH_OBJECT);
+
+	e = gfm_client_slave_read_connect(ms, gfm_client_username(master),
+	    seqnum, gfm_serverp, &rtt);
+
+	gfarm_mutex_lock(&staticp->slave_read_mutex, diag,
+	    SLAVE_READ_MUTEX_DIAG);
+	if (e == GFARM_ERR_NO_ERROR) {
+		if (rtt > 0)
+			s->rtt = s->rtt == 0 ? rtt : (s->rtt * 7 + rtt) / 8;
+	} else if (e != GFARM_ERR_RESOURCE_TEMPORARILY_UNAVAILABLE) {
+		gflog_debug(GFARM_MSG_UNFIXED,
+		    "slave gfmd %s:%d is not used for read: %s",
+		    gfarm_metadb_server_get_name(ms),
+		    gfarm_metadb_server_get_port(ms), gfarm_error_string(e));
+		/* a stale slave may catch up soon */
+		s->retry_time = now;
+		gfarm_timeval_add_microsec(&s->retry_time,
+		    e == GFARM_ERR_OPERATION_TIMED_OUT ?
+		    (long)gfarm_ctxp->metadb_server_slave_read_staleness *
+		    GFARM_MILLISEC_BY_MICROSEC :
+		    GFM_CLIENT_SLAVE_READ_RETRY_INTERVAL *
+		    GFARM_SECOND_BY_MICROSEC);
+	}
+	gfarm_mutex_unlock(&staticp->slave_read_mutex, diag,
+	    SLAVE_READ_MUTEX_DIAG);
+	return (e);
+}
+
+#endif /* __KERNEL__ */
+
 static gfarm_error_t
 gfm_client_connection_dispose(void *connection_data)
 {
@@ -895,8 +1201,8 @@ gfm_client_connection_dispose(void *connection_data)
 void
 gfm_client_connection_free(struct gfm_connection *gfm_server)
 {
-	gfp_cached_or_uncached_connection_free(&staticp->server_cache,
-	    gfm_server->cache_entry);
+	gfp_cached_or_uncached_connection_free(
+	    gfm_client_connection_cache(gfm_server), gfm_server->cache_entry);
 }
 
 /*
@@ -916,6 +1222,7 @@ void
 gfm_client_terminate(void)
 {
 	gfp_cached_connection_terminate(&staticp->server_cache);
+	gfp_cached_connection_terminate(&staticp->slave_read_cache);
 }
 void
 gfm_client_connection_unlock(struct gfm_connection *gfm_server)
@@ -934,6 +1241,9 @@ check_connection_or_purge(struct gfm_connection *gfm_server,
 {
 	if (IS_CONNECTION_ERROR(e)) {
 		gfm_client_purge_from_cache(gfm_server);
+		/* a slave is not the master, thus no failover is needed */
+		if (gfm_server->slave_read)
+			return;
 		/*
 		 * failover-detected flag must always be incremented
 		 * at purging gfm_connection to replace gfm_connection
@@ -4370,9 +4680,14 @@ gfm_client_process_alloc(struct gfm_connection *gfm_server,
 	gfarm_int32_t keytype, const char *sharedkey, size_t sharedkey_size,
 	gfarm_pid_t *pidp)
 {
-	return (gfm_client_rpc(gfm_server,
+	gfarm_error_t e;
+
+	gfm_client_connection_lock(gfm_server);
+	e = gfm_client_rpc(gfm_server,
 	    GFM_PROTO_PROCESS_ALLOC, "ib/l",
-	    keytype, sharedkey_size, sharedkey, pidp));
+	    keytype, sharedkey_size, sharedkey, pidp);
+	gfm_client_connection_unlock(gfm_server);
+	return (e);
 }
 
 #ifdef NOT_USED
@@ -4664,6 +4979,39 @@ gfm_client_metadb_server_remove(struct gfm_connection *gfm_server,
 	return (e);
 }
 
+gfarm_error_t
+gfm_client_metadb_server_seqnum_get(struct gfm_connection *gfm_server,
+	gfarm_uint64_t *seqnump)
+{
+	gfarm_error_t e;
+
+	if ((e = gfm_client_rpc(gfm_server, GFM_PROTO_METADB_SERVER_SEQNUM_GET,
+	    "/l", seqnump)) != GFARM_ERR_NO_ERROR) {
+		gflog_debug(GFARM_MSG_UNFIXED,
+		    "gfm_client_rpc() failed: %s",
+		    gfarm_error_string(e));
+	}
+	return (e);
+}
+
+gfarm_error_t
+gfm_client_metadb_server_read_only(struct gfm_connection *gfm_server,
+	gfarm_uint64_t seqnum, int timeout_msec, gfarm_uint64_t *appliedp)
+{
+	gfarm_error_t e;
+
+	gfm_client_connection_lock(gfm_server);
+	if ((e = gfm_client_rpc(gfm_server, GFM_PROTO_METADB_SERVER_READ_ONLY,
+	    "li/l", seqnum, (gfarm_int32_t)timeout_msec, appliedp))
+	    != GFARM_ERR_NO_ERROR) {
+		gflog_debug(GFARM_MSG_UNFIXED,
+		    "gfm_client_rpc() failed: %s",
+		    gfarm_error_string(e));
+	}
+	gfm_client_connection_unlock(gfm_server);
+	return (e);
+}
+
 
 #if 0 /* not used in gfarm v2 */
 /*
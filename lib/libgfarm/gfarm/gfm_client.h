@@ -55,6 +55,8 @@ gfarm_error_t gfm_client_connection_acquire(const char *, int, const char *,
 gfarm_error_t gfm_client_connection_addref(struct gfm_connection *);
 gfarm_error_t gfm_client_connection_and_process_acquire(const char *, int,
 	const char *, struct gfm_connection **);
+gfarm_error_t gfm_client_slave_read_connection_acquire(struct gfm_connection *,
+	struct gfm_connection **);
 gfarm_error_t gfm_client_connect(const char *, int, const char *,
 	struct gfm_connection **, const char *);
 struct passwd;
@@ -519,6 +521,10 @@ gfarm_error_t gfm_client_metadb_server_modify(struct gfm_connection *,
 	struct gfarm_metadb_server *);
 gfarm_error_t gfm_client_metadb_server_remove(struct gfm_connection *,
 	const char *);
+gfarm_error_t gfm_client_metadb_server_seqnum_get(struct gfm_connection *,
+	gfarm_uint64_t *);
+gfarm_error_t gfm_client_metadb_server_read_only(struct gfm_connection *,
+	gfarm_uint64_t, int, gfarm_uint64_t *);
 
 /* exported for a use from a private extension */
 gfarm_error_t gfm_client_rpc_request(struct gfm_connection *,
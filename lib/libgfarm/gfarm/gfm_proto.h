@@ -336,8 +336,8 @@ enum gfm_proto_command {
 	GFM_PROTO_METADB_SERVER_SET,
 	GFM_PROTO_METADB_SERVER_MODIFY,
 	GFM_PROTO_METADB_SERVER_REMOVE,
-	GFM_PROTO_METADB_SERVER_RESERVE6,
-	GFM_PROTO_METADB_SERVER_RESERVE7,
+	GFM_PROTO_METADB_SERVER_SEQNUM_GET,
+	GFM_PROTO_METADB_SERVER_READ_ONLY,
 	GFM_PROTO_METADB_SERVER_RESERVE8,
 	GFM_PROTO_METADB_SERVER_RESERVE9,
 	GFM_PROTO_METADB_SERVER_RESERVE10,
@@ -11,18 +11,25 @@
 #include <limits.h>
 #include <netinet/in.h> /* ntoh[ls]()/hton[ls]() on glibc */
 #include <gfarm/gfarm_config.h>
+#if defined(HAVE_SENDFILE) && defined(HAVE_SYS_SENDFILE_H) && \
+	!defined(__KERNEL__)
+#include <sys/sendfile.h>
+#ifdef HAVE_POLL
+#include <poll.h>
+#else
+#include <sys/select.h>
+#endif
+#endif
 #include <gfarm/gflog.h>
 #include <gfarm/error.h>
 #include <gfarm/gfarm_misc.h>
-#include <sqlite3.h>
-#include <sys/ipc.h>
-#include <sys/sem.h>
 
 #include "gfutil.h" /* gflog_fatal() */
 
 #include "liberror.h"
 #include "iobuffer.h"
 #include "gfp_xdr.h"
+#include "io_fd.h"
 #include "thrsubr.h"
 
 #ifndef va_copy /* since C99 standard */
@@ -51,40 +58,8 @@ struct gfp_xdr {
 
 	/* XXX currently used by client only, but should be used by servers */
 	struct gfp_xdr_async_server *async;
-
-	gfarm_uint32_t client_addr;
-
-	gfarm_uint32_t total_cache_hit;
-	gfarm_uint32_t total_read;
-	double latest_cache_hitrate;
 };
 
-static int db_semid;
-
-void 
-db_lock(int semid)
-{
-	struct sembuf sb[1];
-	sb[0].sem_num = 0;
-	sb[0].sem_op  = -1;
-	sb[0].sem_flg = 0;	
-	if (EOF == semop(semid, sb, 1)) {
-		gflog_fatal(GFARM_MSG_UNFIXED, "semaphore lock error");
-	}
-}
-
-void 
-db_unlock(int semid)
-{
-	struct sembuf sb[1];
-	sb[0].sem_num = 0;
-	sb[0].sem_op  = 1;
-	sb[0].sem_flg = 0;
-	if (EOF == semop(semid, sb, 1)) {
-		gflog_fatal(GFARM_MSG_UNFIXED, "semaphore unlock error");
-	}
-}
-
 /*
  * switch to new iobuffer operation,
  * and (possibly) switch to new cookie/fd
@@ -250,6 +225,128 @@ gfp_xdr_flush(struct gfp_xdr *conn)
 	return (gfarm_iobuffer_get_error(conn->sendbuffer));
 }
 
+#ifndef __KERNEL__
+#if defined(HAVE_SENDFILE) && defined(HAVE_SYS_SENDFILE_H)
+/*
+ * returns -1 and sets errno, if sendfile(2) cannot be used for the fd.
+ * SIGPIPE has to be ignored by the caller, since MSG_NOSIGNAL is not
+ * available for sendfile(2).
+ */
+static ssize_t
+gfp_xdr_sendfile(int sock, int file_fd, gfarm_int64_t offset, size_t len)
+{
+	off_t off = offset;
+	ssize_t rv;
+	size_t sent = 0;
+
+	while (sent < len) {
+		rv = sendfile(sock, file_fd, &off, len - sent);
+		if (rv == -1) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN) {
+#ifdef HAVE_POLL
+				struct pollfd fds[1];
+
+				fds[0].fd = sock;
+				fds[0].events = POLLOUT;
+				fds[0].revents = 0;
+				poll(fds, 1, -1);
+#else
+				fd_set writable;
+
+				FD_ZERO(&writable);
+				FD_SET(sock, &writable);
+				select(sock + 1, NULL, &writable, NULL, NULL);
+#endif
+				continue;
+			}
+			if (sent > 0) /* cannot fall back anymore */
+				errno = EIO;
+			return (-1);
+		}
+		if (rv == 0) /* end of file */
+			break;
+		sent += rv;
+	}
+	return (sent);
+}
+#endif /* defined(HAVE_SENDFILE) && defined(HAVE_SYS_SENDFILE_H) */
+
+/*
+ * send "len" bytes at "offset" of the file "file_fd" as raw bytes.
+ *
+ * if the connection writes to the socket as is (i.e. it's not
+ * encrypted), the bytes are sent by sendfile(2) without passing
+ * through the user space.  otherwise, they are read(2) and sent
+ * via the send buffer.
+ *
+ * the caller has to send the length beforehand, thus if the file is
+ * shorter than "len" (e.g. truncated after the length was sent),
+ * the rest is filled with zeros to keep the data stream, and
+ * the number of bytes actually read from the file is stored to "*filledp".
+ * the connection has to be closed in any error case.
+ */
+gfarm_error_t
+gfp_xdr_send_file_range(struct gfp_xdr *conn, int file_fd,
+	gfarm_int64_t offset, size_t len, size_t *filledp)
+{
+	gfarm_error_t e;
+	char buffer[GFP_XDR_BUFSIZE];
+	size_t sent = 0, filled;
+	ssize_t rv;
+
+#if defined(HAVE_SENDFILE) && defined(HAVE_SYS_SENDFILE_H)
+	if (conn->iob_ops->blocking_write ==
+	    gfarm_iobuffer_blocking_write_socket_op) {
+		if ((e = gfp_xdr_flush(conn)) != GFARM_ERR_NO_ERROR)
+			return (e);
+		rv = gfp_xdr_sendfile(conn->fd, file_fd, offset, len);
+		if (rv != -1) {
+			sent = rv;
+			goto fill_zero;
+		}
+		if (errno != EINVAL && errno != ENOSYS)
+			return (gfarm_errno_to_error(errno));
+		/* sendfile(2) is not supported for the file, fall back */
+	}
+#endif
+	while (sent < len) {
+		rv = pread(file_fd, buffer,
+		    len - sent < sizeof(buffer) ? len - sent : sizeof(buffer),
+		    offset + sent);
+		if (rv == -1) {
+			if (errno == EINTR)
+				continue;
+			return (gfarm_errno_to_error(errno));
+		}
+		if (rv == 0) /* end of file */
+			break;
+		gfarm_iobuffer_put_write(conn->sendbuffer, buffer, rv);
+		if ((e = gfarm_iobuffer_get_error(conn->sendbuffer))
+		    != GFARM_ERR_NO_ERROR)
+			return (e);
+		sent += rv;
+	}
+#if defined(HAVE_SENDFILE) && defined(HAVE_SYS_SENDFILE_H)
+fill_zero:
+#endif
+	*filledp = sent;
+	if (sent < len)
+		memset(buffer, 0, sizeof(buffer));
+	while (sent < len) {
+		filled = len - sent < sizeof(buffer) ?
+		    len - sent : sizeof(buffer);
+		gfarm_iobuffer_put_write(conn->sendbuffer, buffer, filled);
+		if ((e = gfarm_iobuffer_get_error(conn->sendbuffer))
+		    != GFARM_ERR_NO_ERROR)
+			return (e);
+		sent += filled;
+	}
+	return (GFARM_ERR_NO_ERROR);
+}
+#endif /* __KERNEL__ */
+
 gfarm_error_t
 gfp_xdr_purge_sized(struct gfp_xdr *conn, int just, int len, size_t *sizep)
 {
@@ -823,7 +920,8 @@ recv_sized(struct gfp_xdr *conn, int just, int do_timeout, void *p, size_t sz,
 	return (GFARM_ERR_NO_ERROR); /* rv may be 0, if sz == 0 */
 }
 
-static void
+/* free the first format_parsed parameters received by gfp_xdr_vrecv*() */
+void
 gfp_xdr_vrecv_free(int format_parsed, const char *format, va_list *app)
 {
 	gfarm_int8_t *cp;
@@ -1703,634 +1801,8 @@ gfp_xdr_sendbuffer_overwrite_at(struct gfp_xdr *conn,
 }
 
 /* For bayesian Cooperative Cache */
-#define SQL_CALLBACK_WRAPPER_STRUCTURE(tag)		\
-struct wrap_ ## tag ## _entry {					\
-	int valid_num_of_entry;						\
-	int allocated_entries_size;					\
-	struct tag##_entry *entries;				\
-}
-
-#define STRUCT_SQL_CALLBACK_WRAPPER(tag) \
-	struct wrap_ ## tag ## _entry
-
-#define SQL_CALLBACK_WRAPPER_GARD_ARYSIZE(_wp, increment_size)			\
-	do {																\
-		if ((_wp)->allocated_entries_size < (_wp)->valid_num_of_entry) { \
-			(_wp)->allocated_entries_size += (increment_size);			\
-			(_wp)->entries = GFARM_REALLOC_ARRAY((_wp)->entries, (_wp)->entries, \
-												 (_wp)->allocated_entries_size); \
-		}																\
-	} while (0)
-
-#define P_GET_SQL_WRAPPER_CURRENT_ARY_LEN(p) \
-	((p)->valid_num_of_entry)
-
-#define P_INCREMENT_SQL_WRAPPER_ARY_LEN(p) \
-	((p)->valid_num_of_entry++)
-
-#define P_SQL_WRAPPER_ENTRY(p) \
-	((p)->entries)
-
-#define GET_SQL_WRAPPER_CURRENT_ARY_LEN(val) \
-	((val).valid_num_of_entry)
-
-#define INCREMENT_SQL_WRAPPER_ARY_LEN(val) \
-	((val).valid_num_of_entry++)
-
-#define SQL_WRAPPER_ENTRY(val) \
-	((val).entries)
-
-void
-gfp_record_client_subquery(sqlite3 *db, struct gfp_xdr *conn, 
-	struct sockaddr *client_addr)
-{
-	struct sockaddr_in *sin = (struct sockaddr_in *)client_addr;
-	gfarm_uint32_t client_ip = (gfarm_uint32_t)sin->sin_addr.s_addr;
-	char *errmsg = NULL;
-	int rc;
-	char sql[255];
-	char *_sql = 
-		"insert or ignore into clients(cliaddr, total_reads, total_hits) "
-		"          values(%d, 0, 0)";
-	
-	snprintf(sql, sizeof(sql), _sql, client_ip);
-	
-	db_lock(db_semid); {
-		rc = sqlite3_exec(db, sql, 0, 0, &errmsg);
-	}; db_unlock(db_semid);
-	if (rc != SQLITE_OK) {
-		gflog_error(GFARM_MSG_1000018,
-			"Could not record a client into the db %s (client ip: %d)",
-			errmsg, client_ip);
-		sqlite3_free(errmsg);
-	} else 
-		gflog_debug(GFARM_MSG_1000018,
-					"insert a client (%d) into the table\n", client_ip);
-	
-	conn->client_addr     = client_ip;	
-	conn->total_cache_hit = 0;
-	conn->total_read      = 0;
-	
-	return;
-}
-
-void
-gfp_record_client(sqlite3 *db, struct gfp_xdr *conn, 
-	struct sockaddr *client_addr)
-{
-	struct sockaddr_in *sin = (struct sockaddr_in *)client_addr;
-	gfarm_uint32_t client_ip = (gfarm_uint32_t)sin->sin_addr.s_addr;
-	char *errmsg = NULL;
-	int rc;
-	char sql[255];
-	char *_sql = 
-		/* "insert or ignore into clients(cliaddr, total_reads, total_hits) " */
-		/* "          values(%d, 10, 10)"; */
-		"	INSERT or IGNORE into clients (cliaddr, total_reads, total_hits)"
-		"		SELECT coalesce(cliaddr, %u), "
-		"		       coalesce(total_reads, 0), "
-		"		       coalesce(total_hits, 0)"
-		"		FROM clients where cliaddr = %u";
-	
-	snprintf(sql, sizeof(sql), _sql, client_ip, client_ip);
-
-	db_lock(db_semid); {
-		rc = sqlite3_exec(db, sql, 0, 0, &errmsg);
-		if (rc != SQLITE_OK) {
-			gflog_error(GFARM_MSG_1000018,
-						"Could not record a client into the db %s (client ip: %d)",
-						errmsg, client_ip);
-			sqlite3_free(errmsg);
-		} else 
-			gflog_debug(GFARM_MSG_1000018,
-						"insert a client (%d) into the table\n", client_ip);
-	}; db_unlock(db_semid);
-	
-	conn->client_addr     = client_ip;	
-	conn->total_cache_hit = 0;
-	conn->total_read      = 0;
-	
-	return;
-}
-
-/* void */
-/* gfp_update_histgram_entries(sqlite3 *db, struct gfp_xdr *conn,  */
-/* 	gfarm_int64_t ino, gfarm_int64_t pagenum) */
-/* { */
-/* 	int rc; */
-/* 	char *errmsg = NULL; */
-/* 	char sql[255]; */
-/* 	char *_sql =  */
-/* 		"INSERT INTO entries (inum, pagenum)" */
-/* 		"       SELECT %lu, %lu" */
-/* 		"              FROM dual" */
-/* 		"                   WHERE NOT EXISTS " */
-/* 		"      (SELECT id FROM entries WHERE inum = %lu AND pagenum = %lu)"; */
-
-/* 	snprintf(sql, sizeof(sql), _sql, ino, pagenum, ino, pagenum); */
-	
-/* 	gfarm_mutex_lock(&sql_mutex, lock_diag, "mutex"); {	 */
-/* 		rc = sqlite3_exec(db, sql, 0, 0, &errmsg); */
-/* 		if (rc != SQLITE_OK) { */
-/* 			gflog_error(GFARM_MSG_1000018, */
-/* 						"Could not update histgram entries: %s", errmsg); */
-/* 			sqlite3_free(errmsg); */
-/* 		} */
-/* 	}; gfarm_mutex_unlock(&sql_mutex, lock_diag, "mutex"); */
-/* } */
-
-gfarm_error_t
-gfp_update_totalchit_and_total_read(sqlite3 *db, struct gfp_xdr *conn)
-{	
-	int rc;
-	char *errmsg = NULL;
-	char sql[1024];
-	char *_sql = 
-		"INSERT into clients (cliaddr, total_reads, total_hits)"
-		"       SELECT coalesce(cliaddr, %u), "
-		"              coalesce(total_reads + %u, %u), "
-		"              coalesce(total_hits + %u, %u)"
-		"                      FROM clients where cliaddr = %u";
-
-	snprintf(sql, sizeof(sql), _sql, conn->client_addr, 
-			 conn->total_read, conn->total_read,
-			 conn->total_cache_hit, conn->total_cache_hit,
-			 conn->client_addr);
-
-	db_lock(db_semid); {	
-		rc = sqlite3_exec(db, sql, 0, 0, &errmsg);
-	}; db_unlock(db_semid);
-	if (rc != SQLITE_OK) {
-		gflog_error(GFARM_MSG_1000018,
-		   "Could not update cache hit rate and total read: %s", errmsg);
-		sqlite3_free(errmsg);
-		return GFARM_ERR_SQL;
-	}
-	
-	return GFARM_ERR_NO_ERROR;
-}
-
-struct conn_entry {
-	gfarm_uint32_t cliaddr;
-	gfarm_uint32_t total_reads;
-	gfarm_uint32_t total_hits;
-};
-SQL_CALLBACK_WRAPPER_STRUCTURE(conn);
-
-static int
-callback_form_conn_entries(void *ptr, int argc, 
-	char **argv, char **azColName)
-{
-	int i;
-	int idx;
-	STRUCT_SQL_CALLBACK_WRAPPER(conn) *p = (STRUCT_SQL_CALLBACK_WRAPPER(conn)*)ptr;
-	
-	SQL_CALLBACK_WRAPPER_GARD_ARYSIZE(p, 10);
-	
-	P_INCREMENT_SQL_WRAPPER_ARY_LEN(p);
-	idx = P_GET_SQL_WRAPPER_CURRENT_ARY_LEN(p) - 1;
-
-	for (i = 0 ; i < argc ; i++) {
-		if (strcmp(azColName[i], "cliaddr") == 0) {
-			P_SQL_WRAPPER_ENTRY(p)[idx].cliaddr = atoi(argv[i]);
-		} else if (strcmp(azColName[i], "total_reads") == 0) {
-			P_SQL_WRAPPER_ENTRY(p)[idx].total_reads = atoll(argv[i]);
-		} else if (strcmp(azColName[i], "total_hits") == 0) {
-			P_SQL_WRAPPER_ENTRY(p)[idx].total_hits = atoll(argv[i]);
-		}
-	}	
-
-	return SQLITE_OK;
-}
-
-gfarm_error_t
-gfp_get_totalchit_and_total_read(sqlite3 *db, struct gfp_xdr *conn, 
-	const char *diag, char **result, int *result_len)
-{
-	int rc;
-	int i;
-	char *s;
-	char *errmsg = NULL;
-	char tmp[255];
-	STRUCT_SQL_CALLBACK_WRAPPER(conn) clients;
-	size_t ary_size = 10;
-	char *_sql = 
-		"SELECT * from clients";
-
-	memset(&clients, 0, sizeof(STRUCT_SQL_CALLBACK_WRAPPER(conn)));
-	GFARM_MALLOC_ARRAY(clients.entries, 10);
-	clients.allocated_entries_size = 10;
-	clients.valid_num_of_entry     = 0;
-	if (clients.entries == NULL) {
-		gflog_fatal_errno(GFARM_MSG_UNFIXED, "%s: no memory for %d bytes",
-						  diag, 10);
-	}
-	
-	db_lock(db_semid); {	
-		rc = sqlite3_exec(db, _sql, callback_form_conn_entries, &clients, &errmsg);
-	}; db_unlock(db_semid);
-	
-	if (rc != SQLITE_OK) {
-		gflog_error(GFARM_MSG_UNFIXED,
-					"Could not obtain clients list: %s", errmsg);
-		sqlite3_free(errmsg);
-		free(clients.entries);
-		return GFARM_ERR_SQL;
-	}
-
-	/* if (GET_SQL_WRAPPER_CURRENT_ARY_LEN(clients) > 1) { */
-	/* 	gflog_error(GFARM_MSG_1000018, */
-	/* 				"client record may not be unique: %s (%d rows)",  */
-	/* 				errmsg, */
-	/* 				GET_SQL_WRAPPER_CURRENT_ARY_LEN(clients)); */
-	/* } */
-
-	ary_size = (clients.valid_num_of_entry * (15 + 10 + 10 + 2)) + 1;
-	GFARM_MALLOC_ARRAY(s, ary_size);
-	memset(s, 0, ary_size);
-
-	for (i = 0 ; i < clients.valid_num_of_entry ; i++) {
-		snprintf(tmp, sizeof(tmp), "%u:%u/%u\n", 
-			SQL_WRAPPER_ENTRY(clients)[i].cliaddr, 
-			SQL_WRAPPER_ENTRY(clients)[i].total_hits,
-			SQL_WRAPPER_ENTRY(clients)[i].total_reads);
-		strcat(s, tmp);
-	}
-
-	free(clients.entries);
-	*result     = s;
-	*result_len = strlen(s);
-
-
-	gflog_error(GFARM_MSG_UNFIXED,"send value (%d clients): %s", 
-				clients.valid_num_of_entry, s);
-	
-	return GFARM_ERR_NO_ERROR;
-}
-
-gfarm_error_t
-gfp_clear_totalchit_and_total_read(sqlite3 *db, struct gfp_xdr *conn)
-{
-	int rc;
-	gfarm_error_t ret = GFARM_ERR_NO_ERROR;
-	char *errmsg = NULL;
-	char *_sql = 
-		"UPDATE clients SET total_reads = 0, total_hits = 0 WHERE id >= 0";
-	char *__sql = 
-		"DELETE from reads WHERE id >= 0";
-	
-	db_lock(db_semid); {	
-		rc = sqlite3_exec(db, _sql, 0, 0, &errmsg);
-		if (rc != SQLITE_OK) {
-			gflog_error(GFARM_MSG_1000018,
-						"Could not clear total_reads and total_hits: %s", errmsg);
-			sqlite3_free(errmsg);
-			ret = GFARM_ERR_SQL;
-			goto exit;
-		}
-
-		rc = sqlite3_exec(db, __sql, 0, 0, &errmsg);
-		if (rc != SQLITE_OK) {
-			gflog_error(GFARM_MSG_1000018,
-						"Could not delete lru cache buffer: %s", errmsg);
-			sqlite3_free(errmsg);
-			ret = GFARM_ERR_SQL;
-			goto exit;
-		}
-	}
- exit:
-	db_unlock(db_semid);
-
-	return ret;
-}
-
-void
-gfp_show_client_hitrates(struct gfp_xdr *conn)
-{
-	/* TODO: total_cache_hit and total_read is stored into DB */
-	double hitrate = (double)conn->total_cache_hit / (double)conn->total_read;
-	
-	conn->latest_cache_hitrate = hitrate;
-
-	gflog_info(GFARM_MSG_1004204, 
-          "############## <IP:%d> CACHE HIT RATE %lf (hit: %u / read: %u) ##############",
-		  conn->client_addr, hitrate, conn->total_cache_hit, conn->total_read);
-}
-
 void
 gfp_show_msg(struct gfp_xdr *conn, const char *msg)
 {
 	gflog_info(GFARM_MSG_1004205, "%s", msg);
 }
-
-/* struct client_entry { */
-/* 	gfarm_uint32_t client_addr; */
-/* }; */
-/* SQL_CALLBACK_WRAPPER_STRUCTURE(client); */
-
-/* void */
-/* gfp_get_allclients(struct gfp_xdr *conn, struct wrap_cache_entry *p) */
-/* { */
-/* 	char *_sql = "SELECT cliaddr FROM clients";	 */
-
-/* 	rc = sqlite3_exec(db, _sql, callback_form_cache_entries, &cache, &errmsg); */
-/* 	if (rc != SQLITE_OK) { */
-/* 		gflog_error(GFARM_MSG_1000018, */
-/* 					"Could not obtain native lru: %s", errmsg); */
-/* 		sqlite3_free(errmsg); */
-/* 		free(cache.entries); */
-/* 		return; */
-/* 	}	 */
-/* } */
-
-struct cache_entry {
-	gfarm_uint32_t client_id;
-	gfarm_uint64_t inum;
-	gfarm_uint64_t gnum;
-	gfarm_uint64_t pagenum;
-	gfarm_uint32_t count;
-};
-SQL_CALLBACK_WRAPPER_STRUCTURE(cache);
-
-static int
-callback_form_cache_entries(void *ptr, int argc, 
-	char **argv, char **azColName)
-{
-	int i;
-	int idx;
-	STRUCT_SQL_CALLBACK_WRAPPER(cache) *p = (STRUCT_SQL_CALLBACK_WRAPPER(cache)*)ptr;
-
-	SQL_CALLBACK_WRAPPER_GARD_ARYSIZE(p, 10);
-
-	P_INCREMENT_SQL_WRAPPER_ARY_LEN(p);
-	idx = P_GET_SQL_WRAPPER_CURRENT_ARY_LEN(p) - 1;
-	
-	for (i = 0 ; i < argc ; i++) {
-		if (strcmp(azColName[i], "client_id") == 0) {
-			P_SQL_WRAPPER_ENTRY(p)[idx].client_id = atoi(argv[i]);
-		} else if (strcmp(azColName[i], "inum") == 0) {
-			P_SQL_WRAPPER_ENTRY(p)[idx].inum = atoll(argv[i]);
-		} else if (strcmp(azColName[i], "gnum") == 0) {
-			P_SQL_WRAPPER_ENTRY(p)[idx].gnum = atoll(argv[i]);
-		} else if (strcmp(azColName[i], "pagenum") == 0) {
-			P_SQL_WRAPPER_ENTRY(p)[idx].pagenum = atoll(argv[i]);
-		} else if (strcmp(azColName[i], "count") == 0) {
-			P_SQL_WRAPPER_ENTRY(p)[idx].count = atoll(argv[i]);
-		}
-	}
-	
-	return SQLITE_OK;
-}
-
-void
-gfp_count_client_cachehits_by_naive_lru(sqlite3 *db, struct gfp_xdr *conn,
-	gfarm_int64_t ino, gfarm_int64_t gnum, gfarm_int64_t offset, 
-	size_t size, gfarm_uint64_t granularity,
-	gfarm_uint64_t clientcachememsize)
-{
-	static gfarm_uint64_t culm_iosize = 0;
-	static gfarm_uint64_t culm_count = 0;
-	char *errmsg = NULL;
-	int rc;
-	char sql[255];
-	/* char *_sql2 = */
-	/* 	"SELECT client_id, inum, gnum, pagenum, count" */
-	/* 	"      FROM reads where client_id = %u order by id desc limit %llu"; */
-	char *_sql2 =
-		"SELECT client_id, inum, gnum, pagenum, count"
-		"      FROM reads order by id desc limit %llu";
-	gfarm_uint64_t i, j;	
-	gfarm_uint64_t arysize = clientcachememsize / granularity;
-	STRUCT_SQL_CALLBACK_WRAPPER(cache) cache;
-
-	memset(&cache, 0, sizeof(STRUCT_SQL_CALLBACK_WRAPPER(cache)));
-	GFARM_MALLOC_ARRAY(cache.entries, arysize);
-	cache.allocated_entries_size = arysize;
-	cache.valid_num_of_entry     = 0;
-
-	/* gflog_debug(GFARM_MSG_1004206,  */
-	/* 			"update lru list: offset = %lu, size = %lu", offset, size); */
-
-	snprintf(sql, sizeof(sql), _sql2, arysize);
-
-	db_lock(db_semid); {	
-		rc = sqlite3_exec(db, sql, callback_form_cache_entries, &cache, &errmsg);
-	}; db_unlock(db_semid);
-	
-	if (rc != SQLITE_OK) {
-		gflog_error(GFARM_MSG_1000018,
-					"Could not obtain native lru: %s", errmsg);
-		sqlite3_free(errmsg);
-		free(cache.entries);
-		return;
-	}
-
-	conn->total_read      = 0;
-	conn->total_cache_hit = 0;
-
-	for (i = offset / granularity ; 
-		 i <= ((offset / granularity) + (size / granularity)) 
-			 ; i++) {
-		for (j = 0 ; j < cache.valid_num_of_entry ; j++) {
-			if ((cache.entries[j].inum == ino) &&
-				(cache.entries[j].gnum == gnum) &&
-				(cache.entries[j].pagenum == i)) {
-				/* Cache hit!!! */
-				conn->total_cache_hit++;
-				j = cache.valid_num_of_entry;
-			}
-		}
-		conn->total_read++;
-		culm_count++;	   
-	}
-	
-	gfp_update_totalchit_and_total_read(db, conn);
-
-	conn->total_read      = 0;
-	conn->total_cache_hit = 0;
-	
-	free(cache.entries);
-	return;
-}
-
-void
-gfp_update_reads_histgram(sqlite3 *db, struct gfp_xdr *conn, 
-	gfarm_int64_t ino, gfarm_int64_t gnum, gfarm_int64_t offset, 
-	size_t size, gfarm_uint64_t granularity)
-{
-	char *errmsg = NULL;
-	gfarm_uint64_t i;
-	gfarm_uint64_t count = 0;
-	int rc;
-	char sql[1024];
-	char *_sql = 
-		"INSERT into reads (entry_id, client_id, inum, gnum, pagenum, count)"
-		"       SELECT coalesce(entry_id, LAST_INSERT_ROWID()) , "
-		"              coalesce(client_id, %u), coalesce(inum, %u), coalesce(gnum, %u),"
-		"              coalesce(pagenum, %llu), coalesce(max(count) + 1, 1)"
-		"                     FROM reads where client_id = %u AND inum = %llu AND gnum = %llu AND pagenum = %llu";
-
-	for (i = offset / granularity ;
-		 i <= ((offset / granularity) + (size / granularity))
-			 ; i++) {
-		snprintf(sql, sizeof(sql), _sql, 
-				 conn->client_addr, ino, gnum, i, conn->client_addr, ino, gnum, i);
-		db_lock(db_semid); {
-			rc = sqlite3_exec(db, sql, 0, 0, &errmsg);
-		}; db_unlock(db_semid);
-		if (rc != SQLITE_OK) {
-			gflog_error(GFARM_MSG_1000018,
-						"Could not update reads histgram: %s", errmsg);
-			sqlite3_free(errmsg);
-		} else
-			count++;
-	}
-}
-
-gfarm_error_t
-gfp_client_insert_or_increment_read_count(sqlite3 *db, struct gfp_xdr *conn)
-{
-	int rc;
-	char *errmsg = NULL;
-	char sql[1024];
-	char *_sql = 
-		"INSERT into clients (cliaddr, total_reads, total_hits) "
-		"   SELECT coalesce(cliaddr, %u), coalesce(max(total_reads) + 1, 0), coalesce(total_hits, 0) "
-		"      FROM clients where cliaddr = %u";
-
-	snprintf(sql, sizeof(sql), _sql, conn->client_addr, conn->client_addr);
-	db_lock(db_semid); {	
-		rc = sqlite3_exec(db, sql, 0, 0, &errmsg);
-	}; db_unlock(db_semid);
-	if (rc != SQLITE_OK) {
-		gflog_error(GFARM_MSG_1000510,
-					"Could not increment total read count: %s", errmsg);
-		sqlite3_free(errmsg);
-		return GFARM_ERR_UNEXPECTED_EOF;
-	}
-
-	return GFARM_ERR_NO_ERROR;
-}
-
-gfarm_error_t
-gfp_client_insert_or_increment_total_hit(sqlite3 *db, struct gfp_xdr *conn)
-{
-	int rc;
-	char *errmsg = NULL;
-	char sql[1024];
-	char *_sql =
-		"INSERT into clients (cliaddr, total_reads, total_hits) "
-		"    SELECT coalesce(cliaddr, %u), coalesce(total_reads, 0), coalesce(max(total_hits) + 1, 0) "
-		"       FROM clients where cliaddr = %u";
-
-	snprintf(sql, sizeof(sql), _sql, conn->client_addr, conn->client_addr);
-	db_lock(db_semid); {	
-		rc = sqlite3_exec(db, sql, 0, 0, &errmsg);
-	}; db_unlock(db_semid);
-	if (rc != SQLITE_OK) {
-		gflog_error(GFARM_MSG_1000510,
-					"Could not increment total hit: %s", errmsg);
-		sqlite3_free(errmsg);
-		return GFARM_ERR_UNEXPECTED_EOF;
-	}
-
-	return GFARM_ERR_NO_ERROR;	
-}
-
-void
-gfp_create_histgram(sqlite3 **db, const char *dbname)
-{
-	int rc;
-	sqlite3 *db_p;
-	
-	/* 
-	 * for bayesian cache 
-	 */
-	rc = sqlite3_open(dbname, &db_p);
-	if (rc) {
-		sqlite3_close(db_p);
-		gflog_fatal_errno(GFARM_MSG_1000599, "Could not open database");
-	} else {
-		int second_chance = 1;
-		char *errmsg = NULL;
-		char create_clients[] = 
-			"create table clients ("
-			"                 id            INTEGER NOT NULL primary key AUTOINCREMENT,"
-			"                 cliaddr       INTEGER NOT NULL, "
-			"                 total_reads   INTEGER NOT NULL, "
-			"                 total_hits    INTEGER NOT NULL, "
-			"                 UNIQUE(cliaddr) ON CONFLICT REPLACE)";
-
-		char create_histgram_reads[] =
-			"create table reads ("
-			"                  id         INTEGER NOT NULL primary key AUTOINCREMENT,"
-			"                  entry_id   INTEGER NOT NULL,"
-			"                  client_id  INTEGER NOT NULL,"
-			"                  inum       UINT8 NOT NULL,"
-			"                  gnum       UINT8 NOT NULL,"
-			"                  pagenum    UINT8 NOT NULL,"
-			"                  count      INTEGER NOT NULL,"
-			"                  UNIQUE(entry_id) ON CONFLICT REPLACE)";		
-
-	create_table_1:
-		rc = sqlite3_exec(db_p, create_clients, 0, 0, &errmsg);
-		if (rc != SQLITE_OK) {
-			if (second_chance) {
-				rc = sqlite3_exec(db_p, "DROP TABLE clients", 0, 0, &errmsg);
-				if (rc != SQLITE_OK) {
-					gflog_fatal_errno(GFARM_MSG_1000599,
-									  "Could not drop table %s",
-									  errmsg); 
-					sqlite3_free(errmsg);
-				}
-				second_chance = 0;
-				goto create_table_1;
-			}
-			gflog_fatal_errno(GFARM_MSG_1000599,
-				  "Could not create or recreate a table for recording connected clients: %s",
-				  errmsg);
-		}
-
-		second_chance = 1;
-		
-	create_table_2:
-		rc = sqlite3_exec(db_p, create_histgram_reads, 0, 0, &errmsg);
-		if (rc != SQLITE_OK) {
-			if (second_chance) {
-				rc = sqlite3_exec(db_p, "DROP TABLE reads", 0, 0, &errmsg);
-				if (rc != SQLITE_OK) {
-					gflog_fatal_errno(GFARM_MSG_1000599,
-									  "Could not drop table %s",
-									  errmsg); 
-					sqlite3_free(errmsg);					
-				}
-				second_chance = 0;
-				goto create_table_2;
-			}
-			gflog_fatal_errno(GFARM_MSG_1000599,
-				   "Could not create or recreate a table for recording read histgrams: %s",
-				   errmsg);
-		}
-	}
-
-	*db = db_p;
-}
-
-void
-gfp_init_semaphore(void)
-{
-	db_semid = semget(IPC_PRIVATE, 1, 0666);
-	if (db_semid == EOF) {
-		gflog_fatal(GFARM_MSG_UNFIXED, "semaphore init error 1");
-	}
-	
-	if ((semctl(db_semid, 0, SETVAL, 1)) == EOF) {
-		gflog_fatal(GFARM_MSG_UNFIXED, "semaphore init error 2");
-	}
-}
-
-void gfp_free_histgram(sqlite3 *db)
-{
-	sqlite3_free(db);
-}
-
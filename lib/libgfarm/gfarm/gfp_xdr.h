@@ -21,8 +21,6 @@ struct gfp_xdr;
 struct gfp_xdr_async_server;
 struct sockaddr;
 
-#include <sqlite3.h>
-
 #define IS_CONNECTION_ERROR(e) \
 	((e) == GFARM_ERR_BROKEN_PIPE || (e) == GFARM_ERR_UNEXPECTED_EOF || \
 	 (e) == GFARM_ERR_PROTOCOL || \
@@ -62,6 +60,8 @@ void gfarm_iobuffer_set_nonblocking_write_xxx(struct gfarm_iobuffer *,
 
 int gfp_xdr_recv_is_ready(struct gfp_xdr *);
 gfarm_error_t gfp_xdr_flush(struct gfp_xdr *);
+gfarm_error_t gfp_xdr_send_file_range(struct gfp_xdr *, int,
+	gfarm_int64_t, size_t, size_t *);
 gfarm_error_t gfp_xdr_purge(struct gfp_xdr *, int, int);
 void gfp_xdr_purge_all(struct gfp_xdr *);
 gfarm_error_t gfp_xdr_vsend_size_add(size_t *, const char **, va_list *);
@@ -74,6 +74,7 @@ gfarm_error_t gfp_xdr_vrecv_sized(struct gfp_xdr *, int, int, size_t *,
 	int *, const char **, va_list *);
 gfarm_error_t gfp_xdr_vrecv(struct gfp_xdr *, int, int,
 	int *, const char **, va_list *);
+void gfp_xdr_vrecv_free(int, const char *, va_list *);
 
 gfarm_error_t gfp_xdr_send_size_add(size_t *, const char *, ...);
 gfarm_error_t gfp_xdr_send(struct gfp_xdr *, const char *, ...);
@@ -173,23 +174,6 @@ void gfp_xdr_sendbuffer_get_pos(struct gfp_xdr *, int *);
 void gfp_xdr_sendbuffer_overwrite_at(struct gfp_xdr *, const void *, int, int);
 
 /* for bayesian cache */
-void gfp_record_client(sqlite3 *, struct gfp_xdr *, struct sockaddr *);
-void gfp_update_histgram_entries(sqlite3 *, struct gfp_xdr *, gfarm_int64_t, gfarm_int64_t);
-void gfp_update_reads_histgram(sqlite3 *, struct gfp_xdr *, gfarm_int64_t, 
-	 gfarm_int64_t, gfarm_int64_t, size_t, gfarm_uint64_t);
-gfarm_error_t gfp_update_totalchit_and_total_read(sqlite3 *, struct gfp_xdr *);
-gfarm_error_t gfp_clear_totalchit_and_total_read(sqlite3 *, struct gfp_xdr *);
-gfarm_error_t gfp_get_totalchit_and_total_read(sqlite3 *, struct gfp_xdr *, 
-	 const char *, char **, int *);
-void gfp_show_client_hitrates(struct gfp_xdr *);
-void gfp_create_histgram(sqlite3 **, const char *);
-void gfp_init_semaphore(void);
-void gfp_free_histgram(sqlite3 *);
-
-void gfp_count_client_cachehits_by_naive_lru(sqlite3 *, struct gfp_xdr *,
-	gfarm_int64_t, gfarm_int64_t, gfarm_int64_t, 
-	size_t, gfarm_uint64_t, gfarm_uint64_t);
-
 void gfp_show_msg(struct gfp_xdr *, const char *);
 
 /* gfp_xdr_client.c */
@@ -371,26 +371,33 @@ gfp_xdr_vrecv_request_parameters(struct gfp_xdr *client, int just,
 {
 	gfarm_error_t e;
 	int eof;
+	const char *format_start = format;
+	va_list ap_start;
 
+	va_copy(ap_start, *app);
 	/* always do timeout here, because request type is already received */
 	e = gfp_xdr_vrecv_sized(client, just, 1, sizep, &eof, &format, app);
-	if (e != GFARM_ERR_NO_ERROR)
-		return (e);
-	if (eof)
-		return (GFARM_ERR_UNEXPECTED_EOF);
-	if (*format != '\0') {
+	if (e != GFARM_ERR_NO_ERROR) {
+		; /* parameters are already freed */
+	} else if (eof) {
+		e = GFARM_ERR_UNEXPECTED_EOF;
+	} else if (*format != '\0') {
 		gflog_debug(GFARM_MSG_1001017,
 		    "gfp_xdr_vrecv_request_parameters: "
 		    "invalid format character: %c(%x)", *format, *format);
-		return (GFARM_ERRMSG_GFP_XDR_VRPC_INVALID_FORMAT_CHARACTER);
-	}
-	if (sizep != NULL && *sizep != 0) {
+		e = GFARM_ERRMSG_GFP_XDR_VRPC_INVALID_FORMAT_CHARACTER;
+		gfp_xdr_vrecv_free(format - format_start, format_start,
+		    &ap_start);
+	} else if (sizep != NULL && *sizep != 0) {
 		gflog_debug(GFARM_MSG_1001018,
 		    "gfp_xdr_vrecv_request_parameters: residual %d bytes",
 		    (int)*sizep);
-		return (GFARM_ERR_PROTOCOL);
+		e = GFARM_ERR_PROTOCOL;
+		gfp_xdr_vrecv_free(format - format_start, format_start,
+		    &ap_start);
 	}
-	return (GFARM_ERR_NO_ERROR);
+	va_end(ap_start);
+	return (e);
 }
 
 /* the caller should call gfp_xdr_flush() after this function */
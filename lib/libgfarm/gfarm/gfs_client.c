@@ -85,6 +85,29 @@ struct gfs_connection {
 	void *context; /* work area for RPC (esp. GFS_PROTO_COMMAND) */
 
 	int failover_count; /* compare to gfm_connection.failover_count */
+
+	/* outstanding gfs_client_async_io, in order of the requests */
+	struct gfs_client_async_io *async_head, **async_tail;
+	int async_reads;
+};
+
+/*
+ * asynchronous GFS_PROTO_PREAD/GFS_PROTO_PWRITE.
+ * the result is received into "buffer", when the caller waits for it,
+ * or when another request is going to be sent on the connection.
+ */
+struct gfs_client_async_io {
+	struct gfs_client_async_io *next;
+	struct gfp_xdr_xid_record *xidr;
+
+	int is_write;
+	char *buffer;
+	size_t size;
+
+	/* result */
+	int done;
+	gfarm_error_t error;
+	size_t length;
 };
 
 #define staticp	(gfarm_ctxp->gfs_client_static)
@@ -97,6 +120,10 @@ struct gfs_client_static {
 	int self_ip_asked;
 	int self_ip_count;
 	struct in_addr *self_ip_list;
+
+	/* gfs_client_async_io_reserve() */
+	pthread_mutex_t async_io_mutex;
+	size_t async_io_bytes;
 };
 
 #define SERVER_HASHTAB_SIZE	3079	/* prime number */
@@ -121,6 +148,9 @@ gfs_client_static_init(struct gfarm_context *ctxp)
 	s->self_ip_asked = 0;
 	s->self_ip_count = 0;
 	s->self_ip_list = NULL;
+	gfarm_mutex_init(&s->async_io_mutex, "gfs_client_static_init",
+	    "async_io");
+	s->async_io_bytes = 0;
 
 	ctxp->gfs_client_static = s;
 	return (GFARM_ERR_NO_ERROR);
@@ -136,6 +166,8 @@ gfs_client_static_term(struct gfarm_context *ctxp)
 
 	gfp_conn_cache_term(&s->server_cache);
 	free(staticp->self_ip_list);
+	gfarm_mutex_destroy(&s->async_io_mutex, "gfs_client_static_term",
+	    "async_io");
 	free(s);
 }
 
@@ -446,6 +478,9 @@ gfs_client_connection_alloc(const char *canonical_hostname,
 	gfs_server->context = NULL;
 	gfs_server->opened = 0;
 	gfs_server->failover_count = failover_count;
+	gfs_server->async_head = NULL;
+	gfs_server->async_tail = &gfs_server->async_head;
+	gfs_server->async_reads = 0;
 
 	gfs_server->cache_entry = cache_entry;
 	gfp_cached_connection_set_data(cache_entry, gfs_server);
@@ -575,6 +610,9 @@ gfsk_client_connection_alloc_and_auth(struct gfarm_eventqueue *q,
 	gfs_server->context = NULL;
 	gfs_server->opened = 0;
 	gfs_server->failover_count = failover_count;
+	gfs_server->async_head = NULL;
+	gfs_server->async_tail = &gfs_server->async_head;
+	gfs_server->async_reads = 0;
 
 	gfs_server->cache_entry = cache_entry;
 	gfp_cached_connection_set_data(cache_entry, gfs_server);
@@ -604,6 +642,7 @@ gfs_client_connection_dispose(void *connection_data)
 	gfp_uncached_connection_dispose(gfs_server->cache_entry);
 	free(gfs_server->hostname);
 	/* XXX - gfs_server->context should be NULL here */
+	/* XXX - gfs_server->async_head should be NULL here too */
 	free(gfs_server);
 	return (e);
 }
@@ -1300,18 +1339,18 @@ gfarm_fd_receive_message(int fd, void *buf, size_t size,
 	return (0); /* success */
 }
 
-gfarm_error_t
-gfs_client_rpc_request(struct gfs_connection *gfs_server,
+static void gfs_client_async_io_drain(struct gfs_connection *,
+	struct gfs_client_async_io *);
+
+static gfarm_error_t
+gfs_client_vrpc_request(struct gfs_connection *gfs_server,
 	struct gfp_xdr_xid_record **xidrp,
-	int command, const char *format, ...)
+	int command, const char **formatp, va_list *app)
 {
-	va_list ap;
 	gfarm_error_t e;
 
-	va_start(ap, format);
 	e = gfp_xdr_vrpc_raw_request(gfs_server->conn, xidrp,
-	    command, &format, &ap);
-	va_end(ap);
+	    command, formatp, app);
 	if (IS_CONNECTION_ERROR(e)) {
 		gfs_client_execute_hook_for_connection_error(gfs_server);
 		gfs_client_purge_from_cache(gfs_server);
@@ -1324,6 +1363,23 @@ gfs_client_rpc_request(struct gfs_connection *gfs_server,
 	return (e);
 }
 
+gfarm_error_t
+gfs_client_rpc_request(struct gfs_connection *gfs_server,
+	struct gfp_xdr_xid_record **xidrp,
+	int command, const char *format, ...)
+{
+	va_list ap;
+	gfarm_error_t e;
+
+	/* the results of asynchronous requests have to be received first */
+	gfs_client_async_io_drain(gfs_server, NULL);
+
+	va_start(ap, format);
+	e = gfs_client_vrpc_request(gfs_server, xidrp, command, &format, &ap);
+	va_end(ap);
+	return (e);
+}
+
 gfarm_error_t
 gfs_client_rpc_result(struct gfs_connection *gfs_server, int just,
 	struct gfp_xdr_xid_record *xidr, const char *format, ...)
@@ -1382,6 +1438,7 @@ gfs_client_vrpc(struct gfs_connection *gfs_server, int just, int do_timeout,
 	int errcode;
 
 	gfs_client_connection_used(gfs_server);
+	gfs_client_async_io_drain(gfs_server, NULL);
 
 	e = gfp_xdr_vrpc(gfs_server->conn, just, do_timeout,
 	    command, &errcode, &format, app);
@@ -1625,6 +1682,355 @@ gfs_client_pwrite(struct gfs_connection *gfs_server,
 	return (GFARM_ERR_NO_ERROR);
 }
 
+/*
+ * pipelined GFS_PROTO_PREAD/GFS_PROTO_PWRITE.
+ *
+ * the range is split into GFS_PROTO_MAX_IOSIZE requests, and at most
+ * "window" requests are outstanding on the connection.  gfsd serves
+ * the requests of a connection in order, thus the results are received
+ * in the order of the requests.
+ * no more request is sent after the first short read/write or error,
+ * but the results of all requests which have been already sent are
+ * received, and "*np" is the length of the contiguous range from "off"
+ * which has been transferred successfully.
+ * NOTE: in the write case, the requests after the failed one may have
+ * been stored beyond "*np", and then an error is returned instead,
+ * because the file may have been extended with a hole at "off + *np".
+ */
+static gfarm_error_t
+gfs_client_pio_pipelined(struct gfs_connection *gfs_server, int is_write,
+	gfarm_int32_t fd, char *buffer, size_t size, gfarm_off_t off,
+	int window, size_t *np)
+{
+	gfarm_error_t e, e_save = GFARM_ERR_NO_ERROR;
+	struct gfp_xdr_xid_record **xidrs;
+	size_t n = 0, beyond = 0, pos, chunk, len;
+	gfarm_int32_t wlen;
+	int nreqs, nsent = 0, nrecvd = 0, done = 0, contiguous = 1;
+
+	nreqs = (size + GFS_PROTO_MAX_IOSIZE - 1) / GFS_PROTO_MAX_IOSIZE;
+	if (window > nreqs)
+		window = nreqs;
+	GFARM_MALLOC_ARRAY(xidrs, window);
+	if (xidrs == NULL) {
+		gflog_debug(GFARM_MSG_UNFIXED,
+		    "gfs_client_pio_pipelined: no memory for %d requests",
+		    window);
+		return (GFARM_ERR_NO_MEMORY);
+	}
+
+	gfs_client_connection_lock(gfs_server);
+	for (;;) {
+		while (!done && nsent < nreqs && nsent - nrecvd < window) {
+			pos = (size_t)nsent * GFS_PROTO_MAX_IOSIZE;
+			chunk = size - pos < GFS_PROTO_MAX_IOSIZE ?
+			    size - pos : GFS_PROTO_MAX_IOSIZE;
+			if (is_write)
+				e = gfs_client_rpc_request(gfs_server,
+				    &xidrs[nsent % window], GFS_PROTO_PWRITE,
+				    "ibl", fd, chunk, buffer + pos, off + pos);
+			else
+				e = gfs_client_rpc_request(gfs_server,
+				    &xidrs[nsent % window], GFS_PROTO_PREAD,
+				    "iil", fd, (int)chunk, off + pos);
+			if (e != GFARM_ERR_NO_ERROR) {
+				e_save = e;
+				done = 1;
+				break;
+			}
+			nsent++;
+		}
+		/* drain the results of all requests sent */
+		if (nrecvd == nsent)
+			break;
+
+		pos = (size_t)nrecvd * GFS_PROTO_MAX_IOSIZE;
+		chunk = size - pos < GFS_PROTO_MAX_IOSIZE ?
+		    size - pos : GFS_PROTO_MAX_IOSIZE;
+		if (is_write) {
+			e = gfs_client_rpc_result(gfs_server, 0,
+			    xidrs[nrecvd % window], "i", &wlen);
+			len = wlen;
+		} else {
+			/* the data beyond "*np" is not meaningful */
+			e = gfs_client_rpc_result(gfs_server, 0,
+			    xidrs[nrecvd % window], "b", chunk, &len,
+			    buffer + pos);
+		}
+		nrecvd++;
+		if (e == GFARM_ERR_NO_ERROR && len > chunk) {
+			gflog_debug(GFARM_MSG_UNFIXED,
+			    "Protocol error in client pipelined %s "
+			    "(%llu)>(%llu)", is_write ? "pwrite" : "pread",
+			    (unsigned long long)len,
+			    (unsigned long long)chunk);
+			e = is_write ?
+			    GFARM_ERRMSG_GFS_PROTO_PWRITE_PROTOCOL :
+			    GFARM_ERRMSG_GFS_PROTO_PREAD_PROTOCOL;
+		}
+		if (e != GFARM_ERR_NO_ERROR) {
+			gflog_debug(GFARM_MSG_UNFIXED,
+			    "gfs_client_pio_pipelined: %s: %s",
+			    is_write ? "pwrite" : "pread",
+			    gfarm_error_string(e));
+			if (contiguous)
+				e_save = e;
+			contiguous = 0;
+			done = 1;
+			if (IS_CONNECTION_ERROR(e)) /* cannot receive the rest */
+				break;
+			continue;
+		}
+		if (!contiguous) {
+			beyond += len;
+			continue;
+		}
+		n += len;
+		if (len < chunk) {
+			contiguous = 0;
+			done = 1;
+		}
+	}
+	gfs_client_connection_unlock(gfs_server);
+	free(xidrs);
+
+	if (is_write && beyond > 0) {
+		if (e_save == GFARM_ERR_NO_ERROR) /* short write */
+			e_save = GFARM_ERR_NO_SPACE;
+		gflog_warning(GFARM_MSG_UNFIXED,
+		    "gfs_client_pio_pipelined: pwrite: %llu bytes at %llu, "
+		    "but %llu bytes beyond it are also written: %s",
+		    (unsigned long long)n, (unsigned long long)off,
+		    (unsigned long long)beyond, gfarm_error_string(e_save));
+		return (e_save);
+	}
+	/* report the error at the next call, if some data is transferred */
+	if (n == 0 && e_save != GFARM_ERR_NO_ERROR)
+		return (e_save);
+	*np = n;
+	return (GFARM_ERR_NO_ERROR);
+}
+
+gfarm_error_t
+gfs_client_pread_pipelined(struct gfs_connection *gfs_server,
+	gfarm_int32_t fd, void *buffer, size_t size,
+	gfarm_off_t off, int window, size_t *np)
+{
+	return (gfs_client_pio_pipelined(gfs_server, 0,
+	    fd, buffer, size, off, window, np));
+}
+
+gfarm_error_t
+gfs_client_pwrite_pipelined(struct gfs_connection *gfs_server,
+	gfarm_int32_t fd, const void *buffer, size_t size,
+	gfarm_off_t off, int window, size_t *np)
+{
+	/* the buffer is not modified in the write case */
+	return (gfs_client_pio_pipelined(gfs_server, 1,
+	    fd, (char *)buffer, size, off, window, np));
+}
+
+static const char async_io_diag[] = "gfs_client_async_io";
+
+/*
+ * reserve "size" bytes of client_file_async_io_budget.
+ * returns 0, if the budget is exhausted.
+ */
+int
+gfs_client_async_io_reserve(size_t size)
+{
+	int ok;
+
+	gfarm_mutex_lock(&staticp->async_io_mutex, async_io_diag, "reserve");
+	ok = staticp->async_io_bytes + size <=
+	    (size_t)gfarm_ctxp->client_file_async_io_budget;
+	if (ok)
+		staticp->async_io_bytes += size;
+	gfarm_mutex_unlock(&staticp->async_io_mutex, async_io_diag, "reserve");
+	return (ok);
+}
+
+void
+gfs_client_async_io_unreserve(size_t size)
+{
+	gfarm_mutex_lock(&staticp->async_io_mutex, async_io_diag, "unreserve");
+	staticp->async_io_bytes -= size;
+	gfarm_mutex_unlock(&staticp->async_io_mutex, async_io_diag,
+	    "unreserve");
+}
+
+/*
+ * receive the results of outstanding asynchronous requests until "until"
+ * is done, or all of them if "until" is NULL.
+ * the connection lock has to be held.
+ */
+static void
+gfs_client_async_io_drain(struct gfs_connection *gfs_server,
+	struct gfs_client_async_io *until)
+{
+	struct gfs_client_async_io *io;
+	gfarm_error_t e_conn = GFARM_ERR_NO_ERROR;
+	gfarm_int32_t n; /* size_t may be 64bit */
+
+	while ((io = gfs_server->async_head) != NULL) {
+		if ((gfs_server->async_head = io->next) == NULL)
+			gfs_server->async_tail = &gfs_server->async_head;
+		if (!io->is_write)
+			--gfs_server->async_reads;
+
+		io->length = 0;
+		if (e_conn != GFARM_ERR_NO_ERROR) {
+			io->error = e_conn;
+		} else if (io->is_write) {
+			io->error = gfs_client_rpc_result(gfs_server, 0,
+			    io->xidr, "i", &n);
+			if (io->error == GFARM_ERR_NO_ERROR) {
+				io->length = n;
+				if (io->length > io->size)
+					io->error =
+					    GFARM_ERRMSG_GFS_PROTO_PWRITE_PROTOCOL;
+			}
+		} else {
+			io->error = gfs_client_rpc_result(gfs_server, 0,
+			    io->xidr, "b", io->size, &io->length, io->buffer);
+			if (io->error == GFARM_ERR_NO_ERROR &&
+			    io->length > io->size)
+				io->error = GFARM_ERRMSG_GFS_PROTO_PREAD_PROTOCOL;
+		}
+		if (IS_CONNECTION_ERROR(io->error)) /* cannot receive the rest */
+			e_conn = io->error;
+		io->done = 1;
+		if (io == until && e_conn == GFARM_ERR_NO_ERROR)
+			break;
+	}
+}
+
+static gfarm_error_t
+gfs_client_async_rpc_request(struct gfs_connection *gfs_server,
+	struct gfp_xdr_xid_record **xidrp,
+	int command, const char *format, ...)
+{
+	va_list ap;
+	gfarm_error_t e;
+
+	va_start(ap, format);
+	e = gfs_client_vrpc_request(gfs_server, xidrp, command, &format, &ap);
+	va_end(ap);
+	return (e);
+}
+
+static gfarm_error_t
+gfs_client_async_io_request(struct gfs_connection *gfs_server, int is_write,
+	gfarm_int32_t fd, char *buffer, size_t size, gfarm_off_t off,
+	struct gfs_client_async_io **iop)
+{
+	gfarm_error_t e;
+	struct gfs_client_async_io *io;
+
+	if (size > GFS_PROTO_MAX_IOSIZE)
+		size = GFS_PROTO_MAX_IOSIZE;
+	GFARM_MALLOC(io);
+	if (io == NULL) {
+		gflog_debug(GFARM_MSG_UNFIXED,
+		    "allocation of gfs_client_async_io failed");
+		return (GFARM_ERR_NO_MEMORY);
+	}
+	io->next = NULL;
+	io->is_write = is_write;
+	io->buffer = buffer;
+	io->size = size;
+	io->done = 0;
+	io->error = GFARM_ERR_NO_ERROR;
+	io->length = 0;
+
+	gfs_client_connection_lock(gfs_server);
+	/*
+	 * gfsd may be blocked to send the results of GFS_PROTO_PREAD,
+	 * thus they have to be received before sending a large request.
+	 */
+	if (is_write && gfs_server->async_reads > 0)
+		gfs_client_async_io_drain(gfs_server, NULL);
+	if (is_write)
+		e = gfs_client_async_rpc_request(gfs_server, &io->xidr,
+		    GFS_PROTO_PWRITE, "ibl", fd, size, buffer, off);
+	else
+		e = gfs_client_async_rpc_request(gfs_server, &io->xidr,
+		    GFS_PROTO_PREAD, "iil", fd, (int)size, off);
+	if (e == GFARM_ERR_NO_ERROR) {
+		/* let gfsd start the I/O now */
+		e = gfp_xdr_flush(gfs_server->conn);
+		if (IS_CONNECTION_ERROR(e)) {
+			gfs_client_execute_hook_for_connection_error(
+			    gfs_server);
+			gfs_client_purge_from_cache(gfs_server);
+		}
+	}
+	if (e == GFARM_ERR_NO_ERROR) {
+		*gfs_server->async_tail = io;
+		gfs_server->async_tail = &io->next;
+		if (!is_write)
+			++gfs_server->async_reads;
+	}
+	gfs_client_connection_unlock(gfs_server);
+
+	if (e != GFARM_ERR_NO_ERROR) {
+		free(io);
+		gflog_debug(GFARM_MSG_UNFIXED,
+		    "gfs_client_async_io_request: %s", gfarm_error_string(e));
+		return (e);
+	}
+	*iop = io;
+	return (GFARM_ERR_NO_ERROR);
+}
+
+/*
+ * send GFS_PROTO_PREAD without waiting for the result.
+ * at most GFS_PROTO_MAX_IOSIZE bytes are requested, and they will be
+ * stored into "buffer", which has to be kept until
+ * gfs_client_async_io_result() is called.
+ */
+gfarm_error_t
+gfs_client_pread_request(struct gfs_connection *gfs_server,
+	gfarm_int32_t fd, void *buffer, size_t size, gfarm_off_t off,
+	struct gfs_client_async_io **iop)
+{
+	return (gfs_client_async_io_request(gfs_server, 0,
+	    fd, buffer, size, off, iop));
+}
+
+/*
+ * send GFS_PROTO_PWRITE without waiting for the result.
+ * at most GFS_PROTO_MAX_IOSIZE bytes are written.
+ * "buffer" can be reused as soon as this function returns.
+ */
+gfarm_error_t
+gfs_client_pwrite_request(struct gfs_connection *gfs_server,
+	gfarm_int32_t fd, const void *buffer, size_t size, gfarm_off_t off,
+	struct gfs_client_async_io **iop)
+{
+	/* the buffer is not modified in the write case */
+	return (gfs_client_async_io_request(gfs_server, 1,
+	    fd, (char *)buffer, size, off, iop));
+}
+
+/* wait for the result of an asynchronous request, and free "io" */
+gfarm_error_t
+gfs_client_async_io_result(struct gfs_connection *gfs_server,
+	struct gfs_client_async_io *io, size_t *np)
+{
+	gfarm_error_t e;
+
+	gfs_client_connection_lock(gfs_server);
+	if (!io->done)
+		gfs_client_async_io_drain(gfs_server, io);
+	gfs_client_connection_unlock(gfs_server);
+
+	e = io->error;
+	*np = io->length;
+	free(io);
+	return (e);
+}
+
 gfarm_error_t
 gfs_client_write(struct gfs_connection *gfs_server,
 	gfarm_int32_t fd, const void *buffer, size_t size,
@@ -1918,6 +2324,8 @@ gfs_client_ctx_rpc_request(struct gfs_connection *gfs_server,
 	va_list ap;
 	gfarm_error_t e;
 
+	gfs_client_async_io_drain(gfs_server, NULL);
+
 	va_start(ap, format);
 	e = gfp_xdr_vrpc_request(gfs_server->conn, ctx, command, &format, &ap);
 	va_end(ap);
@@ -2257,6 +2665,114 @@ gfs_client_replica_recv(struct gfs_connection *gfs_server,
 	return (e);
 #endif /* implementation until gfarm-2.X and before */
 }
+
+#define REPLICA_RECV_CHAIN_WAIT_MIN	(10 * 1000 * 1000) /* 10ms */
+#define REPLICA_RECV_CHAIN_WAIT_MAX	(500 * 1000 * 1000) /* 500ms */
+
+/*
+ * same as gfs_client_replica_recv(), but the replica at gfs_server may
+ * be still being written by another replication, i.e. the source is
+ * the previous hop of a replication chain.
+ * thus, a short read doesn't mean EOF until `size' bytes are received,
+ * and we wait for the source to catch up, until network_receive_timeout
+ * passes without any progress.
+ */
+gfarm_error_t
+gfs_client_replica_recv_chain(struct gfs_connection *gfs_server,
+	gfarm_ino_t ino, gfarm_uint64_t gen, gfarm_off_t size,
+	gfarm_int32_t local_fd,
+	gfarm_error_t *e_localp, gfarm_error_t *e_remotep)
+{
+	char *buffer;
+	gfarm_error_t e_remote, e_local = GFARM_ERR_NO_ERROR, e2;
+	gfarm_int32_t remote_fd;
+	gfarm_off_t offset = 0;
+	unsigned long long wait = REPLICA_RECV_CHAIN_WAIT_MIN;
+	time_t progress = time(NULL);
+	size_t got, i;
+	ssize_t rv = 0;
+	static const char diag[] = "gfs_client_replica_recv_chain";
+
+	GFARM_MALLOC_ARRAY(buffer, GFS_PROTO_MAX_IOSIZE);
+	if (buffer == NULL) {
+		*e_localp = GFARM_ERR_NO_MEMORY;
+		*e_remotep = GFARM_ERR_NO_ERROR;
+		return (GFARM_ERR_NO_MEMORY);
+	}
+	e_remote = gfs_client_rpc(gfs_server, 0, GFS_PROTO_FHOPEN,
+	    "ll/i", ino, gen, &remote_fd);
+	if (e_remote != GFARM_ERR_NO_ERROR) {
+		if (IS_CONNECTION_ERROR(e_remote)) {
+			gfs_client_execute_hook_for_connection_error(
+			    gfs_server);
+			gfs_client_purge_from_cache(gfs_server);
+		}
+		gflog_debug(GFARM_MSG_UNFIXED,
+		    "%s: GFS_PROTO_FHOPEN failed: %s",
+		    diag, gfarm_error_string(e_remote));
+		free(buffer);
+		*e_localp = GFARM_ERR_NO_ERROR;
+		*e_remotep = e_remote;
+		return (e_remote);
+	}
+	while (offset < size) {
+		e_remote = gfs_client_pread(gfs_server, remote_fd, buffer,
+		    size - offset < GFS_PROTO_MAX_IOSIZE ?
+		    (size_t)(size - offset) : GFS_PROTO_MAX_IOSIZE,
+		    offset, &got);
+		if (e_remote != GFARM_ERR_NO_ERROR) {
+			gflog_error(GFARM_MSG_UNFIXED,
+			    "%s: GFS_PROTO_PREAD: %s",
+			    diag, gfarm_error_string(e_remote));
+			break;
+		}
+		if (got == 0) {
+			/* the previous hop hasn't written this part yet */
+			if (time(NULL) - progress >
+			    gfarm_ctxp->network_receive_timeout) {
+				e_remote = GFARM_ERR_OPERATION_TIMED_OUT;
+				gflog_error(GFARM_MSG_UNFIXED,
+				    "%s: %lld:%lld: no progress at offset "
+				    "%lld/%lld within %d seconds "
+				    "(network_receive_timeout)", diag,
+				    (long long)ino, (long long)gen,
+				    (long long)offset, (long long)size,
+				    (int)gfarm_ctxp->network_receive_timeout);
+				break;
+			}
+			gfarm_nanosleep(wait);
+			if (wait < REPLICA_RECV_CHAIN_WAIT_MAX)
+				wait += wait;
+			continue;
+		}
+		for (i = 0; i < got; i += rv) {
+			rv = write(local_fd, buffer + i, got - i);
+			if (rv == -1)
+				break;
+			gfarm_iostat_local_add(GFARM_IOSTAT_IO_WCOUNT, 1);
+			gfarm_iostat_local_add(GFARM_IOSTAT_IO_WBYTES, rv);
+		}
+		if (i < got) {
+			e_local = gfarm_errno_to_error(
+			    rv == 0 ? ENOSPC : errno);
+			break;
+		}
+		offset += got;
+		progress = time(NULL);
+		wait = REPLICA_RECV_CHAIN_WAIT_MIN;
+	}
+	e2 = gfs_client_close(gfs_server, remote_fd);
+	if (e2 != GFARM_ERR_NO_ERROR) {
+		gflog_debug(GFARM_MSG_UNFIXED,
+		    "%s: GFS_PROTO_CLOSE(%d): %s",
+		    diag, remote_fd, gfarm_error_string(e2));
+	}
+	free(buffer);
+
+	*e_localp = e_local;
+	*e_remotep = e_remote;
+	return (e_remote != GFARM_ERR_NO_ERROR ? e_remote : e_local);
+}
 #endif /* __KERNEL__ */
 
 /*
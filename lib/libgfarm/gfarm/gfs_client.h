@@ -69,6 +69,21 @@ gfarm_error_t gfs_client_pread(struct gfs_connection *,
 gfarm_error_t gfs_client_pwrite(struct gfs_connection *,
 			gfarm_int32_t, const void *, size_t, gfarm_off_t,
 			size_t *);
+gfarm_error_t gfs_client_pread_pipelined(struct gfs_connection *,
+	gfarm_int32_t, void *, size_t, gfarm_off_t, int, size_t *);
+gfarm_error_t gfs_client_pwrite_pipelined(struct gfs_connection *,
+	gfarm_int32_t, const void *, size_t, gfarm_off_t, int, size_t *);
+struct gfs_client_async_io;
+int gfs_client_async_io_reserve(size_t);
+void gfs_client_async_io_unreserve(size_t);
+gfarm_error_t gfs_client_pread_request(struct gfs_connection *,
+	gfarm_int32_t, void *, size_t, gfarm_off_t,
+	struct gfs_client_async_io **);
+gfarm_error_t gfs_client_pwrite_request(struct gfs_connection *,
+	gfarm_int32_t, const void *, size_t, gfarm_off_t,
+	struct gfs_client_async_io **);
+gfarm_error_t gfs_client_async_io_result(struct gfs_connection *,
+	struct gfs_client_async_io *, size_t *);
 gfarm_error_t gfs_client_write(struct gfs_connection *,
 			gfarm_int32_t, const void *, size_t,
 			size_t *, gfarm_off_t *, gfarm_off_t *);
@@ -96,6 +111,9 @@ gfarm_error_t gfs_client_replica_add_from(struct gfs_connection *,
 gfarm_error_t gfs_client_replica_recv(struct gfs_connection *,
 	gfarm_ino_t, gfarm_uint64_t, gfarm_int32_t,
 	gfarm_error_t *, gfarm_error_t *);
+gfarm_error_t gfs_client_replica_recv_chain(struct gfs_connection *,
+	gfarm_ino_t, gfarm_uint64_t, gfarm_off_t, gfarm_int32_t,
+	gfarm_error_t *, gfarm_error_t *);
 gfarm_error_t gfs_client_statfs(struct gfs_connection *, char *,
 	gfarm_int32_t *,
 	gfarm_off_t *, gfarm_off_t *, gfarm_off_t *,
@@ -29,6 +29,7 @@ struct stat_cache_data {
 	struct stat_cache_data *next, *prev; /* doubly linked circular list */
 	struct gfarm_hash_entry *entry;
 	struct timeval expiration;
+	int negative; /* caches nonexistence of the path, st is not set */
 	struct gfs_stat st;
 	int nattrs;
 	char **attrnames;
@@ -44,22 +45,37 @@ struct stat_cache {
 	struct timeval lifespan;
 	int count;
 	int lifespan_is_set;
+
+	/*
+	 * doubly linked circular list head of negative entries,
+	 * which have shorter lifespan than data_list.
+	 */
+	struct stat_cache_data negative_list;
+	struct timeval negative_lifespan;
 };
 
 #define STAT_CACHE_DATA_HEAD(c) (&(c)->data_list)
+#define STAT_CACHE_NEGATIVE_HEAD(c) (&(c)->negative_list)
 #define FOREACH_STAT_CACHE_DATA(p, c) \
 	for (p = (c)->data_list.next; \
 		p != STAT_CACHE_DATA_HEAD(c); p = p->next)
 #define FOREACH_STAT_CACHE_DATA_SAFE(p, q, c) \
 	for (p = (c)->data_list.next, q = p->next; \
 		p != STAT_CACHE_DATA_HEAD(c); p = q, q = p->next)
+#define FOREACH_STAT_CACHE_LIST_SAFE(p, q, h) \
+	for (p = (h)->next, q = p->next; p != (h); p = q, q = p->next)
 
 static struct stat_cache stat_cache = {
 	{
 		STAT_CACHE_DATA_HEAD(&stat_cache),
 		STAT_CACHE_DATA_HEAD(&stat_cache),
 	},
-	gfs_stat
+	gfs_stat,
+	NULL, { 0, 0 }, 0, 0,
+	{
+		STAT_CACHE_NEGATIVE_HEAD(&stat_cache),
+		STAT_CACHE_NEGATIVE_HEAD(&stat_cache),
+	},
 };
 
 static struct stat_cache lstat_cache = {
@@ -67,9 +83,39 @@ static struct stat_cache lstat_cache = {
 		STAT_CACHE_DATA_HEAD(&lstat_cache),
 		STAT_CACHE_DATA_HEAD(&lstat_cache),
 	},
-	gfs_lstat
+	gfs_lstat,
+	NULL, { 0, 0 }, 0, 0,
+	{
+		STAT_CACHE_NEGATIVE_HEAD(&lstat_cache),
+		STAT_CACHE_NEGATIVE_HEAD(&lstat_cache),
+	},
 };
 
+/* gfarm_attr_cache_negative_timeout, but not longer than the lifespan */
+static void
+gfs_stat_cache_negative_lifespan_set(struct stat_cache *cache)
+{
+	int timeout = gfarm_ctxp->attr_cache_negative_timeout;
+
+	if (timeout < 0)
+		timeout = 0;
+	cache->negative_lifespan.tv_sec = timeout /
+	    (GFARM_SECOND_BY_MICROSEC / GFARM_MILLISEC_BY_MICROSEC);
+	cache->negative_lifespan.tv_usec = (timeout -
+	    cache->negative_lifespan.tv_sec *
+	    (GFARM_SECOND_BY_MICROSEC / GFARM_MILLISEC_BY_MICROSEC)) *
+	    GFARM_MILLISEC_BY_MICROSEC;
+	if (gfarm_timeval_cmp(&cache->negative_lifespan, &cache->lifespan) > 0)
+		cache->negative_lifespan = cache->lifespan;
+}
+
+static int
+gfs_stat_cache_negative_is_enabled(struct stat_cache *cache)
+{
+	return (cache->negative_lifespan.tv_sec > 0 ||
+	    cache->negative_lifespan.tv_usec > 0);
+}
+
 static gfarm_error_t
 gfs_stat_cache_init0(struct stat_cache *cache)
 {
@@ -82,6 +128,7 @@ gfs_stat_cache_init0(struct stat_cache *cache)
 		    (GFARM_SECOND_BY_MICROSEC / GFARM_MILLISEC_BY_MICROSEC)) *
 		    GFARM_MILLISEC_BY_MICROSEC;
 	}
+	gfs_stat_cache_negative_lifespan_set(cache);
 
 	if (cache->table != NULL) /* already initialized */
 		return (GFARM_ERR_NO_ERROR);
@@ -122,6 +169,8 @@ gfarm_anyptrs_free_deeply(int n, void **values)
 static void
 gfs_stat_cache_data_free(struct stat_cache_data *p)
 {
+	if (p->negative)
+		return;
 	gfs_stat_free(&p->st);
 	gfarm_strings_free_deeply(p->nattrs, p->attrnames);
 	gfarm_anyptrs_free_deeply(p->nattrs, p->attrvalues);
@@ -129,20 +178,27 @@ gfs_stat_cache_data_free(struct stat_cache_data *p)
 }
 
 static void
-gfs_stat_cache_clear0(struct stat_cache *cache)
+gfs_stat_cache_list_clear(struct stat_cache *cache,
+	struct stat_cache_data *head)
 {
 	struct stat_cache_data *p, *q;
 	struct gfarm_hash_entry *entry;
 
-	FOREACH_STAT_CACHE_DATA_SAFE(p, q, cache) {
+	FOREACH_STAT_CACHE_LIST_SAFE(p, q, head) {
 		gfs_stat_cache_data_free(p);
 
 		entry = p->entry;
 		gfarm_hash_purge(cache->table, gfarm_hash_entry_key(entry),
 		    gfarm_hash_entry_key_length(entry));
 	}
-	STAT_CACHE_DATA_HEAD(cache)->next = STAT_CACHE_DATA_HEAD(cache)->prev =
-	    STAT_CACHE_DATA_HEAD(cache);
+	head->next = head->prev = head;
+}
+
+static void
+gfs_stat_cache_clear0(struct stat_cache *cache)
+{
+	gfs_stat_cache_list_clear(cache, STAT_CACHE_DATA_HEAD(cache));
+	gfs_stat_cache_list_clear(cache, STAT_CACHE_NEGATIVE_HEAD(cache));
 	cache->count = 0;
 }
 
@@ -154,13 +210,13 @@ gfs_stat_cache_clear(void)
 }
 
 static void
-gfs_stat_cache_expire_internal0(struct stat_cache *cache,
-	const struct timeval *nowp)
+gfs_stat_cache_list_expire(struct stat_cache *cache,
+	struct stat_cache_data *head, const struct timeval *nowp)
 {
 	struct stat_cache_data *p, *q;
 	struct gfarm_hash_entry *entry;
 
-	FOREACH_STAT_CACHE_DATA_SAFE(p, q, cache) {
+	FOREACH_STAT_CACHE_LIST_SAFE(p, q, head) {
 		/* assumes monotonic time */
 		if (gfarm_timeval_cmp(&p->expiration, nowp) > 0)
 			break;
@@ -172,8 +228,17 @@ gfs_stat_cache_expire_internal0(struct stat_cache *cache,
 		    gfarm_hash_entry_key_length(entry));
 		--cache->count;
 	}
-	STAT_CACHE_DATA_HEAD(cache)->next = p;
-	p->prev = STAT_CACHE_DATA_HEAD(cache);
+	head->next = p;
+	p->prev = head;
+}
+
+static void
+gfs_stat_cache_expire_internal0(struct stat_cache *cache,
+	const struct timeval *nowp)
+{
+	gfs_stat_cache_list_expire(cache, STAT_CACHE_DATA_HEAD(cache), nowp);
+	gfs_stat_cache_list_expire(cache, STAT_CACHE_NEGATIVE_HEAD(cache),
+	    nowp);
 }
 
 static void
@@ -197,7 +262,8 @@ gfs_stat_cache_expiration_set0(struct stat_cache *cache,
 	long lifespan_millsecond)
 {
 	struct timeval old_lifespan = cache->lifespan;
-	struct stat_cache_data *p;
+	struct timeval old_negative_lifespan = cache->negative_lifespan;
+	struct stat_cache_data *p, *q;
 
 	cache->lifespan_is_set = 1;
 	cache->lifespan.tv_sec = lifespan_millsecond / 1000;
@@ -208,6 +274,12 @@ gfs_stat_cache_expiration_set0(struct stat_cache *cache,
 		gfarm_timeval_sub(&p->expiration, &old_lifespan);
 		gfarm_timeval_add(&p->expiration, &cache->lifespan);
 	}
+
+	gfs_stat_cache_negative_lifespan_set(cache);
+	FOREACH_STAT_CACHE_LIST_SAFE(p, q, STAT_CACHE_NEGATIVE_HEAD(cache)) {
+		gfarm_timeval_sub(&p->expiration, &old_negative_lifespan);
+		gfarm_timeval_add(&p->expiration, &cache->negative_lifespan);
+	}
 }
 
 void
@@ -266,6 +338,31 @@ attrvalues_copy(int nattrs, void ***attrvaluesp, size_t **attrsizesp,
 	return (GFARM_ERR_NO_ERROR);
 }
 
+/* remove the oldest entry, if the cache is full */
+static void
+gfs_stat_cache_limit(struct stat_cache *cache)
+{
+	struct stat_cache_data *data;
+	struct gfarm_hash_entry *entry;
+
+	if (cache->count < gfarm_ctxp->attr_cache_limit)
+		return;
+
+	/* negative entries are cheaper to be looked up again */
+	data = STAT_CACHE_NEGATIVE_HEAD(cache)->next;
+	if (data == STAT_CACHE_NEGATIVE_HEAD(cache))
+		data = STAT_CACHE_DATA_HEAD(cache)->next;
+	if (data == STAT_CACHE_DATA_HEAD(cache)) /* both lists are empty */
+		return;
+	data->prev->next = data->next;
+	data->next->prev = data->prev;
+	gfs_stat_cache_data_free(data);
+	entry = data->entry;
+	gfarm_hash_purge(cache->table, gfarm_hash_entry_key(entry),
+	    gfarm_hash_entry_key_length(entry));
+	--cache->count;
+}
+
 static gfarm_error_t
 gfs_stat_cache_enter_internal0(struct stat_cache *cache,
 	const char *path, const struct gfs_stat *st,
@@ -286,18 +383,7 @@ gfs_stat_cache_enter_internal0(struct stat_cache *cache,
 		}
 	}
 	gfs_stat_cache_expire_internal0(cache, nowp);
-
-	if (cache->count >= gfarm_ctxp->attr_cache_limit) {
-		/* remove the head of the list (i.e. oldest entry) */
-		data = STAT_CACHE_DATA_HEAD(cache)->next;
-		data->prev->next = data->next;
-		data->next->prev = data->prev;
-		gfs_stat_cache_data_free(data);
-		entry = data->entry;
-		gfarm_hash_purge(cache->table, gfarm_hash_entry_key(entry),
-		    gfarm_hash_entry_key_length(entry));
-		--cache->count;
-	}
+	gfs_stat_cache_limit(cache);
 
 	entry = gfarm_hash_enter(cache->table, path, strlen(path) + 1,
 	    sizeof(*data), &created);
@@ -320,6 +406,7 @@ gfs_stat_cache_enter_internal0(struct stat_cache *cache,
 		gfs_stat_cache_data_free(data);
 	}
 
+	data->negative = 0;
 	e = gfs_stat_copy(&data->st, st);
 	if (nattrs == 0) {
 		data->attrnames = NULL;
@@ -366,6 +453,55 @@ gfs_stat_cache_enter_internal0(struct stat_cache *cache,
 	return (GFARM_ERR_NO_ERROR);
 }
 
+/* cache nonexistence of the path */
+static gfarm_error_t
+gfs_stat_cache_enter_negative0(struct stat_cache *cache,
+	const char *path, const struct timeval *nowp)
+{
+	struct gfarm_hash_entry *entry;
+	struct stat_cache_data *data;
+	int created;
+
+	/* cache->table is initialized by gfs_stat_cache_data_get0() */
+	if (cache->table == NULL || !gfs_stat_cache_negative_is_enabled(cache))
+		return (GFARM_ERR_NO_ERROR);
+	gfs_stat_cache_expire_internal0(cache, nowp);
+	gfs_stat_cache_limit(cache);
+
+	entry = gfarm_hash_enter(cache->table, path, strlen(path) + 1,
+	    sizeof(*data), &created);
+	if (entry == NULL) {
+		gflog_debug(GFARM_MSG_UNFIXED,
+		    "allocation of hash entry for stat cache failed: %s",
+		    gfarm_error_string(GFARM_ERR_NO_MEMORY));
+		return (GFARM_ERR_NO_MEMORY);
+	}
+	data = gfarm_hash_entry_data(entry);
+	if (created) {
+		++cache->count;
+		data->entry = entry;
+	} else {
+		data->prev->next = data->next;
+		data->next->prev = data->prev;
+
+		gfs_stat_cache_data_free(data);
+	}
+	data->negative = 1;
+	data->nattrs = 0;
+	data->attrnames = NULL;
+	data->attrvalues = NULL;
+	data->attrsizes = NULL;
+
+	data->expiration = *nowp;
+	gfarm_timeval_add(&data->expiration, &cache->negative_lifespan);
+	/* add to the end of the negative list, i.e. assumes monotonic time */
+	data->next = STAT_CACHE_NEGATIVE_HEAD(cache);
+	data->prev = STAT_CACHE_NEGATIVE_HEAD(cache)->prev;
+	STAT_CACHE_NEGATIVE_HEAD(cache)->prev->next = data;
+	STAT_CACHE_NEGATIVE_HEAD(cache)->prev = data;
+	return (GFARM_ERR_NO_ERROR);
+}
+
 static gfarm_error_t
 gfs_stat_cache_purge0(struct stat_cache *cache, const char *path)
 {
@@ -422,6 +558,48 @@ gfs_stat_cache_purge(const char *path)
 #endif
 }
 
+/* purge the negative entries which are equal to or below the path */
+static void
+gfs_stat_cache_purge_negative0(struct stat_cache *cache, const char *path,
+	int all)
+{
+	struct stat_cache_data *p, *q;
+	struct gfarm_hash_entry *entry;
+	const char *key;
+	size_t len = strlen(path);
+
+	if (cache->table == NULL) /* there is nothing to purge */
+		return;
+	while (len > 1 && path[len - 1] == '/')
+		--len;
+	FOREACH_STAT_CACHE_LIST_SAFE(p, q, STAT_CACHE_NEGATIVE_HEAD(cache)) {
+		entry = p->entry;
+		key = gfarm_hash_entry_key(entry);
+		if (!all && (strncmp(key, path, len) != 0 ||
+		    (key[len] != '\0' && key[len] != '/')))
+			continue;
+		p->prev->next = p->next;
+		p->next->prev = p->prev;
+		gfs_stat_cache_data_free(p);
+		gfarm_hash_purge(cache->table, key,
+		    gfarm_hash_entry_key_length(entry));
+		--cache->count;
+	}
+}
+
+/*
+ * called when the path is created by this process.
+ * every negative entry of the stat cache is purged, because it may be
+ * a dangling symbolic link which points to the path now.
+ */
+void
+gfs_stat_cache_purge_created(const char *path)
+{
+	(void)gfs_stat_cache_purge(path);
+	gfs_stat_cache_purge_negative0(&lstat_cache, path, 0);
+	gfs_stat_cache_purge_negative0(&stat_cache, path, 1);
+}
+
 /* this returns uncached result, but enter the result to the cache */
 static gfarm_error_t
 gfs_getattrplus_caching0(struct stat_cache *cache,
@@ -436,6 +614,15 @@ gfs_getattrplus_caching0(struct stat_cache *cache,
 	e = (no_follow ? gfs_lgetattrplus : gfs_getattrplus)
 		(path, patterns, npatterns, 0,
 		st, nattrsp, attrnamesp, attrvaluesp, attrsizesp);
+	if (e == GFARM_ERR_NO_SUCH_FILE_OR_DIRECTORY) {
+		gettimeofday(&now, NULL);
+		/* it's ok to fail, since it's merely cache */
+		(void)gfs_stat_cache_enter_negative0(cache, path, &now);
+		/* stat(2) fails too, if lstat(2) fails with ENOENT */
+		if (no_follow)
+			(void)gfs_stat_cache_enter_negative0(&stat_cache,
+			    path, &now);
+	}
 	if (e != GFARM_ERR_NO_ERROR) {
 		gflog_debug(GFARM_MSG_1002465, "gfs_getattrplusstat(%s): %s",
 		    path, gfarm_error_string(e));
@@ -581,6 +768,40 @@ gfs_lgetxattr_caching(const char *path, const char *name,
 	return (gfs_getxattr_caching0(&lstat_cache, path, name, value, sizep));
 }
 
+/*
+ * if nonexistence of an ancestor directory is cached, the path doesn't
+ * exist either.  returns the negative entry of the ancestor, or NULL.
+ */
+static struct gfarm_hash_entry *
+gfs_stat_cache_negative_ancestor(struct stat_cache *cache, const char *path)
+{
+	struct gfarm_hash_entry *entry = NULL;
+	struct stat_cache_data *data;
+	char *ancestor, *p;
+
+	if (STAT_CACHE_NEGATIVE_HEAD(cache)->next ==
+	    STAT_CACHE_NEGATIVE_HEAD(cache)) /* no negative entry */
+		return (NULL);
+	if ((ancestor = strdup(path)) == NULL)
+		return (NULL);
+	for (p = strchr(ancestor + 1, '/'); p != NULL && entry == NULL;
+	    p = strchr(p + 1, '/')) {
+		if (p[-1] == '/')
+			continue;
+		*p = '\0';
+		entry = gfarm_hash_lookup(cache->table,
+		    ancestor, p - ancestor + 1);
+		*p = '/';
+		if (entry != NULL) {
+			data = gfarm_hash_entry_data(entry);
+			if (!data->negative)
+				entry = NULL;
+		}
+	}
+	free(ancestor);
+	return (entry);
+}
+
 static gfarm_error_t
 gfs_stat_cache_data_get0(struct stat_cache *cache, const char *path,
 	struct stat_cache_data **datap)
@@ -601,6 +822,8 @@ gfs_stat_cache_data_get0(struct stat_cache *cache, const char *path,
 	gettimeofday(&now, NULL);
 	gfs_stat_cache_expire_internal0(cache, &now);
 	entry = gfarm_hash_lookup(cache->table, path, strlen(path) + 1);
+	if (entry == NULL)
+		entry = gfs_stat_cache_negative_ancestor(cache, path);
 	if (entry != NULL) {
 #ifdef DIRCACHE_DEBUG
 		gflog_debug(GFARM_MSG_1000092,
@@ -630,6 +853,8 @@ gfs_stat_cached_internal0(struct stat_cache *cache, const char *path,
 		return (e);
 	if (data == NULL) /* not hit */
 		return (gfs_stat_caching0(cache, path, st));
+	if (data->negative) /* hit */
+		return (GFARM_ERR_NO_SUCH_FILE_OR_DIRECTORY);
 
 	return (gfs_stat_copy(st, &data->st)); /* hit */
 }
@@ -662,6 +887,8 @@ gfs_getxattr_cached_internal0(struct stat_cache *cache,
 	if (data == NULL) /* not hit */
 		return (gfs_getxattr_caching0(cache, path, name, value,
 			sizep));
+	if (data->negative) /* hit */
+		return (GFARM_ERR_NO_SUCH_FILE_OR_DIRECTORY);
 
 	/* hit */
 	for (i = 0; i < data->nattrs; i++) {
@@ -1,5 +1,6 @@
 gfarm_error_t gfs_stat_cached_internal(const char *, struct gfs_stat *);
 gfarm_error_t gfs_lstat_cached_internal(const char *, struct gfs_stat *);
+void gfs_stat_cache_purge_created(const char *);
 gfarm_error_t gfs_opendir_caching_internal(const char *, GFS_Dir *);
 gfarm_error_t gfs_getxattr_cached_internal(const char *, const char *,
 	void *, size_t *);
@@ -7,6 +7,7 @@
 #include "context.h"
 #include "gfm_client.h"
 #include "lookup.h"
+#include "gfs_dircache.h"
 
 struct gfm_link_closure {
 	/* input, for gfarm_file_trace */
@@ -76,6 +77,8 @@ gfs_link(const char *src, const char *dst)
 	    gfm_link_request, NULL, gfm_link_result,
 	    gfm_name2_success_op_connection_free, NULL,
 	    gfm_link_must_be_warned, &closure);
+	/* purge the negative cache, even if the path already exists */
+	gfs_stat_cache_purge_created(dst);
 	if (e != GFARM_ERR_NO_ERROR) {
 		if (e == GFARM_ERR_PATH_IS_ROOT)
 			e = GFARM_ERR_OPERATION_NOT_PERMITTED;
@@ -34,6 +34,7 @@
 #include "gfp_xdr.h"
 #include "gfs_failover.h"
 #include "gfs_file_list.h"
+#include "gfs_dircache.h"
 
 #define staticp	(gfarm_ctxp->gfs_pio_static)
 
@@ -310,8 +311,11 @@ gfs_pio_create_igen(const char *url, int flags, gfarm_mode_t mode,
 	GFARM_TIMEVAL_FIX_INITIALIZE_WARNING(t1);
 	gfs_profile(gfarm_gettimerval(&t1));
 
-	if ((e = gfm_create_fd(url, flags, mode, &gfm_server, &fd, &type,
-			&inum, &gen, &real_url)) == GFARM_ERR_NO_ERROR) {
+	e = gfm_create_fd(url, flags, mode, &gfm_server, &fd, &type,
+	    &inum, &gen, &real_url);
+	/* purge the negative cache, even if the path already exists */
+	gfs_stat_cache_purge_created(url);
+	if (e == GFARM_ERR_NO_ERROR) {
 		if (type != GFS_DT_REG) {
 			e = type == GFS_DT_DIR ? GFARM_ERR_IS_A_DIRECTORY :
 			    type == GFS_DT_LNK ? GFARM_ERR_IS_A_SYMBOLIC_LINK :
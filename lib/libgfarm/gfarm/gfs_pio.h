@@ -82,6 +82,9 @@ gfarm_error_t gfs_pio_set_view_global(GFS_File, int);
 struct gfs_connection;
 gfarm_error_t gfs_pio_open_local_section(GFS_File, struct gfs_connection *);
 gfarm_error_t gfs_pio_open_remote_section(GFS_File, struct gfs_connection *);
+void gfs_pio_remote_async_free(GFS_File);
+void gfs_pio_remote_ra_invalidate(GFS_File);
+int gfs_pio_remote_ra_is_active(void);
 gfarm_error_t gfs_pio_internal_set_view_section(GFS_File, char *);
 gfarm_error_t gfs_pio_reconnect(GFS_File);
 gfarm_error_t gfs_pio_view_fd(GFS_File gf, int *fdp);
@@ -122,6 +125,8 @@ struct gfs_file_section_context {
 #endif /* not yet in gfarm v2 */
 	int fd; /* local file descriptor. i.e. never used in remote case */
 	pid_t pid;
+	/* read-ahead and write-behind state of remote storage, or NULL */
+	struct gfs_pio_remote_async *async;
 
 #ifdef EVP_MD_CTX_FLAG_ONESHOT /* for kernel mode */
 	/* for checksum, maintained only if GFS_FILE_MODE_CALC_DIGEST */
@@ -4,6 +4,7 @@
  * $Id: gfs_pio_remote.c 7734 2013-02-08 06:26:24Z tatebe $
  */
 
+#include <pthread.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
@@ -13,7 +14,9 @@
 #include <gfarm/gfarm.h>
 
 #include "queue.h"
+#include "thrsubr.h"
 
+#include "context.h"
 #include "host.h"
 #include "config.h"
 #include "gfs_proto.h"	/* GFS_PROTO_FSYNC_* */
@@ -22,10 +25,340 @@
 #include "gfs_pio.h"
 #include "schedule.h"
 
+/*
+ * adaptive read-ahead and write-behind.
+ *
+ * read-ahead:
+ *	when a file is read sequentially, GFS_PROTO_PREAD requests for
+ *	the following blocks are sent in advance, and their results are
+ *	received into a ring of buffers.  the number of blocks read ahead
+ *	starts from 1, and doubles whenever the reader consumes a block
+ *	which has been read ahead, up to GFS_PIO_REMOTE_RA_MAX.
+ *	a non-sequential read or a write discards the ring, and so does
+ *	a write by another GFS_File of the same inode in this process.
+ * write-behind:
+ *	GFS_PROTO_PWRITE is sent without waiting for its result, so that
+ *	the reply from gfsd overlaps the computation of the caller.
+ *	an error of a deferred write is reported by the next write,
+ *	ftruncate, fsync or close.  this is only enabled by
+ *	client_file_write_behind, because of that.
+ *
+ * both are bounded by client_file_async_io_budget of the process,
+ * and gfsd serves the requests of a connection in order, thus a read
+ * always sees the preceding writes.
+ */
+#define GFS_PIO_REMOTE_RA_MAX	16	/* blocks in the read-ahead ring */
+#define GFS_PIO_REMOTE_WB_MAX	16	/* outstanding write-behind requests */
+
+struct gfs_pio_remote_ra_block {
+	struct gfs_client_async_io *io; /* NULL, if the result is received */
+	char *buffer;
+	gfarm_off_t offset;
+	size_t size;		/* requested size, reserved in the budget */
+	size_t pos, length;	/* consumed and received length */
+	gfarm_error_t error;
+};
+
+struct gfs_pio_remote_wb_request {
+	struct gfs_client_async_io *io;
+	size_t size;
+};
+
+struct gfs_pio_remote_async {
+	/* read-ahead */
+	gfarm_off_t ra_next;	/* offset of the next sequential read */
+	int ra_sequential;	/* the last read was sequential */
+	int ra_window;		/* number of blocks to read ahead */
+	int ra_head, ra_count;
+	struct gfs_pio_remote_ra_block ra[GFS_PIO_REMOTE_RA_MAX];
+
+	/* write-behind */
+	int wb_head, wb_count;
+	struct gfs_pio_remote_wb_request wb[GFS_PIO_REMOTE_WB_MAX];
+	gfarm_error_t wb_error;
+};
+
+/* number of blocks read ahead in this process */
+static pthread_mutex_t gfs_pio_remote_ra_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int gfs_pio_remote_ra_blocks = 0;
+static const char ra_diag[] = "gfs_pio_remote_ra";
+
+static void
+gfs_pio_remote_ra_blocks_add(int n)
+{
+	gfarm_mutex_lock(&gfs_pio_remote_ra_mutex, ra_diag, "add");
+	gfs_pio_remote_ra_blocks += n;
+	gfarm_mutex_unlock(&gfs_pio_remote_ra_mutex, ra_diag, "add");
+}
+
+/* returns true, if any GFS_File in this process has read ahead */
+int
+gfs_pio_remote_ra_is_active(void)
+{
+	int active;
+
+	if (gfarm_ctxp->client_file_async_io_budget <= 0)
+		return (0);
+	gfarm_mutex_lock(&gfs_pio_remote_ra_mutex, ra_diag, "is_active");
+	active = gfs_pio_remote_ra_blocks > 0;
+	gfarm_mutex_unlock(&gfs_pio_remote_ra_mutex, ra_diag, "is_active");
+	return (active);
+}
+
+static void
+gfs_pio_remote_async_alloc(struct gfs_file_section_context *vc)
+{
+	struct gfs_pio_remote_async *a;
+
+	if (gfarm_ctxp->client_file_async_io_budget <= 0)
+		return;
+	GFARM_MALLOC(a);
+	if (a == NULL) { /* just disable read-ahead and write-behind */
+		gflog_debug(GFARM_MSG_UNFIXED,
+		    "allocation of gfs_pio_remote_async failed");
+		return;
+	}
+	a->ra_next = -1;
+	a->ra_sequential = 0;
+	a->ra_window = 0;
+	a->ra_head = a->ra_count = 0;
+	a->wb_head = a->wb_count = 0;
+	a->wb_error = GFARM_ERR_NO_ERROR;
+	vc->async = a;
+}
+
+/* receive the result of the oldest read-ahead block, if not yet */
+static void
+gfs_pio_remote_ra_wait(struct gfs_connection *gfs_server,
+	struct gfs_pio_remote_ra_block *b)
+{
+	if (b->io == NULL)
+		return;
+	b->error = gfs_client_async_io_result(gfs_server, b->io, &b->length);
+	b->io = NULL;
+}
+
+static void
+gfs_pio_remote_ra_pop(struct gfs_connection *gfs_server,
+	struct gfs_pio_remote_async *a)
+{
+	struct gfs_pio_remote_ra_block *b = &a->ra[a->ra_head];
+
+	gfs_pio_remote_ra_wait(gfs_server, b);
+	free(b->buffer);
+	gfs_client_async_io_unreserve(b->size);
+	a->ra_head = (a->ra_head + 1) % GFS_PIO_REMOTE_RA_MAX;
+	--a->ra_count;
+	gfs_pio_remote_ra_blocks_add(-1);
+}
+
+static void
+gfs_pio_remote_ra_discard(struct gfs_connection *gfs_server,
+	struct gfs_pio_remote_async *a)
+{
+	while (a->ra_count > 0)
+		gfs_pio_remote_ra_pop(gfs_server, a);
+	a->ra_window = 0;
+}
+
+/* send GFS_PROTO_PREAD for the blocks following "offset" */
+static void
+gfs_pio_remote_ra_fill(GFS_File gf, struct gfs_pio_remote_async *a,
+	gfarm_off_t offset, size_t size)
+{
+	struct gfs_file_section_context *vc = gf->view_context;
+	struct gfs_connection *gfs_server = vc->storage_context;
+	struct gfs_pio_remote_ra_block *b;
+	gfarm_error_t e;
+
+	if (size > GFS_PROTO_MAX_IOSIZE)
+		size = GFS_PROTO_MAX_IOSIZE;
+	if (a->ra_count > 0) {
+		b = &a->ra[(a->ra_head + a->ra_count - 1) %
+		    GFS_PIO_REMOTE_RA_MAX];
+		if (b->io == NULL && b->length < b->size)
+			return; /* reached the end of file */
+		offset = b->offset + b->size;
+	}
+	while (a->ra_count < a->ra_window) {
+		if (!gfs_client_async_io_reserve(size))
+			break;
+		b = &a->ra[(a->ra_head + a->ra_count) % GFS_PIO_REMOTE_RA_MAX];
+		GFARM_MALLOC_ARRAY(b->buffer, size);
+		if (b->buffer == NULL) {
+			gfs_client_async_io_unreserve(size);
+			break;
+		}
+		e = gfs_client_pread_request(gfs_server, gf->fd,
+		    b->buffer, size, offset, &b->io);
+		if (e != GFARM_ERR_NO_ERROR) {
+			free(b->buffer);
+			gfs_client_async_io_unreserve(size);
+			break;
+		}
+		b->offset = offset;
+		b->size = size;
+		b->pos = b->length = 0;
+		b->error = GFARM_ERR_NO_ERROR;
+		++a->ra_count;
+		gfs_pio_remote_ra_blocks_add(1);
+		offset += size;
+	}
+}
+
+/*
+ * returns 1 and sets *ep, if the read is served by the read-ahead ring.
+ */
+static int
+gfs_pio_remote_ra_read(GFS_File gf, struct gfs_pio_remote_async *a,
+	char *buffer, size_t size, gfarm_off_t offset, size_t *lengthp,
+	gfarm_error_t *ep)
+{
+	struct gfs_file_section_context *vc = gf->view_context;
+	struct gfs_connection *gfs_server = vc->storage_context;
+	struct gfs_pio_remote_ra_block *b;
+	size_t len;
+	int eof;
+
+	a->ra_sequential = offset == a->ra_next;
+	if (a->ra_count == 0)
+		return (0);
+	b = &a->ra[a->ra_head];
+	if (b->offset + b->pos != offset) { /* not sequential */
+		gfs_pio_remote_ra_discard(gfs_server, a);
+		return (0);
+	}
+	gfs_pio_remote_ra_wait(gfs_server, b);
+	if (b->error != GFARM_ERR_NO_ERROR) {
+		*ep = b->error;
+		gfs_pio_remote_ra_discard(gfs_server, a);
+		return (1);
+	}
+	len = b->length - b->pos;
+	if (len > size)
+		len = size;
+	memcpy(buffer, b->buffer + b->pos, len);
+	b->pos += len;
+	eof = b->length < b->size;
+	if (b->pos >= b->length) {
+		gfs_pio_remote_ra_pop(gfs_server, a);
+		if (a->ra_window < GFS_PIO_REMOTE_RA_MAX)
+			a->ra_window *= 2;
+	}
+	a->ra_next = offset + len;
+	if (!eof)
+		gfs_pio_remote_ra_fill(gf, a, offset + len, size);
+	*lengthp = len;
+	*ep = GFARM_ERR_NO_ERROR;
+	return (1);
+}
+
+/* receive the result of the oldest write-behind request */
 static gfarm_error_t
-gfs_pio_remote_storage_close(GFS_File gf)
+gfs_pio_remote_wb_wait(struct gfs_connection *gfs_server,
+	struct gfs_pio_remote_async *a)
 {
+	struct gfs_pio_remote_wb_request *r = &a->wb[a->wb_head];
 	gfarm_error_t e;
+	size_t len;
+
+	e = gfs_client_async_io_result(gfs_server, r->io, &len);
+	gfs_client_async_io_unreserve(r->size);
+	a->wb_head = (a->wb_head + 1) % GFS_PIO_REMOTE_WB_MAX;
+	--a->wb_count;
+	/* a short write cannot be reported as is anymore */
+	if (e == GFARM_ERR_NO_ERROR && len < r->size)
+		e = GFARM_ERR_INPUT_OUTPUT;
+	if (e != GFARM_ERR_NO_ERROR && a->wb_error == GFARM_ERR_NO_ERROR)
+		a->wb_error = e;
+	return (e);
+}
+
+/* wait for all write-behind requests, and returns the deferred error */
+static gfarm_error_t
+gfs_pio_remote_wb_flush(GFS_File gf)
+{
+	struct gfs_file_section_context *vc = gf->view_context;
+	struct gfs_connection *gfs_server = vc->storage_context;
+	struct gfs_pio_remote_async *a = vc->async;
+	gfarm_error_t e;
+
+	if (a == NULL)
+		return (GFARM_ERR_NO_ERROR);
+	while (a->wb_count > 0)
+		(void)gfs_pio_remote_wb_wait(gfs_server, a);
+	e = a->wb_error;
+	a->wb_error = GFARM_ERR_NO_ERROR;
+	return (e);
+}
+
+/*
+ * returns 1 and sets *ep, if the write is sent without waiting for
+ * the result.
+ */
+static int
+gfs_pio_remote_wb_write(GFS_File gf, struct gfs_pio_remote_async *a,
+	const char *buffer, size_t size, gfarm_off_t offset, size_t *lengthp,
+	gfarm_error_t *ep)
+{
+	struct gfs_file_section_context *vc = gf->view_context;
+	struct gfs_connection *gfs_server = vc->storage_context;
+	struct gfs_pio_remote_wb_request *r;
+	gfarm_error_t e;
+
+	if (a->wb_error != GFARM_ERR_NO_ERROR) {
+		*ep = a->wb_error;
+		a->wb_error = GFARM_ERR_NO_ERROR;
+		return (1);
+	}
+	if (size > GFS_PROTO_MAX_IOSIZE)
+		size = GFS_PROTO_MAX_IOSIZE;
+	while (a->wb_count >= GFS_PIO_REMOTE_WB_MAX ||
+	    !gfs_client_async_io_reserve(size)) {
+		if (a->wb_count == 0)
+			return (0); /* budget is used by others */
+		if ((e = gfs_pio_remote_wb_wait(gfs_server, a))
+		    != GFARM_ERR_NO_ERROR) {
+			a->wb_error = GFARM_ERR_NO_ERROR;
+			*ep = e;
+			return (1);
+		}
+	}
+	r = &a->wb[(a->wb_head + a->wb_count) % GFS_PIO_REMOTE_WB_MAX];
+	e = gfs_client_pwrite_request(gfs_server, gf->fd,
+	    buffer, size, offset, &r->io);
+	if (e != GFARM_ERR_NO_ERROR) {
+		gfs_client_async_io_unreserve(size);
+		*ep = e;
+		return (1);
+	}
+	r->size = size;
+	++a->wb_count;
+	*lengthp = size;
+	*ep = GFARM_ERR_NO_ERROR;
+	return (1);
+}
+
+/* also called from gfs_pio_reconnect() before switching the connection */
+void
+gfs_pio_remote_async_free(GFS_File gf)
+{
+	struct gfs_file_section_context *vc = gf->view_context;
+	struct gfs_connection *gfs_server = vc->storage_context;
+	struct gfs_pio_remote_async *a = vc->async;
+
+	if (a == NULL)
+		return;
+	gfs_pio_remote_ra_discard(gfs_server, a);
+	(void)gfs_pio_remote_wb_flush(gf);
+	free(a);
+	vc->async = NULL;
+}
+
+static gfarm_error_t
+gfs_pio_remote_storage_close(GFS_File gf)
+{
+	gfarm_error_t e, e_wb;
 	struct gfs_file_section_context *vc = gf->view_context;
 	struct gfs_connection *gfs_server = vc->storage_context;
 
@@ -37,7 +370,11 @@ gfs_pio_remote_storage_close(GFS_File gf)
 	 */
 	if (vc->pid != getpid())
 		return (GFARM_ERR_NO_ERROR);
+	e_wb = gfs_pio_remote_wb_flush(gf);
+	gfs_pio_remote_async_free(gf);
 	e = gfs_client_close(gfs_server, gf->fd);
+	if (e == GFARM_ERR_NO_ERROR)
+		e = e_wb;
 	gfarm_schedule_host_unused(
 	    gfs_client_hostname(gfs_server),
 	    gfs_client_port(gfs_server),
@@ -60,13 +397,32 @@ gfs_pio_remote_storage_pwrite(GFS_File gf,
 {
 	struct gfs_file_section_context *vc = gf->view_context;
 	struct gfs_connection *gfs_server = vc->storage_context;
+	struct gfs_pio_remote_async *a = vc->async;
+	int window = gfarm_ctxp->client_file_write_io_window;
+	gfarm_error_t e;
+
+	if (a != NULL) {
+		gfs_pio_remote_ra_discard(gfs_server, a);
+		a->ra_next = -1;
+		if (gfarm_ctxp->client_file_write_behind &&
+		    gfs_pio_remote_wb_write(gf, a, buffer, size, offset,
+		    lengthp, &e))
+			return (e);
+	}
 
 	/*
 	 * buffer beyond GFS_PROTO_MAX_IOSIZE are just ignored by gfsd,
 	 * we don't perform such GFS_PROTO_WRITE request, because it's
 	 * inefficient.
+	 * Instead, up to "window" requests are pipelined.
 	 * Note that upper gfs_pio layer should care this partial write.
 	 */
+	if (window > 1 && size > GFS_PROTO_MAX_IOSIZE) {
+		if (size > (size_t)GFS_PROTO_MAX_IOSIZE * window)
+			size = (size_t)GFS_PROTO_MAX_IOSIZE * window;
+		return (gfs_client_pwrite_pipelined(gfs_server, gf->fd,
+		    buffer, size, offset, window, lengthp));
+	}
 	if (size > GFS_PROTO_MAX_IOSIZE)
 		size = GFS_PROTO_MAX_IOSIZE;
 	return (gfs_client_pwrite(gfs_server, gf->fd, buffer, size, offset,
@@ -99,13 +455,45 @@ gfs_pio_remote_storage_pread(GFS_File gf,
 {
 	struct gfs_file_section_context *vc = gf->view_context;
 	struct gfs_connection *gfs_server = vc->storage_context;
+	struct gfs_pio_remote_async *a = vc->async;
+	int window = gfarm_ctxp->client_file_io_window;
+	gfarm_error_t e;
+
+	if (a != NULL) {
+		if (gfs_pio_remote_ra_read(gf, a, buffer, size, offset,
+		    lengthp, &e))
+			return (e);
+		/* start to read ahead at the second sequential read */
+		if (a->ra_sequential && size <= GFS_PROTO_MAX_IOSIZE) {
+			e = gfs_client_pread(gfs_server, gf->fd,
+			    buffer, size, offset, lengthp);
+			if (e == GFARM_ERR_NO_ERROR) {
+				a->ra_next = offset + *lengthp;
+				if (*lengthp == size) {
+					if (a->ra_window == 0)
+						a->ra_window = 1;
+					gfs_pio_remote_ra_fill(gf, a,
+					    a->ra_next, size);
+				}
+			}
+			return (e);
+		}
+		a->ra_next = offset + size; /* expected, if not short */
+	}
 
 	/*
 	 * Unlike gfs_pio_remote_storage_write(), we don't care
 	 * buffer size here, because automatic i/o size truncation
 	 * performed by gfsd isn't inefficient for read case.
+	 * But a large read is pipelined to hide the round trip time.
 	 * Note that upper gfs_pio layer should care the partial read.
 	 */
+	if (window > 1 && size > GFS_PROTO_MAX_IOSIZE) {
+		if (size > (size_t)GFS_PROTO_MAX_IOSIZE * window)
+			size = (size_t)GFS_PROTO_MAX_IOSIZE * window;
+		return (gfs_client_pread_pipelined(gfs_server, gf->fd,
+		    buffer, size, offset, window, lengthp));
+	}
 	return (gfs_client_pread(gfs_server, gf->fd, buffer, size, offset,
 	    lengthp));
 }
@@ -115,8 +503,13 @@ gfs_pio_remote_storage_ftruncate(GFS_File gf, gfarm_off_t length)
 {
 	struct gfs_file_section_context *vc = gf->view_context;
 	struct gfs_connection *gfs_server = vc->storage_context;
+	gfarm_error_t e, e_wb;
 
-	return (gfs_client_ftruncate(gfs_server, gf->fd, length));
+	e_wb = gfs_pio_remote_wb_flush(gf);
+	if (vc->async != NULL)
+		gfs_pio_remote_ra_discard(gfs_server, vc->async);
+	e = gfs_client_ftruncate(gfs_server, gf->fd, length);
+	return (e != GFARM_ERR_NO_ERROR ? e : e_wb);
 }
 
 static gfarm_error_t
@@ -124,8 +517,11 @@ gfs_pio_remote_storage_fsync(GFS_File gf, int operation)
 {
 	struct gfs_file_section_context *vc = gf->view_context;
 	struct gfs_connection *gfs_server = vc->storage_context;
+	gfarm_error_t e, e_wb;
 
-	return (gfs_client_fsync(gfs_server, gf->fd, operation));
+	e_wb = gfs_pio_remote_wb_flush(gf);
+	e = gfs_client_fsync(gfs_server, gf->fd, operation);
+	return (e != GFARM_ERR_NO_ERROR ? e : e_wb);
 }
 
 static gfarm_error_t
@@ -145,7 +541,14 @@ gfs_pio_remote_storage_reopen(GFS_File gf)
 	gfarm_error_t e;
 	struct gfs_file_section_context *vc = gf->view_context;
 	struct gfs_connection *gfs_server = vc->storage_context;
+	struct gfs_pio_remote_async *a = vc->async;
 
+	/* the results for the old descriptor, an error is kept in wb_error */
+	if (a != NULL) {
+		gfs_pio_remote_ra_discard(gfs_server, a);
+		while (a->wb_count > 0)
+			(void)gfs_pio_remote_wb_wait(gfs_server, a);
+	}
 	if ((e = gfs_client_open(gfs_server, gf->fd)) != GFARM_ERR_NO_ERROR)
 		gflog_debug(GFARM_MSG_1003379,
 		    "gfs_client_open_local: %s", gfarm_error_string(e));
@@ -174,6 +577,24 @@ struct gfs_storage_ops gfs_pio_remote_storage_ops = {
 	gfs_pio_remote_storage_write,
 };
 
+/*
+ * called when another GFS_File of the same inode in this process writes,
+ * because the blocks read ahead by "gf" may be stale.
+ */
+void
+gfs_pio_remote_ra_invalidate(GFS_File gf)
+{
+	struct gfs_file_section_context *vc = gf->view_context;
+	struct gfs_pio_remote_async *a;
+
+	if (vc == NULL || vc->ops != &gfs_pio_remote_storage_ops ||
+	    vc->storage_context == NULL || vc->pid != getpid() ||
+	    (a = vc->async) == NULL)
+		return;
+	gfs_pio_remote_ra_discard(vc->storage_context, a);
+	a->ra_next = -1;
+}
+
 gfarm_error_t
 gfs_pio_open_remote_section(GFS_File gf, struct gfs_connection *gfs_server)
 {
@@ -192,5 +613,7 @@ gfs_pio_open_remote_section(GFS_File gf, struct gfs_connection *gfs_server)
 	vc->storage_context = gfs_server;
 	vc->fd = -1; /* not used */
 	vc->pid = getpid();
+	if (vc->async == NULL)
+		gfs_pio_remote_async_alloc(vc);
 	return (GFARM_ERR_NO_ERROR);
 }
@@ -34,6 +34,7 @@
 #include "gfs_pio.h"
 #include "schedule.h"
 #include "filesystem.h"
+#include "gfs_file_list.h"
 #include "gfs_failover.h"
 
 #define staticp	(gfarm_ctxp->gfs_pio_section_static)
@@ -228,6 +229,33 @@ gfs_pio_view_section_close(GFS_File gf)
 	return (e_save);
 }
 
+extern struct gfs_pio_ops gfs_pio_view_section_ops;
+
+static int
+gfs_pio_view_section_invalidate_ra(struct gfs_file *gf, void *closure)
+{
+	GFS_File writer = closure;
+
+	if (gf != writer && gf->ino == writer->ino &&
+	    gf->ops == &gfs_pio_view_section_ops)
+		gfs_pio_remote_ra_invalidate(gf);
+	return (1);
+}
+
+/*
+ * the data read ahead by other GFS_Files of the same inode may be stale,
+ * after "gf" writes.
+ */
+static void
+gfs_pio_view_section_written(GFS_File gf)
+{
+	if (!gfs_pio_remote_ra_is_active())
+		return;
+	gfs_pio_file_list_foreach(gfarm_filesystem_opened_file_list(
+	    gfarm_filesystem_get_by_connection(gf->gfm_server)),
+	    gfs_pio_view_section_invalidate_ra, gf);
+}
+
 static gfarm_error_t
 gfs_pio_view_section_pwrite(GFS_File gf,
 	const char *buffer, size_t size, gfarm_off_t offset, size_t *lengthp)
@@ -236,6 +264,8 @@ gfs_pio_view_section_pwrite(GFS_File gf,
 	gfarm_error_t e = (*vc->ops->storage_pwrite)(gf,
 	    buffer, size, offset, lengthp);
 
+	gfs_pio_view_section_written(gf);
+
 #if 0 /* not yet in gfarm v2  */ 
 	if (e == GFARM_ERR_NO_ERROR && *lengthp > 0 &&
 	    (gf->mode & GFS_FILE_MODE_CALC_DIGEST) != 0)
@@ -260,6 +290,8 @@ gfs_pio_view_section_write(GFS_File gf,
 	gfarm_error_t e = (*vc->ops->storage_write)(gf,
 	    buffer, size, lengthp, offsetp, total_sizep);
 
+	gfs_pio_view_section_written(gf);
+
 #if 0 /* not yet in gfarm v2  */
 	if (e == GFARM_ERR_NO_ERROR && *lengthp > 0 &&
 	    (gf->mode & GFS_FILE_MODE_CALC_DIGEST) != 0)
@@ -301,8 +333,10 @@ static gfarm_error_t
 gfs_pio_view_section_ftruncate(GFS_File gf, gfarm_off_t length)
 {
 	struct gfs_file_section_context *vc = gf->view_context;
+	gfarm_error_t e = (*vc->ops->storage_ftruncate)(gf, length);
 
-	return ((*vc->ops->storage_ftruncate)(gf, length));
+	gfs_pio_view_section_written(gf);
+	return (e);
 }
 
 static gfarm_error_t
@@ -713,6 +747,7 @@ gfs_file_section_context_alloc(void)
 
 	vc->storage_context = NULL;
 	vc->pid = 0;
+	vc->async = NULL;
 
 	return (vc);
 }
@@ -831,6 +866,7 @@ gfs_pio_reconnect(GFS_File gf)
 		return (e);
 	}
 	gfarm_schedule_host_cache_purge(sc);
+	gfs_pio_remote_async_free(gf); /* read-ahead from the old replica */
 	if ((e = schedule_file_loop(gf, NULL, 0)) != GFARM_ERR_NO_ERROR)
 		goto end;
 	vc = gf->view_context;
@@ -58,6 +58,9 @@ enum gfs_proto_command {
 
 	GFS_PROTO_HITRATES_GET,
 	GFS_PROTO_HITRATES_CLEAR,
+
+	/* from gfmd */
+	GFS_PROTO_REPLICATION_CHAIN_REQUEST,
 };
 
 /*
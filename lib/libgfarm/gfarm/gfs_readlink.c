@@ -48,7 +48,8 @@ gfs_readlink(const char *path, char **srcp)
 	struct gfm_readlink_closure closure;
 
 	closure.srcp = srcp;
-	return (gfm_inode_op_no_follow_readonly(path, GFARM_FILE_LOOKUP,
+	return (gfm_inode_op_no_follow_readonly_on_slave(path,
+	    GFARM_FILE_LOOKUP,
 	    gfm_readlink_request,
 	    gfm_readlink_result,
 	    gfm_inode_success_op_connection_free,
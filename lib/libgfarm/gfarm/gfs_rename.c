@@ -7,6 +7,7 @@
 #include "context.h"
 #include "gfm_client.h"
 #include "lookup.h"
+#include "gfs_dircache.h"
 
 struct gfm_rename_closure {
 	/* input, for gfarm_file_trace */
@@ -76,6 +77,8 @@ gfs_rename(const char *src, const char *dst)
 	    NULL, gfm_rename_request, gfm_rename_result,
 	    gfm_name2_success_op_connection_free, NULL,
 	    gfm_rename_must_be_warned, &closure);
+	(void)gfs_stat_cache_purge(src);
+	gfs_stat_cache_purge_created(dst);
 	if (e != GFARM_ERR_NO_ERROR) {
 		if (e == GFARM_ERR_PATH_IS_ROOT)
 			e = GFARM_ERR_OPERATION_NOT_PERMITTED;
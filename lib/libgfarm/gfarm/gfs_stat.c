@@ -96,7 +96,7 @@ gfs_stat(const char *path, struct gfs_stat *s)
 	gfs_profile(gfarm_gettimerval(&t1));
 
 	closure.st = s;
-	e = gfm_inode_op_readonly(path, GFARM_FILE_LOOKUP,
+	e = gfm_inode_op_readonly_on_slave(path, GFARM_FILE_LOOKUP,
 	    gfm_stat_request,
 	    gfm_stat_result,
 	    gfm_inode_success_op_connection_free,
@@ -128,7 +128,7 @@ gfs_lstat(const char *path, struct gfs_stat *s)
 	gfs_profile(gfarm_gettimerval(&t1));
 
 	closure.st = s;
-	e = gfm_inode_op_no_follow_readonly(path, GFARM_FILE_LOOKUP,
+	e = gfm_inode_op_no_follow_readonly_on_slave(path, GFARM_FILE_LOOKUP,
 	    gfm_stat_request,
 	    gfm_stat_result,
 	    gfm_inode_success_op_connection_free,
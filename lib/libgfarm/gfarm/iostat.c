@@ -340,3 +340,22 @@ gfarm_iostat_local_add(unsigned int cat, int val)
 	}
 	gfarm_iostat_stat_add(ip, cat, val);
 }
+void
+gfarm_iostat_local_set(unsigned int cat, gfarm_int64_t val)
+{
+	struct gfarm_iostat_head *hp; struct gfarm_iostat_items *sip, *ip;
+
+	if (!is_statfile_valid(hp, sip))
+		return;
+	if (!(ip = staticp->stat_local_ip)) {
+		gflog_debug(GFARM_MSG_UNFIXED, "not initialized");
+		return;
+	}
+	if (cat >= hp->s_nitem) {
+		gflog_error(GFARM_MSG_UNFIXED,
+			"gfarm_iostat_local_set(%s) too big cat %d",
+			hp->s_name, cat);
+		return;
+	}
+	ip->s_vals[cat] = val;
+}
@@ -9,3 +9,4 @@ void gfarm_iostat_set_local_ip(struct gfarm_iostat_items *ip);
 void gfarm_iostat_stat_add(struct gfarm_iostat_items *ip,
 			unsigned int cat, int val);
 void gfarm_iostat_local_add(unsigned int cat, int val);
+void gfarm_iostat_local_set(unsigned int cat, gfarm_int64_t val);
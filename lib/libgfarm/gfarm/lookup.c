@@ -674,10 +674,10 @@ gfm_inode_or_name_op0(const char *url, int flags,
 	gfm_name_request_op_t name_request_op,
 	gfm_result_op_t result_op, gfm_success_op_t success_op,
 	gfm_cleanup_op_t cleanup_op, void *closure,
-	struct gfm_connection **gfm_serverp)
+	struct gfm_connection **gfm_serverp, int slave_read)
 {
 	gfarm_error_t e, e2;
-	struct gfm_connection *gfm_server = NULL;
+	struct gfm_connection *gfm_server = NULL, *slave;
 	struct gfp_xdr_context *ctx = NULL;
 	struct gfp_xdr_xid_record *on_error_pos = NULL;
 	int type;
@@ -719,6 +719,13 @@ gfm_inode_or_name_op0(const char *url, int flags,
 				    url, gfarm_error_string(e));
 				break;
 			}
+			/* otherwise, the master is used */
+			if (slave_read &&
+			    gfm_client_slave_read_connection_acquire(
+			    gfm_server, &slave) == GFARM_ERR_NO_ERROR) {
+				gfm_client_connection_free(gfm_server);
+				gfm_server = slave;
+			}
 			if (path[0] == '\0')
 				path = "/";
 			gfm_client_connection_lock(gfm_server);
@@ -887,7 +894,7 @@ inode_or_name_op_rpc(struct gfm_connection **gfm_serverp, void *closure)
 	e = gfm_inode_or_name_op0(ii->url, ii->flags,
 	    ii->inode_request_op, ii->name_request_op,
 	    ii->result_op, ii->success_op, ii->cleanup_op,
-	    ii->closure, gfm_serverp);
+	    ii->closure, gfm_serverp, 0);
 	return (e);
 }
 
@@ -965,6 +972,42 @@ gfm_inode_op_readonly(const char *url, int flags,
 	    cleanup_op, NULL, closure));
 }
 
+/*
+ * same as gfm_inode_op_readonly(), but a slave gfmd may serve the request,
+ * if metadb_server_slave_read is enabled.
+ * request_op and result_op must only use requests which a slave serves
+ * by itself (see protocol_type() of gfmd), and success_op must free
+ * the connection.
+ */
+gfarm_error_t
+gfm_inode_op_readonly_on_slave(const char *url, int flags,
+	gfm_inode_request_op_t request_op, gfm_result_op_t result_op,
+	gfm_success_op_t success_op, gfm_cleanup_op_t cleanup_op, void *closure)
+{
+	gfarm_error_t e;
+	struct gfm_connection *gfm_server = NULL;
+
+	if (!gfarm_ctxp->metadb_server_slave_read)
+		return (gfm_inode_op(url, flags, request_op, result_op,
+		    success_op, cleanup_op, NULL, closure));
+
+	e = gfm_inode_or_name_op0(url, flags | GFARM_FILE_OPEN_LAST_COMPONENT,
+	    request_op, NULL, result_op, success_op, cleanup_op, closure,
+	    &gfm_server, 1);
+	if (e != GFARM_ERR_NO_ERROR && gfm_server != NULL)
+		gfm_client_connection_free(gfm_server);
+	if (gfm_client_is_connection_error(e)) {
+		/* retry by the master, with failover */
+		gflog_debug(GFARM_MSG_UNFIXED,
+		    "read on slave gfmd: %s, retry on master",
+		    gfarm_error_string(e));
+		return (gfm_inode_op(url, flags, request_op, result_op,
+		    success_op, cleanup_op, NULL, closure));
+	}
+	return (e == GFARM_ERR_PATH_IS_ROOT ?
+		GFARM_ERR_OPERATION_NOT_PERMITTED : e);
+}
+
 gfarm_error_t
 gfm_inode_op_modifiable(const char *url, int flags,
 	gfm_inode_request_op_t request_op, gfm_result_op_t result_op,
@@ -995,6 +1038,16 @@ gfm_inode_op_no_follow_readonly(const char *url, int flags,
 	    success_op, cleanup_op, NULL, closure));
 }
 
+gfarm_error_t
+gfm_inode_op_no_follow_readonly_on_slave(const char *url, int flags,
+	gfm_inode_request_op_t request_op, gfm_result_op_t result_op,
+	gfm_success_op_t success_op, gfm_cleanup_op_t cleanup_op, void *closure)
+{
+	return (gfm_inode_op_readonly_on_slave(url,
+	    flags | GFARM_FILE_SYMLINK_NO_FOLLOW,
+	    request_op, result_op, success_op, cleanup_op, closure));
+}
+
 gfarm_error_t
 gfm_inode_op_no_follow_modifiable(const char *url, int flags,
 	gfm_inode_request_op_t request_op, gfm_result_op_t result_op,
@@ -40,6 +40,12 @@ gfarm_error_t gfm_inode_op_modifiable(const char *, int,
 gfarm_error_t gfm_inode_op_no_follow_readonly(const char *, int,
 	gfm_inode_request_op_t, gfm_result_op_t, gfm_success_op_t,
 	gfm_cleanup_op_t, void *);
+gfarm_error_t gfm_inode_op_readonly_on_slave(const char *, int,
+	gfm_inode_request_op_t, gfm_result_op_t, gfm_success_op_t,
+	gfm_cleanup_op_t, void *);
+gfarm_error_t gfm_inode_op_no_follow_readonly_on_slave(const char *, int,
+	gfm_inode_request_op_t, gfm_result_op_t, gfm_success_op_t,
+	gfm_cleanup_op_t, void *);
 gfarm_error_t gfm_inode_op_no_follow_modifiable(const char *, int,
 	gfm_inode_request_op_t, gfm_result_op_t, gfm_success_op_t,
 	gfm_cleanup_op_t, gfm_must_be_warned_op_t, void *);
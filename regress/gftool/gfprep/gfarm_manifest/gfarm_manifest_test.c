@@ -0,0 +1,335 @@
+/*
+ * test of the manifest file of gfpcopy
+ *
+ * usage:
+ *	gfarm_manifest_test <local file>
+ *		save and load manifests to/from the file, and check that
+ *		a manifest for other URLs, of another byte order or version,
+ *		or truncated is rejected
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <gfarm/gfarm.h>
+
+#include "gfarm_manifest.h"
+
+#define SRC_URL		"gfarm:///src"
+#define DST_URL		"file:///dst"
+
+/* more than the initial size of the hash table, to make it grow */
+#define NENTRIES	5000
+
+/* offsets in the header of a manifest file */
+#define HEADER_BYTE_ORDER_OFF	8
+#define HEADER_VERSION_OFF	12
+#define HEADER_SIZE		40
+
+static const char *file;
+
+static void
+entry_set(struct gfarm_manifest_entry *ent, int i)
+{
+	char subpath[64];
+
+	snprintf(subpath, sizeof(subpath), "dir%d/file%d", i % 10, i);
+	memset(ent, 0, sizeof(*ent));
+	ent->key = gfarm_manifest_key(subpath);
+	ent->size = i;
+	ent->m_sec = 1000000000 + i;
+	ent->m_nsec = i % 1000000000;
+	ent->d_type = GFS_DT_REG;
+	ent->ino = 100 + i;
+	ent->gen = i % 7;
+}
+
+static gfarm_manifest_t *
+manifest_new(void)
+{
+	gfarm_manifest_t *manifest;
+	gfarm_error_t e;
+
+	if ((e = gfarm_manifest_init(&manifest)) != GFARM_ERR_NO_ERROR) {
+		fprintf(stderr, "gfarm_manifest_init: %s\n",
+		    gfarm_error_string(e));
+		exit(2);
+	}
+	return (manifest);
+}
+
+static int
+manifest_check(const char *diag, gfarm_manifest_t *manifest, int n)
+{
+	struct gfarm_manifest_entry ent;
+	const struct gfarm_manifest_entry *found;
+	int i;
+
+	if (gfarm_manifest_count(manifest) != n) {
+		fprintf(stderr, "%s: %d entries, expected %d\n",
+		    diag, gfarm_manifest_count(manifest), n);
+		return (0);
+	}
+	for (i = 0; i < n; i++) {
+		entry_set(&ent, i);
+		found = gfarm_manifest_lookup(manifest, ent.key);
+		if (found == NULL) {
+			fprintf(stderr, "%s: entry %d not found\n", diag, i);
+			return (0);
+		}
+		if (memcmp(found, &ent, sizeof(ent)) != 0) {
+			fprintf(stderr, "%s: entry %d differs\n", diag, i);
+			return (0);
+		}
+	}
+	entry_set(&ent, n);
+	if (gfarm_manifest_lookup(manifest, ent.key) != NULL) {
+		fprintf(stderr, "%s: entry %d unexpectedly found\n", diag, n);
+		return (0);
+	}
+	return (1);
+}
+
+static int
+test_enter(gfarm_manifest_t *manifest)
+{
+	struct gfarm_manifest_entry ent;
+	gfarm_error_t e;
+	int i;
+
+	for (i = 0; i < NENTRIES; i++) {
+		entry_set(&ent, i);
+		if ((e = gfarm_manifest_enter(manifest, &ent))
+		    != GFARM_ERR_NO_ERROR) {
+			fprintf(stderr, "gfarm_manifest_enter: %s\n",
+			    gfarm_error_string(e));
+			return (0);
+		}
+	}
+	if (!manifest_check("enter", manifest, NENTRIES))
+		return (0);
+
+	/* entering the same key again replaces the entry */
+	entry_set(&ent, 0);
+	ent.size = -1;
+	if ((e = gfarm_manifest_enter(manifest, &ent)) != GFARM_ERR_NO_ERROR) {
+		fprintf(stderr, "gfarm_manifest_enter: %s\n",
+		    gfarm_error_string(e));
+		return (0);
+	}
+	if (gfarm_manifest_count(manifest) != NENTRIES ||
+	    gfarm_manifest_lookup(manifest, ent.key)->size != -1) {
+		fprintf(stderr, "enter: an entry of the same key is not "
+		    "replaced\n");
+		return (0);
+	}
+	entry_set(&ent, 0);
+	gfarm_manifest_enter(manifest, &ent);
+	return (1);
+}
+
+static int
+load_expect(const char *diag, const char *src_url, const char *dst_url,
+	gfarm_error_t expected)
+{
+	gfarm_manifest_t *manifest = manifest_new();
+	gfarm_error_t e;
+
+	e = gfarm_manifest_load(manifest, file, src_url, dst_url);
+	gfarm_manifest_free(manifest);
+	if (e != expected) {
+		fprintf(stderr, "%s: %s, expected %s\n", diag,
+		    gfarm_error_string(e), gfarm_error_string(expected));
+		return (0);
+	}
+	return (1);
+}
+
+static int
+test_save_load(gfarm_manifest_t *manifest)
+{
+	gfarm_manifest_t *loaded;
+	gfarm_error_t e;
+	int ok;
+
+	unlink(file);
+	if (!load_expect("load of a nonexistent file", SRC_URL, DST_URL,
+	    GFARM_ERR_NO_SUCH_FILE_OR_DIRECTORY))
+		return (0);
+
+	if ((e = gfarm_manifest_save(manifest, file, SRC_URL, DST_URL))
+	    != GFARM_ERR_NO_ERROR) {
+		fprintf(stderr, "gfarm_manifest_save: %s\n",
+		    gfarm_error_string(e));
+		return (0);
+	}
+	loaded = manifest_new();
+	if ((e = gfarm_manifest_load(loaded, file, SRC_URL, DST_URL))
+	    != GFARM_ERR_NO_ERROR) {
+		fprintf(stderr, "gfarm_manifest_load: %s\n",
+		    gfarm_error_string(e));
+		gfarm_manifest_free(loaded);
+		return (0);
+	}
+	ok = manifest_check("load", loaded, NENTRIES);
+	gfarm_manifest_free(loaded);
+	return (ok);
+}
+
+static int
+test_urls(void)
+{
+	int ok = 1;
+
+	if (!load_expect("other source URL", "gfarm:///srx", DST_URL,
+	    GFARM_ERR_INVALID_ARGUMENT))
+		ok = 0;
+	if (!load_expect("other destination URL", SRC_URL, "file:///dsx",
+	    GFARM_ERR_INVALID_ARGUMENT))
+		ok = 0;
+	if (!load_expect("longer source URL", SRC_URL "/a", DST_URL,
+	    GFARM_ERR_INVALID_ARGUMENT))
+		ok = 0;
+	if (!load_expect("shorter destination URL", SRC_URL, "file:///",
+	    GFARM_ERR_INVALID_ARGUMENT))
+		ok = 0;
+	if (!load_expect("swapped URLs", DST_URL, SRC_URL,
+	    GFARM_ERR_INVALID_ARGUMENT))
+		ok = 0;
+	return (ok);
+}
+
+static void
+file_read_write(long off, void *buf, size_t len, int write)
+{
+	FILE *fp;
+
+	if ((fp = fopen(file, "r+")) == NULL ||
+	    fseek(fp, off, SEEK_SET) == -1 ||
+	    (write ? fwrite(buf, len, 1, fp) : fread(buf, len, 1, fp)) != 1 ||
+	    fclose(fp) == EOF) {
+		perror(file);
+		exit(2);
+	}
+}
+
+static int
+header_corrupt_expect(const char *diag, long off, gfarm_error_t expected)
+{
+	gfarm_uint32_t orig, val;
+	int ok;
+
+	file_read_write(off, &orig, sizeof(orig), 0);
+	val = off == HEADER_BYTE_ORDER_OFF ?
+	    /* as if it is written on a host of the other byte order */
+	    ((orig & 0xff) << 24) | ((orig & 0xff00) << 8) |
+	    ((orig >> 8) & 0xff00) | ((orig >> 24) & 0xff) :
+	    orig + 1;
+	file_read_write(off, &val, sizeof(val), 1);
+	ok = load_expect(diag, SRC_URL, DST_URL, expected);
+	file_read_write(off, &orig, sizeof(orig), 1);
+	return (ok);
+}
+
+static int
+test_header(void)
+{
+	int ok = 1;
+	char magic;
+
+	if (!header_corrupt_expect("other byte order", HEADER_BYTE_ORDER_OFF,
+	    GFARM_ERR_PROTOCOL_NOT_SUPPORTED))
+		ok = 0;
+	if (!header_corrupt_expect("other version", HEADER_VERSION_OFF,
+	    GFARM_ERR_PROTOCOL_NOT_SUPPORTED))
+		ok = 0;
+
+	file_read_write(0, &magic, 1, 0);
+	magic ^= 1;
+	file_read_write(0, &magic, 1, 1);
+	if (!load_expect("broken magic", SRC_URL, DST_URL, GFARM_ERR_PROTOCOL))
+		ok = 0;
+	magic ^= 1;
+	file_read_write(0, &magic, 1, 1);
+
+	/* make sure that the file is restored */
+	if (!load_expect("restored", SRC_URL, DST_URL, GFARM_ERR_NO_ERROR))
+		ok = 0;
+	return (ok);
+}
+
+static int
+test_truncated(void)
+{
+	long url_end = HEADER_SIZE + strlen(SRC_URL) + strlen(DST_URL);
+	long ents_end = url_end +
+	    (long)NENTRIES * sizeof(struct gfarm_manifest_entry);
+	int ok = 1;
+
+	if (truncate(file, ents_end - 1) == -1) {
+		perror(file);
+		exit(2);
+	}
+	if (!load_expect("truncated in the last entry", SRC_URL, DST_URL,
+	    GFARM_ERR_UNEXPECTED_EOF))
+		ok = 0;
+	if (truncate(file, url_end) == -1) {
+		perror(file);
+		exit(2);
+	}
+	if (!load_expect("truncated after the URLs", SRC_URL, DST_URL,
+	    GFARM_ERR_UNEXPECTED_EOF))
+		ok = 0;
+	if (truncate(file, url_end - 1) == -1) {
+		perror(file);
+		exit(2);
+	}
+	if (!load_expect("truncated in the URLs", SRC_URL, DST_URL,
+	    GFARM_ERR_INVALID_ARGUMENT))
+		ok = 0;
+	if (truncate(file, HEADER_SIZE - 1) == -1) {
+		perror(file);
+		exit(2);
+	}
+	if (!load_expect("truncated in the header", SRC_URL, DST_URL,
+	    GFARM_ERR_UNEXPECTED_EOF))
+		ok = 0;
+	if (truncate(file, 0) == -1) {
+		perror(file);
+		exit(2);
+	}
+	if (!load_expect("empty", SRC_URL, DST_URL, GFARM_ERR_UNEXPECTED_EOF))
+		ok = 0;
+	return (ok);
+}
+
+int
+main(int argc, char **argv)
+{
+	gfarm_manifest_t *manifest;
+	int ok;
+
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s <local file>\n", argv[0]);
+		return (2);
+	}
+	file = argv[1];
+
+	manifest = manifest_new();
+	ok = test_enter(manifest) && test_save_load(manifest);
+	gfarm_manifest_free(manifest);
+	if (ok) {
+		if (!test_urls())
+			ok = 0;
+		if (!test_header())
+			ok = 0;
+		if (!test_truncated())
+			ok = 0;
+	}
+	unlink(file);
+	if (ok)
+		printf("ok\n");
+	return (ok ? 0 : 1);
+}
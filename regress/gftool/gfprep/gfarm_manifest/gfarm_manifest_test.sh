@@ -0,0 +1,12 @@
+#!/bin/sh
+
+. ./regress.conf
+
+trap 'rm -f $localtmp $localtmp.tmp; exit $exit_trap' $trap_sigs
+
+if $testbin/gfarm_manifest_test $localtmp; then
+	exit_code=$exit_pass
+fi
+
+rm -f $localtmp $localtmp.tmp
+exit $exit_code
@@ -0,0 +1,177 @@
+/*
+ * test vectors and micro-benchmark of gfarm_crc32()
+ *
+ * usage:
+ *	crc32_test
+ *		compare every implementation with the known CRC values,
+ *		and with the byte-at-a-time implementation
+ *	crc32_test -b [-s size] [-n count]
+ *		measure the throughput of every implementation
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include <gfarm/gfarm.h>
+
+#include "crc32.h"
+
+static const char *implementations[] = {
+	"pclmul", "sliced8", "bytewise", NULL
+};
+
+static const struct {
+	const char *data;
+	gfarm_uint32_t crc;
+} vectors[] = {
+	{ "", 0x00000000 },
+	{ "a", 0xe8b7be43 },
+	{ "abc", 0x352441c2 },
+	{ "123456789", 0xcbf43926 },
+	{ "message digest", 0x20159d7f },
+	{ "abcdefghijklmnopqrstuvwxyz", 0x4c2750bd },
+	{ "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789",
+	  0x1fc2e6d2 },
+	{ "1234567890123456789012345678901234567890"
+	  "1234567890123456789012345678901234567890", 0x7ca94a72 },
+	{ "The quick brown fox jumps over the lazy dog", 0x414fa339 },
+};
+
+#define NVECTORS	(sizeof(vectors) / sizeof(vectors[0]))
+
+typedef gfarm_uint32_t (*crc32_func_t)(gfarm_uint32_t, const void *, size_t);
+
+static int
+test_vectors(const char *name, crc32_func_t func)
+{
+	int i, ok = 1;
+	gfarm_uint32_t crc;
+
+	for (i = 0; i < NVECTORS; i++) {
+		crc = (*func)(0, vectors[i].data, strlen(vectors[i].data));
+		if (crc != vectors[i].crc) {
+			fprintf(stderr, "%s: \"%s\": %08x, expected %08x\n",
+			    name, vectors[i].data, crc, vectors[i].crc);
+			ok = 0;
+		}
+	}
+	return (ok);
+}
+
+/* every length, every alignment, and split into two calls */
+static int
+test_compare(const char *name, crc32_func_t func)
+{
+	unsigned char *buf;
+	size_t bufsize = 4096 + 16, off, len, split;
+	gfarm_uint32_t crc, expected;
+	int i, ok = 1;
+
+	if ((buf = malloc(bufsize)) == NULL) {
+		fprintf(stderr, "no memory\n");
+		return (0);
+	}
+	srandom(1);
+	for (i = 0; i < bufsize; i++)
+		buf[i] = random();
+
+	for (off = 0; off < 16 && ok; off++) {
+		for (len = 0; off + len <= bufsize && ok;
+		    len += len < 300 ? 1 : 61) {
+			expected = gfarm_crc32_bytewise(0, buf + off, len);
+			crc = (*func)(0, buf + off, len);
+			split = len / 3;
+			if (crc != expected ||
+			    (*func)((*func)(0, buf + off, split),
+			    buf + off + split, len - split) != expected) {
+				fprintf(stderr, "%s: offset %d, length %d: "
+				    "%08x, expected %08x\n", name,
+				    (int)off, (int)len, crc, expected);
+				ok = 0;
+			}
+		}
+	}
+	free(buf);
+	return (ok);
+}
+
+static double
+timeval_sub(struct timeval *t1, struct timeval *t0)
+{
+	return ((t1->tv_sec - t0->tv_sec) +
+	    (t1->tv_usec - t0->tv_usec) / 1000000.0);
+}
+
+static void
+benchmark(const char *name, crc32_func_t func, size_t size, int count)
+{
+	unsigned char *buf;
+	struct timeval t0, t1;
+	gfarm_uint32_t crc = 0;
+	double t;
+	int i;
+
+	if ((buf = malloc(size)) == NULL) {
+		fprintf(stderr, "no memory\n");
+		exit(2);
+	}
+	for (i = 0; i < size; i++)
+		buf[i] = i;
+	gettimeofday(&t0, NULL);
+	for (i = 0; i < count; i++)
+		crc = (*func)(crc, buf, size);
+	gettimeofday(&t1, NULL);
+	t = timeval_sub(&t1, &t0);
+	printf("%-8s %8d bytes x %8d: %10.3f MB/s (%08x)\n", name,
+	    (int)size, count,
+	    t > 0 ? (double)size * count / t / 1000000.0 : 0.0, crc);
+	free(buf);
+}
+
+int
+main(int argc, char **argv)
+{
+	int c, i, ok = 1, bench = 0, count = 0;
+	size_t size = 4096;
+	crc32_func_t func;
+
+	while ((c = getopt(argc, argv, "bn:s:")) != -1) {
+		switch (c) {
+		case 'b':
+			bench = 1;
+			break;
+		case 'n':
+			count = atoi(optarg);
+			break;
+		case 's':
+			size = strtol(optarg, NULL, 0);
+			break;
+		default:
+			fprintf(stderr,
+			    "usage: %s [-b [-s size] [-n count]]\n", argv[0]);
+			return (2);
+		}
+	}
+	if (count <= 0)
+		count = (256 * 1024 * 1024) / (size > 0 ? size : 1);
+
+	printf("gfarm_crc32: %s\n", gfarm_crc32_implementation());
+	ok = test_vectors("gfarm_crc32", gfarm_crc32) &&
+	    test_compare("gfarm_crc32", gfarm_crc32);
+	for (i = 0; implementations[i] != NULL; i++) {
+		func = gfarm_crc32_implementation_lookup(implementations[i]);
+		if (func == NULL) {
+			printf("%-8s not available\n", implementations[i]);
+			continue;
+		}
+		if (!test_vectors(implementations[i], func) ||
+		    !test_compare(implementations[i], func))
+			ok = 0;
+		else if (bench)
+			benchmark(implementations[i], func, size, count);
+	}
+	return (ok ? 0 : 1);
+}
@@ -0,0 +1,187 @@
+/*
+ * test of the in-memory index of XML extended attributes
+ *
+ * usage:
+ *	xmlattr_index_test
+ *		compare the element paths of documents and the results of
+ *		expressions with the known ones
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gfarm/gfarm.h>
+
+#include "xmlattr_index.h"
+
+/* paths are separated by ' ', and NULL means "cannot be indexed" */
+static const struct {
+	const char *doc;
+	const char *paths;
+} documents[] = {
+	{ "<a/>", "/a" },
+	{ "<a><b/><c>text</c></a>", "/a /a/b /a/c" },
+	{ "<a><b/><b></b></a>", "/a /a/b" },
+	{ "<a><b><c/></b><d><c/></d></a>", "/a /a/b /a/b/c /a/d /a/d/c" },
+	{ "<?xml version=\"1.0\"?>\n<a>\n <b />\n</a>\n", "/a /a/b" },
+	{ "<a x='1' y=\"/\"><b z='>'/></a>", "/a /a/b" },
+	{ "<a><b></b ></a >", "/a /a/b" },
+	{ "", "" },
+	{ "text", "" },
+
+	/* comments, CDATA and processing instructions */
+	{ "<!-- <x> --><a><!-- </a> --><b/></a>", "/a /a/b" },
+	{ "<a><![CDATA[<x></y>]]></a>", "/a" },
+	{ "<a><?pi <x>?></a>", "/a" },
+	{ "<a><!-- unterminated </a>", NULL },
+	{ "<a><![CDATA[ unterminated </a>", NULL },
+
+	/* DOCTYPE */
+	{ "<!DOCTYPE a SYSTEM \"a.dtd\"><a/>", "/a" },
+	{ "<!DOCTYPE a [<!ENTITY e \"<b/>\">]><a>&e;</a>", NULL },
+	{ "<a><!DOCTYPE a></a>", NULL },
+
+	/* not well-formed */
+	{ "<a></b>", NULL },
+	{ "<a><b></a></b>", NULL },
+	{ "<ab></a>", NULL },
+	{ "<a></ab>", NULL },
+	{ "<a><b></b>", NULL },
+	{ "<a></a></a>", NULL },
+	{ "</a>", NULL },
+	{ "<a x='1></a>", NULL },
+	{ "<1a/>", NULL },
+
+	/* namespaces */
+	{ "<x:a/>", NULL },
+	{ "<a xmlns=\"urn:x\"/>", NULL },
+};
+
+#define NDOCUMENTS	(sizeof(documents) / sizeof(documents[0]))
+
+static const char expr_document[] = "<a><b><c/></b><d><c/></d></a>";
+
+/* match < 0 means that the expression is not supported */
+static const struct {
+	const char *expr;
+	int match;
+} expressions[] = {
+	{ "/a", 1 },
+	{ "/b", 0 },
+	{ "/a/c", 0 },
+	{ "/a/b/c", 1 },
+	{ "/a/b/c/d", 0 },
+	{ "//c", 1 },
+	{ "//e", 0 },
+	{ "/a//c", 1 },
+	{ "//b//c", 1 },
+	{ "//d/b", 0 },
+	{ "/*", 1 },
+	{ "//*", 1 },
+	{ "/a/*/c", 1 },
+	{ "/*/b", 1 },
+	{ "/*/*/*/*", 0 },
+	{ "", -1 },
+	{ "a", -1 },
+	{ "/a[1]", -1 },
+	{ "/a/text()", -1 },
+	{ "//@x", -1 },
+	{ "/a/", -1 },
+	{ "///a", -1 },
+};
+
+#define NEXPRESSIONS	(sizeof(expressions) / sizeof(expressions[0]))
+
+/* returns the packed paths in the " " separated form */
+static char *
+paths_to_string(const char *paths)
+{
+	const char *p;
+	char *s;
+	size_t len = 1;
+
+	for (p = paths; *p != '\0'; p += strlen(p) + 1)
+		len += strlen(p) + 1;
+	if ((s = malloc(len)) == NULL) {
+		fprintf(stderr, "no memory\n");
+		exit(2);
+	}
+	*s = '\0';
+	for (p = paths; *p != '\0'; p += strlen(p) + 1) {
+		if (*s != '\0')
+			strcat(s, " ");
+		strcat(s, p);
+	}
+	return (s);
+}
+
+static int
+test_documents(void)
+{
+	int i, ok = 1;
+	char *paths, *s;
+
+	for (i = 0; i < NDOCUMENTS; i++) {
+		paths = xmlattr_index_paths(documents[i].doc,
+		    strlen(documents[i].doc));
+		s = paths == NULL ? NULL : paths_to_string(paths);
+		if (s == NULL ? documents[i].paths != NULL :
+		    documents[i].paths == NULL ||
+		    strcmp(s, documents[i].paths) != 0) {
+			fprintf(stderr, "\"%s\": \"%s\", expected \"%s\"\n",
+			    documents[i].doc, s == NULL ? "(NULL)" : s,
+			    documents[i].paths == NULL ? "(NULL)" :
+			    documents[i].paths);
+			ok = 0;
+		}
+		free(s);
+		free(paths);
+	}
+	return (ok);
+}
+
+static int
+test_expressions(void)
+{
+	int i, ok = 1, supported, match;
+	char *paths;
+
+	paths = xmlattr_index_paths(expr_document, strlen(expr_document));
+	if (paths == NULL) {
+		fprintf(stderr, "\"%s\": cannot be indexed\n", expr_document);
+		return (0);
+	}
+	for (i = 0; i < NEXPRESSIONS; i++) {
+		supported = xmlattr_index_expr_is_supported(
+		    expressions[i].expr);
+		if (!supported) {
+			match = -1;
+		} else {
+			match = xmlattr_index_match(paths,
+			    expressions[i].expr);
+		}
+		if (match != expressions[i].match) {
+			fprintf(stderr, "\"%s\": %d, expected %d\n",
+			    expressions[i].expr, match,
+			    expressions[i].match);
+			ok = 0;
+		}
+	}
+	free(paths);
+	return (ok);
+}
+
+int
+main(int argc, char **argv)
+{
+	int ok = 1;
+
+	if (!test_documents())
+		ok = 0;
+	if (!test_expressions())
+		ok = 0;
+	if (ok)
+		printf("ok\n");
+	return (ok ? 0 : 1);
+}
@@ -17,6 +17,7 @@
 
 #include "gfutil.h"
 #include "thrsubr.h"
+#include "timer.h"
 
 #include "gfp_xdr.h"
 #include "config.h"
@@ -71,6 +72,20 @@ static db_enter_func_t db_enter_op = dbq_enter1;
 
 static int transaction_nesting = 0;
 
+/*
+ * group commit isn't worth for a single begin/update/end sequence,
+ * thus it's used only if more entries than this are waiting.
+ */
+#define DBQ_GROUP_COMMIT_THRESHOLD	3
+
+static pthread_mutex_t dbq_group_stat_mutex = PTHREAD_MUTEX_INITIALIZER;
+static const char DBQ_GROUP_STAT_MUTEX_DIAG[] = "dbq_group_stat_mutex";
+static struct dbq_group_stat {
+	unsigned long long groups, entries;
+	int max_entries;
+	double commit_time, max_commit_time;
+} dbq_group_stat;
+
 gfarm_error_t
 dbq_init(struct dbq *q)
 {
@@ -305,17 +320,23 @@ gfarm_dbq_enter_for_waitret(
 	return (dbq_enter_for_waitret(func, data, ctx));
 }
 
-gfarm_error_t
-dbq_delete(struct dbq *q, struct dbq_entry *entp)
+/*
+ * if "wait" is 0, this returns GFARM_ERR_NO_SUCH_OBJECT immediately
+ * when the queue is empty, without marking the queue quited.
+ */
+static gfarm_error_t
+dbq_delete0(struct dbq *q, struct dbq_entry *entp, int wait, int *nremainp)
 {
 	gfarm_error_t e;
 	static const char diag[] = "dbq_delete";
 
 	gfarm_mutex_lock(&q->mutex, diag, "mutex");
-	while (q->n <= 0 && !q->quitting) {
+	while (wait && q->n <= 0 && !q->quitting) {
 		gfarm_cond_wait(&q->nonempty, &q->mutex, diag, "nonempty");
 	}
-	if (q->n <= 0) {
+	if (q->n <= 0 && !wait) {
+		e = GFARM_ERR_NO_SUCH_OBJECT;
+	} else if (q->n <= 0) {
 		assert(q->quitting);
 		q->quited = 1;
 		gfarm_cond_signal(&q->finished, diag, "finished");
@@ -329,10 +350,18 @@ dbq_delete(struct dbq *q, struct dbq_entry *entp)
 			gfarm_cond_signal(&q->nonfull, diag, "nonfull");
 		}
 	}
+	if (nremainp != NULL)
+		*nremainp = q->n;
 	gfarm_mutex_unlock(&q->mutex, diag, "mutex");
 	return (e);
 }
 
+gfarm_error_t
+dbq_delete(struct dbq *q, struct dbq_entry *entp)
+{
+	return (dbq_delete0(q, entp, 1, NULL));
+}
+
 int
 db_getfreenum(void)
 {
@@ -415,36 +444,209 @@ get_db_access_mutex(void)
 	return (&db_access_mutex);
 }
 
+/* nesting level of ops->begin and ops->end, only used by db_thread */
+static int db_thread_depth = 0;
+
+static void
+db_thread_call(struct dbq_entry *ent)
+{
+	gfarm_error_t e;
+	static const char diag[] = "db_thread";
+
+	if (ent->func == (dbq_entry_func_t)ops->begin)
+		++db_thread_depth;
+	else if (ent->func == (dbq_entry_func_t)ops->end)
+		--db_thread_depth;
+
+	/* lock to avoid race condition between
+	 * db_journal_store_thread. */
+	gfarm_mutex_lock(&db_access_mutex, diag,
+	    DB_ACCESS_MUTEX_DIAG);
+
+	/* Do not execute a function that writes to database
+	 * when metadata-replication enabled.
+	 * Because we pass seqnum as zero. */
+	do {
+		e = (*ent->func)(0, ent->data);
+	} while (e == GFARM_ERR_DB_ACCESS_SHOULD_BE_RETRIED);
+
+	gfarm_mutex_unlock(&db_access_mutex, diag,
+	    DB_ACCESS_MUTEX_DIAG);
+}
+
+static gfarm_error_t
+db_thread_call_op(dbq_entry_func_t op)
+{
+	gfarm_error_t e;
+	static const char diag[] = "db_thread";
+
+	gfarm_mutex_lock(&db_access_mutex, diag, DB_ACCESS_MUTEX_DIAG);
+	e = (*op)(0, NULL);
+	gfarm_mutex_unlock(&db_access_mutex, diag, DB_ACCESS_MUTEX_DIAG);
+	return (e);
+}
+
+/* entries applied in the current group, only used by db_thread */
+static struct dbq_entry *db_thread_group_entries = NULL;
+static int db_thread_group_entries_size = 0;
+
+/* returns 0, if the entry cannot be replayed */
+static int
+db_thread_group_save(int n, struct dbq_entry *ent)
+{
+	struct dbq_entry *entries;
+	int size;
+
+	if (n >= db_thread_group_entries_size) {
+		size = db_thread_group_entries_size == 0 ?
+		    gfarm_metadb_dbq_group_commit_size :
+		    db_thread_group_entries_size * 2;
+		GFARM_REALLOC_ARRAY(entries, db_thread_group_entries, size);
+		if (entries == NULL)
+			return (0);
+		db_thread_group_entries = entries;
+		db_thread_group_entries_size = size;
+	}
+	db_thread_group_entries[n] = *ent;
+	return (1);
+}
+
+/*
+ * group commit:
+ * apply queued entries in one backend transaction, until the queue
+ * becomes empty, or the group reaches its size or time limit.
+ * the group ends only between top-level transactions, i.e. never
+ * between db_begin() and db_end().
+ * an entry with a callback waits for its result, thus it's not grouped.
+ * the backend keeps the data of the entries until group_end succeeds,
+ * and if it fails, e.g. the connection is recovered in the group,
+ * the entries are applied again one by one.
+ *
+ * returns 0, if the queue is quited.
+ */
+static int
+db_thread_group(struct dbq_entry *ent)
+{
+	gfarm_error_t e;
+	int i, n = 0, nsaved = 0, has_next = 0, running = 1;
+	struct timeval deadline;
+	gfarm_timerval_t t1, t2;
+	double commit_time;
+	static const char diag[] = "db_thread_group";
+
+	if ((e = db_thread_call_op(ops->group_begin)) != GFARM_ERR_NO_ERROR) {
+		gflog_warning(GFARM_MSG_UNFIXED,
+		    "%s: group_begin: %s", diag, gfarm_error_string(e));
+		db_thread_call(ent);
+		return (1);
+	}
+	gettimeofday(&deadline, NULL);
+	gfarm_timeval_add_microsec(&deadline,
+	    gfarm_metadb_dbq_group_commit_interval * 1000L);
+	for (;;) {
+		if (db_thread_group_save(nsaved, ent))
+			nsaved++;
+		db_thread_call(ent);
+		++n;
+		if (db_thread_depth == 0 &&
+		    (n >= gfarm_metadb_dbq_group_commit_size ||
+		    gfarm_timeval_is_expired(&deadline)))
+			break;
+		/* wait for the end of the transaction, if it's not queued */
+		e = dbq_delete0(&dbq, ent, db_thread_depth > 0, NULL);
+		if (e != GFARM_ERR_NO_ERROR) {
+			running = db_thread_depth == 0; /* quited if waited */
+			break;
+		}
+		if (db_thread_depth == 0 && ent->func == dbq_call_callback) {
+			has_next = 1;
+			break;
+		}
+	}
+
+	gfarm_gettimerval(&t1);
+	e = db_thread_call_op(ops->group_end);
+	gfarm_gettimerval(&t2);
+	commit_time = gfarm_timerval_sub(&t2, &t1);
+	if (e != GFARM_ERR_NO_ERROR) {
+		if (nsaved < n)
+			gflog_error(GFARM_MSG_UNFIXED,
+			    "%s: group_end: %d entries: %s, "
+			    "%d entries are lost due to no memory",
+			    diag, n, gfarm_error_string(e), n - nsaved);
+		else
+			gflog_warning(GFARM_MSG_UNFIXED,
+			    "%s: group_end: %d entries: %s, "
+			    "applying them one by one",
+			    diag, n, gfarm_error_string(e));
+		for (i = 0; i < nsaved; i++)
+			db_thread_call(&db_thread_group_entries[i]);
+	}
+
+	gfarm_mutex_lock(&dbq_group_stat_mutex, diag,
+	    DBQ_GROUP_STAT_MUTEX_DIAG);
+	dbq_group_stat.groups++;
+	dbq_group_stat.entries += n;
+	if (dbq_group_stat.max_entries < n)
+		dbq_group_stat.max_entries = n;
+	dbq_group_stat.commit_time += commit_time;
+	if (dbq_group_stat.max_commit_time < commit_time)
+		dbq_group_stat.max_commit_time = commit_time;
+	gfarm_mutex_unlock(&dbq_group_stat_mutex, diag,
+	    DBQ_GROUP_STAT_MUTEX_DIAG);
+
+	if (has_next)
+		db_thread_call(ent);
+	return (running);
+}
+
 void *
 db_thread(void *arg)
 {
 	gfarm_error_t e;
 	struct dbq_entry ent;
-	static const char diag[] = "db_thread";
+	int nremain;
 
 	for (;;) {
-		e = dbq_delete(&dbq, &ent);
+		e = dbq_delete0(&dbq, &ent, 1, &nremain);
 		if (e == GFARM_ERR_NO_ERROR) {
-			/* lock to avoid race condition between
-			 * db_journal_store_thread. */
-			gfarm_mutex_lock(&db_access_mutex, diag,
-			    DB_ACCESS_MUTEX_DIAG);
-
-			/* Do not execute a function that writes to database
-			 * when metadata-replication enabled.
-			 * Because we pass seqnum as zero. */
-			do {
-				e = (*ent.func)(0, ent.data);
-			} while (e == GFARM_ERR_DB_ACCESS_SHOULD_BE_RETRIED);
-
-			gfarm_mutex_unlock(&db_access_mutex, diag,
-			    DB_ACCESS_MUTEX_DIAG);
+			if (ops->group_begin != NULL &&
+			    gfarm_metadb_dbq_group_commit_size > 1 &&
+			    db_thread_depth == 0 &&
+			    nremain >= DBQ_GROUP_COMMIT_THRESHOLD &&
+			    ent.func != dbq_call_callback) {
+				if (!db_thread_group(&ent))
+					break;
+			} else
+				db_thread_call(&ent);
 		} else if (e == GFARM_ERR_NO_SUCH_OBJECT)
 			break;
 	}
 	return (NULL);
 }
 
+void
+db_thread_info(void)
+{
+	struct dbq_group_stat st;
+	static const char diag[] = "db_thread_info";
+
+	gfarm_mutex_lock(&dbq_group_stat_mutex, diag,
+	    DBQ_GROUP_STAT_MUTEX_DIAG);
+	st = dbq_group_stat;
+	gfarm_mutex_unlock(&dbq_group_stat_mutex, diag,
+	    DBQ_GROUP_STAT_MUTEX_DIAG);
+
+	gflog_info(GFARM_MSG_UNFIXED,
+	    "db group commit: %llu groups, %llu entries "
+	    "(average %.1f, max %d), commit %.3f sec (average %.6f, max %.6f)",
+	    st.groups, st.entries,
+	    st.groups == 0 ? 0.0 : (double)st.entries / st.groups,
+	    st.max_entries, st.commit_time,
+	    st.groups == 0 ? 0.0 : st.commit_time / st.groups,
+	    st.max_commit_time);
+}
+
 gfarm_error_t
 db_begin(const char *diag)
 {
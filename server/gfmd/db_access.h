@@ -7,6 +7,7 @@
 gfarm_error_t db_initialize(void);
 gfarm_error_t db_terminate(void);
 void *db_thread(void *);
+void db_thread_info(void);
 int db_getfreenum(void);
 
 gfarm_error_t db_begin(const char *);
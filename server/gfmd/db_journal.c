@@ -12,9 +12,7 @@
 #include <stdarg.h>
 #include <errno.h>
 #include <sys/param.h>
-#ifdef DEBUG_JOURNAL
 #include <sys/time.h>
-#endif
 
 #include <gfarm/gfarm.h>
 
@@ -23,9 +21,8 @@
 #include "queue.h"
 #include "gfutil.h"
 #include "thrsubr.h"
-#ifdef DEBUG_JOURNAL
 #include "timer.h"
-#endif
+#include "nanosec.h"
 
 #include "metadb_common.h"
 #include "xattr_info.h"
@@ -62,6 +59,8 @@ static const struct db_ops	*journal_apply_ops;
  */
 static void			(*db_journal_fail_store_op)(void);
 static gfarm_error_t		(*db_journal_sync_op)(gfarm_uint64_t);
+static pthread_key_t		journal_sync_pending_key;
+static int			journal_sync_pending_key_created = 0;
 static void			(*db_journal_remove_db_update_info_op)(
 					gfarm_uint64_t, const char *);
 
@@ -96,6 +95,19 @@ static int journal_transaction_nesting = 0;
 static int journal_begin_called = 0;
 static int journal_slave_transaction_nesting = 0;
 
+/* seqnum of the journal applied to the memory of a slave */
+#define JOURNAL_APPLIED_DIAG	"journal_applied"
+
+static struct journal_applied {
+	pthread_mutex_t mutex;
+	pthread_cond_t updated;
+	gfarm_uint64_t seqnum;
+} journal_applied = {
+	PTHREAD_MUTEX_INITIALIZER,
+	PTHREAD_COND_INITIALIZER,
+	GFARM_METADB_SERVER_SEQNUM_INVALID,
+};
+
 
 static void
 db_seqnum_load_callback(void *closure, struct db_seqnum_arg *a)
@@ -141,10 +153,17 @@ db_journal_init_seqnum(void)
 	}
 }
 
+static void
+journal_sync_pending_free(void *p)
+{
+	free(p);
+}
+
 void
 db_journal_init(void)
 {
 	gfarm_error_t e;
+	int err;
 	char path[MAXPATHLEN + 1];
 	const char *journal_dir = gfarm_get_journal_dir();
 #ifdef DEBUG_JOURNAL
@@ -159,7 +178,15 @@ db_journal_init(void)
 		    gfarm_error_string(e));
 	}
 
+	if ((err = pthread_key_create(&journal_sync_pending_key,
+	    journal_sync_pending_free)) != 0)
+		gflog_fatal(GFARM_MSG_UNFIXED,
+		    "db_journal_init: pthread_key_create: %s", strerror(err));
+	journal_sync_pending_key_created = 1;
+
 	db_journal_init_seqnum();
+	/* the memory is loaded from the backend DB at this point */
+	journal_applied.seqnum = journal_seqnum;
 	gflog_info(GFARM_MSG_1003503,
 	    "db_journal_init_seqnum : seqnum=%llu",
 	    (unsigned long long)journal_seqnum);
@@ -568,6 +595,237 @@ db_journal_file_writer_sync(void)
 	return (journal_file_writer_sync(journal_file_writer(self_jf)));
 }
 
+/**********************************************************/
+/* group commit of fdatasync */
+
+/*
+ * a committed transaction does not call fdatasync(2) by itself,
+ * but requests it to journal_sync_thread, and the thread which
+ * committed the transaction waits for the completion before sending
+ * the reply to the client, after the giant lock is released.
+ * thus, transactions committed while fdatasync(2) is running share
+ * the next fdatasync(2).
+ *
+ * all records are flushed to the journal file by journal_file_write()
+ * before they are requested, so they are covered by the next
+ * fdatasync(2) of a dup(2)ed descriptor.
+ *
+ * once fdatasync(2) fails, the error is latched, and every transaction
+ * after the last successful one is reported as not durable, because
+ * a later fdatasync(2) may succeed without writing the lost pages.
+ */
+
+#define JOURNAL_SYNC_DIAG	"journal_sync"
+
+static struct journal_sync {
+	pthread_mutex_t mutex;
+	pthread_cond_t requested, done;
+	int fd;				/* dup(2) of the journal file */
+
+	gfarm_uint64_t requested_seqnum, synced_seqnum;
+	gfarm_uint64_t nrequests;	/* of the current group */
+	gfarm_error_t error;		/* latched error of fdatasync */
+	gfarm_uint64_t failed_seqnum;	/* the first seqnum not synced */
+	gfarm_uint64_t last_group_size;
+	double latency;			/* average of fdatasync, in seconds */
+
+	/* statistics */
+	gfarm_uint64_t total_syncs, total_requests;
+	double total_delay;
+} journal_sync = {
+	PTHREAD_MUTEX_INITIALIZER,
+	PTHREAD_COND_INITIALIZER,
+	PTHREAD_COND_INITIALIZER,
+	-1,
+};
+
+/* the last seqnum committed by the current thread, 0 if none */
+static gfarm_uint64_t *
+journal_sync_pending(void)
+{
+	gfarm_uint64_t *pending = pthread_getspecific(journal_sync_pending_key);
+
+	if (pending == NULL) {
+		GFARM_MALLOC(pending);
+		if (pending == NULL)
+			return (NULL);
+		*pending = 0;
+		pthread_setspecific(journal_sync_pending_key, pending);
+	}
+	return (pending);
+}
+
+static void *
+db_journal_sync_thread(void *arg)
+{
+	struct journal_sync *js = &journal_sync;
+	gfarm_error_t e;
+	gfarm_uint64_t target;
+	long long delay; /* nanoseconds */
+	gfarm_timerval_t t1, t2;
+	double latency;
+	static const char diag[] = "db_journal_sync_thread";
+
+	for (;;) {
+		gfarm_mutex_lock(&js->mutex, diag, JOURNAL_SYNC_DIAG);
+		while (js->requested_seqnum <= js->synced_seqnum)
+			gfarm_cond_wait(&js->requested, &js->mutex,
+			    diag, JOURNAL_SYNC_DIAG);
+
+		/*
+		 * if the previous fdatasync was shared, transactions are
+		 * committed concurrently, thus wait for more of them.
+		 */
+		delay = 0;
+		if (js->last_group_size > 1) {
+			delay = js->latency / 2 * GFARM_SECOND_BY_NANOSEC;
+			if (delay > (long long)gfarm_get_journal_sync_group_delay()
+			    * GFARM_MICROSEC_BY_NANOSEC)
+				delay = (long long)
+				    gfarm_get_journal_sync_group_delay() *
+				    GFARM_MICROSEC_BY_NANOSEC;
+		}
+		if (delay > 0) {
+			gfarm_mutex_unlock(&js->mutex, diag,
+			    JOURNAL_SYNC_DIAG);
+			gfarm_nanosleep(delay);
+			gfarm_mutex_lock(&js->mutex, diag, JOURNAL_SYNC_DIAG);
+			js->total_delay += (double)delay /
+			    GFARM_SECOND_BY_NANOSEC;
+		}
+		target = js->requested_seqnum;
+		js->last_group_size = js->nrequests;
+		js->nrequests = 0;
+		gfarm_mutex_unlock(&js->mutex, diag, JOURNAL_SYNC_DIAG);
+
+		gfarm_gettimerval(&t1);
+		e = journal_file_sync_fd(js->fd);
+		gfarm_gettimerval(&t2);
+		latency = gfarm_timerval_sub(&t2, &t1);
+		if (e != GFARM_ERR_NO_ERROR)
+			gflog_error(GFARM_MSG_UNFIXED,
+			    "journal file sync: %s", gfarm_error_string(e));
+
+		gfarm_mutex_lock(&js->mutex, diag, JOURNAL_SYNC_DIAG);
+		if (e != GFARM_ERR_NO_ERROR && js->error == GFARM_ERR_NO_ERROR) {
+			js->error = e;
+			js->failed_seqnum = js->synced_seqnum + 1;
+		}
+		js->synced_seqnum = target;
+		js->latency = js->total_syncs == 0 ? latency :
+		    (js->latency * 7 + latency) / 8;
+		js->total_syncs++;
+		gfarm_cond_broadcast(&js->done, diag, JOURNAL_SYNC_DIAG);
+		gfarm_mutex_unlock(&js->mutex, diag, JOURNAL_SYNC_DIAG);
+	}
+
+	/*NOTREACHED*/
+	return (NULL);
+}
+
+static void
+db_journal_sync_thread_start(void)
+{
+	gfarm_error_t e;
+	int fd;
+
+	fd = dup(gfp_xdr_fd(journal_file_writer_xdr(
+	    journal_file_writer(self_jf))));
+	if (fd == -1)
+		gflog_fatal_errno(GFARM_MSG_UNFIXED,
+		    "db_journal_sync: dup");
+	journal_sync.fd = fd;
+	if ((e = create_detached_thread(db_journal_sync_thread, NULL))
+	    != GFARM_ERR_NO_ERROR)
+		gflog_fatal(GFARM_MSG_UNFIXED,
+		    "create_detached_thread(db_journal_sync_thread): %s",
+		    gfarm_error_string(e));
+}
+
+/*
+ * request fdatasync of the journal file up to "seqnum", and returns
+ * without waiting. db_journal_sync_wait() waits for the completion.
+ *
+ * PREREQUISITE: giant_lock
+ */
+gfarm_error_t
+db_journal_sync_request(gfarm_uint64_t seqnum)
+{
+	struct journal_sync *js = &journal_sync;
+	gfarm_uint64_t *pending;
+	static pthread_once_t initialized = PTHREAD_ONCE_INIT;
+	static const char diag[] = "db_journal_sync_request";
+
+	pthread_once(&initialized, db_journal_sync_thread_start);
+	if ((pending = journal_sync_pending()) == NULL)
+		return (db_journal_file_writer_sync()); /* no memory */
+
+	gfarm_mutex_lock(&js->mutex, diag, JOURNAL_SYNC_DIAG);
+	if (js->requested_seqnum < seqnum)
+		js->requested_seqnum = seqnum;
+	js->nrequests++;
+	js->total_requests++;
+	gfarm_cond_signal(&js->requested, diag, JOURNAL_SYNC_DIAG);
+	gfarm_mutex_unlock(&js->mutex, diag, JOURNAL_SYNC_DIAG);
+
+	*pending = seqnum;
+	return (GFARM_ERR_NO_ERROR);
+}
+
+/*
+ * wait until the transactions committed by the current thread are
+ * synced to the journal file, and returns an error if they are not
+ * durable.
+ * this should be called before a reply is sent, without giant_lock.
+ */
+gfarm_error_t
+db_journal_sync_wait(void)
+{
+	struct journal_sync *js = &journal_sync;
+	gfarm_uint64_t *pending;
+	gfarm_error_t e = GFARM_ERR_NO_ERROR;
+	static const char diag[] = "db_journal_sync_wait";
+
+	if (!journal_sync_pending_key_created)
+		return (GFARM_ERR_NO_ERROR);
+	pending = pthread_getspecific(journal_sync_pending_key);
+	if (pending == NULL || *pending == 0)
+		return (GFARM_ERR_NO_ERROR);
+
+	gfarm_mutex_lock(&js->mutex, diag, JOURNAL_SYNC_DIAG);
+	while (js->synced_seqnum < *pending)
+		gfarm_cond_wait(&js->done, &js->mutex,
+		    diag, JOURNAL_SYNC_DIAG);
+	if (js->error != GFARM_ERR_NO_ERROR && *pending >= js->failed_seqnum)
+		e = js->error;
+	gfarm_mutex_unlock(&js->mutex, diag, JOURNAL_SYNC_DIAG);
+	*pending = 0;
+	return (e);
+}
+
+void
+db_journal_sync_info(void)
+{
+	struct journal_sync *js = &journal_sync;
+	gfarm_uint64_t syncs, requests;
+	double latency, delay;
+	static const char diag[] = "db_journal_sync_info";
+
+	gfarm_mutex_lock(&js->mutex, diag, JOURNAL_SYNC_DIAG);
+	syncs = js->total_syncs;
+	requests = js->total_requests;
+	latency = js->latency;
+	delay = js->total_delay;
+	gfarm_mutex_unlock(&js->mutex, diag, JOURNAL_SYNC_DIAG);
+
+	gflog_info(GFARM_MSG_UNFIXED,
+	    "journal sync: %llu transactions by %llu fdatasync "
+	    "(%.2f transactions/fdatasync), latency %.6f sec, "
+	    "total delay %.3f sec",
+	    (unsigned long long)requests, (unsigned long long)syncs,
+	    syncs == 0 ? 0.0 : (double)requests / syncs, latency, delay);
+}
+
 static gfarm_error_t
 db_journal_write_string_size_add(enum journal_operation ope,
 	size_t *sizep, void *arg)
@@ -3516,6 +3774,77 @@ db_journal_is_rec_stored(struct db_journal_rec *rec)
 
 GFARM_STAILQ_HEAD(db_journal_rec_list, db_journal_rec);
 
+/**********************************************************/
+/* applied seqnum of a slave */
+
+static void
+db_journal_set_applied_seqnum(gfarm_uint64_t seqnum)
+{
+	struct journal_applied *ja = &journal_applied;
+	static const char diag[] = "db_journal_set_applied_seqnum";
+
+	gfarm_mutex_lock(&ja->mutex, diag, JOURNAL_APPLIED_DIAG);
+	if (ja->seqnum < seqnum) {
+		ja->seqnum = seqnum;
+		gfarm_cond_broadcast(&ja->updated, diag, JOURNAL_APPLIED_DIAG);
+	}
+	gfarm_mutex_unlock(&ja->mutex, diag, JOURNAL_APPLIED_DIAG);
+}
+
+/*
+ * the last seqnum whose transaction is visible in the memory of a slave.
+ * this is meaningless in a master, use db_journal_get_current_seqnum().
+ */
+gfarm_uint64_t
+db_journal_get_applied_seqnum(void)
+{
+	struct journal_applied *ja = &journal_applied;
+	gfarm_uint64_t seqnum;
+	static const char diag[] = "db_journal_get_applied_seqnum";
+
+	gfarm_mutex_lock(&ja->mutex, diag, JOURNAL_APPLIED_DIAG);
+	seqnum = ja->seqnum;
+	gfarm_mutex_unlock(&ja->mutex, diag, JOURNAL_APPLIED_DIAG);
+	return (seqnum);
+}
+
+/*
+ * wait until the transaction of the seqnum is applied to the memory.
+ * the giant lock must not be held, because the apply thread needs it.
+ */
+gfarm_error_t
+db_journal_wait_for_applied_seqnum(gfarm_uint64_t seqnum, int timeout_msec,
+	gfarm_uint64_t *appliedp)
+{
+	struct journal_applied *ja = &journal_applied;
+	struct timeval now;
+	struct timespec until;
+	gfarm_uint64_t applied;
+	static const char diag[] = "db_journal_wait_for_applied_seqnum";
+
+	gettimeofday(&now, NULL);
+	until.tv_sec = now.tv_sec + timeout_msec / 1000;
+	until.tv_nsec = now.tv_usec * 1000 +
+	    (long)(timeout_msec % 1000) * 1000000;
+	if (until.tv_nsec >= GFARM_SECOND_BY_NANOSEC) {
+		until.tv_sec++;
+		until.tv_nsec -= GFARM_SECOND_BY_NANOSEC;
+	}
+
+	gfarm_mutex_lock(&ja->mutex, diag, JOURNAL_APPLIED_DIAG);
+	while (ja->seqnum < seqnum) {
+		if (!gfarm_cond_timedwait(&ja->updated, &ja->mutex, &until,
+		    diag, JOURNAL_APPLIED_DIAG))
+			break;
+	}
+	applied = ja->seqnum;
+	gfarm_mutex_unlock(&ja->mutex, diag, JOURNAL_APPLIED_DIAG);
+
+	*appliedp = applied;
+	return (applied >= seqnum ?
+	    GFARM_ERR_NO_ERROR : GFARM_ERR_OPERATION_TIMED_OUT);
+}
+
 /* PREREQUISITE: journal_file_mutex */
 static gfarm_error_t
 db_journal_apply_op(void *op_arg, gfarm_uint64_t seqnum,
@@ -3590,6 +3919,7 @@ retry:
 		    != GFARM_ERR_NO_ERROR)
 			goto end;
 	}
+	db_journal_set_applied_seqnum(seqnum);
 end:
 	giant_unlock();
 	GFARM_STAILQ_FOREACH_SAFE(ai, c, next, tai) {
@@ -4302,4 +4632,6 @@ struct db_ops db_journal_ops = {
 	db_journal_mdhost_load,
 
 	db_journal_write_fsngroup_modify,
+	NULL,
+	NULL,
 };
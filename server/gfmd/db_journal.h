@@ -11,6 +11,9 @@ enum journal_operation;
 
 gfarm_uint64_t db_journal_next_seqnum(void);
 gfarm_uint64_t db_journal_get_current_seqnum(void);
+gfarm_uint64_t db_journal_get_applied_seqnum(void);
+gfarm_error_t db_journal_wait_for_applied_seqnum(gfarm_uint64_t, int,
+	gfarm_uint64_t *);
 void db_journal_set_apply_ops(const struct db_ops *);
 void db_journal_set_fail_store_op(void (*)(void));
 gfarm_error_t db_journal_read(struct journal_file_reader *, void *,
@@ -27,6 +30,9 @@ gfarm_error_t db_journal_recvq_enter(gfarm_uint64_t, gfarm_uint64_t, int,
 void db_journal_cancel_recvq();
 void db_journal_set_sync_op(gfarm_error_t (*func)(gfarm_uint64_t));
 gfarm_error_t db_journal_file_writer_sync(void);
+gfarm_error_t db_journal_sync_request(gfarm_uint64_t);
+gfarm_error_t db_journal_sync_wait(void);
+void db_journal_sync_info(void);
 void db_journal_set_remove_db_update_info_op(void (*)(gfarm_uint64_t,
 	const char *));
 void db_journal_wait_until_readable(void);
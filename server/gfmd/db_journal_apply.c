@@ -901,6 +901,8 @@ const struct db_ops db_journal_apply_ops = {
 	NULL,
 
 	db_journal_apply_fsngroup_modify,
+	NULL,
+	NULL,
 };
 
 void
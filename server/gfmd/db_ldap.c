@@ -3222,4 +3222,6 @@ const struct db_ops db_ldap_ops = {
 	NULL,
 
 	gfarm_ldap_fsngroup_modify,
+	NULL,
+	NULL,
 };
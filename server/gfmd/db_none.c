@@ -532,4 +532,6 @@ const struct db_ops db_none_ops = {
 	gfarm_none_mdhost_load,
 
 	gfarm_none_fsngroup_modify,
+	NULL,
+	NULL,
 };
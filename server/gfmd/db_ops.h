@@ -263,4 +263,12 @@ struct db_ops {
 
 	gfarm_error_t (*fsngroup_modify)(gfarm_uint64_t,
 		struct db_fsngroup_modify_arg *);
+
+	/*
+	 * group commit, NULL if not supported.
+	 * the arguments of the operations in a group must be kept until
+	 * group_end, and if group_end fails, they are applied again.
+	 */
+	gfarm_error_t (*group_begin)(gfarm_uint64_t, void *);
+	gfarm_error_t (*group_end)(gfarm_uint64_t, void *);
 };
@@ -31,6 +31,7 @@
 #include "internal_host_info.h"
 
 #include "gfutil.h"
+#include "hash.h"
 
 #include "gfp_xdr.h"
 #include "config.h"
@@ -106,6 +107,55 @@ static gfarm_error_t gfarm_pgsql_seqnum_modify(struct db_seqnum_arg *);
 
 /**********************************************************************/
 
+/*
+ * while group_active is 1, i.e. between gfarm_pgsql_group_begin() and
+ * gfarm_pgsql_group_end(), the arguments are not freed, because the
+ * caller applies them again, if the group is not committed.
+ * group_lost is set, if the group transaction is lost by a reconnection,
+ * and the rest of the group is not applied in that case.
+ */
+static int group_active = 0;
+static int group_lost = 0;
+static void **group_args = NULL;
+static int group_nargs = 0, group_args_size = 0;
+
+static void
+free_arg_deferred(void *arg)
+{
+	void **args;
+	int size;
+
+	if (arg == NULL)
+		return;
+	if (group_nargs >= group_args_size) {
+		size = group_args_size == 0 ? 1024 : group_args_size * 2;
+		GFARM_REALLOC_ARRAY(args, group_args, size);
+		if (args == NULL) {
+			/* leaked, but it may be applied again */
+			gflog_error(GFARM_MSG_UNFIXED,
+			    "pgsql group commit: no memory for %d args",
+			    size);
+			return;
+		}
+		group_args = args;
+		group_args_size = size;
+	}
+	group_args[group_nargs++] = arg;
+}
+
+/* if "committed" is 0, the caller frees them by applying them again */
+static void
+free_arg_deferred_end(int committed)
+{
+	int i;
+
+	if (committed) {
+		for (i = 0; i < group_nargs; i++)
+			free(group_args[i]);
+	}
+	group_nargs = 0;
+}
+
 static void
 free_arg(void *arg)
 {
@@ -129,8 +179,13 @@ free_arg(void *arg)
 	 *   db_journal_free_rec_list().
 	 *
 	 */
-	if (!gfarm_get_metadb_replication_enabled())
-		free(arg);
+	if (gfarm_get_metadb_replication_enabled())
+		return;
+	if (group_active) {
+		free_arg_deferred(arg);
+		return;
+	}
+	free(arg);
 }
 
 static PGconn *conn = NULL;
@@ -138,6 +193,20 @@ static int transaction_nesting = 0;
 static int transaction_ok;
 static int connection_recovered = 0;
 
+/*
+ * while transaction_group is 1, transaction_nesting 1 means the
+ * transaction opened by gfarm_pgsql_group_begin(), and each transaction
+ * in it is a savepoint.
+ */
+static int transaction_group = 0;
+#define GFARM_PGSQL_GROUP_SAVEPOINT	"gfarm_group"
+
+/* statements prepared by gfarm_pgsql_exec_prepared() */
+#define GFARM_PGSQL_STMT_HASHTAB_SIZE	127
+#define GFARM_PGSQL_STMT_MAX		256
+static struct gfarm_hash_table *stmt_table = NULL;
+static int stmt_count = 0;
+
 static char *
 gfarm_pgsql_make_conninfo(const char **varnames, char **varvalues, int n,
 	char *others)
@@ -254,11 +323,23 @@ gfarm_pgsql_initialize(void)
 	return (GFARM_ERR_NO_ERROR);
 }
 
+/* prepared statements belong to a connection */
+static void
+gfarm_pgsql_stmt_forget(void)
+{
+	if (stmt_table != NULL) {
+		gfarm_hash_table_free(stmt_table);
+		stmt_table = NULL;
+	}
+	stmt_count = 0;
+}
+
 gfarm_error_t
 gfarm_pgsql_terminate(void)
 {
 	/* close and free connection resources */
 	PQfinish(conn);
+	gfarm_pgsql_stmt_forget();
 
 	return (GFARM_ERR_NO_ERROR);
 }
@@ -417,9 +498,14 @@ pgsql_should_retry(PGresult *res)
 		 */
 		gflog_info(GFARM_MSG_1002333,
 		    "PostgreSQL connection recovered");
+		/* the whole group is lost too, in a group commit */
+		if (group_active)
+			group_lost = 1;
 		transaction_nesting = 0;
+		transaction_group = 0;
 		connection_recovered = 1;
 		transaction_ok = 0;
+		gfarm_pgsql_stmt_forget();
 		return (1);
 	} else if (PQresultStatus(res) == PGRES_FATAL_ERROR &&
 	    pge != NULL &&
@@ -576,6 +662,67 @@ gfarm_pgsql_insert_and_log(const char *command,
 	return (e);
 }
 
+/*
+ * same as PQexecParams(), but the command is prepared at its first use,
+ * to save parsing and planning of frequently used updates.
+ * this assumes the command is one of the fixed SQL statements in this file.
+ */
+static PGresult *
+gfarm_pgsql_exec_prepared(const char *command,
+	int nParams,
+	const Oid *paramTypes,
+	const char *const *paramValues,
+	const int *paramLengths,
+	const int *paramFormats,
+	int resultFormat)
+{
+	PGresult *res;
+	struct gfarm_hash_entry *entry;
+	int keylen = strlen(command) + 1, *stmtp;
+	char name[sizeof("gfarm_stmt_") + GFARM_INT32STRLEN];
+
+	if (stmt_table == NULL && (stmt_table = gfarm_hash_table_alloc(
+	    GFARM_PGSQL_STMT_HASHTAB_SIZE,
+	    gfarm_hash_default, gfarm_hash_key_equal_default)) == NULL)
+		return (PQexecParams(conn, command, nParams, paramTypes,
+		    paramValues, paramLengths, paramFormats, resultFormat));
+
+	entry = gfarm_hash_lookup(stmt_table, command, keylen);
+	if (entry != NULL) {
+		stmtp = gfarm_hash_entry_data(entry);
+	} else {
+		if (stmt_count >= GFARM_PGSQL_STMT_MAX)
+			return (PQexecParams(conn, command, nParams,
+			    paramTypes, paramValues, paramLengths,
+			    paramFormats, resultFormat));
+		snprintf(name, sizeof(name), "gfarm_stmt_%d", stmt_count);
+		res = PQprepare(conn, name, command, nParams, paramTypes);
+		if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+			/* let PQexecParams() report the problem */
+			PQclear(res);
+			return (PQexecParams(conn, command, nParams,
+			    paramTypes, paramValues, paramLengths,
+			    paramFormats, resultFormat));
+		}
+		PQclear(res);
+		entry = gfarm_hash_enter(stmt_table, command, keylen,
+		    sizeof(*stmtp), NULL);
+		if (entry == NULL) {
+			gflog_debug(GFARM_MSG_UNFIXED,
+			    "gfarm_pgsql_exec_prepared: no memory");
+			++stmt_count; /* the name is used */
+			return (PQexecPrepared(conn, name, nParams,
+			    paramValues, paramLengths, paramFormats,
+			    resultFormat));
+		}
+		stmtp = gfarm_hash_entry_data(entry);
+		*stmtp = stmt_count++;
+	}
+	snprintf(name, sizeof(name), "gfarm_stmt_%d", *stmtp);
+	return (PQexecPrepared(conn, name, nParams,
+	    paramValues, paramLengths, paramFormats, resultFormat));
+}
+
 static PGresult *
 gfarm_pgsql_exec_params(const char *command,
 	int nParams,
@@ -585,7 +732,7 @@ gfarm_pgsql_exec_params(const char *command,
 	const int *paramFormats,
 	int resultFormat)
 {
-	return (PQexecParams(conn, command, nParams,
+	return (gfarm_pgsql_exec_prepared(command, nParams,
 	    paramTypes, paramValues, paramLengths, paramFormats,
 	    resultFormat));
 }
@@ -602,7 +749,7 @@ gfarm_pgsql_exec_params_with_retry(const char *command,
 	PGresult *res;
 
 	do {
-		res = PQexecParams(conn, command, nParams,
+		res = gfarm_pgsql_exec_prepared(command, nParams,
 		    paramTypes, paramValues, paramLengths, paramFormats,
 		    resultFormat);
 	} while (PQresultStatus(res) != PGRES_COMMAND_OK &&
@@ -615,13 +762,16 @@ gfarm_pgsql_start(const char *diag)
 {
 	PGresult *res;
 
+	if (group_lost) /* will be applied again after the group */
+		return (GFARM_ERR_CONNECTION_ABORTED);
 	if (connection_recovered)
 		connection_recovered = 0;
-	if (transaction_nesting++ > 0)
+	if (transaction_nesting++ > transaction_group)
 		return (GFARM_ERR_NO_ERROR);
 
 	transaction_ok = 1;
-	res = PQexec(conn, "START TRANSACTION");
+	res = PQexec(conn, transaction_group ?
+	    "SAVEPOINT " GFARM_PGSQL_GROUP_SAVEPOINT : "START TRANSACTION");
 
 	if (PQresultStatus(res) != PGRES_COMMAND_OK) {
 		gflog_error(GFARM_MSG_1003244, "%s transaction BEGIN: %s",
@@ -641,14 +791,18 @@ gfarm_pgsql_start_with_retry(const char *diag)
 {
 	PGresult *res;
 
+	if (group_lost) /* will be applied again after the group */
+		return (GFARM_ERR_CONNECTION_ABORTED);
 	if (connection_recovered)
 		connection_recovered = 0;
-	if (transaction_nesting++ > 0)
+	if (transaction_nesting++ > transaction_group)
 		return (GFARM_ERR_NO_ERROR);
 
 	transaction_ok = 1;
 	do {
-		res = PQexec(conn, "START TRANSACTION");
+		res = PQexec(conn, transaction_group ?
+		    "SAVEPOINT " GFARM_PGSQL_GROUP_SAVEPOINT :
+		    "START TRANSACTION");
 	} while (PQresultStatus(res) != PGRES_COMMAND_OK &&
 	    pgsql_should_retry(res));
 	if (PQresultStatus(res) != PGRES_COMMAND_OK) {
@@ -661,15 +815,43 @@ gfarm_pgsql_start_with_retry(const char *diag)
 	return (GFARM_ERR_NO_ERROR);
 }
 
+/*
+ * end of a transaction in a group.
+ * a failed statement aborts the whole transaction of PostgreSQL,
+ * thus roll back to the savepoint in that case, to save the others.
+ */
+static gfarm_error_t
+gfarm_pgsql_savepoint_end(const char *diag)
+{
+	PGresult *res;
+
+	if (transaction_ok) {
+		res = PQexec(conn,
+		    "RELEASE SAVEPOINT " GFARM_PGSQL_GROUP_SAVEPOINT);
+		if (PQresultStatus(res) == PGRES_COMMAND_OK) {
+			PQclear(res);
+			return (GFARM_ERR_NO_ERROR);
+		}
+		PQclear(res);
+	}
+	return (gfarm_pgsql_exec_and_log(
+	    "ROLLBACK TO SAVEPOINT " GFARM_PGSQL_GROUP_SAVEPOINT "; "
+	    "RELEASE SAVEPOINT " GFARM_PGSQL_GROUP_SAVEPOINT, diag));
+}
+
 static gfarm_error_t
 gfarm_pgsql_commit_sn(gfarm_uint64_t seqnum, const char *diag)
 {
+	if (group_lost)
+		return (GFARM_ERR_CONNECTION_ABORTED);
 	if (connection_recovered)
 		connection_recovered = 0;
-	else if (--transaction_nesting > 0)
+	else if (--transaction_nesting > transaction_group)
 		return (GFARM_ERR_NO_ERROR);
 
-	assert(transaction_nesting == 0);
+	assert(transaction_nesting == transaction_group);
+	if (transaction_group)
+		return (gfarm_pgsql_savepoint_end(diag));
 
 	if (gfarm_get_metadb_replication_enabled() && seqnum > 0) {
 		gfarm_error_t e, e2;
@@ -724,11 +906,11 @@ gfarm_pgsql_insert0(gfarm_uint64_t seqnum,
 	PGresult *res;
 	gfarm_error_t e;
 
-	if (transaction_nesting == 0) {
+	if (transaction_nesting == transaction_group) {
 		e = start_op(diag);
 		if (e != GFARM_ERR_NO_ERROR)
 			return (e);
-		res = PQexecParams(conn, command, nParams, paramTypes,
+		res = gfarm_pgsql_exec_prepared(command, nParams, paramTypes,
 		    paramValues, paramLengths, paramFormats, resultFormat);
 		e = gfarm_pgsql_check_insert(res, command, diag);
 		if (e == GFARM_ERR_DB_ACCESS_SHOULD_BE_RETRIED)
@@ -799,11 +981,11 @@ gfarm_pgsql_update_or_delete0(gfarm_uint64_t seqnum,
 	PGresult *res;
 	gfarm_error_t e;
 
-	if (transaction_nesting == 0) {
+	if (transaction_nesting == transaction_group) {
 		e = start_op(diag);
 		if (e != GFARM_ERR_NO_ERROR)
 			return (e);
-		res = PQexecParams(conn, command, nParams,
+		res = gfarm_pgsql_exec_prepared(command, nParams,
 		    paramTypes, paramValues, paramLengths, paramFormats,
 		    resultFormat);
 		e = gfarm_pgsql_check_update_or_delete(res, command, diag);
@@ -1296,7 +1478,7 @@ gfarm_pgsql_generic_load(
 static gfarm_error_t
 gfarm_pgsql_begin(gfarm_uint64_t seqnum, void *arg)
 {
-	assert(transaction_nesting == 0);
+	assert(transaction_nesting == transaction_group);
 	return (gfarm_pgsql_start("pgsql_begin"));
 }
 
@@ -1306,7 +1488,54 @@ gfarm_pgsql_end(gfarm_uint64_t seqnum, void *arg)
 	gfarm_error_t e = gfarm_pgsql_commit_sn(seqnum,
 	    transaction_ok ? "gfarm_pgsql_end(OK)" : "gfarm_pgsql_end(NG)");
 
-	assert(transaction_nesting == 0);
+	assert(transaction_nesting == transaction_group);
+	return (e);
+}
+
+/*
+ * group commit:
+ * transactions between group_begin and group_end are committed at once.
+ */
+static gfarm_error_t
+gfarm_pgsql_group_begin(gfarm_uint64_t seqnum, void *arg)
+{
+	gfarm_error_t e;
+
+	assert(transaction_nesting == 0 && transaction_group == 0);
+	e = gfarm_pgsql_start("pgsql_group_begin");
+	if (e == GFARM_ERR_NO_ERROR) {
+		transaction_group = 1;
+		group_active = 1;
+	} else
+		transaction_nesting = 0;
+	return (e);
+}
+
+/*
+ * returns an error, if the group is not committed.
+ * the caller has to apply the transactions in the group again then.
+ */
+static gfarm_error_t
+gfarm_pgsql_group_end(gfarm_uint64_t seqnum, void *arg)
+{
+	gfarm_error_t e;
+
+	if (group_lost) { /* connection was recovered in the group */
+		e = GFARM_ERR_CONNECTION_ABORTED;
+		group_lost = 0;
+		transaction_nesting = 0;
+	} else {
+		assert(transaction_nesting == 1);
+		transaction_group = 0;
+		/* each failed transaction is already undone */
+		transaction_ok = 1;
+		e = gfarm_pgsql_commit_sn(seqnum, "pgsql_group_end");
+		/* the connection may be recovered by the COMMIT */
+		group_lost = 0;
+		transaction_nesting = 0;
+	}
+	group_active = 0;
+	free_arg_deferred_end(e == GFARM_ERR_NO_ERROR);
 	return (e);
 }
 
@@ -3158,6 +3387,13 @@ pgsql_xattr_info_set_fields(PGresult *res, int row, void *vinfo)
 	return (pgsql_xattr_set_attrvalue_binary(res, row, vinfo));
 }
 
+static gfarm_error_t
+pgsql_xmlattr_info_set_fields(PGresult *res, int row, void *vinfo)
+{
+	pgsql_xattr_set_inum_and_attrname(res, row, vinfo);
+	return (pgsql_xattr_set_attrvalue_string(res, row, vinfo));
+}
+
 static gfarm_error_t
 gfarm_pgsql_xattr_load(void *closure,
 		void (*callback)(void *, struct xattr_info *))
@@ -3167,14 +3403,22 @@ gfarm_pgsql_xattr_load(void *closure,
 	char *command, *diag;
 	struct xattr_info *vinfo;
 	int i, n;
+	gfarm_error_t (*set_fields)(PGresult *, int, void *);
 
-	if (xmlMode) {
+	if (xmlMode && gfarm_xmlattr_index) {
+		/* attrvalue is necessary to build the index */
+		command = "SELECT inumber,attrname,attrvalue FROM XmlAttr";
+		diag = "pgsql_xattr_load_xml";
+		set_fields = pgsql_xmlattr_info_set_fields;
+	} else if (xmlMode) {
 		/* NOTE: if xmlMode, attrvalue is unnecessary to load. */
 		command = "SELECT inumber,attrname FROM XmlAttr";
 		diag = "pgsql_xattr_load_xml";
+		set_fields = pgsql_xattr_set_inum_and_attrname;
 	} else {
 		command = "SELECT inumber,attrname,attrvalue FROM XAttr";
 		diag = "pgsql_xattr_load_norm";
+		set_fields = pgsql_xattr_info_set_fields;
 	}
 
 	/* XXX FIXME: should use gfarm_pgsql_generic_load() instead */
@@ -3182,10 +3426,7 @@ gfarm_pgsql_xattr_load(void *closure,
 		command,
 		0, NULL,
 		&n, &vinfo,
-		&gfarm_base_xattr_info_ops,
-		xmlMode ?
-		pgsql_xattr_set_inum_and_attrname :
-		pgsql_xattr_info_set_fields,
+		&gfarm_base_xattr_info_ops, set_fields,
 		diag);
 	if (e == GFARM_ERR_NO_SUCH_OBJECT)
 		return GFARM_ERR_NO_ERROR;
@@ -3846,4 +4087,7 @@ const struct db_ops db_pgsql_ops = {
 	gfarm_pgsql_mdhost_load,
 
 	gfarm_pgsql_fsngroup_modify,
+
+	gfarm_pgsql_group_begin,
+	gfarm_pgsql_group_end,
 };
@@ -1,4 +1,5 @@
 #include <assert.h>
+#include <pthread.h>
 #include <stddef.h>
 #include <string.h>
 
@@ -7,10 +8,17 @@
 #include <gfarm/gfarm_misc.h>
 #include <gfarm/gfs.h> /* gfarm_off_t */
 
+#include "slab.h"
 #include "dir.h"
 
 /*
- * this implementation uses red-black tree
+ * this implementation uses red-black tree,
+ * which is augmented by the number of entries in each subtree
+ * to implement dir_cursor_set_pos() and dir_cursor_get_pos().
+ *
+ * a huge directory is also indexed by a hash table,
+ * because looking up the tree of millions of entries costs
+ * dozens of string comparisons on cache-cold nodes.
  */
 
 #include <stdlib.h>
@@ -28,10 +36,33 @@ struct rbdir_entry {
 	gfarm_off_t nentries;
 
 	struct inode *inode;
+
+	/* only valid while the directory is indexed by the hash */
+	struct rbdir_entry *hash_next;
+	unsigned int hash;
 };
 
 RB_HEAD(rbdir, rbdir_entry);
 
+static struct slab rbdir_entry_slab =
+	SLAB_INITIALIZER("dir_entry", struct rbdir_entry);
+
+/*
+ * a directory is indexed by the hash table, if it has more than
+ * DIR_HASH_THRESHOLD entries, and the index is dropped, if it becomes
+ * less than DIR_HASH_THRESHOLD / 4 entries.
+ * the number of hash buckets is kept between
+ * the number of entries / 2 and the number of entries * 4.
+ */
+#define DIR_HASH_THRESHOLD	1024
+
+struct dir {
+	struct rbdir tree;
+
+	struct rbdir_entry **hash;	/* NULL, if not indexed */
+	unsigned int hash_mask;
+};
+
 static int
 rbdir_compare(DirEntry a, DirEntry b)
 {
@@ -66,6 +97,93 @@ rbdir_augment(DirEntry entry)
 RB_PROTOTYPE(rbdir, rbdir_entry, node, rbdir_compare)
 RB_GENERATE(rbdir, rbdir_entry, node, rbdir_compare)
 
+/* FNV-1a */
+static unsigned int
+dir_hash(const char *name, int namelen)
+{
+	unsigned int hash = 2166136261U;
+	int i;
+
+	for (i = 0; i < namelen; i++) {
+		hash ^= (unsigned char)name[i];
+		hash *= 16777619U;
+	}
+	return (hash);
+}
+
+static void
+dir_hash_insert(Dir dir, DirEntry entry)
+{
+	DirEntry *bucket = &dir->hash[entry->hash & dir->hash_mask];
+
+	entry->hash_next = *bucket;
+	*bucket = entry;
+}
+
+static void
+dir_hash_remove(Dir dir, DirEntry entry)
+{
+	DirEntry *pp = &dir->hash[entry->hash & dir->hash_mask];
+
+	for (; *pp != NULL; pp = &(*pp)->hash_next) {
+		if (*pp == entry) {
+			*pp = entry->hash_next;
+			return;
+		}
+	}
+	assert(0);
+}
+
+static DirEntry
+dir_hash_lookup(Dir dir, const char *name, int namelen)
+{
+	unsigned int hash = dir_hash(name, namelen);
+	DirEntry entry = dir->hash[hash & dir->hash_mask];
+
+	for (; entry != NULL; entry = entry->hash_next) {
+		if (entry->hash == hash && entry->keylen == namelen &&
+		    memcmp(entry->key, name, namelen) == 0)
+			return (entry);
+	}
+	return (NULL);
+}
+
+/*
+ * (re)build the hash index with the number of buckets for "nentries",
+ * the directory is left unindexed if there is no memory.
+ */
+static void
+dir_hash_rebuild(Dir dir, gfarm_off_t nentries)
+{
+	DirEntry entry, *hash;
+	unsigned int nbuckets = 1;
+	int hashed = dir->hash != NULL;
+
+	while (nbuckets < nentries)
+		nbuckets <<= 1;
+	GFARM_CALLOC_ARRAY(hash, nbuckets);
+	free(dir->hash);
+	dir->hash = hash;
+	if (hash == NULL) {
+		gflog_debug(GFARM_MSG_UNFIXED,
+		    "dir hash: no memory for %u buckets", nbuckets);
+		return;
+	}
+	dir->hash_mask = nbuckets - 1;
+	RB_FOREACH(entry, rbdir, &dir->tree) {
+		if (!hashed)
+			entry->hash = dir_hash(entry->key, entry->keylen);
+		dir_hash_insert(dir, entry);
+	}
+}
+
+static void
+dir_hash_free(Dir dir)
+{
+	free(dir->hash);
+	dir->hash = NULL;
+}
+
 static DirEntry
 rbdir_entry_prev(DirEntry entry)
 {
@@ -97,7 +215,7 @@ static void
 rbdir_entry_free(struct rbdir_entry *entry)
 {
 	free(entry->key);
-	free(entry);
+	slab_free(&rbdir_entry_slab, entry);
 }
 
 static int
@@ -106,12 +224,22 @@ rbdir_entry_delete(Dir dir, DirEntry entry)
 	DirEntry deleted;
 	DirEntry parent = RB_PARENT(entry, node);
 	DirEntry prev = rbdir_entry_prev(entry);
+	gfarm_off_t nentries;
 
-	deleted = RB_REMOVE(rbdir, dir, entry);
+	if (dir->hash != NULL)
+		dir_hash_remove(dir, entry);
+	deleted = RB_REMOVE(rbdir, &dir->tree, entry);
 	if (prev != NULL)
 		rbdir_fixup(prev);
 	if (parent != NULL)
 		rbdir_fixup(parent);
+	if (dir->hash != NULL) {
+		nentries = dir_get_entry_count(dir);
+		if (nentries < DIR_HASH_THRESHOLD / 4)
+			dir_hash_free(dir);
+		else if (nentries < (dir->hash_mask + 1) / 4)
+			dir_hash_rebuild(dir, nentries);
+	}
 	if (deleted != NULL) {
 		rbdir_entry_free(deleted);
 		return (1);
@@ -130,7 +258,9 @@ dir_alloc(void)
 			"allocation of 'Dir' failed");
 		return (NULL);
 	}
-	RB_INIT(dir);
+	RB_INIT(&dir->tree);
+	dir->hash = NULL;
+	dir->hash_mask = 0;
 	return (dir);
 }
 
@@ -139,7 +269,8 @@ dir_free(Dir dir)
 {
 	DirEntry entry;
 
-	while ((entry = RB_MIN(rbdir, dir)) != NULL)
+	dir_hash_free(dir);
+	while ((entry = RB_MIN(rbdir, &dir->tree)) != NULL)
 		rbdir_entry_delete(dir, entry);
 	free(dir);
 }
@@ -148,14 +279,14 @@ dir_free(Dir dir)
 int
 dir_is_empty(Dir dir)
 {
-	return (RB_ROOT(dir) == NULL);
+	return (RB_ROOT(&dir->tree) == NULL);
 }
 #endif
 
 gfarm_off_t
 dir_get_entry_count(Dir dir)
 {
-	DirEntry root = RB_ROOT(dir);
+	DirEntry root = RB_ROOT(&dir->tree);
 
 	if (root == NULL)
 		return (0);
@@ -168,8 +299,15 @@ dir_enter(Dir dir, const char *name, int namelen, int *createdp)
 	DirEntry entry;
 	DirEntry found;
 	DirEntry prev;
+	gfarm_off_t nentries;
 
-	GFARM_MALLOC(entry);
+	if (dir->hash != NULL &&
+	    (found = dir_hash_lookup(dir, name, namelen)) != NULL) {
+		*createdp = 0;
+		return (found);
+	}
+
+	entry = slab_alloc(&rbdir_entry_slab);
 	if (entry == NULL) {
 		gflog_debug(GFARM_MSG_1001709,
 			"allocation of 'DirEntry' failed");
@@ -178,7 +316,7 @@ dir_enter(Dir dir, const char *name, int namelen, int *createdp)
 	entry->keylen = namelen;
 	GFARM_MALLOC_ARRAY(entry->key, namelen);
 	if (entry->key == NULL) {
-		free(entry);
+		slab_free(&rbdir_entry_slab, entry);
 		gflog_debug(GFARM_MSG_1001710,
 			"allocation of 'DirEntry.key' failed");
 		return (NULL); /* no memory */
@@ -186,7 +324,7 @@ dir_enter(Dir dir, const char *name, int namelen, int *createdp)
 	memcpy(entry->key, name, namelen);
 	entry->nentries = 1; /* leaf */
 
-	found = RB_INSERT(rbdir, dir, entry);
+	found = RB_INSERT(rbdir, &dir->tree, entry);
 	if (found != NULL) {
 		rbdir_entry_free(entry);
 		*createdp = 0;
@@ -201,6 +339,17 @@ dir_enter(Dir dir, const char *name, int namelen, int *createdp)
 	/* for assertion in dir_entry_set_inode() */
 	entry->inode = NULL;
 
+	nentries = dir_get_entry_count(dir);
+	if (dir->hash != NULL) {
+		entry->hash = dir_hash(name, namelen);
+		if (nentries > (dir->hash_mask + 1) * 2)
+			dir_hash_rebuild(dir, nentries);
+		else
+			dir_hash_insert(dir, entry);
+	} else if (nentries > DIR_HASH_THRESHOLD) {
+		dir_hash_rebuild(dir, nentries);
+	}
+
 	if (createdp != NULL)
 		*createdp = 1;
 	return (entry);
@@ -211,9 +360,11 @@ dir_lookup(Dir dir, const char *name, int namelen)
 {
 	struct rbdir_entry entry;
 
+	if (dir->hash != NULL)
+		return (dir_hash_lookup(dir, name, namelen));
 	entry.keylen = namelen;
 	entry.key = (char *)name;
-	return (RB_FIND(rbdir, dir, &entry));
+	return (RB_FIND(rbdir, &dir->tree, &entry));
 }
 
 int
@@ -268,7 +419,7 @@ dir_cursor_next(Dir dir, DirCursor *cursor)
 {
 	if (*cursor == NULL)
 		return (0); /* end of directory */
-	*cursor = RB_NEXT(rbdir, dir, *cursor);
+	*cursor = RB_NEXT(rbdir, &dir->tree, *cursor);
 	if (*cursor == NULL)
 		return (0); /* end of directory */
 	return (1); /* ok */
@@ -281,7 +432,7 @@ dir_cursor_remove_entry(Dir dir, DirCursor *cursor)
 
 	if (entry == NULL)
 		return (0); /* end of directory */
-	*cursor = RB_NEXT(rbdir, dir, entry);
+	*cursor = RB_NEXT(rbdir, &dir->tree, entry);
 	rbdir_entry_delete(dir, entry);
 	return (*cursor != NULL); /* is there still any entry? */
 }
@@ -289,7 +440,7 @@ dir_cursor_remove_entry(Dir dir, DirCursor *cursor)
 int
 dir_cursor_set_pos(Dir dir, gfarm_off_t nth, DirCursor *cursor)
 {
-	DirEntry entry = RB_ROOT(dir);
+	DirEntry entry = RB_ROOT(&dir->tree);
 	gfarm_off_t index;
 
 	while (entry != NULL) {
@@ -312,7 +463,7 @@ gfarm_off_t
 dir_cursor_get_pos(Dir dir, DirCursor *cursor)
 {
 	DirEntry key = *cursor;
-	DirEntry entry = RB_ROOT(dir);
+	DirEntry entry = RB_ROOT(&dir->tree);
 	int cmp;
 	gfarm_off_t delta, index = 0;
 
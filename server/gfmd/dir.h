@@ -11,7 +11,7 @@ typedef struct gfarm_hash_iterator DirCursor;
 #else /* ! USE_HASH */
 
 /* red-black tree */
-typedef struct rbdir *Dir;
+typedef struct dir *Dir;
 typedef struct rbdir_entry *DirEntry;
 typedef DirEntry DirCursor;
 
@@ -23,7 +23,8 @@
 #include "back_channel.h"
 #include "file_replication.h"
 #include "inode.h"
-#include "gfmd.h" /* gfmd_port */
+#include "gfmd.h" /* gfmd_port, sync_protocol_get_thrpool() */
+#include "thrpool.h"
 #include "thrstatewait.h"
 
 struct dead_file_copy;
@@ -46,6 +47,15 @@ struct file_replication {
 
 	struct host *src;
 
+	/*
+	 * replication chain, see file_replication_chain().
+	 * the src of chain_next is the dst of this replication,
+	 * and chain_next is queued when this is accepted by the dst.
+	 * chain_prev is NULL, if this is the head of a chain, or queued.
+	 */
+	struct file_replication *chain_prev, *chain_next;
+	gfarm_off_t chain_size; /* -1, if not chained */
+
 	/*
 	 * old generation which should be removed just after
 	 * the completion of the replication,
@@ -103,6 +113,100 @@ file_replication_set_handle(struct file_replication *fr, gfarm_int64_t handle)
 	fr->handle = handle;
 }
 
+/*
+ * PREREQUISITE: giant_lock
+ */
+static void
+file_replication_enqueue(struct file_replication *fr)
+{
+	fr->queued = 1;
+
+	/*
+	 * we don't have to check the result, because of
+	 * NETSENDQ_ADD_FLAG_DETACH_ERROR_HANDLING
+	 */
+	(void)netsendq_add_entry(abstract_host_get_sendq(fr->qentry.abhost),
+	    &fr->qentry, NETSENDQ_ADD_FLAG_DETACH_ERROR_HANDLING);
+}
+
+/*
+ * make `next' receive the file from the dst of `prev', instead of
+ * the source of the file, so that the source host reads the file only once.
+ * `next' is not queued by file_replication_start(), but is queued
+ * when the dst of `prev' accepts the replication request, i.e. when
+ * the dst has truncated the old content, and `next' receives the file
+ * while the dst of `prev' is still receiving it.
+ *
+ * PREREQUISITE: giant_lock, and both are not queued yet
+ */
+void
+file_replication_chain(struct file_replication *prev,
+	struct file_replication *next)
+{
+	prev->chain_next = next;
+	next->chain_prev = prev;
+	next->src = file_replication_get_dst(prev);
+	next->chain_size = inode_get_size(next->inode);
+}
+
+/*
+ * PREREQUISITE: giant_lock
+ */
+static void
+file_replication_chain_remove(struct file_replication *fr)
+{
+	struct file_replication *next = fr->chain_next;
+
+	if (fr->chain_prev != NULL)
+		fr->chain_prev->chain_next = next;
+	if (next == NULL)
+		return;
+
+	next->chain_prev = fr->chain_prev;
+	/* the dst of `fr' is not a valid replica, skip it */
+	if (fr->chain_prev != NULL || !inode_is_file(fr->inode) ||
+	    !inode_has_replica(fr->inode, file_replication_get_dst(fr)))
+		next->src = fr->src;
+	if (next->chain_prev == NULL && fr->queued)
+		file_replication_enqueue(next);
+}
+
+struct file_replication_chain_arg {
+	struct host *dst;
+	gfarm_ino_t ino;
+	gfarm_int64_t gen;
+	gfarm_int64_t handle;
+};
+
+static struct file_replication *file_replication_lookup(struct host *,
+	gfarm_ino_t, gfarm_int64_t, gfarm_int64_t);
+
+/*
+ * the replication request was accepted by the dst, start the next one.
+ * `fr' may be already freed, thus it's looked up again under giant_lock.
+ */
+static void *
+file_replication_chain_next_start(void *closure)
+{
+	struct file_replication_chain_arg *arg = closure;
+	struct file_replication *fr, *next;
+
+	giant_lock();
+	fr = file_replication_lookup(arg->dst, arg->ino, arg->gen,
+	    arg->handle);
+	if (fr != NULL && (next = fr->chain_next) != NULL) {
+		fr->chain_next = NULL;
+		next->chain_prev = NULL;
+		file_replication_enqueue(next);
+	}
+	giant_unlock();
+
+	free(arg);
+
+	/* this return value won't be used, because this thread is detached */
+	return (NULL);
+}
+
 gfarm_error_t
 file_replication_new(struct inode *inode, gfarm_uint64_t gen,
 	struct host *src, struct host *dst,
@@ -138,6 +242,8 @@ file_replication_new(struct inode *inode, gfarm_uint64_t gen,
 	fr->inode = inode;
 	fr->igen = gen;
 	fr->src = src;
+	fr->chain_prev = fr->chain_next = NULL;
+	fr->chain_size = -1;
 	fr->cleanup = deferred_cleanup;
 	fr->queued = 0;
 	fr->handle = -1;
@@ -145,6 +251,7 @@ file_replication_new(struct inode *inode, gfarm_uint64_t gen,
 	fr->statewait = NULL;
 
 	++outstanding_file_replications;
+	host_replication_receiving_add(dst, 1);
 
 	*frp = fr;
 	return (GFARM_ERR_NO_ERROR);
@@ -157,6 +264,9 @@ file_replication_free(struct file_replication *fr,
 	struct inode_replication_state *irs = *rstatep;
 
 	--outstanding_file_replications;
+	host_replication_receiving_add(file_replication_get_dst(fr), -1);
+
+	file_replication_chain_remove(fr);
 
 	GFARM_HCIRCLEQ_REMOVE(fr, replications);
 	if (GFARM_HCIRCLEQ_EMPTY(irs->same_inode_list, replications)) {
@@ -189,18 +299,9 @@ file_replication_start(struct inode_replication_state *rstate,
 	struct file_replication *fr;
 
 	GFARM_HCIRCLEQ_FOREACH(fr, rstate->same_inode_list, replications) {
-		if (fr->igen <= gen && !fr->queued) {
-			fr->queued = 1;
-
-			/*
-			 * we don't have to check the result, because of
-			 * NETSENDQ_ADD_FLAG_DETACH_ERROR_HANDLING
-			 */
-			(void)netsendq_add_entry(
-			    abstract_host_get_sendq(fr->qentry.abhost),
-			    &fr->qentry,
-			    NETSENDQ_ADD_FLAG_DETACH_ERROR_HANDLING);
-		}
+		/* a chained one is queued by its previous replication */
+		if (fr->igen <= gen && !fr->queued && fr->chain_prev == NULL)
+			file_replication_enqueue(fr);
 	}
 }
 
@@ -408,15 +509,53 @@ gfs_client_replication_request_result(void *p, void *arg, size_t size)
 	struct file_replication *fr = arg;
 	gfarm_int64_t handle;
 	struct host *dst = file_replication_get_dst(fr);
+	struct file_replication_chain_arg *chain_arg;
 	gfarm_error_t e, errcode;
 	static const char diag[] = "GFS_PROTO_REPLICATION_REQUEST result";
 
 	/* XXX FIXME, src_err and dst_err should be passed separately */
 	e = gfs_client_recv_result_and_error(peer, dst, size, &errcode,
 	    diag, "l", &handle);
-	if (e == GFARM_ERR_NO_ERROR) {
+	if (e == GFARM_ERR_NO_ERROR && errcode != GFARM_ERR_NO_ERROR) {
+		/*
+		 * the dst refused the request, thus it won't have the
+		 * replica, and the next one of the chain has to receive
+		 * the file from the src of this replication instead.
+		 * the next one is queued when `fr' is freed.
+		 */
+		giant_lock();
+		if (fr->chain_next != NULL)
+			fr->chain_next->src = fr->src;
+		giant_unlock();
+		file_replication_finishedq_enqueue(fr, GFARM_ERR_NO_ERROR,
+		    errcode);
+	} else if (e == GFARM_ERR_NO_ERROR) {
+		/*
+		 * `fr' may be freed by GFM_PROTO_REPLICATION_RESULT after
+		 * the handle is set, so prepare the arg for the chain before.
+		 */
+		chain_arg = NULL;
+		if (gfarm_replication_chain) {
+			GFARM_MALLOC(chain_arg);
+			if (chain_arg == NULL) {
+				/* next one will be queued when `fr' is done */
+				gflog_warning(GFARM_MSG_UNFIXED,
+				    "%s: (%s, %lld:%lld): replication chain: "
+				    "no memory", diag, host_name(dst),
+				    (long long)inode_get_number(fr->inode),
+				    (long long)fr->igen);
+			} else {
+				chain_arg->dst = dst;
+				chain_arg->ino = inode_get_number(fr->inode);
+				chain_arg->gen = fr->igen;
+				chain_arg->handle = handle;
+			}
+		}
 		fr->handle = handle;
 		/* this will be handled by GFM_PROTO_REPLICATION_RESULT */
+		if (chain_arg != NULL)
+			thrpool_add_job(sync_protocol_get_thrpool(),
+			    file_replication_chain_next_start, chain_arg);
 	} else {
 		file_replication_finishedq_enqueue(fr, GFARM_ERR_NO_ERROR, e);
 	}
@@ -452,12 +591,22 @@ gfs_client_replication_request_request(void *closure)
 	gfarm_error_t e;
 	static const char diag[] = "GFS_PROTO_REPLICATION_REQUEST request";
 
-	e = gfs_client_send_request(dst, NULL, diag,
-	    gfs_client_replication_request_result,
-	    gfs_client_replication_request_free,
-	    fr,
-	    GFS_PROTO_REPLICATION_REQUEST, "sill",
-	    host_name(fr->src), host_port(fr->src), ino, gen);
+	/* fr->src and fr->chain_size won't be changed after queued */
+	if (fr->chain_size >= 0)
+		e = gfs_client_send_request(dst, NULL, diag,
+		    gfs_client_replication_request_result,
+		    gfs_client_replication_request_free,
+		    fr,
+		    GFS_PROTO_REPLICATION_CHAIN_REQUEST, "silll",
+		    host_name(fr->src), host_port(fr->src), ino, gen,
+		    fr->chain_size);
+	else
+		e = gfs_client_send_request(dst, NULL, diag,
+		    gfs_client_replication_request_result,
+		    gfs_client_replication_request_free,
+		    fr,
+		    GFS_PROTO_REPLICATION_REQUEST, "sill",
+		    host_name(fr->src), host_port(fr->src), ino, gen);
 	netsendq_entry_was_sent(abstract_host_get_sendq(fr->qentry.abhost),
 	    &fr->qentry);
 
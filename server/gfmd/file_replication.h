@@ -26,6 +26,8 @@ gfarm_error_t file_replication_new(struct inode *, gfarm_uint64_t,
 	struct inode_replication_state **, struct file_replication **);
 void file_replication_free(struct file_replication *,
 	struct inode_replication_state **);
+void file_replication_chain(struct file_replication *,
+	struct file_replication *);
 
 void file_replication_init(void);
 
@@ -144,7 +144,7 @@ gfm_server_get_fd(struct peer *peer, gfp_xdr_xid_t xid, size_t *sizep,
 	else if ((e = peer_fdpair_get_current(peer, &fd)) !=
 		 GFARM_ERR_NO_ERROR)
 		;
-	else if (mdhost_self_is_master() || FD_IS_SLAVE_ONLY(fd))
+	else if (peer_fd_is_local(peer, fd))
 		e = peer_fdpair_externalize_current(peer);
 	else
 		do_relay = 1;
@@ -187,7 +187,7 @@ gfm_server_put_fd(struct peer *peer, gfp_xdr_xid_t xid, size_t *sizep,
 	else {
 		peer_fdpair_set_current(peer, fd);
 		e = peer_fdpair_externalize_current(peer);
-		if (!mdhost_self_is_master() && !FD_IS_SLAVE_ONLY(fd))
+		if (!peer_fd_is_local(peer, fd))
 			do_relay = 1;
 	}
 	giant_unlock();
@@ -232,7 +232,7 @@ gfm_server_save_fd(struct peer *peer, gfp_xdr_xid_t xid, size_t *sizep,
 		 * XXX: FIXME
 		 * more error check is needed, when COMPOUND starts to work
 		 */
-		if (!mdhost_self_is_master() && !FD_IS_SLAVE_ONLY(fd))
+		if (!peer_fd_is_local(peer, fd))
 			do_relay = 1;
 	}
 	giant_unlock();
@@ -277,7 +277,7 @@ gfm_server_restore_fd(struct peer *peer, gfp_xdr_xid_t xid, size_t *sizep,
 		 * XXX: FIXME
 		 * more error check is needed, when COMPOUND starts to work
 		 */
-		if (!mdhost_self_is_master() && !FD_IS_SLAVE_ONLY(fd))
+		if (!peer_fd_is_local(peer, fd))
 			do_relay = 1;
 	}
 	giant_unlock();
@@ -307,6 +307,22 @@ trace_log_get_operation_name(int hlink_removed, gfarm_mode_t imode_removed)
 	}
 }
 
+/*
+ * process_get_file_inode() for a giant_rdlock() holder.
+ * the descriptor table may be updated by a concurrent OPEN or CLOSE.
+ */
+static gfarm_error_t
+fs_get_file_inode_rdlocked(struct process *process, gfarm_int32_t fd,
+	struct inode **inodep)
+{
+	gfarm_error_t e;
+
+	giant_rdlock_update_lock();
+	e = process_get_file_inode(process, fd, inodep);
+	giant_rdlock_update_unlock();
+	return (e);
+}
+
 /* this assumes that giant_lock is already acquired */
 /*
  * create_log and remove_log is malloc(3)ed string,
@@ -619,6 +635,89 @@ gfm_server_create(struct peer *peer, gfp_xdr_xid_t xid, size_t *sizep,
 	return (e2);
 }
 
+/*
+ * OPEN by GFARM_FILE_LOOKUP from a client (e.g. by gfs_stat(3)) is
+ * processed under giant_rdlock(), because it only allocates a descriptor.
+ */
+static int
+gfm_server_open_is_lookup_only(int from_client, gfarm_int32_t flag)
+{
+	return (from_client && flag == GFARM_FILE_LOOKUP &&
+	    !gfarm_ctxp->file_trace);
+}
+
+/*
+ * this assumes that giant_rdlock is already acquired.
+ * GFARM_ERR_RESOURCE_TEMPORARILY_UNAVAILABLE is returned, if
+ * the current descriptor cannot be closed under giant_rdlock,
+ * and the caller has to use gfm_server_open_common() under giant_lock.
+ */
+static gfarm_error_t
+gfm_server_open_lookup(struct peer *peer, char *name,
+	gfarm_ino_t *inump, gfarm_uint64_t *genp, gfarm_int32_t *modep)
+{
+	gfarm_error_t e;
+	struct process *process;
+	struct inode *base, *inode;
+	gfarm_int32_t cfd, fd;
+
+	if ((process = peer_get_process(peer)) == NULL) {
+		gflog_debug(GFARM_MSG_UNFIXED,
+			"operation is not permitted: peer_get_process() "
+			"failed");
+		return (GFARM_ERR_OPERATION_NOT_PERMITTED);
+	}
+	if (process_get_user(process) == NULL) {
+		gflog_debug(GFARM_MSG_UNFIXED,
+			"operation is not permitted: process_get_user() "
+			"failed");
+		return (GFARM_ERR_OPERATION_NOT_PERMITTED);
+	}
+	if ((e = peer_fdpair_get_current(peer, &cfd)) != GFARM_ERR_NO_ERROR) {
+		gflog_debug(GFARM_MSG_UNFIXED,
+			"peer_fdpair_get_current() failed: %s",
+			gfarm_error_string(e));
+		return (e);
+	}
+	if ((e = fs_get_file_inode_rdlocked(process, cfd, &base))
+	    != GFARM_ERR_NO_ERROR) {
+		gflog_debug(GFARM_MSG_UNFIXED,
+		    "process_get_file_inode() failed: %s",
+		    gfarm_error_string(e));
+		return (e);
+	}
+	if ((e = inode_lookup_by_name(base, name, process,
+	    accmode_to_op(GFARM_FILE_LOOKUP), &inode)) != GFARM_ERR_NO_ERROR) {
+		gflog_debug(GFARM_MSG_UNFIXED,
+		    "inode_lookup_by_name() failed: %s",
+		    gfarm_error_string(e));
+		return (e);
+	}
+
+	giant_rdlock_update_lock();
+	/* peer_fdpair_set_current() may close the current descriptor */
+	cfd = peer_fdpair_get_current_to_close(peer);
+	if (cfd != GFARM_DESCRIPTOR_INVALID &&
+	    !process_close_is_trivial(process, peer, cfd)) {
+		e = GFARM_ERR_RESOURCE_TEMPORARILY_UNAVAILABLE;
+	} else if ((e = process_open_file(process, inode, GFARM_FILE_LOOKUP,
+	    0, peer, NULL, &fd)) != GFARM_ERR_NO_ERROR) {
+		gflog_debug(GFARM_MSG_UNFIXED,
+		    "process_open_file() failed: %s",
+		    gfarm_error_string(e));
+	} else {
+		peer_fdpair_set_current(peer, fd);
+	}
+	giant_rdlock_update_unlock();
+	if (e != GFARM_ERR_NO_ERROR)
+		return (e);
+
+	*inump = inode_get_number(inode);
+	*genp = inode_get_gen(inode);
+	*modep = inode_get_mode(inode);
+	return (GFARM_ERR_NO_ERROR);
+}
+
 gfarm_error_t
 gfm_server_open(struct peer *peer, gfp_xdr_xid_t xid, size_t *sizep,
 	int from_client, int skip)
@@ -645,10 +744,29 @@ gfm_server_open(struct peer *peer, gfp_xdr_xid_t xid, size_t *sizep,
 		free(name);
 	} else {
 		/* do not relay RPC to master gfmd */
-		giant_lock();
+		if (gfm_server_open_is_lookup_only(from_client, flag)) {
+			giant_rdlock();
+			e = gfm_server_open_lookup(peer, name,
+			    &inum, &gen, &mode);
+			if (e == GFARM_ERR_RESOURCE_TEMPORARILY_UNAVAILABLE) {
+				giant_unlock();
+				giant_lock();
+				e = gfm_server_open_common(diag, peer,
+				    from_client, name, flag, 0, 0,
+				    &inum, &gen, &mode, NULL, NULL);
+			}
+		} else {
+			giant_lock();
 
-		e = gfm_server_open_common(diag, peer, from_client,
-		    name, flag, 0, 0, &inum, &gen, &mode, NULL, NULL);
+			/* a read-only peer may only look a file up */
+			if (peer_is_read_only(peer) &&
+			    (flag & GFARM_FILE_ACCMODE) != GFARM_FILE_LOOKUP)
+				e = GFARM_ERR_READ_ONLY_FILE_SYSTEM;
+			else
+				e = gfm_server_open_common(diag, peer,
+				    from_client, name, flag, 0, 0,
+				    &inum, &gen, &mode, NULL, NULL);
+		}
 
 		if (debug_mode) {
 			if (e != GFARM_ERR_NO_ERROR) {
@@ -883,6 +1001,32 @@ gfm_server_fhopen(struct peer *peer, gfp_xdr_xid_t xid, size_t *sizep,
 	return (gfm_server_put_reply(peer, xid, sizep, diag, e, "i", mode));
 }
 
+/*
+ * CLOSE of a descriptor opened by gfm_server_open_lookup().
+ * GFARM_ERR_RESOURCE_TEMPORARILY_UNAVAILABLE is returned, if the descriptor
+ * cannot be closed under giant_rdlock, or if an error has to be reported.
+ */
+static gfarm_error_t
+gfm_server_close_lookup(struct peer *peer)
+{
+	gfarm_error_t e = GFARM_ERR_RESOURCE_TEMPORARILY_UNAVAILABLE;
+	struct process *process;
+	gfarm_int32_t fd;
+
+	giant_rdlock();
+	if ((process = peer_get_process(peer)) != NULL &&
+	    peer_fdpair_get_current(peer, &fd) == GFARM_ERR_NO_ERROR) {
+		giant_rdlock_update_lock();
+		if (process_close_is_trivial(process, peer, fd) &&
+		    (e = process_close_file(process, peer, fd, NULL)) ==
+		    GFARM_ERR_NO_ERROR)
+			e = peer_fdpair_close_current(peer);
+		giant_rdlock_update_unlock();
+	}
+	giant_unlock();
+	return (e);
+}
+
 gfarm_error_t
 gfm_server_close(struct peer *peer, gfp_xdr_xid_t xid, size_t *sizep,
 	int from_client, int skip)
@@ -903,7 +1047,9 @@ gfm_server_close(struct peer *peer, gfp_xdr_xid_t xid, size_t *sizep,
 	if (skip)
 		return (GFARM_ERR_NO_ERROR);
 
-	if (relay == NULL) {
+	if (relay == NULL && (!from_client ||
+	    (e = gfm_server_close_lookup(peer)) ==
+	    GFARM_ERR_RESOURCE_TEMPORARILY_UNAVAILABLE)) {
 		/* do not relay RPC to master gfmd */
 		giant_lock();
 
@@ -970,7 +1116,7 @@ gfm_server_verify_type_common(
 
 	if (relay == NULL) {
 		/* do not relay RPC to master gfmd */
-		giant_lock();
+		giant_rdlock(); /* read-only */
 		if ((process = peer_get_process(peer)) == NULL) {
 			gflog_debug(GFARM_MSG_1002844,
 			    "operation is not permitted : peer_get_process() "
@@ -981,8 +1127,8 @@ gfm_server_verify_type_common(
 			gflog_debug(GFARM_MSG_1002845,
 			    "peer_fdpair_get_current() "
 			    "failed: %s", gfarm_error_string(e));
-		} else if ((e = process_get_file_inode(process, cfd, &inode)) !=
-			   GFARM_ERR_NO_ERROR) {
+		} else if ((e = fs_get_file_inode_rdlocked(process, cfd,
+		    &inode)) != GFARM_ERR_NO_ERROR) {
 			gflog_debug(GFARM_MSG_1002846,
 			    "process_get_file_inode() "
 			    "failed: %s", gfarm_error_string(e));
@@ -1109,7 +1255,10 @@ inode_get_stat(struct inode *inode, struct gfs_stat *st)
 		st->st_ncopy = inode_get_ncopy(inode);
 	else
 		st->st_ncopy = 1;
+	/* atime may be updated by a giant_rdlock() holder */
+	giant_rdlock_update_lock();
 	st->st_atimespec = *inode_get_atime(inode);
+	giant_rdlock_update_unlock();
 	st->st_mtimespec = *inode_get_mtime(inode);
 	st->st_ctimespec = *inode_get_ctime(inode);
 	if (st->st_user == NULL || st->st_group == NULL) {
@@ -1149,7 +1298,7 @@ gfm_server_fstat(struct peer *peer, gfp_xdr_xid_t xid, size_t *sizep,
 
 	if (relay == NULL) {
 		/* do not relay RPC to master gfmd */
-		giant_lock();
+		giant_rdlock(); /* read-only */
 
 		if (!from_client &&
 		    (spool_host = peer_get_host(peer)) == NULL) {
@@ -1166,8 +1315,8 @@ gfm_server_fstat(struct peer *peer, gfp_xdr_xid_t xid, size_t *sizep,
 			gflog_debug(GFARM_MSG_1001819,
 			    "peer_fdpair_get_current() failed: %s",
 			    gfarm_error_string(e));
-		} else if ((e = process_get_file_inode(process, fd, &inode)) ==
-			   GFARM_ERR_NO_ERROR)
+		} else if ((e = fs_get_file_inode_rdlocked(process, fd,
+		    &inode)) == GFARM_ERR_NO_ERROR)
 			e = inode_get_stat(inode, &st);
 
 		giant_unlock();
@@ -1283,7 +1432,7 @@ gfm_server_fgetattrplus(struct peer *peer, gfp_xdr_xid_t xid, size_t *sizep,
 		    diag, gfarm_error_string(e_rpc));
 	}
 
-	giant_lock();
+	giant_rdlock(); /* read-only */
 
 	if (e_rpc != GFARM_ERR_NO_ERROR) {
 		;
@@ -1302,8 +1451,8 @@ gfm_server_fgetattrplus(struct peer *peer, gfp_xdr_xid_t xid, size_t *sizep,
 		gflog_debug(GFARM_MSG_1002499,
 			"peer_fdpair_get_current() failed: %s",
 			gfarm_error_string(e_rpc));
-	} else if ((e_rpc = process_get_file_inode(process, fd, &inode)) !=
-	    GFARM_ERR_NO_ERROR) {
+	} else if ((e_rpc = fs_get_file_inode_rdlocked(process, fd, &inode))
+	    != GFARM_ERR_NO_ERROR) {
 		;
 	} else if ((e_rpc = inode_get_stat(inode, &st)) !=
 	    GFARM_ERR_NO_ERROR) {
@@ -1321,8 +1470,10 @@ gfm_server_fgetattrplus(struct peer *peer, gfp_xdr_xid_t xid, size_t *sizep,
 			if (px->value == NULL) {
 				/* not cached */
 				db_waitctx_init(&waitctx);
+				giant_rdlock_update_lock();
 				e_rpc = db_xattr_get(0, st.st_ino, px->name,
 				    &px->value, &px->size, &waitctx);
+				giant_rdlock_update_unlock();
 				if (e_rpc == GFARM_ERR_NO_ERROR) {
 					/*
 					 * XXX this is slow, but we don't know
@@ -1330,7 +1481,7 @@ gfm_server_fgetattrplus(struct peer *peer, gfp_xdr_xid_t xid, size_t *sizep,
 					 */
 					giant_unlock();
 					e_rpc = dbq_waitret(&waitctx);
-					giant_lock();
+					giant_rdlock();
 				}
 				db_waitctx_fini(&waitctx);
 				/* if error happens, px->value == NULL here */
@@ -2663,7 +2814,7 @@ gfm_server_readlink(struct peer *peer, gfp_xdr_xid_t xid, size_t *sizep,
 
 	if (relay == NULL) {
 		/* do not relay RPC to master gfmd */
-		giant_lock();
+		giant_rdlock(); /* read-only */
 
 		if (!from_client &&
 		    (spool_host = peer_get_host(peer)) == NULL) {
@@ -2679,8 +2830,8 @@ gfm_server_readlink(struct peer *peer, gfp_xdr_xid_t xid, size_t *sizep,
 			gflog_debug(GFARM_MSG_1001904,
 			    "peer_fdpair_get_current() "
 			    "failed: %s", gfarm_error_string(e));
-		} else if ((e = process_get_file_inode(process, fd, &inode)) !=
-			   GFARM_ERR_NO_ERROR) {
+		} else if ((e = fs_get_file_inode_rdlocked(process, fd,
+		    &inode)) != GFARM_ERR_NO_ERROR) {
 			gflog_debug(GFARM_MSG_1001905,
 			    "process_get_file_inode() "
 			    "failed: %s", gfarm_error_string(e));
@@ -2826,6 +2977,21 @@ fs_dir_get(struct peer *peer, int from_client,
 	}
 }
 
+/* fs_dir_get() for a giant_rdlock() holder */
+static gfarm_error_t
+fs_dir_get_rdlocked(struct peer *peer, int from_client,
+	gfarm_int32_t *np, struct process **processp, gfarm_int32_t *fdp,
+	struct inode **inodep, Dir *dirp, DirCursor *cursorp)
+{
+	gfarm_error_t e;
+
+	giant_rdlock_update_lock();
+	e = fs_dir_get(peer, from_client, np, processp, fdp,
+	    inodep, dirp, cursorp);
+	giant_rdlock_update_unlock();
+	return (e);
+}
+
 /* remember current position */
 static void
 fs_dir_remember_cursor(struct peer *peer, struct process *process,
@@ -2880,12 +3046,12 @@ gfm_server_getdirents(struct peer *peer, gfp_xdr_xid_t xid, size_t *sizep,
 		    diag, gfarm_error_string(e_rpc));
 		/* Continue processing. */
 	}
-	giant_lock();
+	giant_rdlock();
 
 	if (e_rpc != GFARM_ERR_NO_ERROR) {
 		; /* Continue processing. */
-	} else if ((e_rpc = fs_dir_get(peer, from_client, &n, &process, &fd,
-	    &inode, &dir, &cursor)) != GFARM_ERR_NO_ERROR) {
+	} else if ((e_rpc = fs_dir_get_rdlocked(peer, from_client, &n,
+	    &process, &fd, &inode, &dir, &cursor)) != GFARM_ERR_NO_ERROR) {
 		gflog_debug(GFARM_MSG_1001920, "fs_dir_get() failed: %s",
 			gfarm_error_string(e_rpc));
 	} else if (n > 0 && GFARM_MALLOC_ARRAY(p,  n) == NULL) {
@@ -2906,10 +3072,12 @@ gfm_server_getdirents(struct peer *peer, gfp_xdr_xid_t xid, size_t *sizep,
 				break;
 		}
 		if (e_rpc == GFARM_ERR_NO_ERROR) {
+			giant_rdlock_update_lock();
 			fs_dir_remember_cursor(peer, process, fd, dir,
 			    &cursor, n == 0);
 			if (i > 0) /* XXX is this check necessary? */
 				inode_accessed(inode);
+			giant_rdlock_update_unlock();
 		}
 		n = i;
 	}
@@ -2976,12 +3144,12 @@ gfm_server_getdirentsplus(struct peer *peer, gfp_xdr_xid_t xid, size_t *sizep,
 		    diag, gfarm_error_string(e_rpc));
 		/* Continue processing. */
 	}
-	giant_lock();
+	giant_rdlock();
 
 	if (e_rpc != GFARM_ERR_NO_ERROR) {
 		; /* Continue processing. */
-	} else if ((e_rpc = fs_dir_get(peer, from_client, &n, &process, &fd,
-	    &inode, &dir, &cursor)) != GFARM_ERR_NO_ERROR) {
+	} else if ((e_rpc = fs_dir_get_rdlocked(peer, from_client, &n,
+	    &process, &fd, &inode, &dir, &cursor)) != GFARM_ERR_NO_ERROR) {
 		gflog_debug(GFARM_MSG_1001923, "fs_dir_get() failed: %s",
 		    gfarm_error_string(e_rpc));
 	} else if (n > 0 && GFARM_MALLOC_ARRAY(p,  n) == NULL) {
@@ -3012,10 +3180,12 @@ gfm_server_getdirentsplus(struct peer *peer, gfp_xdr_xid_t xid, size_t *sizep,
 				break;
 		}
 		if (e_rpc == GFARM_ERR_NO_ERROR) {
+			giant_rdlock_update_lock();
 			fs_dir_remember_cursor(peer, process, fd, dir,
 			    &cursor, n == 0);
 			if (i > 0) /* XXX is this check necessary? */
 				inode_accessed(inode);
+			giant_rdlock_update_unlock();
 		}
 		n = i;
 	}
@@ -79,19 +79,10 @@ fsngroup_get_tuples(gfarm_int32_t *n_tuples, struct fsngroup_tuple **tuplesp)
 	return (GFARM_ERR_NO_ERROR);
 }
 
-static int
-fsngroup_filter(struct host *h, void *closure)
-{
-	const char *fsngroup = closure;
-
-	return (strcmp(host_fsngroup(h), fsngroup) == 0);
-}
-
 gfarm_error_t
 fsngroup_get_hosts(const char *fsngroup, int *nhostsp, struct host ***hostsp)
 {
-	return (host_from_all(fsngroup_filter, (char *)fsngroup, /* UNCONST */
-	    nhostsp, hostsp));
+	return (host_fsngroup_array_alloc(fsngroup, nhostsp, hostsp));
 }
 
 /*****************************************************************************/
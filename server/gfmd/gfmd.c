@@ -44,6 +44,8 @@
 #include "repattr.h"
 
 #include "subr.h"
+#include "slab.h"
+#include "snapshot.h"
 #include "rpcsubr.h"
 #include "thrpool.h"
 #include "callout.h"
@@ -126,13 +128,13 @@ protocol_type(gfarm_int32_t request)
 {
 	switch (request) {
 	case GFM_PROTO_HOST_INFO_GET_ALL:
-		return (PROTO_HANDLED_BY_SLAVE);
+		return (PROTO_HANDLED_BY_SLAVE|PROTO_READ_ONLY);
 	case GFM_PROTO_HOST_INFO_GET_BY_ARCHITECTURE:
-		return (PROTO_HANDLED_BY_SLAVE);
+		return (PROTO_HANDLED_BY_SLAVE|PROTO_READ_ONLY);
 	case GFM_PROTO_HOST_INFO_GET_BY_NAMES:
-		return (PROTO_HANDLED_BY_SLAVE);
+		return (PROTO_HANDLED_BY_SLAVE|PROTO_READ_ONLY);
 	case GFM_PROTO_HOST_INFO_GET_BY_NAMEALIASES:
-		return (PROTO_HANDLED_BY_SLAVE);
+		return (PROTO_HANDLED_BY_SLAVE|PROTO_READ_ONLY);
 	case GFM_PROTO_HOST_INFO_SET:
 		return (0);
 	case GFM_PROTO_HOST_INFO_MODIFY:
@@ -140,15 +142,15 @@ protocol_type(gfarm_int32_t request)
 	case GFM_PROTO_HOST_INFO_REMOVE:
 		return (0);
 	case GFM_PROTO_FSNGROUP_GET_ALL:
-		return (PROTO_HANDLED_BY_SLAVE);
+		return (PROTO_HANDLED_BY_SLAVE|PROTO_READ_ONLY);
 	case GFM_PROTO_FSNGROUP_GET_BY_HOSTNAME:
-		return (PROTO_HANDLED_BY_SLAVE);
+		return (PROTO_HANDLED_BY_SLAVE|PROTO_READ_ONLY);
 	case GFM_PROTO_FSNGROUP_MODIFY:
 		return (0);
 	case GFM_PROTO_USER_INFO_GET_ALL:
-		return (PROTO_HANDLED_BY_SLAVE);
+		return (PROTO_HANDLED_BY_SLAVE|PROTO_READ_ONLY);
 	case GFM_PROTO_USER_INFO_GET_BY_NAMES:
-		return (PROTO_HANDLED_BY_SLAVE);
+		return (PROTO_HANDLED_BY_SLAVE|PROTO_READ_ONLY);
 	case GFM_PROTO_USER_INFO_SET:
 		return (0);
 	case GFM_PROTO_USER_INFO_MODIFY:
@@ -156,11 +158,11 @@ protocol_type(gfarm_int32_t request)
 	case GFM_PROTO_USER_INFO_REMOVE:
 		return (0);
 	case GFM_PROTO_USER_INFO_GET_BY_GSI_DN:
-		return (PROTO_HANDLED_BY_SLAVE);
+		return (PROTO_HANDLED_BY_SLAVE|PROTO_READ_ONLY);
 	case GFM_PROTO_GROUP_INFO_GET_ALL:
-		return (PROTO_HANDLED_BY_SLAVE);
+		return (PROTO_HANDLED_BY_SLAVE|PROTO_READ_ONLY);
 	case GFM_PROTO_GROUP_INFO_GET_BY_NAMES:
-		return (PROTO_HANDLED_BY_SLAVE);
+		return (PROTO_HANDLED_BY_SLAVE|PROTO_READ_ONLY);
 	case GFM_PROTO_GROUP_INFO_SET:
 		return (0);
 	case GFM_PROTO_GROUP_INFO_MODIFY:
@@ -172,32 +174,39 @@ protocol_type(gfarm_int32_t request)
 	case GFM_PROTO_GROUP_INFO_REMOVE_USERS:
 		return (0);
 	case GFM_PROTO_GROUP_NAMES_GET_BY_USERS:
-		return (PROTO_HANDLED_BY_SLAVE);
+		return (PROTO_HANDLED_BY_SLAVE|PROTO_READ_ONLY);
 	case GFM_PROTO_COMPOUND_BEGIN:
-		return (PROTO_HANDLED_BY_SLAVE);
+		return (PROTO_HANDLED_BY_SLAVE|PROTO_READ_ONLY);
 	case GFM_PROTO_COMPOUND_END:
-		return (PROTO_HANDLED_BY_SLAVE);
+		return (PROTO_HANDLED_BY_SLAVE|PROTO_READ_ONLY);
 	case GFM_PROTO_COMPOUND_ON_ERROR:
-		return (PROTO_HANDLED_BY_SLAVE);
+		return (PROTO_HANDLED_BY_SLAVE|PROTO_READ_ONLY);
 	case GFM_PROTO_GET_FD: /* NOTE: externalize fd */
-		return (PROTO_HANDLED_BY_SLAVE|PROTO_USE_FD_CURRENT);
+		return (PROTO_HANDLED_BY_SLAVE|PROTO_USE_FD_CURRENT|
+		    PROTO_READ_ONLY);
 	case GFM_PROTO_PUT_FD: /* NOTE: explicitly pass fd */
-		return (PROTO_HANDLED_BY_SLAVE|PROTO_SET_FD_CURRENT);
+		return (PROTO_HANDLED_BY_SLAVE|PROTO_SET_FD_CURRENT|
+		    PROTO_READ_ONLY);
 	case GFM_PROTO_SAVE_FD:
 		return (PROTO_HANDLED_BY_SLAVE|
-		    PROTO_USE_FD_CURRENT|PROTO_SET_FD_SAVED);
+		    PROTO_USE_FD_CURRENT|PROTO_SET_FD_SAVED|
+		    PROTO_READ_ONLY);
 	case GFM_PROTO_RESTORE_FD:
 		return (PROTO_HANDLED_BY_SLAVE|
-		    PROTO_SET_FD_CURRENT|PROTO_USE_FD_SAVED);
+		    PROTO_SET_FD_CURRENT|PROTO_USE_FD_SAVED|
+		    PROTO_READ_ONLY);
 	case GFM_PROTO_CREATE:
 		return (PROTO_HANDLED_BY_SLAVE);
 	case GFM_PROTO_OPEN:
-		return (PROTO_USE_FD_CURRENT|PROTO_SET_FD_CURRENT);
+		return (PROTO_USE_FD_CURRENT|PROTO_SET_FD_CURRENT|
+		    PROTO_READ_ONLY);
 	case GFM_PROTO_OPEN_ROOT:
-		return (PROTO_HANDLED_BY_SLAVE|PROTO_SET_FD_CURRENT);
+		return (PROTO_HANDLED_BY_SLAVE|PROTO_SET_FD_CURRENT|
+		    PROTO_READ_ONLY);
 	case GFM_PROTO_OPEN_PARENT:
 		return (PROTO_HANDLED_BY_SLAVE|
-		    PROTO_USE_FD_CURRENT|PROTO_SET_FD_CURRENT);
+		    PROTO_USE_FD_CURRENT|PROTO_SET_FD_CURRENT|
+		    PROTO_READ_ONLY);
 #if 0
 	case GFM_PROTO_OPEN_DIR:
 		return (PROTO_HANDLED_BY_SLAVE|
@@ -206,11 +215,14 @@ protocol_type(gfarm_int32_t request)
 	case GFM_PROTO_FHOPEN:
 		return (PROTO_SET_FD_CURRENT);
 	case GFM_PROTO_CLOSE:
-		return (PROTO_HANDLED_BY_SLAVE|PROTO_USE_FD_CURRENT);
+		return (PROTO_HANDLED_BY_SLAVE|PROTO_USE_FD_CURRENT|
+		    PROTO_READ_ONLY);
 	case GFM_PROTO_VERIFY_TYPE:
-		return (PROTO_HANDLED_BY_SLAVE|PROTO_USE_FD_CURRENT);
+		return (PROTO_HANDLED_BY_SLAVE|PROTO_USE_FD_CURRENT|
+		    PROTO_READ_ONLY);
 	case GFM_PROTO_VERIFY_TYPE_NOT:
-		return (PROTO_HANDLED_BY_SLAVE|PROTO_USE_FD_CURRENT);
+		return (PROTO_HANDLED_BY_SLAVE|PROTO_USE_FD_CURRENT|
+		    PROTO_READ_ONLY);
 	case GFM_PROTO_BEQUEATH_FD:
 		return (PROTO_USE_FD_CURRENT);
 	case GFM_PROTO_INHERIT_FD:
@@ -218,7 +230,8 @@ protocol_type(gfarm_int32_t request)
 	case GFM_PROTO_REVOKE_GFSD_ACCESS: /* NOTE: explicitly pass fd */
 		return (0);
 	case GFM_PROTO_FSTAT:
-		return (PROTO_HANDLED_BY_SLAVE|PROTO_USE_FD_CURRENT);
+		return (PROTO_HANDLED_BY_SLAVE|PROTO_USE_FD_CURRENT|
+		    PROTO_READ_ONLY);
 	case GFM_PROTO_FUTIMES:
 		return (PROTO_USE_FD_CURRENT);
 	case GFM_PROTO_FCHMOD:
@@ -226,7 +239,8 @@ protocol_type(gfarm_int32_t request)
 	case GFM_PROTO_FCHOWN:
 		return (PROTO_USE_FD_CURRENT);
 	case GFM_PROTO_CKSUM_GET:
-		return (PROTO_HANDLED_BY_SLAVE|PROTO_USE_FD_CURRENT);
+		return (PROTO_HANDLED_BY_SLAVE|PROTO_USE_FD_CURRENT|
+		    PROTO_READ_ONLY);
 	case GFM_PROTO_CKSUM_SET:
 		return (PROTO_USE_FD_CURRENT);
 	case GFM_PROTO_SCHEDULE_FILE:
@@ -234,7 +248,8 @@ protocol_type(gfarm_int32_t request)
 	case GFM_PROTO_SCHEDULE_FILE_WITH_PROGRAM:
 		return (PROTO_USE_FD_CURRENT|PROTO_USE_FD_SAVED);
 	case GFM_PROTO_FGETATTRPLUS:
-		return (PROTO_HANDLED_BY_SLAVE|PROTO_USE_FD_CURRENT);
+		return (PROTO_HANDLED_BY_SLAVE|PROTO_USE_FD_CURRENT|
+		    PROTO_READ_ONLY);
 	case GFM_PROTO_REMOVE:
 		return (PROTO_USE_FD_CURRENT);
 	case GFM_PROTO_RENAME:
@@ -246,17 +261,22 @@ protocol_type(gfarm_int32_t request)
 	case GFM_PROTO_SYMLINK:
 		return (PROTO_USE_FD_CURRENT);
 	case GFM_PROTO_READLINK:
-		return (PROTO_HANDLED_BY_SLAVE|PROTO_USE_FD_CURRENT);
+		return (PROTO_HANDLED_BY_SLAVE|PROTO_USE_FD_CURRENT|
+		    PROTO_READ_ONLY);
 	case GFM_PROTO_GETDIRPATH: /* XXX: can be done in slave */
 		return (PROTO_USE_FD_CURRENT);
 	case GFM_PROTO_GETDIRENTS:
-		return (PROTO_HANDLED_BY_SLAVE|PROTO_USE_FD_CURRENT);
+		return (PROTO_HANDLED_BY_SLAVE|PROTO_USE_FD_CURRENT|
+		    PROTO_READ_ONLY);
 	case GFM_PROTO_SEEK:
-		return (PROTO_HANDLED_BY_SLAVE|PROTO_USE_FD_CURRENT);
+		return (PROTO_HANDLED_BY_SLAVE|PROTO_USE_FD_CURRENT|
+		    PROTO_READ_ONLY);
 	case GFM_PROTO_GETDIRENTSPLUS:
-		return (PROTO_HANDLED_BY_SLAVE|PROTO_USE_FD_CURRENT);
+		return (PROTO_HANDLED_BY_SLAVE|PROTO_USE_FD_CURRENT|
+		    PROTO_READ_ONLY);
 	case GFM_PROTO_GETDIRENTSPLUSXATTR:
-		return (PROTO_HANDLED_BY_SLAVE|PROTO_USE_FD_CURRENT);
+		return (PROTO_HANDLED_BY_SLAVE|PROTO_USE_FD_CURRENT|
+		    PROTO_READ_ONLY);
 	case GFM_PROTO_REOPEN:
 		return (PROTO_USE_FD_CURRENT);
 	case GFM_PROTO_CLOSE_READ:
@@ -338,13 +358,13 @@ protocol_type(gfarm_int32_t request)
 	case GFM_PROTO_REPLICA_CREATE_FILE_IN_LOST_FOUND:
 		return (0);
 	case GFM_PROTO_PROCESS_ALLOC:
-		return (PROTO_HANDLED_BY_SLAVE);
+		return (PROTO_HANDLED_BY_SLAVE|PROTO_READ_ONLY);
 #ifdef NOT_USED
 	case GFM_PROTO_PROCESS_ALLOC_CHILD:
 		return (PROTO_HANDLED_BY_SLAVE);
 #endif
 	case GFM_PROTO_PROCESS_FREE:
-		return (PROTO_HANDLED_BY_SLAVE);
+		return (PROTO_HANDLED_BY_SLAVE|PROTO_READ_ONLY);
 	case GFM_PROTO_PROCESS_SET:
 		return (PROTO_HANDLED_BY_SLAVE);
 	case GFJ_PROTO_LOCK_REGISTER:
@@ -392,15 +412,19 @@ protocol_type(gfarm_int32_t request)
 	case GFM_PROTO_QUOTA_CHECK:
 		return (0);
 	case GFM_PROTO_METADB_SERVER_GET:
-		return (PROTO_HANDLED_BY_SLAVE);
+		return (PROTO_HANDLED_BY_SLAVE|PROTO_READ_ONLY);
 	case GFM_PROTO_METADB_SERVER_GET_ALL:
-		return (PROTO_HANDLED_BY_SLAVE);
+		return (PROTO_HANDLED_BY_SLAVE|PROTO_READ_ONLY);
 	case GFM_PROTO_METADB_SERVER_SET:
 		return (0);
 	case GFM_PROTO_METADB_SERVER_MODIFY:
 		return (0);
 	case GFM_PROTO_METADB_SERVER_REMOVE:
 		return (0);
+	case GFM_PROTO_METADB_SERVER_SEQNUM_GET:
+		return (PROTO_HANDLED_BY_SLAVE|PROTO_READ_ONLY);
+	case GFM_PROTO_METADB_SERVER_READ_ONLY:
+		return (PROTO_HANDLED_BY_SLAVE|PROTO_READ_ONLY);
 	default:
 		return ((*gfm_server_protocol_type_extension)(request));
 	}
@@ -455,6 +479,14 @@ protocol_switch(struct peer *peer, gfp_xdr_xid_t xid, size_t *sizep,
 		peer_record_protocol_error(peer); /* mark this peer finished */
 		return (GFARM_ERR_FUNCTION_NOT_IMPLEMENTED);
 	}
+	if (peer_is_read_only(peer) && (type & PROTO_READ_ONLY) == 0) {
+		/* the arguments cannot be skipped without knowing them */
+		gflog_warning(GFARM_MSG_UNFIXED,
+		    "request %d is not allowed for a read-only connection",
+		    (int)request);
+		peer_record_protocol_error(peer); /* mark this peer finished */
+		return (GFARM_ERR_READ_ONLY_FILE_SYSTEM);
+	}
 
 	peer_stat_add(peer, GFARM_IOSTAT_TRAN_NUM, 1);
 
@@ -953,6 +985,14 @@ protocol_switch(struct peer *peer, gfp_xdr_xid_t xid, size_t *sizep,
 		e = gfm_server_metadb_server_remove(peer, xid, sizep,
 		    from_client, skip);
 		break;
+	case GFM_PROTO_METADB_SERVER_SEQNUM_GET:
+		e = gfm_server_metadb_server_seqnum_get(peer, xid, sizep,
+		    from_client, skip);
+		break;
+	case GFM_PROTO_METADB_SERVER_READ_ONLY:
+		e = gfm_server_metadb_server_read_only(peer, xid, sizep,
+		    from_client, skip);
+		break;
 	default:
 		e = gfm_server_protocol_extension(peer, xid, sizep,
 		    from_client, skip, level, request, requestp, on_errorp);
@@ -1826,6 +1866,12 @@ sigs_handler(void *p)
 		case SIGUSR2:
 			thrpool_info();
 			replica_check_info();
+			giant_info();
+			inode_table_info();
+			slab_info();
+			db_thread_info();
+			if (gfarm_get_metadb_replication_enabled())
+				db_journal_sync_info();
 			continue;
 
 		/* some of these will be never delivered due to `*sigs' */
@@ -1888,6 +1934,10 @@ gfmd_terminate(const char *diag)
 	/* db_terminate() needs giant_lock(), see comment in dbq_enter() */
 	db_terminate();
 
+	/* the metadata is not completely loaded until gfmd becomes ready */
+	if (gfmd_startup_state_is_ready())
+		(void)snapshot_save();
+
 	if (iostat_dirbuf) {
 		unlink(iostat_dirbuf);
 		free(iostat_dirbuf);
@@ -1945,6 +1995,7 @@ gfmd_modules_init_default(int table_size)
 		db_journal_apply_init();
 		db_journal_init();
 		boot_apply_db_journal();
+		snapshot_open();
 	}
 	mdhost_init();
 	back_channel_init();
@@ -1963,6 +2014,7 @@ gfmd_modules_init_default(int table_size)
 	file_copy_init();
 	symlink_init();
 	xattr_init();
+	snapshot_close();
 	quota_init();
 
 	/* must be after hosts and filesystem */
@@ -2227,7 +2279,8 @@ main(int argc, char **argv)
 		if (is_master) {
 			sock = open_accepting_socket(gfmd_port);
 			replica_check_start();
-		} else if (gfarm_get_metadb_server_slave_listen()) {
+		} else if (gfarm_get_metadb_server_slave_listen() ||
+		    gfarm_get_metadb_server_slave_read_service()) {
 			sock = open_accepting_socket(gfmd_port);
 		} else {
 			sock = wait_transform_to_master(gfmd_port);
@@ -2237,7 +2290,7 @@ main(int argc, char **argv)
 		replica_check_start();
 	}
 
-	/* master, or inter-gfmd RPC relay is enabled */
+	/* master, inter-gfmd RPC relay or slave read service is enabled */
 
 	accepting_loop(sock);
 
@@ -2436,7 +2436,8 @@ gfmdc_connect(void)
 		 *  other slaves won't connect to the new master, see #361),
 		 * but currently that doesn't work with protocol relay. FIXME.
 		 */
-		int multicast = gfarm_get_metadb_server_slave_listen() ? 0 : 1;
+		int multicast = gfarm_get_metadb_server_slave_listen() ||
+		    gfarm_get_metadb_server_slave_read_service() ? 0 : 1;
 
 		/* try connecting to multiple destinations */
 		e = gfm_client_connect_with_seteuid(hostname, port,
@@ -2786,8 +2787,9 @@ gfmdc_journal_sync_multiple(gfarm_uint64_t seqnum)
 
 	mdhost_foreach(gfmdc_journal_sync_count_host, &nhosts);
 	if (nhosts == 0) {
+		/* group commit, the reply waits by db_journal_sync_wait() */
 		if (gfarm_get_journal_sync_file())
-			return (db_journal_file_writer_sync());
+			return (db_journal_sync_request(seqnum));
 		return (GFARM_ERR_NO_ERROR);
 	}
 
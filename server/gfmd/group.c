@@ -268,6 +268,13 @@ group_name(struct group *g)
 	    g->groupname : REMOVED_GROUP_NAME);
 }
 
+/* the name is kept even after the group is removed */
+char *
+group_name_including_invalid(struct group *g)
+{
+	return (g != NULL ? g->groupname : REMOVED_GROUP_NAME);
+}
+
 struct quota *
 group_quota(struct group *g)
 {
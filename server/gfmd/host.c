@@ -91,6 +91,8 @@ struct host {
 	gfarm_time_t last_report;
 	gfarm_time_t disconnect_time;
 	int status_callout_retry;
+
+	int replication_receiving; /* protected by giant_lock */
 };
 
 static struct gfarm_hash_table *host_hashtab = NULL;
@@ -99,6 +101,27 @@ static struct gfarm_hash_table *hostalias_hashtab = NULL;
 static struct host *host_new(struct gfarm_host_info *, struct callout *);
 static void host_free(struct host *);
 
+/*
+ * index of valid hosts, to avoid walking host_hashtab and sorting the hosts
+ * for each scheduling of a file or a replica.
+ * hosts[] is sorted by host_order(), and fsngroup_hosts[] is sorted by
+ * the fsngroup, and then by host_order().
+ * it's rebuilt by host_index_update() lazily, after it becomes stale
+ * by addition or removal of a host, or modification of its fsngroup.
+ * protected by giant_lock.
+ */
+struct host_index_fsngroup {
+	const char *fsngroupname; /* shared with struct host */
+	int start, nhosts; /* range in fsngroup_hosts[] */
+};
+static struct host_index {
+	int is_stale;
+	int nhosts;
+	struct host **hosts, **fsngroup_hosts;
+	int nfsngroups;
+	struct host_index_fsngroup *fsngroups;
+} host_index = { 1, 0, NULL, NULL, 0, NULL };
+
 /* NOTE: each entry should be checked by host_is_valid(h) too */
 #define FOR_ALL_HOSTS(it) \
 	for (gfarm_hash_iterator_begin(host_hashtab, (it)); \
@@ -131,12 +154,14 @@ static void
 host_invalidate(struct host *h)
 {
 	abstract_host_invalidate(&h->ah);
+	host_index.is_stale = 1;
 }
 
 static void
 host_validate(struct host *h)
 {
 	abstract_host_validate(&h->ah);
+	host_index.is_stale = 1;
 }
 
 static int
@@ -742,7 +767,7 @@ host_disable(struct abstract_host *ah)
 	back_channel_mutex_unlock(h, diag);
 
 	host_total_disk_update(saved_used, saved_avail, 0, 0);
-	replica_check_signal_host_down();
+	replica_check_signal_host_down(h);
 }
 
 static void
@@ -815,6 +840,7 @@ host_new(struct gfarm_host_info *hi, struct callout *callout)
 	h->status_callout_retry = 0;
 	h->last_report = 0;
 	h->disconnect_time = time(NULL);
+	h->replication_receiving = 0;
 	return (h);
 }
 
@@ -877,6 +903,16 @@ host_unique(int nhosts, struct host **hosts)
 int
 host_unique_sort(int nhosts, struct host **hosts)
 {
+	int i;
+
+	/* short cut for a copy of host_index, which is sorted and unique */
+	for (i = 1; i < nhosts; i++) {
+		if (host_order(&hosts[i - 1], &hosts[i]) >= 0)
+			break;
+	}
+	if (i >= nhosts)
+		return (nhosts > 0 ? nhosts : 0);
+
 	host_sort(nhosts, hosts);
 	return (host_unique(nhosts, hosts));
 }
@@ -992,12 +1028,32 @@ host_is_disk_available_filter(struct host *host, void *closure)
 	return (host_is_disk_available(host, *sizep));
 }
 
-gfarm_error_t
-host_array_alloc(int *nhostsp, struct host ***hostsp)
+static int
+host_fsngroup_order(const void *a, const void *b)
 {
-	int i, nhosts;
-	struct host *h, **hosts;
+	const struct host *const *h1 = a, *const *h2 = b;
+	int cmp = strcmp(host_fsngroup((struct host *)*h1), /* UNCONST */
+	    host_fsngroup((struct host *)*h2)); /* UNCONST */
+
+	return (cmp != 0 ? cmp : host_order(a, b));
+}
+
+/*
+ * PREREQUISITE: giant_lock
+ * LOCKS: nothing
+ * SLEEPS: no
+ */
+static gfarm_error_t
+host_index_update(void)
+{
+	int i, n, nhosts, nfsngroups;
+	struct host *h, **hosts, **fsngroup_hosts;
+	struct host_index_fsngroup *fsngroups;
 	struct gfarm_hash_iterator it;
+	const char *g;
+
+	if (!host_index.is_stale)
+		return (GFARM_ERR_NO_ERROR);
 
 	nhosts = 0;
 	FOR_ALL_HOSTS(&it) {
@@ -1005,24 +1061,127 @@ host_array_alloc(int *nhostsp, struct host ***hostsp)
 		if (host_is_valid(h))
 			++nhosts;
 	}
-
 	GFARM_MALLOC_ARRAY(hosts, nhosts > 0 ? nhosts : 1);
-	if (hosts == NULL)
+	GFARM_MALLOC_ARRAY(fsngroup_hosts, nhosts > 0 ? nhosts : 1);
+	GFARM_MALLOC_ARRAY(fsngroups, nhosts > 0 ? nhosts : 1);
+	if (hosts == NULL || fsngroup_hosts == NULL || fsngroups == NULL) {
+		free(hosts);
+		free(fsngroup_hosts);
+		free(fsngroups);
 		return (GFARM_ERR_NO_MEMORY);
+	}
 
-	i = 0;
+	n = 0;
 	FOR_ALL_HOSTS(&it) {
-		if (i >= nhosts) /* always false due to giant_lock */
+		if (n >= nhosts) /* always false due to giant_lock */
 			break;
 		h = host_iterator_access(&it);
 		if (host_is_valid(h))
-			hosts[i++] = h;
+			hosts[n++] = h;
 	}
-	*nhostsp = i;
-	*hostsp = hosts;
+	nhosts = n;
+	host_sort(nhosts, hosts);
+
+	memcpy(fsngroup_hosts, hosts, sizeof(*hosts) * nhosts);
+	if (nhosts > 0)
+		qsort(fsngroup_hosts, nhosts, sizeof(*fsngroup_hosts),
+		    host_fsngroup_order);
+	nfsngroups = 0;
+	for (i = 0; i < nhosts; i++) {
+		g = host_fsngroup(fsngroup_hosts[i]);
+		if (nfsngroups == 0 ||
+		    strcmp(fsngroups[nfsngroups - 1].fsngroupname, g) != 0) {
+			fsngroups[nfsngroups].fsngroupname = g;
+			fsngroups[nfsngroups].start = i;
+			fsngroups[nfsngroups].nhosts = 0;
+			nfsngroups++;
+		}
+		fsngroups[nfsngroups - 1].nhosts++;
+	}
+
+	free(host_index.hosts);
+	free(host_index.fsngroup_hosts);
+	free(host_index.fsngroups);
+	host_index.nhosts = nhosts;
+	host_index.hosts = hosts;
+	host_index.fsngroup_hosts = fsngroup_hosts;
+	host_index.nfsngroups = nfsngroups;
+	host_index.fsngroups = fsngroups;
+	host_index.is_stale = 0;
 	return (GFARM_ERR_NO_ERROR);
 }
 
+static gfarm_error_t
+host_array_dup(int nhosts, struct host **hosts,
+	int *nhostsp, struct host ***hostsp)
+{
+	struct host **dup;
+
+	GFARM_MALLOC_ARRAY(dup, nhosts > 0 ? nhosts : 1);
+	if (dup == NULL)
+		return (GFARM_ERR_NO_MEMORY);
+	memcpy(dup, hosts, sizeof(*hosts) * nhosts);
+	*nhostsp = nhosts;
+	*hostsp = dup;
+	return (GFARM_ERR_NO_ERROR);
+}
+
+/*
+ * the result is sorted by host_order(), and unique.
+ *
+ * PREREQUISITE: giant_lock
+ * LOCKS: nothing
+ * SLEEPS: no
+ */
+gfarm_error_t
+host_array_alloc(int *nhostsp, struct host ***hostsp)
+{
+	gfarm_error_t e = host_index_update();
+
+	if (e != GFARM_ERR_NO_ERROR)
+		return (e);
+	return (host_array_dup(host_index.nhosts, host_index.hosts,
+	    nhostsp, hostsp));
+}
+
+/*
+ * valid hosts which belong to the fsngroup.
+ * the result is sorted by host_order(), and unique.
+ *
+ * PREREQUISITE: giant_lock
+ * LOCKS: nothing
+ * SLEEPS: no
+ */
+gfarm_error_t
+host_fsngroup_array_alloc(const char *fsngroup,
+	int *nhostsp, struct host ***hostsp)
+{
+	gfarm_error_t e = host_index_update();
+	int l, r, m, cmp;
+	struct host_index_fsngroup *g;
+
+	if (e != GFARM_ERR_NO_ERROR)
+		return (e);
+
+	/* binary search */
+	l = 0;
+	r = host_index.nfsngroups;
+	while (l < r) {
+		m = l + (r - l) / 2;
+		g = &host_index.fsngroups[m];
+		cmp = strcmp(fsngroup, g->fsngroupname);
+		if (cmp == 0)
+			return (host_array_dup(g->nhosts,
+			    &host_index.fsngroup_hosts[g->start],
+			    nhostsp, hostsp));
+		if (cmp < 0)
+			r = m;
+		else
+			l = m + 1;
+	}
+	return (host_array_dup(0, NULL, nhostsp, hostsp));
+}
+
 gfarm_error_t
 host_from_all(int (*filter)(struct host *, void *), void *closure,
 	gfarm_int32_t *nhostsp, struct host ***hostsp)
@@ -1066,10 +1225,52 @@ host_number()
 }
 
 /*
- * just select randomly		XXX FIXME: needs to improve
+ * PREREQUISITE: giant_lock
+ * LOCKS: host::back_channel_mutex
+ * SLEEPS: no
+ */
+void
+host_replication_receiving_add(struct host *h, int n)
+{
+	h->replication_receiving += n;
+	if (h->replication_receiving < 0) {
+		gflog_error(GFARM_MSG_UNFIXED,
+		    "host %s: replication_receiving %d: unexpected",
+		    host_name(h), h->replication_receiving);
+		h->replication_receiving = 0;
+	}
+}
+
+/*
+ * a host is preferred, if it has more free space, lower load average,
+ * and less replications in flight to it.
+ *
+ * PREREQUISITE: giant_lock
+ * LOCKS: host::back_channel_mutex
+ * SLEEPS: no
  */
+static double
+host_select_weight(struct host *h)
+{
+	double avail = 0.0, loadavg = 0.0;
+	static const char diag[] = "host_select_weight";
+
+	back_channel_mutex_lock(h, diag);
+	if (host_is_up_unlocked(h) &&
+	    (h->report_flags & GFM_PROTO_SCHED_FLAG_LOADAVG_AVAIL) != 0) {
+		avail = h->status.disk_avail;
+		loadavg = h->status.loadavg_1min;
+	}
+	back_channel_mutex_unlock(h, diag);
+
+	if (loadavg < 0.0)
+		loadavg = 0.0;
+	return ((avail + 1.0) /
+	    ((1.0 + loadavg) * (1.0 + h->replication_receiving)));
+}
+
 static void
-select_hosts(int nhosts, struct host **hosts,
+select_hosts_randomly(int nhosts, struct host **hosts,
 	int nresults, struct host **results)
 {
 	int i, j;
@@ -1082,6 +1283,45 @@ select_hosts(int nhosts, struct host **hosts,
 	}
 }
 
+/*
+ * weighted random sampling without replacement,
+ * by the weight of host_select_weight().
+ * this function breaks the order of hosts[].
+ */
+static void
+select_hosts(int nhosts, struct host **hosts,
+	int nresults, struct host **results)
+{
+	int i, j;
+	double *weights, total, r;
+
+	assert(nhosts > nresults);
+	GFARM_MALLOC_ARRAY(weights, nhosts);
+	if (weights == NULL) {
+		select_hosts_randomly(nhosts, hosts, nresults, results);
+		return;
+	}
+	total = 0.0;
+	for (j = 0; j < nhosts; j++) {
+		weights[j] = host_select_weight(hosts[j]);
+		total += weights[j];
+	}
+	for (i = 0; i < nresults; i++) {
+		r = total * (gfarm_random() / 2147483648.0); /* [0, total) */
+		for (j = 0; j < nhosts - 1; j++) {
+			if (r < weights[j])
+				break;
+			r -= weights[j];
+		}
+		results[i] = hosts[j];
+		total -= weights[j];
+		--nhosts;
+		hosts[j] = hosts[nhosts];
+		weights[j] = weights[nhosts];
+	}
+	free(weights);
+}
+
 /*
  * this function modifies *n_exceptionsp and exceptions[],
  * but they may be abled to be used later.
@@ -1128,52 +1368,42 @@ host_schedule_n_except(
 	int (*filter)(struct host *, void *), void *closure,
 	int n_desired, int *n_targetsp, struct host ***targetsp, int *n_validp)
 {
-	gfarm_error_t e;
-	int i, n_before, nhosts, n_shortage, n_up = 0, n_down = 0, n_zero = 0;
-	struct host **targets, **up, **down;
+	int i, j, k, nhosts, n_valid, n_shortage;
+	struct host *h, **targets;
 
-	e = host_except(nhostsp, hosts, n_being_removedp, being_removed,
-	    NULL, NULL);
-	if (e != GFARM_ERR_NO_ERROR)
-		return (e);
+	nhosts = host_unique_sort(*nhostsp, hosts);
+	*n_being_removedp = host_unique_sort(*n_being_removedp, being_removed);
+	*n_existingp = host_unique_sort(*n_existingp, existing);
 
-	GFARM_MALLOC_ARRAY(up, *n_existingp);
-	GFARM_MALLOC_ARRAY(down, *n_existingp);
-	if (up == NULL || down == NULL) {
-		free(up);
-		free(down);
-		return (GFARM_ERR_NO_MEMORY);
-	}
-	for (i = 0; i < *n_existingp; i++) {
-		if (host_is_up_with_grace(existing[i], grace))
-			up[n_up++] = existing[i];
-		else
-			down[n_down++] = existing[i];
-	}
-	e = host_except(nhostsp, hosts, &n_down, down, NULL, NULL);
-	if (e != GFARM_ERR_NO_ERROR) {
-		free(up);
-		free(down);
-		return (e);
-	}
-	n_before = *nhostsp;
-	e = host_except(nhostsp, hosts, &n_up, up, NULL, NULL);
-	if (e != GFARM_ERR_NO_ERROR) {
-		free(up);
-		free(down);
-		return (e);
+	/*
+	 * a single merge pass over the sorted hosts[]:
+	 * exclude being_removed[] and existing[] (counting existing valid
+	 * replicas), then apply the filter to the rest.
+	 */
+	n_valid = 0;
+	j = k = 0;
+	*nhostsp = 0;
+	for (i = 0; i < nhosts; i++) {
+		h = hosts[i];
+		while (j < *n_being_removedp &&
+		    host_order(&being_removed[j], &h) < 0)
+			j++;
+		if (j < *n_being_removedp && being_removed[j] == h)
+			continue;
+		while (k < *n_existingp && host_order(&existing[k], &h) < 0)
+			k++;
+		if (k < *n_existingp && existing[k] == h) {
+			if (host_is_up_with_grace(h, grace))
+				n_valid++;
+			continue;
+		}
+		if (filter == NULL || filter(h, closure))
+			hosts[(*nhostsp)++] = h;
 	}
-	*n_validp = n_before - *nhostsp; /* existing valid replicas */
-	free(up);
-	free(down);
-
-	/* search available hosts */
-	e = host_except(nhostsp, hosts, &n_zero, NULL, filter, closure);
-	if (e != GFARM_ERR_NO_ERROR)
-		return (e);
+	*n_validp = n_valid; /* existing valid replicas */
 
 	nhosts = *nhostsp;
-	n_shortage = n_desired - *n_validp;
+	n_shortage = n_desired - n_valid;
 	if (n_shortage <= 0) { /* sufficient */
 		*n_targetsp = 0;
 		*targetsp = NULL;
@@ -1252,6 +1482,7 @@ host_add_one(void *closure,
 			h->fsngroupname = hi->fsngroupname;
 		else
 			h->fsngroupname = NULL;
+		host_index.is_stale = 1;
 	}
 }
 
@@ -1764,6 +1995,7 @@ host_fsngroup_modify(struct host *h, const char *fsngroupname,
 	if (h->fsngroupname != NULL)
 		free(h->fsngroupname);
 	h->fsngroupname = g;
+	host_index.is_stale = 1;
 
 	return (GFARM_ERR_NO_ERROR);
 }
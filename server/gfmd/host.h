@@ -63,6 +63,7 @@ gfarm_error_t host_except(int *, struct host **, int *, struct host **,
 
 gfarm_error_t host_is_disk_available_filter(struct host *, void *);
 gfarm_error_t host_array_alloc(int *, struct host ***);
+gfarm_error_t host_fsngroup_array_alloc(const char *, int *, struct host ***);
 gfarm_error_t host_from_all(int (*)(struct host *, void *), void *,
 	gfarm_int32_t *, struct host ***);
 int host_number();
@@ -76,6 +77,7 @@ gfarm_error_t host_schedule_n_except(
 	int *, struct host **,
 	int (*)(struct host *, void *), void *,
 	int, int *, struct host ***, int *);
+void host_replication_receiving_add(struct host *, int);
 void host_status_update(struct host *, struct host_status *);
 
 struct gfarm_host_info;
@@ -48,6 +48,9 @@
 #include "repattr.h"
 #include "fsngroup.h"
 #include "replica_check.h"
+#include "slab.h"
+#include "snapshot.h"
+#include "xmlattr_index.h"
 
 #include "auth.h" /* for "peer.h" */
 #include "peer.h" /* peer_reset_pending_new_generation() */
@@ -56,8 +59,17 @@
 #define MAX_DIR_DEPTH			1024	/* == GFARM_PATH_MAX */
 
 #define ROOT_INUMBER			2
-#define INODE_TABLE_SIZE_INITIAL	1000
-#define INODE_TABLE_SIZE_MULTIPLY	2
+
+/*
+ * inodes are stored in pages of INODE_PAGE_SIZE inodes indexed by
+ * i_number, instead of malloc(3)ing each inode and keeping a pointer
+ * to it in a flat table.  i_number of a never allocated slot is 0.
+ */
+#define INODE_PAGE_SHIFT		12
+#define INODE_PAGE_SIZE			(1 << INODE_PAGE_SHIFT)
+#define INODE_PAGE_MASK			(INODE_PAGE_SIZE - 1)
+#define INODE_PAGES_INITIAL		16
+#define INODE_PAGES_MULTIPLY		2
 
 #define INODE_MODE_FREE			0	/* struct inode:i_mode */
 
@@ -93,10 +105,11 @@ struct xattr_entry {
 	char *name;
 	void *cached_attrvalue;
 	int cached_attrsize;
+	char *xmlpaths; /* xmlattr_index_paths(), if xmlattr is indexed */
 };
 
 struct xattrs {
-	struct xattr_entry *head, *tail;
+	struct xattr_entry *head; /* head->prev is the tail */
 };
 
 struct inode {
@@ -170,8 +183,9 @@ struct inode_activity {
 	} u;
 };
 
-struct inode **inode_table = NULL;
-gfarm_ino_t inode_table_size = 0;
+static struct inode **inode_pages = NULL;
+static gfarm_ino_t inode_pages_size = 0, inode_pages_allocated = 0;
+gfarm_ino_t inode_table_size = 0; /* inode_pages_size * INODE_PAGE_SIZE */
 gfarm_ino_t inode_free_index = ROOT_INUMBER;
 
 struct inode inode_free_list; /* dummy header of doubly linked circular list */
@@ -181,6 +195,11 @@ static gfarm_uint64_t total_num_inodes;
 static pthread_mutex_t total_num_inodes_mutex = PTHREAD_MUTEX_INITIALIZER;
 static const char total_num_inodes_diag[] = "total_num_inodes_mutex";
 
+static struct slab file_copy_slab =
+	SLAB_INITIALIZER("file_copy", struct file_copy);
+static struct slab xattr_entry_slab =
+	SLAB_INITIALIZER("xattr_entry", struct xattr_entry);
+
 static char dot[] = ".";
 static char dotdot[] = "..";
 
@@ -468,7 +487,7 @@ inode_cksum_get(struct file_opening *fo,
 static void
 xattrs_init(struct xattrs *xattrs)
 {
-	xattrs->head = xattrs->tail =NULL;
+	xattrs->head = NULL;
 }
 
 static void
@@ -480,11 +499,10 @@ xattrs_free_entries(struct xattrs *xattrs)
 		if (entry->cached_attrvalue != NULL)
 			free(entry->cached_attrvalue);
 		next = entry->next;
-		free(entry);
+		slab_free(&xattr_entry_slab, entry);
 		entry = next;
 	}
 	xattrs->head = NULL;
-	xattrs->tail = NULL;
 }
 
 static void
@@ -606,53 +624,62 @@ struct inode *
 inode_alloc_num(gfarm_ino_t inum)
 {
 	gfarm_ino_t i;
-	struct inode *inode;
+	struct inode *inode, *page;
 	static const char diag[] = "inode_alloc_num";
 
 	if (inum < ROOT_INUMBER)
 		return (NULL); /* we don't use 0 and 1 as i_number */
 	if (inode_table_size <= inum) {
-		gfarm_ino_t new_table_size;
+		gfarm_ino_t new_pages_size;
 		struct inode **p;
 
-		if (inum < INODE_TABLE_SIZE_INITIAL)
-			new_table_size = INODE_TABLE_SIZE_INITIAL;
-		else if (inum < inode_table_size * INODE_TABLE_SIZE_MULTIPLY)
-			new_table_size =
-			    inode_table_size * INODE_TABLE_SIZE_MULTIPLY;
+		if ((inum >> INODE_PAGE_SHIFT) < INODE_PAGES_INITIAL)
+			new_pages_size = INODE_PAGES_INITIAL;
+		else if ((inum >> INODE_PAGE_SHIFT) <
+		    inode_pages_size * INODE_PAGES_MULTIPLY)
+			new_pages_size =
+			    inode_pages_size * INODE_PAGES_MULTIPLY;
 		else
-			new_table_size = inum * INODE_TABLE_SIZE_MULTIPLY;
-		GFARM_REALLOC_ARRAY(p, inode_table, new_table_size);
+			new_pages_size = ((inum >> INODE_PAGE_SHIFT) + 1) *
+			    INODE_PAGES_MULTIPLY;
+		GFARM_REALLOC_ARRAY(p, inode_pages, new_pages_size);
 		if (p == NULL) {
 			gflog_debug(GFARM_MSG_1001720,
 				"re-allocation of inode array failed");
 			return (NULL); /* no memory */
 		}
-		inode_table = p;
+		inode_pages = p;
 
-		for (i = inode_table_size; i < new_table_size; i++)
-			inode_table[i] = NULL;
-		inode_table_size = new_table_size;
+		for (i = inode_pages_size; i < new_pages_size; i++)
+			inode_pages[i] = NULL;
+		inode_pages_size = new_pages_size;
+		inode_table_size = new_pages_size << INODE_PAGE_SHIFT;
 	}
-	if ((inode = inode_table[inum]) == NULL) {
-		GFARM_MALLOC(inode);
-		if (inode == NULL) {
+	if ((page = inode_pages[inum >> INODE_PAGE_SHIFT]) == NULL) {
+		/* i_number of all slots are initialized to 0 */
+		GFARM_CALLOC_ARRAY(page, INODE_PAGE_SIZE);
+		if (page == NULL) {
 			gflog_debug(GFARM_MSG_1001721,
 				"allocation of 'inode' failed");
 			return (NULL); /* no memory */
 		}
+		inode_pages[inum >> INODE_PAGE_SHIFT] = page;
+		inode_pages_allocated++;
+	}
+	inode = &page[inum & INODE_PAGE_MASK];
+	if (inode->i_number == 0) { /* never allocated */
 		inode_xattrs_init(inode);
 
 		inode->i_number = inum;
 		inode->i_gen = 0;
 		inode->dead_copies = NULL;
-		inode_table[inum] = inode;
 
 		/* update inode_free_index */
 		if (inum == inode_free_index) { /* always true for now */
 			while (++inode_free_index < inode_table_size) {
 				/* the following is always true for now */
-				if (inode_table[inode_free_index] == NULL)
+				if (inode_lookup_including_free(
+				    inode_free_index) == NULL)
 					break;
 			}
 		}
@@ -779,7 +806,7 @@ inode_schedule_replication_within_scope(
 	gfarm_error_t e, save_e = GFARM_ERR_NO_ERROR;
 	struct host **targets, *src, *dst;
 	int busy = 0, n_success = 0, n_targets, i, n_valid, shortage;
-	struct file_replication *fr;
+	struct file_replication *fr, *prev_fr = NULL;
 	gfarm_off_t necessary_space;
 
 	necessary_space = inode_get_size(inode);
@@ -851,8 +878,15 @@ inode_schedule_replication_within_scope(
 			if (save_e == GFARM_ERR_NO_ERROR ||
 			    e == GFARM_ERR_NO_MEMORY)
 				save_e = e;
-		} else
+		} else {
 			n_success++;
+			/* the source is read only once */
+			if (gfarm_replication_chain) {
+				if (prev_fr != NULL)
+					file_replication_chain(prev_fr, fr);
+				prev_fr = fr;
+			}
+		}
 	}
 	free(targets);
 
@@ -1211,7 +1245,7 @@ update_replicas(struct inode *inode, struct host *spool_host,
 			} else { /* dead_file_copy must be already created */
 				assert(!FILE_COPY_IS_VALID(copy));
 			}
-			free(copy);
+			slab_free(&file_copy_slab, copy);
 		}
 	}
 
@@ -1292,7 +1326,7 @@ update_replicas(struct inode *inode, struct host *spool_host,
 		}
 
 		next = copy->host_next;
-		free(copy);
+		slab_free(&file_copy_slab, copy);
 	}
 
 	/*
@@ -1304,7 +1338,8 @@ update_replicas(struct inode *inode, struct host *spool_host,
 	 */
 	/* avoid calling replica_check if GFARM_ERR_NO_MEMORY occurs */
 	if (save_e != GFARM_ERR_NO_ERROR && save_e != GFARM_ERR_NO_MEMORY)
-		replica_check_signal_rep_request_failed();
+		replica_check_signal_rep_request_failed(inode,
+		    desired_replica_number, repattr);
 }
 
 void
@@ -1328,7 +1363,7 @@ inode_remove(struct inode *inode)
 				/* abandon error */
 			}
 			cn = copy->host_next;
-			free(copy);
+			slab_free(&file_copy_slab, copy);
 		}
 		inode->u.c.s.f.copies = NULL; /* ncopy == 0 */
 		inode_cksum_remove(inode);
@@ -1478,11 +1513,8 @@ inode_table_current_size()
 struct inode *
 inode_lookup(gfarm_ino_t inum)
 {
-	struct inode *inode;
+	struct inode *inode = inode_lookup_including_free(inum);
 
-	if (inum >= inode_table_size)
-		return (NULL);
-	inode = inode_table[inum];
 	if (inode == NULL)
 		return (NULL);
 	if (inode->i_mode == INODE_MODE_FREE)
@@ -1493,23 +1525,41 @@ inode_lookup(gfarm_ino_t inum)
 struct inode *
 inode_lookup_including_free(gfarm_ino_t inum)
 {
+	struct inode *page, *inode;
+
 	if (inum >= inode_table_size)
 		return (NULL);
-	return (inode_table[inum]);
+	if ((page = inode_pages[inum >> INODE_PAGE_SHIFT]) == NULL)
+		return (NULL);
+	inode = &page[inum & INODE_PAGE_MASK];
+	if (inode->i_number == 0) /* never allocated */
+		return (NULL);
+	return (inode);
 }
 
 void
 inode_lookup_all(void *closure, void (*callback)(void *, struct inode *))
 {
-	int i;
+	gfarm_ino_t i;
+	struct inode *inode;
 
 	for (i = ROOT_INUMBER; i < inode_table_size; i++) {
-		if (inode_table[i] != NULL &&
-		    inode_table[i]->i_mode != INODE_MODE_FREE)
-			callback(closure, inode_table[i]);
+		if ((inode = inode_lookup(i)) != NULL)
+			callback(closure, inode);
 	}
 }
 
+/* the numbers may be inaccurate, because giant_lock is not held */
+void
+inode_table_info(void)
+{
+	gflog_info(GFARM_MSG_UNFIXED,
+	    "memory: inode: %zu bytes * %llu in use, %zu bytes allocated",
+	    sizeof(struct inode), (unsigned long long)inode_total_num(),
+	    (size_t)(inode_pages_allocated * INODE_PAGE_SIZE *
+	    sizeof(struct inode) + inode_pages_size * sizeof(*inode_pages)));
+}
+
 int
 inode_is_dir(struct inode *inode)
 {
@@ -3412,7 +3462,7 @@ inode_rename(
 		if (sdir != ddir && (inode_is_dir(src) || inode_is_file(src))
 		    && (!inode_has_desired_number(src, &num) &&
 			!inode_has_repattr(src, NULL)))
-			replica_check_signal_rename();
+			replica_check_signal_rename(src, ddir);
 	}
 	/* db_inode_nlink_modify() is not necessary, because it's unchanged */
 	return (e);
@@ -3585,6 +3635,21 @@ inode_close(struct file_opening *fo, char **trace_logp)
 	inode_close_read(fo, NULL, trace_logp);
 }
 
+/*
+ * returns true, if inode_close() only unlinks this opening from
+ * the inode activity, i.e. it neither updates the DB nor touches
+ * a file replication state.
+ */
+int
+inode_close_is_trivial(struct file_opening *fo)
+{
+	struct inode *inode = fo->inode;
+	struct inode_activity *ia = inode->u.c.activity;
+
+	return ((fo->flag & GFARM_FILE_TRUNC_PENDING) == 0 &&
+	    ia->u.f.rstate == NULL && inode->i_nlink > 0);
+}
+
 /* NOTE: this function is called in slave_mode as well */
 void
 inode_close_read(struct file_opening *fo, struct gfarm_timespec *atime,
@@ -3692,7 +3757,9 @@ inode_check_pending_replication(struct file_opening *fo)
 		 */
 		/* avoid calling replica_check if GFARM_ERR_NO_MEMORY occurs */
 		if (e != GFARM_ERR_NO_ERROR && e != GFARM_ERR_NO_MEMORY)
-			replica_check_signal_rep_request_failed();
+			replica_check_signal_rep_request_failed(inode,
+			    fo->u.f.desired_replica_number,
+			    fo->u.f.repattr);
 	}
 }
 
@@ -4282,7 +4349,7 @@ inode_remove_replica_in_cache(struct inode *inode, struct host *spool_host)
 	}
 	copy = *foundp;
 	*foundp = copy->host_next;
-	free(copy);
+	slab_free(&file_copy_slab, copy);
 	return (GFARM_ERR_NO_ERROR);
 }
 
@@ -4443,7 +4510,7 @@ inode_replicated(struct file_replication *fr,
 		 * #647 - workaround for #646 - retry replication when
 		 * a result of replication is failure
 		 */
-		replica_check_signal_rep_result_failed();
+		replica_check_signal_rep_result_failed(inode);
 	}
 
 	return (e);
@@ -4498,7 +4565,7 @@ inode_add_replica_internal(struct inode *inode, struct host *spool_host,
 		}
 	}
 
-	GFARM_MALLOC(copy);
+	copy = slab_alloc(&file_copy_slab);
 	if (copy == NULL) {
 		gflog_debug(GFARM_MSG_1001768,
 			"allocation of 'copy' failed");
@@ -4628,8 +4695,7 @@ inode_remove_replica_completed(gfarm_ino_t inum, gfarm_int64_t igen,
 	if (inode != NULL) {
 		inode2 = inode;
 	} else {
-		assert(inum < inode_table_size);
-		inode2 = inode_table[inum];
+		inode2 = inode_lookup_including_free(inum);
 		assert(inode2 != NULL);
 	}
 	if (dead_file_copy_list_free_check(inode2->dead_copies))
@@ -4808,7 +4874,7 @@ inode_remove_replica_internal(struct inode *inode, struct host *spool_host,
 					copy->flags |= FILE_COPY_BEING_REMOVED;
 				} else {
 					*foundp = copy->host_next;
-					free(copy);
+					slab_free(&file_copy_slab, copy);
 				}
 			}
 		} else {
@@ -4826,7 +4892,7 @@ inode_remove_replica_internal(struct inode *inode, struct host *spool_host,
 					e = GFARM_ERR_NO_ERROR;
 				}
 				*foundp = copy->host_next;
-				free(copy);
+				slab_free(&file_copy_slab, copy);
 			} else {
 				gflog_debug(GFARM_MSG_1002487,
 				    "remove_replica_metadata(%lld, %lld, %s): "
@@ -5849,11 +5915,17 @@ inode_init(void)
 	if (!inode_free_list_initialized)
 		inode_free_list_init();
 
-	e = db_inode_load(NULL, inode_add_one);
+	if (snapshot_is_open())
+		e = snapshot_inode_load(NULL, inode_add_one);
+	else
+		e = db_inode_load(NULL, inode_add_one);
 	if (e != GFARM_ERR_NO_ERROR)
 		gflog_error(GFARM_MSG_1000355,
 		    "loading inode: %s", gfarm_error_string(e));
-	e = db_inode_cksum_load(NULL, inode_cksum_add_one);
+	if (snapshot_is_open())
+		e = snapshot_inode_cksum_load(NULL, inode_cksum_add_one);
+	else
+		e = db_inode_cksum_load(NULL, inode_cksum_add_one);
 	if (e != GFARM_ERR_NO_ERROR && e != GFARM_ERR_NO_SUCH_OBJECT /* XXX */)
 		gflog_error(GFARM_MSG_1000356,
 		    "loading inode cksum: %s", gfarm_error_string(e));
@@ -5907,7 +5979,10 @@ file_copy_init(void)
 {
 	gfarm_error_t e;
 
-	e = db_filecopy_load(NULL, file_copy_add_one);
+	if (snapshot_is_open())
+		e = snapshot_filecopy_load(NULL, file_copy_add_one);
+	else
+		e = db_filecopy_load(NULL, file_copy_add_one);
 	if (e != GFARM_ERR_NO_ERROR)
 		gflog_error(GFARM_MSG_1000361,
 		    "loading filecopy: %s", gfarm_error_string(e));
@@ -6147,7 +6222,10 @@ dir_entry_init(void)
 	gfarm_error_t e;
 	struct inode *root;
 
-	e = db_direntry_load(NULL, dir_entry_add_one);
+	if (snapshot_is_open())
+		e = snapshot_direntry_load(NULL, dir_entry_add_one);
+	else
+		e = db_direntry_load(NULL, dir_entry_add_one);
 	if (e != GFARM_ERR_NO_ERROR)
 		gflog_error(GFARM_MSG_1000363,
 		    "loading direntry: %s", gfarm_error_string(e));
@@ -6167,7 +6245,10 @@ symlink_init(void)
 {
 	gfarm_error_t e;
 
-	e = db_symlink_load(NULL, symlink_add_one);
+	if (snapshot_is_open())
+		e = snapshot_symlink_load(NULL, symlink_add_one);
+	else
+		e = db_symlink_load(NULL, symlink_add_one);
 	if (e != GFARM_ERR_NO_ERROR)
 		gflog_error(GFARM_MSG_1000364,
 		    "loading symlink: %s", gfarm_error_string(e));
@@ -6204,18 +6285,20 @@ xattr_entry_alloc(const char *attrname)
 	struct xattr_entry *entry;
 	static const char diag[] = "xattr_entry_alloc";
 
-	GFARM_CALLOC_ARRAY(entry, 1);
+	entry = slab_alloc(&xattr_entry_slab);
 	if (entry == NULL) {
 		gflog_debug(GFARM_MSG_1001777,
 			"allocation of 'xattr_entry' failed");
 		return NULL;
 	}
+	memset(entry, 0, sizeof(*entry));
 	if ((entry->name = strdup_log(attrname, diag)) == NULL) {
-		free(entry);
+		slab_free(&xattr_entry_slab, entry);
 		return NULL;
 	}
 	entry->cached_attrvalue = NULL;
 	entry->cached_attrsize = 0;
+	entry->xmlpaths = NULL;
 	return entry;
 }
 
@@ -6226,7 +6309,8 @@ xattr_entry_free(struct xattr_entry *entry)
 		free(entry->name);
 		if (entry->cached_attrvalue != NULL)
 			free(entry->cached_attrvalue);
-		free(entry);
+		free(entry->xmlpaths);
+		slab_free(&xattr_entry_slab, entry);
 	}
 }
 
@@ -6254,15 +6338,17 @@ xattr_add(struct xattrs *xattrs, int xmlMode, const char *attrname,
 			entry->cached_attrsize = size;
 		}
 	}
+	if (xmlMode && gfarm_xmlattr_index && value != NULL)
+		entry->xmlpaths = xmlattr_index_paths(value, size);
 
 	if (xattrs->head == NULL) {
-		xattrs->head = xattrs->tail = entry;
-		entry->prev = NULL;
+		xattrs->head = entry;
+		entry->prev = entry;
 	} else {
-		tail = xattrs->tail;
+		tail = xattrs->head->prev;
 		entry->prev = tail;
 		tail->next = entry;
-		xattrs->tail = entry;
+		xattrs->head->prev = entry;
 	}
 	return entry;
 }
@@ -6318,19 +6404,162 @@ xattr_init(void)
 		gfarm_xattr_caching_pattern_add(GFARM_REPATTR_NAME);
 
 	xmlMode = 0;
-	e = db_xattr_load(&xmlMode, xattr_add_one);
+	if (snapshot_is_open())
+		e = snapshot_xattr_load(&xmlMode, xattr_add_one);
+	else
+		e = db_xattr_load(&xmlMode, xattr_add_one);
 	if (e != GFARM_ERR_NO_ERROR)
 		gflog_error(GFARM_MSG_1000368,
 		    "loading xattr: %s", gfarm_error_string(e));
 #ifdef ENABLE_XMLATTR
 	xmlMode = 1;
-	e = db_xattr_load(&xmlMode, xattr_add_one);
+	if (snapshot_is_open())
+		e = snapshot_xattr_load(&xmlMode, xattr_add_one);
+	else
+		e = db_xattr_load(&xmlMode, xattr_add_one);
 	if (e != GFARM_ERR_NO_ERROR)
 		gflog_error(GFARM_MSG_1000369,
 		    "loading xmlattr: %s", gfarm_error_string(e));
 #endif
 }
 
+static void
+inode_snapshot_write_xattrs(struct snapshot *s, struct inode *inode,
+	struct xattrs *xattrs)
+{
+	struct xattr_entry *entry;
+
+	for (entry = xattrs->head; entry != NULL; entry = entry->next) {
+		snapshot_put_uint64(s, inode->i_number);
+		snapshot_put_string(s, entry->name);
+		snapshot_put_uint64(s, entry->cached_attrvalue != NULL);
+		snapshot_put_bytes(s, entry->cached_attrvalue,
+		    entry->cached_attrvalue != NULL ?
+		    entry->cached_attrsize : 0);
+		snapshot_record_end(s);
+	}
+}
+
+/*
+ * PREREQUISITE: giant_lock
+ * write the records which are same as the ones loaded by *_init() above.
+ * free inodes are written too, to keep i_gen.
+ */
+void
+inode_snapshot_write(struct snapshot *s)
+{
+	gfarm_ino_t i;
+	struct inode *inode;
+	struct file_copy *copy;
+	struct checksum *cksum;
+	Dir dir;
+	DirCursor cursor;
+	DirEntry entry;
+	char *name;
+	int namelen;
+
+	snapshot_section_begin(s, SNAPSHOT_SECTION_INODE);
+	for (i = 0; i < inode_table_size; i++) {
+		if ((inode = inode_lookup_including_free(i)) == NULL)
+			continue;
+		snapshot_put_uint64(s, inode->i_number);
+		snapshot_put_uint64(s, inode->i_gen);
+		snapshot_put_uint64(s, inode->i_mode);
+		snapshot_put_uint64(s, inode->i_nlink);
+		snapshot_put_uint64(s, inode->i_size);
+		snapshot_put_uint64(s, inode->i_atimespec.tv_sec);
+		snapshot_put_uint64(s, inode->i_atimespec.tv_nsec);
+		snapshot_put_uint64(s, inode->i_mtimespec.tv_sec);
+		snapshot_put_uint64(s, inode->i_mtimespec.tv_nsec);
+		snapshot_put_uint64(s, inode->i_ctimespec.tv_sec);
+		snapshot_put_uint64(s, inode->i_ctimespec.tv_nsec);
+		snapshot_put_string(s, user_name_including_invalid(
+		    inode->i_user));
+		snapshot_put_string(s, group_name_including_invalid(
+		    inode->i_group));
+		snapshot_record_end(s);
+	}
+	snapshot_section_end(s);
+
+	snapshot_section_begin(s, SNAPSHOT_SECTION_INODE_CKSUM);
+	for (i = ROOT_INUMBER; i < inode_table_size; i++) {
+		if ((inode = inode_lookup(i)) == NULL ||
+		    !inode_is_file(inode) ||
+		    (cksum = inode->u.c.s.f.cksum) == NULL)
+			continue;
+		snapshot_put_uint64(s, i);
+		snapshot_put_string(s, cksum->type);
+		snapshot_put_bytes(s, cksum->sum, cksum->len);
+		snapshot_record_end(s);
+	}
+	snapshot_section_end(s);
+
+	/* invalid replicas are not stored in the database */
+	snapshot_section_begin(s, SNAPSHOT_SECTION_FILECOPY);
+	for (i = ROOT_INUMBER; i < inode_table_size; i++) {
+		if ((inode = inode_lookup(i)) == NULL || !inode_is_file(inode))
+			continue;
+		for (copy = inode->u.c.s.f.copies; copy != NULL;
+		    copy = copy->host_next) {
+			if (!FILE_COPY_IS_VALID(copy))
+				continue;
+			snapshot_put_uint64(s, i);
+			snapshot_put_string(s, host_name(copy->host));
+			snapshot_record_end(s);
+		}
+	}
+	snapshot_section_end(s);
+
+	snapshot_section_begin(s, SNAPSHOT_SECTION_DIRENTRY);
+	for (i = ROOT_INUMBER; i < inode_table_size; i++) {
+		if ((inode = inode_lookup(i)) == NULL || !inode_is_dir(inode))
+			continue;
+		dir = inode->u.c.s.d.entries;
+		if (!dir_cursor_set_pos(dir, 0, &cursor))
+			continue;
+		do {
+			if ((entry = dir_cursor_get_entry(dir, &cursor))
+			    == NULL)
+				break;
+			name = dir_entry_get_name(entry, &namelen);
+			snapshot_put_uint64(s, i);
+			snapshot_put_bytes(s, name, namelen);
+			snapshot_put_uint64(s,
+			    dir_entry_get_inode(entry)->i_number);
+			snapshot_record_end(s);
+		} while (dir_cursor_next(dir, &cursor));
+	}
+	snapshot_section_end(s);
+
+	snapshot_section_begin(s, SNAPSHOT_SECTION_SYMLINK);
+	for (i = ROOT_INUMBER; i < inode_table_size; i++) {
+		if ((inode = inode_lookup(i)) == NULL ||
+		    !inode_is_symlink(inode) ||
+		    inode->u.c.s.l.source_path == NULL)
+			continue;
+		snapshot_put_uint64(s, i);
+		snapshot_put_string(s, inode->u.c.s.l.source_path);
+		snapshot_record_end(s);
+	}
+	snapshot_section_end(s);
+
+	snapshot_section_begin(s, SNAPSHOT_SECTION_XATTR);
+	for (i = ROOT_INUMBER; i < inode_table_size; i++) {
+		if ((inode = inode_lookup(i)) != NULL)
+			inode_snapshot_write_xattrs(s, inode,
+			    &inode->i_xattrs);
+	}
+	snapshot_section_end(s);
+
+	snapshot_section_begin(s, SNAPSHOT_SECTION_XMLATTR);
+	for (i = ROOT_INUMBER; i < inode_table_size; i++) {
+		if ((inode = inode_lookup(i)) != NULL)
+			inode_snapshot_write_xattrs(s, inode,
+			    &inode->i_xmlattrs);
+	}
+	snapshot_section_end(s);
+}
+
 static struct xattr_entry *
 xattr_find(struct xattrs *xattrs, const char *attrname)
 {
@@ -6392,6 +6621,10 @@ inode_xattr_modify(struct inode *inode, int xmlMode, const char *attrname,
 		entry->cached_attrvalue = NULL;
 		entry->cached_attrsize = 0;
 	}
+	if (xmlMode && gfarm_xmlattr_index) {
+		free(entry->xmlpaths);
+		entry->xmlpaths = xmlattr_index_paths(value, size);
+	}
 	if (!xmlMode && gfarm_xattr_caching(attrname)) {
 		entry->cached_attrvalue = malloc(size);
 		if (entry->cached_attrvalue == NULL) {
@@ -6553,6 +6786,66 @@ inode_xattr_has_xmlattrs(struct inode *inode)
 #endif
 }
 
+static int
+xattr_name_order(const void *a, const void *b)
+{
+	const char *const *n1 = a, *const *n2 = b;
+
+	return (strcmp(*n1, *n2));
+}
+
+/*
+ * find XML extended attributes which match the XPath expression
+ * by the in-memory index, instead of db_xmlattr_find().
+ * the result is sorted by the name, like the backend database.
+ *
+ * returns GFARM_ERR_OPERATION_NOT_SUPPORTED, if the index cannot be used
+ * for the expression or some attribute of the inode.
+ */
+gfarm_error_t
+inode_xmlattr_find_by_index(struct inode *inode, const char *expr,
+	int *nattrsp, char ***attrnamesp)
+{
+	struct xattr_entry *entry;
+	char **names;
+	int i, n = 0;
+	static const char diag[] = "inode_xmlattr_find_by_index";
+
+	if (!gfarm_xmlattr_index || !xmlattr_index_expr_is_supported(expr))
+		return (GFARM_ERR_OPERATION_NOT_SUPPORTED);
+	for (entry = inode->i_xmlattrs.head; entry != NULL;
+	    entry = entry->next) {
+		if (entry->xmlpaths == NULL)
+			return (GFARM_ERR_OPERATION_NOT_SUPPORTED);
+		if (xmlattr_index_match(entry->xmlpaths, expr))
+			n++;
+	}
+
+	*nattrsp = n;
+	*attrnamesp = NULL;
+	if (n == 0)
+		return (GFARM_ERR_NO_ERROR);
+	GFARM_MALLOC_ARRAY(names, n);
+	if (names == NULL)
+		return (GFARM_ERR_NO_MEMORY);
+	i = 0;
+	for (entry = inode->i_xmlattrs.head; entry != NULL;
+	    entry = entry->next) {
+		if (!xmlattr_index_match(entry->xmlpaths, expr))
+			continue;
+		if ((names[i] = strdup_log(entry->name, diag)) == NULL) {
+			while (--i >= 0)
+				free(names[i]);
+			free(names);
+			return (GFARM_ERR_NO_MEMORY);
+		}
+		i++;
+	}
+	qsort(names, n, sizeof(*names), xattr_name_order);
+	*attrnamesp = names;
+	return (GFARM_ERR_NO_ERROR);
+}
+
 gfarm_error_t
 inode_xattr_remove(struct inode *inode, int xmlMode, const char *attrname)
 {
@@ -6561,16 +6854,16 @@ inode_xattr_remove(struct inode *inode, int xmlMode, const char *attrname)
 
 	entry = xattr_find(xattrs, attrname);
 	if (entry != NULL) {
-		prev = entry->prev; // NULL if entry is head
+		prev = entry->prev; // the tail if entry is head
 		next = entry->next; // NULL if entry is tail
 		if (entry == xattrs->head)
 			xattrs->head = next;
 		else
 			prev->next = next;
-		if (entry == xattrs->tail)
-			xattrs->tail = prev;
-		else
+		if (next != NULL)
 			next->prev = prev;
+		else if (xattrs->head != NULL)
+			xattrs->head->prev = prev;
 		xattr_entry_free(entry);
 		return GFARM_ERR_NO_ERROR;
 	} else {
@@ -97,6 +97,9 @@ gfarm_error_t inode_access(struct inode *, struct user *, int);
 
 gfarm_ino_t inode_root_number();
 gfarm_ino_t inode_table_current_size();
+void inode_table_info(void);
+struct snapshot;
+void inode_snapshot_write(struct snapshot *);
 struct inode *inode_lookup(gfarm_ino_t);
 struct inode *inode_lookup_including_free(gfarm_ino_t);
 void inode_lookup_all(void *, void (*callback)(void *, struct inode *));
@@ -158,6 +161,7 @@ gfarm_error_t inode_schedule_replication(
 
 gfarm_error_t inode_open(struct file_opening *);
 void inode_close(struct file_opening *, char **);
+int inode_close_is_trivial(struct file_opening *);
 void inode_close_read(struct file_opening *, struct gfarm_timespec *, char **);
 gfarm_error_t inode_fhclose_read(struct inode *, struct gfarm_timespec *);
 void inode_add_ref_spool_writers(struct inode *);
@@ -229,6 +233,8 @@ gfarm_error_t inode_xattr_cache_is_same(struct inode *, int, const char *,
 	const void *, size_t);
 int inode_xattr_has_attr(struct inode *, int, const char *);
 int inode_xattr_has_xmlattrs(struct inode *);
+gfarm_error_t inode_xmlattr_find_by_index(struct inode *, const char *,
+	int *, char ***);
 gfarm_error_t inode_xattr_remove(struct inode *, int, const char *);
 gfarm_error_t inode_xattr_list(struct inode *, int, char **, size_t *);
 void inode_xattrs_clear(struct inode *);
@@ -1562,18 +1562,25 @@ journal_file_is_closed(struct journal_file *jf)
 	return (jf->path == NULL);
 }
 
+/* "fd" may be a dup(2)ed descriptor of the journal file */
 gfarm_error_t
-journal_file_writer_sync(struct journal_file_writer *writer)
+journal_file_sync_fd(int fd)
 {
 #ifdef HAVE_FDATASYNC
-	if (fdatasync(gfp_xdr_fd(writer->xdr)) == -1)
+	if (fdatasync(fd) == -1)
 #else
-	if (fsync(gfp_xdr_fd(writer->xdr)) == -1)
+	if (fsync(fd) == -1)
 #endif
 		return (gfarm_errno_to_error(errno));
 	return (GFARM_ERR_NO_ERROR);
 }
 
+gfarm_error_t
+journal_file_writer_sync(struct journal_file_writer *writer)
+{
+	return (journal_file_sync_fd(gfp_xdr_fd(writer->xdr)));
+}
+
 gfarm_error_t
 journal_file_writer_flush(struct journal_file_writer *writer)
 {
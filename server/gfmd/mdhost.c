@@ -1360,6 +1360,95 @@ gfm_server_metadb_server_remove(
 	    &e, ""));
 }
 
+/*
+ * the metadata of a slave gfmd is as new as the journal seqnum
+ * which has been applied to its memory.
+ */
+static gfarm_uint64_t
+metadb_server_seqnum_in_memory(void)
+{
+	if (mdhost_self_is_master())
+		return (db_journal_get_current_seqnum());
+	return (db_journal_get_applied_seqnum());
+}
+
+gfarm_error_t
+gfm_server_metadb_server_seqnum_get(
+	struct peer *peer, gfp_xdr_xid_t xid, size_t *sizep,
+	int from_client, int skip)
+{
+	gfarm_error_t e;
+	gfarm_uint64_t seqnum = 0;
+	static const char diag[] = "GFM_PROTO_METADB_SERVER_SEQNUM_GET";
+
+	e = gfm_server_get_request(peer, sizep, diag, "");
+	if (e != GFARM_ERR_NO_ERROR)
+		return (e);
+	if (skip)
+		return (GFARM_ERR_NO_ERROR);
+
+	if (!gfarm_get_metadb_replication_enabled())
+		e = GFARM_ERR_OPERATION_NOT_PERMITTED;
+	else
+		seqnum = metadb_server_seqnum_in_memory();
+	return (gfm_server_put_reply(peer, xid, sizep, diag, e,
+	    "l", seqnum));
+}
+
+/*
+ * switch this connection to a read-only connection served by this slave,
+ * after the slave catches up with the journal seqnum which the client saw
+ * at the master.
+ * this is a no-op on the master, because the master is always up-to-date.
+ */
+gfarm_error_t
+gfm_server_metadb_server_read_only(
+	struct peer *peer, gfp_xdr_xid_t xid, size_t *sizep,
+	int from_client, int skip)
+{
+	gfarm_error_t e;
+	gfarm_uint64_t seqnum, applied = 0;
+	gfarm_int32_t timeout;
+	static const char diag[] = "GFM_PROTO_METADB_SERVER_READ_ONLY";
+
+	e = gfm_server_get_request(peer, sizep, diag, "li",
+	    &seqnum, &timeout);
+	if (e != GFARM_ERR_NO_ERROR)
+		return (e);
+	if (skip)
+		return (GFARM_ERR_NO_ERROR);
+
+	if (!gfarm_get_metadb_replication_enabled() || !from_client) {
+		e = GFARM_ERR_OPERATION_NOT_PERMITTED;
+	} else if (mdhost_self_is_master()) {
+		applied = db_journal_get_current_seqnum();
+	} else if (!gfarm_get_metadb_server_slave_read_service()) {
+		e = GFARM_ERR_OPERATION_NOT_PERMITTED;
+		gflog_debug(GFARM_MSG_UNFIXED,
+		    "%s: metadb_server_slave_read_service is disabled", diag);
+	} else if (!peer_is_read_only(peer) && peer_get_process(peer) != NULL) {
+		/*
+		 * descriptors opened so far live in the master.
+		 * a read-only peer may request again to catch up the master.
+		 */
+		e = GFARM_ERR_OPERATION_NOT_PERMITTED;
+		gflog_debug(GFARM_MSG_UNFIXED,
+		    "%s: process is already allocated", diag);
+	} else if ((e = db_journal_wait_for_applied_seqnum(seqnum, timeout,
+	    &applied)) != GFARM_ERR_NO_ERROR) {
+		gflog_debug(GFARM_MSG_UNFIXED,
+		    "%s: seqnum %llu is not applied yet (%llu): %s", diag,
+		    (unsigned long long)seqnum, (unsigned long long)applied,
+		    gfarm_error_string(e));
+	} else {
+		giant_lock();
+		peer_set_read_only(peer);
+		giant_unlock();
+	}
+	return (gfm_server_put_reply(peer, xid, sizep, diag, e,
+	    "l", applied));
+}
+
 /* no need to lock here */
 void
 mdhost_init(void)
@@ -34,6 +34,10 @@ gfarm_error_t gfm_server_metadb_server_modify(
 	struct peer *, gfp_xdr_xid_t, size_t *, int, int);
 gfarm_error_t gfm_server_metadb_server_remove(
 	struct peer *, gfp_xdr_xid_t, size_t *, int, int);
+gfarm_error_t gfm_server_metadb_server_seqnum_get(
+	struct peer *, gfp_xdr_xid_t, size_t *, int, int);
+gfarm_error_t gfm_server_metadb_server_read_only(
+	struct peer *, gfp_xdr_xid_t, size_t *, int, int);
 
 void mdhost_set_self_as_master(void);
 void mdhost_set_self_as_default_master(void);
@@ -738,6 +738,33 @@ peer_unset_process(struct peer *peer)
 	peer->user = NULL;
 }
 
+/*
+ * a slave gfmd serves read-only requests of this peer by itself,
+ * instead of relaying them to the master, and refuses others.
+ */
+void
+peer_set_read_only(struct peer *peer)
+{
+	peer->flags |= PEER_FLAGS_READ_ONLY;
+}
+
+int
+peer_is_read_only(struct peer *peer)
+{
+	return ((peer->flags & PEER_FLAGS_READ_ONLY) != 0);
+}
+
+/*
+ * whether the descriptor is opened in this gfmd, instead of the master.
+ * a read-only peer never relays, thus all of its descriptors are local.
+ */
+int
+peer_fd_is_local(struct peer *peer, gfarm_int32_t fd)
+{
+	return (mdhost_self_is_master() || FD_IS_SLAVE_ONLY(fd) ||
+	    peer_is_read_only(peer));
+}
+
 void
 peer_record_protocol_error(struct peer *peer)
 {
@@ -792,12 +819,12 @@ peer_fdpair_clear(struct peer *peer)
 	if (peer->fd_current != GFARM_DESCRIPTOR_INVALID &&
 	    (peer->flags & PEER_FLAGS_FD_CURRENT_EXTERNALIZED) == 0 &&
 	    peer->fd_current != peer->fd_saved /* prevent double close */ &&
-	    (mdhost_self_is_master() || FD_IS_SLAVE_ONLY(peer->fd_current))) {
+	    peer_fd_is_local(peer, peer->fd_current)) {
 		process_close_file(peer->process, peer, peer->fd_current, NULL);
 	}
 	if (peer->fd_saved != GFARM_DESCRIPTOR_INVALID &&
 	    (peer->flags & PEER_FLAGS_FD_SAVED_EXTERNALIZED) == 0 &&
-	    (mdhost_self_is_master() || FD_IS_SLAVE_ONLY(peer->fd_saved))) {
+	    peer_fd_is_local(peer, peer->fd_saved)) {
 		process_close_file(peer->process, peer, peer->fd_saved, NULL);
 	}
 	peer->fd_current = GFARM_DESCRIPTOR_INVALID;
@@ -838,6 +865,21 @@ peer_fdpair_close_current(struct peer *peer)
 	return (GFARM_ERR_NO_ERROR);
 }
 
+/*
+ * returns the descriptor which peer_fdpair_set_current() closes,
+ * or GFARM_DESCRIPTOR_INVALID.
+ */
+gfarm_int32_t
+peer_fdpair_get_current_to_close(struct peer *peer)
+{
+	if (peer->fd_current != GFARM_DESCRIPTOR_INVALID &&
+	    (peer->flags & PEER_FLAGS_FD_CURRENT_EXTERNALIZED) == 0 &&
+	    peer->fd_current != peer->fd_saved /* prevent double close */ &&
+	    peer_fd_is_local(peer, peer->fd_current))
+		return (peer->fd_current);
+	return (GFARM_DESCRIPTOR_INVALID);
+}
+
 /* NOTE: caller of this function should acquire giant_lock as well */
 /*
  * NOTE: this shouldn't need db_begin()/db_end() calls at least for now,
@@ -846,12 +888,10 @@ peer_fdpair_close_current(struct peer *peer)
 void
 peer_fdpair_set_current(struct peer *peer, gfarm_int32_t fd)
 {
-	if (peer->fd_current != GFARM_DESCRIPTOR_INVALID &&
-	    (peer->flags & PEER_FLAGS_FD_CURRENT_EXTERNALIZED) == 0 &&
-	    peer->fd_current != peer->fd_saved /* prevent double close */ &&
-	    (mdhost_self_is_master() || FD_IS_SLAVE_ONLY(peer->fd_current))) {
-		process_close_file(peer->process, peer, peer->fd_current, NULL);
-	}
+	gfarm_int32_t fd_to_close = peer_fdpair_get_current_to_close(peer);
+
+	if (fd_to_close != GFARM_DESCRIPTOR_INVALID)
+		process_close_file(peer->process, peer, fd_to_close, NULL);
 	peer->flags &= ~PEER_FLAGS_FD_CURRENT_EXTERNALIZED;
 	peer->fd_current = fd;
 }
@@ -897,7 +937,7 @@ peer_fdpair_save(struct peer *peer)
 	if (peer->fd_saved != GFARM_DESCRIPTOR_INVALID &&
 	    (peer->flags & PEER_FLAGS_FD_SAVED_EXTERNALIZED) == 0 &&
 	    peer->fd_saved != peer->fd_current /* prevent double close */ &&
-	    (mdhost_self_is_master() || FD_IS_SLAVE_ONLY(peer->fd_saved))) {
+	    peer_fd_is_local(peer, peer->fd_saved)) {
 		process_close_file(peer->process, peer, peer->fd_saved, NULL);
 	}
 	peer->fd_saved = peer->fd_current;
@@ -924,7 +964,7 @@ peer_fdpair_restore(struct peer *peer)
 	if (peer->fd_current != GFARM_DESCRIPTOR_INVALID &&
 	    (peer->flags & PEER_FLAGS_FD_CURRENT_EXTERNALIZED) == 0 &&
 	    peer->fd_current != peer->fd_saved /* prevent double close */ &&
-	    (mdhost_self_is_master() || FD_IS_SLAVE_ONLY(peer->fd_current))) {
+	    peer_fd_is_local(peer, peer->fd_current)) {
 		process_close_file(peer->process, peer, peer->fd_current, NULL);
 	}
 	peer->fd_current = peer->fd_saved;
@@ -73,6 +73,9 @@ struct process *peer_get_process(struct peer *);
 void peer_set_process(struct peer *, struct process *);
 void peer_unset_process(struct peer *);
 
+void peer_set_read_only(struct peer *);
+int peer_is_read_only(struct peer *);
+int peer_fd_is_local(struct peer *, gfarm_int32_t);
 void peer_record_protocol_error(struct peer *);
 int peer_had_protocol_error(struct peer *);
 
@@ -86,6 +89,7 @@ struct job_table_entry **peer_get_jobs_ref(struct peer *);
 void peer_fdpair_clear(struct peer *);
 gfarm_error_t peer_fdpair_externalize_current(struct peer *);
 gfarm_error_t peer_fdpair_close_current(struct peer *);
+gfarm_int32_t peer_fdpair_get_current_to_close(struct peer *);
 void peer_fdpair_set_current(struct peer *, gfarm_int32_t);
 gfarm_error_t peer_fdpair_get_current(struct peer *, gfarm_int32_t *);
 gfarm_error_t peer_fdpair_get_saved(struct peer *, gfarm_int32_t *);
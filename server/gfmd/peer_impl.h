@@ -61,6 +61,7 @@ struct peer {
 #define PEER_FLAGS_FD_CURRENT_EXTERNALIZED	0x1
 #define PEER_FLAGS_FD_SAVED_EXTERNALIZED	0x2
 #define PEER_FLAGS_REMOTE_PEER_ALLOCATED	0x4 /* for local_peer */
+#define PEER_FLAGS_READ_ONLY			0x8 /* served by a slave */
 
 	struct inum_path_array *findxmlattrctx;
 
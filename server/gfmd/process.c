@@ -952,6 +952,28 @@ process_close_file(struct process *process, struct peer *peer, int fd,
 	return (GFARM_ERR_NO_ERROR);
 }
 
+/*
+ * returns true, if the descriptor was opened by GFARM_FILE_LOOKUP, and
+ * process_close_file() of it updates nothing but the descriptor table
+ * and the inode activity, i.e. it can be closed under giant_rdlock().
+ */
+int
+process_close_is_trivial(struct process *process, struct peer *peer, int fd)
+{
+	struct file_opening *fo;
+
+	if (FD_IS_SLAVE_ONLY(fd) ||
+	    process_get_file_opening(process, fd, &fo) != GFARM_ERR_NO_ERROR)
+		return (0);
+	if (fo->opener != peer ||
+	    (fo->flag & GFARM_FILE_ACCMODE) != GFARM_FILE_LOOKUP)
+		return (0);
+	if (inode_is_file(fo->inode) && (fo->u.f.spool_opener != NULL ||
+	    fo->u.f.replica_source != NULL))
+		return (0);
+	return (inode_close_is_trivial(fo));
+}
+
 gfarm_error_t
 process_close_file_read(struct process *process, struct peer *peer, int fd,
 	struct gfarm_timespec *atime)
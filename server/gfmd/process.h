@@ -113,6 +113,7 @@ gfarm_error_t process_reopen_file(struct process *,
 	gfarm_ino_t *, gfarm_uint64_t *, gfarm_int32_t *,
 	gfarm_int32_t *, gfarm_int32_t *);
 gfarm_error_t process_close_file(struct process *, struct peer *, int, char **);
+int process_close_is_trivial(struct process *, struct peer *, int);
 gfarm_error_t process_close_file_read(struct process *, struct peer *, int,
 	struct gfarm_timespec *);
 gfarm_error_t process_close_file_write(struct process *, struct peer *, int,
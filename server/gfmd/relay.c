@@ -292,6 +292,9 @@ wait_db_update_info(struct peer *peer,
 	/* DBUPDATE_NOWAIT means no relay but no wait */
 	if (mdhost_self_is_master() || wait_db_update_flags == DBUPDATE_NOWAIT)
 		return (GFARM_ERR_NO_ERROR);
+	/* a read-only peer sees the metadata of this slave as it is */
+	if (peer_is_read_only(peer))
+		return (GFARM_ERR_NO_ERROR);
 
 	gfarm_mutex_lock(&db_update_mutex, diag,
 		RELAY_DB_UPDATE_MUTEX_DIAG);
@@ -665,7 +668,7 @@ gfm_server_relay_get_request(struct peer *peer, size_t *sizep,
 	if (e != GFARM_ERR_NO_ERROR)
 		return (e);
 
-	if (mdhost_self_is_master()) {
+	if (mdhost_self_is_master() || peer_is_read_only(peer)) {
 		*rp = NULL;
 		return (e);
 	}
@@ -1374,7 +1377,7 @@ gfm_server_relay_request_reply(struct peer *peer, gfp_xdr_xid_t xid,
 	int skip, get_request_op_t get_request_op, put_reply_op_t put_reply_op,
 	gfarm_int32_t command, void *closure, const char *diag)
 {
-	if (!mdhost_self_is_master()) {
+	if (!mdhost_self_is_master() && !peer_is_read_only(peer)) {
 		/*
 		 * This gfmd is a slave.
 		 */
@@ -1530,6 +1533,15 @@ gfm_server_put_vreply(struct peer *peer, gfp_xdr_xid_t xid,
 	gfarm_uint64_t seqnum;
 	gfarm_uint64_t flags;
 
+	/* the updates have to be durable, before the reply is sent */
+	e = db_journal_sync_wait();
+	if (e != GFARM_ERR_NO_ERROR && ecode == GFARM_ERR_NO_ERROR) {
+		gflog_error(GFARM_MSG_UNFIXED,
+		    "%s: journal is not durable: %s",
+		    diag, gfarm_error_string(e));
+		ecode = e;
+	}
+
 	if (peer_get_async(peer) == NULL) {
 		/*
 		 * The request comes from a client.
@@ -1580,7 +1592,7 @@ gfm_server_put_vreply_begin(struct peer *peer, struct peer **slave_mhpeerp,
 	gfp_xdr_xid_t xid, int *size_posp, const char *diag,
 	gfarm_error_t ecode, const char *format, va_list *app)
 {
-	gfarm_error_t e;
+	gfarm_error_t e, e_reply;
 	struct gfp_xdr *client = peer_get_conn(peer);
 	struct peer *slave_mhpeer, *mhpeer;
 	struct abstract_host *ah;
@@ -1592,6 +1604,20 @@ gfm_server_put_vreply_begin(struct peer *peer, struct peer **slave_mhpeerp,
 		    "<%s> xid:%d sending reply: %d (%s)",
 		    diag, (int)xid, (int)ecode, gfarm_error_string(ecode));
 
+	/* the updates have to be durable, before the reply is sent */
+	e = db_journal_sync_wait();
+	if (e != GFARM_ERR_NO_ERROR && ecode == GFARM_ERR_NO_ERROR) {
+		gflog_error(GFARM_MSG_UNFIXED,
+		    "%s: journal is not durable: %s",
+		    diag, gfarm_error_string(e));
+		/*
+		 * send the error reply instead, and return the error,
+		 * so that the caller doesn't append the results to it.
+		 */
+		e_reply = gfm_server_put_reply(peer, xid, NULL, diag, e, "");
+		return (e_reply != GFARM_ERR_NO_ERROR ? e_reply : e);
+	}
+
 	if (peer_get_async(peer) == NULL) {
 		/* The request comes from a client. */
 		slave_mhpeer = NULL;
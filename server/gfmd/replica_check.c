@@ -229,8 +229,79 @@ replica_check_giant_lock_default()
 static void (*replica_check_giant_lock)(void);
 static void (*replica_check_giant_unlock)(void) = giant_unlock;
 
+/* a growable array of inode numbers */
+struct replica_check_inums {
+	gfarm_ino_t *inums;
+	size_t n, size;
+};
+
 static int
-replica_check_main_dir(gfarm_ino_t inum, gfarm_ino_t *countp)
+replica_check_inums_add(struct replica_check_inums *a, gfarm_ino_t inum)
+{
+	gfarm_ino_t *inums;
+	size_t size;
+
+	if (a->n >= a->size) {
+		size = a->size == 0 ? REPLICA_CHECK_DIRENTS_BUFCOUNT :
+		    a->size * 2;
+		GFARM_REALLOC_ARRAY(inums, a->inums, size);
+		if (inums == NULL) {
+			gflog_error(GFARM_MSG_UNFIXED,
+			    "replica_check: no memory for %zd directories",
+			    size);
+			return (0);
+		}
+		a->inums = inums;
+		a->size = size;
+	}
+	a->inums[a->n++] = inum;
+	return (1);
+}
+
+/* PREREQUISITE: giant_lock */
+static int
+replica_check_has_replica_on(struct inode *file_ino,
+	struct host **hosts, int nhosts)
+{
+	int i;
+
+	for (i = 0; i < nhosts; i++) {
+		if (inode_has_file_copy(file_ino, hosts[i]))
+			return (1);
+	}
+	return (0);
+}
+
+static gfarm_error_t
+replica_check_fix_with_retry(struct replication_info *infop)
+{
+	gfarm_error_t e;
+	/* 1 milisec. */
+	unsigned long long sl = GFARM_MILLISEC_BY_NANOSEC;
+
+	for (;;) {
+		replica_check_giant_lock();
+		e = replica_check_fix(infop);
+		replica_check_giant_unlock();
+		if (e != GFARM_ERR_RESOURCE_TEMPORARILY_UNAVAILABLE)
+			return (e); /* success or error */
+		/* retry */
+		gfarm_nanosleep(sl);
+		if (sl < GFARM_SECOND_BY_NANOSEC)
+			sl *= 2; /* 2,4,8,...,512,1024,1024 */
+	}
+}
+
+/*
+ * check files in the directory.
+ * if "hosts" is not NULL, only files which have a replica on the hosts
+ * are checked.
+ * if "subdirs" is not NULL, subdirectories are added to it.
+ */
+static int
+replica_check_main_dir(gfarm_ino_t inum,
+	struct host **hosts, int nhosts,
+	gfarm_ino_t *countp, struct replica_check_inums *subdirs)
 {
 	gfarm_error_t e;
 	struct inode *dir_ino, *file_ino;
@@ -239,7 +310,8 @@ replica_check_main_dir(gfarm_ino_t inum, gfarm_ino_t *countp)
 	gfarm_off_t dir_offset = 0;
 	DirEntry entry;
 	struct replication_info rep_info;
-	int need_to_retry = 0, eod = 0, i;
+	int need_to_retry = 0, eod = 0, i, namelen;
+	char *name;
 
 	while (!eod) {
 		replica_check_giant_lock();
@@ -265,8 +337,20 @@ replica_check_main_dir(gfarm_ino_t inum, gfarm_ino_t *countp)
 				break;
 			}
 			file_ino = dir_entry_get_inode(entry);
-			if (inode_is_file(file_ino))
-				replica_check_stack_push(dir_ino, file_ino);
+			if (inode_is_file(file_ino)) {
+				if (hosts == NULL || replica_check_has_replica_on(
+				    file_ino, hosts, nhosts))
+					replica_check_stack_push(
+					    dir_ino, file_ino);
+			} else if (subdirs != NULL && inode_is_dir(file_ino)) {
+				name = dir_entry_get_name(entry, &namelen);
+				if ((namelen != 1 || name[0] != '.') &&
+				    (namelen != 2 || name[0] != '.' ||
+				     name[1] != '.') &&
+				    !replica_check_inums_add(subdirs,
+				    inode_get_number(file_ino)))
+					need_to_retry = 1;
+			}
 			if (!dir_cursor_next(dir, &cursor)) {
 				eod = 1; /* end of directory */
 				break;
@@ -276,21 +360,7 @@ replica_check_main_dir(gfarm_ino_t inum, gfarm_ino_t *countp)
 		replica_check_giant_unlock();
 
 		while (replica_check_stack_pop(&rep_info)) {
-			/* 1 milisec. */
-			unsigned long long sl = GFARM_MILLISEC_BY_NANOSEC;
-
-			for (;;) {
-				replica_check_giant_lock();
-				e = replica_check_fix(&rep_info);
-				replica_check_giant_unlock();
-				if (e !=
-				    GFARM_ERR_RESOURCE_TEMPORARILY_UNAVAILABLE)
-					break; /* success or error */
-				/* retry */
-				gfarm_nanosleep(sl);
-				if (sl < GFARM_SECOND_BY_NANOSEC)
-					sl *= 2; /* 2,4,8,...,512,1024,1024 */
-			}
+			e = replica_check_fix_with_retry(&rep_info);
 			if (e != GFARM_ERR_NO_ERROR) {
 				need_to_retry = 1;
 				gflog_debug(GFARM_MSG_1003631,
@@ -307,8 +377,9 @@ replica_check_main_dir(gfarm_ino_t inum, gfarm_ino_t *countp)
 static gfarm_ino_t info_inum, info_table_size;
 static time_t info_time_start;
 
+/* if "hosts" is not NULL, only replicas on the hosts are checked */
 static int
-replica_check_main()
+replica_check_main(struct host **hosts, int nhosts)
 {
 	gfarm_ino_t inum, table_size, count = 0;
 	gfarm_ino_t root_inum = inode_root_number();
@@ -319,13 +390,17 @@ replica_check_main()
 	info_time_start = time(NULL);
 	replica_check_giant_unlock();
 
-	RC_LOG_INFO(GFARM_MSG_1003632, "replica_check: start");
+	if (hosts == NULL)
+		RC_LOG_INFO(GFARM_MSG_1003632, "replica_check: start");
+	else
+		RC_LOG_INFO(GFARM_MSG_UNFIXED,
+		    "replica_check: start for replicas on %d hosts", nhosts);
 	for (inum = root_inum;;) {
 		replica_check_giant_lock();
 		info_inum = inum;
 		replica_check_giant_unlock();
 
-		if (replica_check_main_dir(inum, &count))
+		if (replica_check_main_dir(inum, hosts, nhosts, &count, NULL))
 			need_to_retry = 1;
 		inum++; /* a next directory */
 		if (inum >= table_size) {
@@ -347,6 +422,309 @@ replica_check_main()
 	return (need_to_retry);
 }
 
+/* check all files under the directory */
+static int
+replica_check_main_subtree(gfarm_ino_t inum, gfarm_ino_t *countp)
+{
+	struct replica_check_inums dirs = { NULL, 0, 0 };
+	int need_to_retry = 0;
+
+	if (!replica_check_inums_add(&dirs, inum))
+		return (1);
+	while (dirs.n > 0) {
+		inum = dirs.inums[--dirs.n];
+		if (replica_check_main_dir(inum, NULL, 0, countp, &dirs))
+			need_to_retry = 1;
+	}
+	free(dirs.inums);
+	return (need_to_retry);
+}
+
+#define REPLICA_CHECK_DIAG "replica_check"
+
+static pthread_mutex_t replica_check_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t replica_check_cond = PTHREAD_COND_INITIALIZER;
+static int replica_check_initialized = 0; /* ignore cond_signal in startup */
+
+/*
+ * incremental replica_check:
+ * the events record the affected inodes and hosts, and only files
+ * which are related to them are checked.
+ * all files are checked, when full_check_requested is set.
+ *
+ * the following variables are protected by replica_check_mutex.
+ */
+struct replica_check_dirty {
+	gfarm_ino_t inum;
+	gfarm_ino_t dir_inum;	/* 0, if unknown */
+	int spec_known;		/* desired_number and repattr are valid */
+	int desired_number;
+	char *repattr;
+};
+
+#define MAX_DIRTY_INODES	65536
+#define MAX_DIRTY_HOSTS		64
+
+static struct replica_check_dirty *dirty_inodes;
+static size_t dirty_inodes_num, dirty_inodes_size;
+static char *dirty_hosts[MAX_DIRTY_HOSTS];
+static int dirty_hosts_num;
+static int full_check_requested = 1; /* at startup */
+
+static int
+replica_check_dirty_inode_add(struct replica_check_dirty *d)
+{
+	struct replica_check_dirty *p;
+	size_t size;
+
+	if (dirty_inodes_num >= dirty_inodes_size) {
+		if (dirty_inodes_size >= MAX_DIRTY_INODES)
+			return (0);
+		size = dirty_inodes_size == 0 ?
+		    REPLICA_CHECK_DIRENTS_BUFCOUNT : dirty_inodes_size * 2;
+		GFARM_REALLOC_ARRAY(p, dirty_inodes, size);
+		if (p == NULL)
+			return (0);
+		dirty_inodes = p;
+		dirty_inodes_size = size;
+	}
+	dirty_inodes[dirty_inodes_num++] = *d;
+	return (1);
+}
+
+static int
+replica_check_dirty_host_add(const char *hostname)
+{
+	int i;
+
+	for (i = 0; i < dirty_hosts_num; i++) {
+		if (strcmp(dirty_hosts[i], hostname) == 0)
+			return (1);
+	}
+	if (dirty_hosts_num >= MAX_DIRTY_HOSTS ||
+	    (dirty_hosts[dirty_hosts_num] = strdup(hostname)) == NULL)
+		return (0);
+	dirty_hosts_num++;
+	return (1);
+}
+
+static void
+replica_check_dirty_clear(void)
+{
+	size_t i;
+	int j;
+
+	for (i = 0; i < dirty_inodes_num; i++)
+		free(dirty_inodes[i].repattr);
+	dirty_inodes_num = 0;
+	for (j = 0; j < dirty_hosts_num; j++)
+		free(dirty_hosts[j]);
+	dirty_hosts_num = 0;
+}
+
+/* PREREQUISITE: replica_check_mutex */
+static void
+replica_check_dirty_add(struct replica_check_dirty *d, const char *hostname)
+{
+	if (full_check_requested)
+		;
+	else if (!gfarm_replica_check_incremental)
+		full_check_requested = 1;
+	else if (d != NULL) {
+		if (replica_check_dirty_inode_add(d))
+			return; /* d->repattr is passed */
+		full_check_requested = 1;
+	} else if (hostname != NULL) {
+		if (!replica_check_dirty_host_add(hostname))
+			full_check_requested = 1;
+	} else
+		full_check_requested = 1;
+
+	if (full_check_requested)
+		replica_check_dirty_clear();
+	if (d != NULL)
+		free(d->repattr);
+}
+
+/* record again the inode or the host to retry, at next replica_check_run */
+static void
+replica_check_dirty_retry(struct replica_check_dirty *d, const char *hostname)
+{
+	static const char diag[] = "replica_check_dirty_retry";
+
+	gfarm_mutex_lock(&replica_check_mutex, diag, REPLICA_CHECK_DIAG);
+	replica_check_dirty_add(d, hostname);
+	gfarm_mutex_unlock(&replica_check_mutex, diag, REPLICA_CHECK_DIAG);
+}
+
+/* the dirty sets are covered by a full check, which is starting now */
+static void
+replica_check_dirty_drop(void)
+{
+	static const char diag[] = "replica_check_dirty_drop";
+
+	gfarm_mutex_lock(&replica_check_mutex, diag, REPLICA_CHECK_DIAG);
+	full_check_requested = 0;
+	replica_check_dirty_clear();
+	gfarm_mutex_unlock(&replica_check_mutex, diag, REPLICA_CHECK_DIAG);
+}
+
+/*
+ * returns 1, if there is an error to retry,
+ * returns -1, if the desired replica spec cannot be determined.
+ */
+static int
+replica_check_dirty_inode(struct replica_check_dirty *d, gfarm_ino_t *countp)
+{
+	gfarm_error_t e;
+	struct inode *inode, *dir_ino;
+	struct replication_info info;
+	char *repattr;
+	int desired_number;
+
+	replica_check_giant_lock();
+	inode = inode_lookup(d->inum);
+	if (inode == NULL) {
+		replica_check_giant_unlock();
+		free(d->repattr);
+		return (0);
+	}
+	if (inode_is_dir(inode)) {
+		replica_check_giant_unlock();
+		free(d->repattr);
+		d->dir_inum = 0;
+		d->spec_known = 0;
+		d->repattr = NULL;
+		if (replica_check_main_subtree(d->inum, countp)) {
+			replica_check_dirty_retry(d, NULL);
+			return (1);
+		}
+		return (0);
+	}
+	if (!inode_is_file(inode)) {
+		replica_check_giant_unlock();
+		free(d->repattr);
+		return (0);
+	}
+	info.inum = d->inum;
+	info.gen = inode_get_gen(inode);
+	if (inode_get_replica_spec(inode, &repattr, &desired_number)) {
+		info.desired_number = desired_number;
+		info.repattr = repattr;
+		free(d->repattr);
+	} else if (d->spec_known) {
+		info.desired_number = d->desired_number;
+		info.repattr = d->repattr;
+	} else if (d->dir_inum != 0 &&
+	    (dir_ino = inode_lookup(d->dir_inum)) != NULL &&
+	    inode_is_dir(dir_ino)) {
+		replica_check_desired_set(dir_ino, inode, &info);
+		free(d->repattr);
+	} else { /* the parent directory is unknown */
+		replica_check_giant_unlock();
+		free(d->repattr);
+		return (-1);
+	}
+	replica_check_giant_unlock();
+
+	e = replica_check_fix_with_retry(&info);
+	(*countp)++;
+	if (e != GFARM_ERR_NO_ERROR) {
+		gflog_debug(GFARM_MSG_UNFIXED,
+		    "replica_check_fix(): %s", gfarm_error_string(e));
+		d->dir_inum = 0;
+		d->spec_known = 1;
+		d->desired_number = info.desired_number;
+		d->repattr = info.repattr; /* passed */
+		replica_check_dirty_retry(d, NULL);
+		return (1);
+	}
+	free(info.repattr);
+	return (0);
+}
+
+/* returns 1, if there is an error to retry */
+static int
+replica_check_full(void)
+{
+	if (replica_check_main(NULL, 0)) {
+		replica_check_dirty_retry(NULL, NULL); /* full check again */
+		return (1);
+	}
+	return (0);
+}
+
+/* returns 1, if there is an error to retry */
+static int
+replica_check_run()
+{
+	static const char diag[] = "replica_check_run";
+	struct host *hosts[MAX_DIRTY_HOSTS];
+	char *hostnames[MAX_DIRTY_HOSTS];
+	struct replica_check_dirty *inodes;
+	size_t ninodes, j;
+	gfarm_ino_t count = 0;
+	int full, nhostnames, nhosts, i, rv, need_to_retry = 0;
+
+	/* take the dirty sets, events after this are handled at next time */
+	gfarm_mutex_lock(&replica_check_mutex, diag, REPLICA_CHECK_DIAG);
+	full = full_check_requested;
+	if (full)
+		replica_check_dirty_clear();
+	full_check_requested = 0;
+	nhostnames = dirty_hosts_num;
+	for (i = 0; i < nhostnames; i++)
+		hostnames[i] = dirty_hosts[i];
+	dirty_hosts_num = 0;
+	inodes = dirty_inodes;
+	ninodes = dirty_inodes_num;
+	dirty_inodes = NULL;
+	dirty_inodes_num = dirty_inodes_size = 0;
+	gfarm_mutex_unlock(&replica_check_mutex, diag, REPLICA_CHECK_DIAG);
+
+	if (full)
+		return (replica_check_full());
+
+	if (nhostnames > 0) {
+		nhosts = 0;
+		replica_check_giant_lock();
+		for (i = 0; i < nhostnames; i++) {
+			if ((hosts[nhosts] = host_lookup(hostnames[i]))
+			    != NULL)
+				nhosts++;
+			free(hostnames[i]);
+		}
+		replica_check_giant_unlock();
+		if (nhosts > 0 && replica_check_main(hosts, nhosts)) {
+			for (i = 0; i < nhosts; i++)
+				replica_check_dirty_retry(NULL,
+				    host_name(hosts[i]));
+			need_to_retry = 1;
+		}
+	}
+
+	for (j = 0; j < ninodes; j++) {
+		rv = replica_check_dirty_inode(&inodes[j], &count);
+		if (rv < 0) {
+			RC_LOG_INFO(GFARM_MSG_UNFIXED,
+			    "replica_check: %lld: parent directory is unknown",
+			    (long long)inodes[j].inum);
+			for (j++; j < ninodes; j++)
+				free(inodes[j].repattr);
+			free(inodes);
+			replica_check_dirty_drop();
+			return (replica_check_full());
+		} else if (rv > 0)
+			need_to_retry = 1;
+	}
+	free(inodes);
+	if (count > 0)
+		RC_LOG_DEBUG(GFARM_MSG_UNFIXED,
+		    "replica_check: incremental, files=%llu",
+		    (unsigned long long)count);
+	return (need_to_retry);
+}
+
 void
 replica_check_info()
 {
@@ -354,6 +732,9 @@ replica_check_info()
 	time_t time_start, elapse;
 	float progress;
 	long long estimate;
+	size_t ninodes;
+	int nhosts, full;
+	static const char diag[] = "replica_check_info";
 
 	replica_check_giant_lock();
 	table_size = info_table_size;
@@ -365,6 +746,15 @@ replica_check_info()
 		RC_LOG_INFO(GFARM_MSG_1004132, "replica_check is disabled");
 		return;
 	}
+
+	gfarm_mutex_lock(&replica_check_mutex, diag, REPLICA_CHECK_DIAG);
+	ninodes = dirty_inodes_num;
+	nhosts = dirty_hosts_num;
+	full = full_check_requested;
+	gfarm_mutex_unlock(&replica_check_mutex, diag, REPLICA_CHECK_DIAG);
+	RC_LOG_INFO(GFARM_MSG_UNFIXED,
+	    "replica_check: pending: %s, inodes=%zd, hosts=%d",
+	    full ? "full" : "incremental", ninodes, nhosts);
 	if (time_start == 0 || table_size == 0) {
 		RC_LOG_INFO(GFARM_MSG_1004133, "replica_check: standby");
 		return;
@@ -382,11 +772,6 @@ replica_check_info()
 	    (long long)elapse, estimate);
 }
 
-#define REPLICA_CHECK_DIAG "replica_check"
-
-static pthread_mutex_t replica_check_mutex = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t replica_check_cond = PTHREAD_COND_INITIALIZER;
-static int replica_check_initialized = 0; /* ignore cond_signal in startup */
 static struct timeval *targets;
 static size_t targets_num, targets_size;
 
@@ -569,76 +954,106 @@ replica_check_wait()
 	gfarm_mutex_unlock(&replica_check_mutex, diag, REPLICA_CHECK_DIAG);
 }
 
+/* "d" and "hostname" are NULL, if all files should be checked */
 static void
-replica_check_signal_general(const char *diag, long sec)
+replica_check_signal_general(const char *diag, long sec,
+	struct replica_check_dirty *d, const char *hostname)
 {
-	if (!gfarm_replica_check)
+	if (!gfarm_replica_check) {
+		if (d != NULL)
+			free(d->repattr);
 		return;
+	}
 
 	gfarm_mutex_lock(&replica_check_mutex, diag, REPLICA_CHECK_DIAG);
 	if (replica_check_initialized) {
 #ifdef DEBUG_REPLICA_CHECK
 		RC_LOG_DEBUG(GFARM_MSG_1003639, "%s is called", diag);
 #endif
+		replica_check_dirty_add(d, hostname);
 		replica_check_targets_add(sec);
 		gfarm_cond_signal(
 		    &replica_check_cond, diag, REPLICA_CHECK_DIAG);
-	}
+	} else {
 #ifdef DEBUG_REPLICA_CHECK
-	else
 		RC_LOG_DEBUG(GFARM_MSG_1003640, "%s is ignored", diag);
 #endif
+		if (d != NULL)
+			free(d->repattr);
+	}
 	gfarm_mutex_unlock(&replica_check_mutex, diag, REPLICA_CHECK_DIAG);
 }
 
+static void
+replica_check_signal_inode(const char *diag, struct inode *inode,
+	struct inode *dir, int spec_known, int desired_number,
+	const char *repattr)
+{
+	struct replica_check_dirty d;
+
+	d.inum = inode_get_number(inode);
+	d.dir_inum = dir == NULL ? 0 : inode_get_number(dir);
+	d.spec_known = spec_known;
+	d.desired_number = desired_number;
+	d.repattr = NULL;
+	if (spec_known && repattr != NULL &&
+	    (d.repattr = strdup(repattr)) == NULL)
+		d.spec_known = 0; /* no memory, find the spec later */
+	replica_check_signal_general(diag, 0, &d, NULL);
+}
+
 void
 replica_check_signal_host_up()
 {
 	static const char diag[] = "replica_check_signal_host_up";
 
-	replica_check_signal_general(diag, 0);
+	/* any file may be able to have more replicas by the host */
+	replica_check_signal_general(diag, 0, NULL, NULL);
 }
 
 void
-replica_check_signal_host_down()
+replica_check_signal_host_down(struct host *host)
 {
 	static const char diag[] = "replica_check_signal_host_down";
 
 	replica_check_signal_general(
-	    diag, gfarm_replica_check_host_down_thresh);
+	    diag, gfarm_replica_check_host_down_thresh,
+	    NULL, host_name(host));
 	/* NOTE: execute replica_check_main() twice after restarting gfsd */
 }
 
 void
-replica_check_signal_update_xattr()
+replica_check_signal_update_xattr(struct inode *inode)
 {
 	static const char diag[] = "replica_check_signal_update_xattr";
 
-	replica_check_signal_general(diag, 0);
+	replica_check_signal_inode(diag, inode, NULL, 0, 0, NULL);
 }
 
 void
-replica_check_signal_rename()
+replica_check_signal_rename(struct inode *inode, struct inode *dir)
 {
 	static const char diag[] = "replica_check_signal_rename";
 
-	replica_check_signal_general(diag, 0);
+	replica_check_signal_inode(diag, inode, dir, 0, 0, NULL);
 }
 
 void
-replica_check_signal_rep_request_failed()
+replica_check_signal_rep_request_failed(struct inode *inode,
+	int desired_number, const char *repattr)
 {
 	static const char diag[] = "replica_check_signal_rep_request_failed";
 
-	replica_check_signal_general(diag, 0);
+	replica_check_signal_inode(diag, inode, NULL, 1,
+	    desired_number, repattr);
 }
 
 void
-replica_check_signal_rep_result_failed()
+replica_check_signal_rep_result_failed(struct inode *inode)
 {
 	static const char diag[] = "replica_check_signal_rep_result_failed";
 
-	replica_check_signal_general(diag, 0);
+	replica_check_signal_inode(diag, inode, NULL, 0, 0, NULL);
 }
 
 static void *
@@ -667,7 +1082,7 @@ replica_check_thread(void *arg)
 
 		replica_check_wait();
 
-		if (replica_check_main()) /* error occured, retry */
+		if (replica_check_run()) /* error occured, retry */
 			replica_check_targets_add(wait_time);
 
 		t = t - time(NULL);
@@ -0,0 +1,109 @@
+#include <pthread.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include <gfarm/gfarm.h>
+
+#include "thrsubr.h"
+
+#include "slab.h"
+
+#define SLAB_CHUNK_SIZE		(64 * 1024)
+
+/* a freed object holds the link of the free list */
+#define SLAB_OBJECT_SIZE(slab) \
+	(((slab)->size + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+
+static struct slab *slab_list = NULL;
+static pthread_mutex_t slab_list_mutex = PTHREAD_MUTEX_INITIALIZER;
+static const char slab_list_diag[] = "slab_list_mutex";
+static const char slab_diag[] = "slab_mutex";
+
+static size_t
+slab_chunk_size(struct slab *slab)
+{
+	size_t objsize = SLAB_OBJECT_SIZE(slab);
+
+	if (objsize > SLAB_CHUNK_SIZE)
+		return (objsize);
+	return (SLAB_CHUNK_SIZE - SLAB_CHUNK_SIZE % objsize);
+}
+
+static int
+slab_chunk_alloc(struct slab *slab)
+{
+	size_t chunksize = slab_chunk_size(slab);
+	char *chunk;
+	static const char diag[] = "slab_chunk_alloc";
+
+	GFARM_MALLOC_ARRAY(chunk, chunksize);
+	if (chunk == NULL)
+		return (0);
+	slab->chunk_next = chunk;
+	slab->chunk_end = chunk + chunksize;
+	if (slab->n_chunks++ == 0) {
+		gfarm_mutex_lock(&slab_list_mutex, diag, slab_list_diag);
+		slab->next = slab_list;
+		slab_list = slab;
+		gfarm_mutex_unlock(&slab_list_mutex, diag, slab_list_diag);
+	}
+	return (1);
+}
+
+/* the object is not initialized, like malloc(3) */
+void *
+slab_alloc(struct slab *slab)
+{
+	void *obj;
+	static const char diag[] = "slab_alloc";
+
+	gfarm_mutex_lock(&slab->mutex, diag, slab_diag);
+	if ((obj = slab->free_list) != NULL) {
+		slab->free_list = *(void **)obj;
+	} else if (slab->chunk_next < slab->chunk_end ||
+	    slab_chunk_alloc(slab)) {
+		obj = slab->chunk_next;
+		slab->chunk_next += SLAB_OBJECT_SIZE(slab);
+	}
+	if (obj != NULL)
+		slab->n_inuse++;
+	gfarm_mutex_unlock(&slab->mutex, diag, slab_diag);
+	return (obj);
+}
+
+void
+slab_free(struct slab *slab, void *obj)
+{
+	static const char diag[] = "slab_free";
+
+	if (obj == NULL)
+		return;
+	gfarm_mutex_lock(&slab->mutex, diag, slab_diag);
+	*(void **)obj = slab->free_list;
+	slab->free_list = obj;
+	slab->n_inuse--;
+	gfarm_mutex_unlock(&slab->mutex, diag, slab_diag);
+}
+
+void
+slab_info(void)
+{
+	struct slab *slab;
+	size_t n_inuse, n_chunks;
+	static const char diag[] = "slab_info";
+
+	gfarm_mutex_lock(&slab_list_mutex, diag, slab_list_diag);
+	for (slab = slab_list; slab != NULL; slab = slab->next) {
+		gfarm_mutex_lock(&slab->mutex, diag, slab_diag);
+		n_inuse = slab->n_inuse;
+		n_chunks = slab->n_chunks;
+		gfarm_mutex_unlock(&slab->mutex, diag, slab_diag);
+
+		gflog_info(GFARM_MSG_UNFIXED,
+		    "memory: %s: %zu bytes * %zu in use, "
+		    "%zu bytes allocated",
+		    slab->name, (size_t)SLAB_OBJECT_SIZE(slab), n_inuse,
+		    slab_chunk_size(slab) * n_chunks);
+	}
+	gfarm_mutex_unlock(&slab_list_mutex, diag, slab_list_diag);
+}
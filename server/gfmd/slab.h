@@ -0,0 +1,28 @@
+/*
+ * allocator of small fixed size objects, which are kept in gfmd memory
+ * for each inode, file replica or directory entry.
+ *
+ * objects are carved out of large chunks without per-object malloc
+ * header, and freed objects are recycled by the free list of the class.
+ * chunks are never returned to the system, like struct inode.
+ */
+
+struct slab {
+	const char *name;
+	size_t size;
+	pthread_mutex_t mutex;
+
+	void *free_list;
+	char *chunk_next, *chunk_end; /* unused part of the last chunk */
+	size_t n_inuse, n_chunks;
+
+	struct slab *next; /* in slab_list, linked at the first allocation */
+};
+
+#define SLAB_INITIALIZER(name, type) \
+	{ name, sizeof(type), PTHREAD_MUTEX_INITIALIZER, \
+	  NULL, NULL, NULL, 0, 0, NULL }
+
+void *slab_alloc(struct slab *);
+void slab_free(struct slab *, void *);
+void slab_info(void);
@@ -0,0 +1,657 @@
+/*
+ * a snapshot file consists of a header and sections.
+ * a section consists of a section header and variable length records,
+ * and a record consists of its length and fields, i.e. 64bit integers and
+ * byte strings with their 32bit length.
+ * it is written in the host byte order, and it is mmap(2)ed when loading.
+ *
+ * the snapshot is only loaded if its journal sequence number is same as
+ * the one of the backend database after boot_apply_db_journal(),
+ * i.e. the backend database has not been updated since the snapshot.
+ * the snapshot is removed after it is read, to make sure that it is never
+ * used with a backend database which has been updated after that.
+ * since the journal records after the snapshot are not applied to it,
+ * the snapshot is only saved at a clean shutdown.
+ */
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+
+#include <gfarm/gflog.h>
+#include <gfarm/error.h>
+#include <gfarm/gfarm_misc.h>
+#include <gfarm/gfs.h>
+
+#include "gfutil.h"
+
+#include "config.h"
+#include "gfm_proto.h" /* GFARM_METADB_SERVER_SEQNUM_INVALID */
+#include "gfp_xdr.h" /* mdhost.h needs this */
+#include "xattr_info.h"
+
+#include "subr.h"
+#include "mdhost.h"
+#include "db_journal.h"
+#include "inode.h"
+#include "snapshot.h"
+
+#define SNAPSHOT_FILE		"gfmd.snapshot"
+#define SNAPSHOT_MAGIC		"GFMDSNAP"
+#define SNAPSHOT_BYTE_ORDER	0x01020304
+#define SNAPSHOT_VERSION	1
+
+#define SNAPSHOT_RECORD_INIT_SIZE	1024
+
+struct snapshot_header {
+	char magic[8];
+	gfarm_uint32_t byte_order;
+	gfarm_uint32_t version;
+	gfarm_uint64_t seqnum;
+};
+
+struct snapshot_section_header {
+	gfarm_uint32_t type;
+	gfarm_uint32_t reserved;
+	gfarm_uint64_t n_records;
+	gfarm_uint64_t size; /* total bytes of the records */
+};
+
+/* writer */
+struct snapshot {
+	FILE *fp;
+	int error; /* errno */
+
+	off_t section_offset;
+	struct snapshot_section_header section;
+
+	char *rec;
+	size_t rec_len, rec_size;
+};
+
+/* reader */
+struct snapshot_cursor {
+	const char *p, *end;
+};
+
+static char *snapshot_addr = NULL;
+static size_t snapshot_size;
+static struct snapshot_cursor snapshot_sections[SNAPSHOT_SECTION_TYPES];
+
+static gfarm_uint64_t snapshot_saved_seqnum =
+	GFARM_METADB_SERVER_SEQNUM_INVALID;
+
+static int
+snapshot_is_enabled(void)
+{
+	return (gfarm_metadb_snapshot &&
+	    gfarm_get_metadb_replication_enabled());
+}
+
+static void
+snapshot_path(char *path, size_t size, const char *suffix)
+{
+	snprintf(path, size, "%s/%s%s",
+	    gfarm_get_journal_dir(), SNAPSHOT_FILE, suffix);
+}
+
+static void
+snapshot_write(struct snapshot *s, const void *p, size_t len)
+{
+	if (s->error == 0 && fwrite(p, 1, len, s->fp) != len)
+		s->error = errno != 0 ? errno : EIO;
+}
+
+void
+snapshot_section_begin(struct snapshot *s, enum snapshot_section_type type)
+{
+	memset(&s->section, 0, sizeof(s->section));
+	s->section.type = type;
+	if (s->error == 0 && (s->section_offset = ftello(s->fp)) == -1)
+		s->error = errno;
+	snapshot_write(s, &s->section, sizeof(s->section));
+}
+
+void
+snapshot_section_end(struct snapshot *s)
+{
+	off_t end;
+
+	if (s->error != 0)
+		return;
+	if ((end = ftello(s->fp)) == -1 ||
+	    fseeko(s->fp, s->section_offset, SEEK_SET) == -1) {
+		s->error = errno;
+		return;
+	}
+	snapshot_write(s, &s->section, sizeof(s->section));
+	if (s->error == 0 && fseeko(s->fp, end, SEEK_SET) == -1)
+		s->error = errno;
+}
+
+static void
+snapshot_rec_append(struct snapshot *s, const void *p, size_t len)
+{
+	size_t size;
+	char *rec;
+
+	if (s->error != 0)
+		return;
+	if (s->rec_len + len > s->rec_size) {
+		size = s->rec_size == 0 ? SNAPSHOT_RECORD_INIT_SIZE :
+		    s->rec_size;
+		while (size < s->rec_len + len)
+			size *= 2;
+		if ((rec = realloc(s->rec, size)) == NULL) {
+			s->error = ENOMEM;
+			return;
+		}
+		s->rec = rec;
+		s->rec_size = size;
+	}
+	memcpy(s->rec + s->rec_len, p, len);
+	s->rec_len += len;
+}
+
+void
+snapshot_put_uint64(struct snapshot *s, gfarm_uint64_t v)
+{
+	snapshot_rec_append(s, &v, sizeof(v));
+}
+
+void
+snapshot_put_bytes(struct snapshot *s, const void *p, size_t len)
+{
+	gfarm_uint32_t len32 = len;
+
+	snapshot_rec_append(s, &len32, sizeof(len32));
+	snapshot_rec_append(s, p, len);
+}
+
+void
+snapshot_put_string(struct snapshot *s, const char *str)
+{
+	snapshot_put_bytes(s, str, strlen(str));
+}
+
+void
+snapshot_record_end(struct snapshot *s)
+{
+	gfarm_uint32_t len = s->rec_len;
+
+	snapshot_write(s, &len, sizeof(len));
+	snapshot_write(s, s->rec, s->rec_len);
+	s->section.n_records++;
+	s->section.size += sizeof(len) + s->rec_len;
+	s->rec_len = 0;
+}
+
+/* a slave may not have applied all received journal records to memory */
+static gfarm_uint64_t
+snapshot_current_seqnum(void)
+{
+	return (mdhost_self_is_master() ?
+	    db_journal_get_current_seqnum() :
+	    db_journal_get_applied_seqnum());
+}
+
+/*
+ * PREREQUISITE: giant_lock
+ * called only at the shutdown of gfmd, because the snapshot is not
+ * usable if the metadata is updated after it, see the comment above.
+ * written into a temporary file, and renamed to keep the old one on error
+ */
+gfarm_error_t
+snapshot_save(void)
+{
+	struct snapshot s;
+	struct snapshot_header hdr;
+	struct timeval t1, t2;
+	char path[MAXPATHLEN + 1], tmp[MAXPATHLEN + 1];
+	gfarm_uint64_t seqnum;
+
+	if (!snapshot_is_enabled())
+		return (GFARM_ERR_NO_ERROR);
+	seqnum = snapshot_current_seqnum();
+	if (seqnum == snapshot_saved_seqnum) /* not updated */
+		return (GFARM_ERR_NO_ERROR);
+
+	gettimeofday(&t1, NULL);
+	snapshot_path(path, sizeof(path), "");
+	snapshot_path(tmp, sizeof(tmp), ".tmp");
+	if ((s.fp = fopen(tmp, "w")) == NULL) {
+		s.error = errno;
+		gflog_error(GFARM_MSG_UNFIXED,
+		    "snapshot %s: %s", tmp, strerror(s.error));
+		return (gfarm_errno_to_error(s.error));
+	}
+	s.error = 0;
+	s.rec = NULL;
+	s.rec_len = s.rec_size = 0;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, SNAPSHOT_MAGIC, sizeof(hdr.magic));
+	hdr.byte_order = SNAPSHOT_BYTE_ORDER;
+	hdr.version = SNAPSHOT_VERSION;
+	hdr.seqnum = seqnum;
+	snapshot_write(&s, &hdr, sizeof(hdr));
+
+	inode_snapshot_write(&s);
+
+	snapshot_section_begin(&s, SNAPSHOT_SECTION_END);
+	snapshot_section_end(&s);
+
+	if (s.error == 0 &&
+	    (fflush(s.fp) == EOF || fsync(fileno(s.fp)) == -1))
+		s.error = errno;
+	if (fclose(s.fp) == EOF && s.error == 0)
+		s.error = errno;
+	free(s.rec);
+	if (s.error == 0 && rename(tmp, path) == -1)
+		s.error = errno;
+	if (s.error != 0) {
+		unlink(tmp);
+		gflog_error(GFARM_MSG_UNFIXED,
+		    "snapshot %s: %s", path, strerror(s.error));
+		return (gfarm_errno_to_error(s.error));
+	}
+	snapshot_saved_seqnum = seqnum;
+
+	gettimeofday(&t2, NULL);
+	gfarm_timeval_sub(&t2, &t1);
+	gflog_info(GFARM_MSG_UNFIXED,
+	    "snapshot %s: seqnum %llu saved in %ld.%06ld seconds", path,
+	    (unsigned long long)seqnum, (long)t2.tv_sec, (long)t2.tv_usec);
+	return (GFARM_ERR_NO_ERROR);
+}
+
+static int
+snapshot_get_record(struct snapshot_cursor *c, struct snapshot_cursor *rec)
+{
+	gfarm_uint32_t len;
+
+	if ((size_t)(c->end - c->p) < sizeof(len))
+		return (0);
+	memcpy(&len, c->p, sizeof(len));
+	if ((size_t)(c->end - c->p) - sizeof(len) < len)
+		return (0);
+	rec->p = c->p + sizeof(len);
+	rec->end = rec->p + len;
+	c->p = rec->end;
+	return (1);
+}
+
+static int
+snapshot_get_uint64(struct snapshot_cursor *rec, gfarm_uint64_t *vp)
+{
+	if ((size_t)(rec->end - rec->p) < sizeof(*vp))
+		return (0);
+	memcpy(vp, rec->p, sizeof(*vp));
+	rec->p += sizeof(*vp);
+	return (1);
+}
+
+/* the result is malloc(3)ed, and terminated by '\0' to be used as string */
+static int
+snapshot_get_bytes(struct snapshot_cursor *rec, char **bufp, size_t *lenp)
+{
+	gfarm_uint32_t len;
+	char *buf;
+
+	if ((size_t)(rec->end - rec->p) < sizeof(len))
+		return (0);
+	memcpy(&len, rec->p, sizeof(len));
+	if ((size_t)(rec->end - rec->p) - sizeof(len) < len)
+		return (0);
+	GFARM_MALLOC_ARRAY(buf, len + 1);
+	if (buf == NULL)
+		return (0);
+	memcpy(buf, rec->p + sizeof(len), len);
+	buf[len] = '\0';
+	rec->p += sizeof(len) + len;
+	*bufp = buf;
+	if (lenp != NULL)
+		*lenp = len;
+	return (1);
+}
+
+static gfarm_error_t
+snapshot_broken_record(const char *diag)
+{
+	gflog_error(GFARM_MSG_UNFIXED,
+	    "%s: broken record or no memory", diag);
+	return (GFARM_ERR_NO_MEMORY);
+}
+
+/* check the boundary of all sections and records */
+static int
+snapshot_sections_init(void)
+{
+	struct snapshot_cursor c, section, rec;
+	struct snapshot_section_header sh;
+	gfarm_uint64_t n;
+
+	c.p = snapshot_addr + sizeof(struct snapshot_header);
+	c.end = snapshot_addr + snapshot_size;
+	for (;;) {
+		if ((size_t)(c.end - c.p) < sizeof(sh))
+			return (0);
+		memcpy(&sh, c.p, sizeof(sh));
+		c.p += sizeof(sh);
+		if (sh.type >= SNAPSHOT_SECTION_TYPES ||
+		    snapshot_sections[sh.type].p != NULL ||
+		    (size_t)(c.end - c.p) < sh.size)
+			return (0);
+		section.p = c.p;
+		section.end = c.p + sh.size;
+		snapshot_sections[sh.type] = section;
+		for (n = 0; snapshot_get_record(&section, &rec); n++)
+			;
+		if (n != sh.n_records || section.p != section.end)
+			return (0);
+		c.p = section.end;
+		if (sh.type == SNAPSHOT_SECTION_END)
+			return (c.p == c.end);
+	}
+}
+
+/*
+ * values of extended attributes are only saved if they are cached.
+ * the snapshot cannot be used, if xattr_cache setting has been changed
+ * to cache some of attributes which are not cached in the snapshot.
+ */
+static int
+snapshot_xattr_cache_is_consistent(void)
+{
+	struct snapshot_cursor c = snapshot_sections[SNAPSHOT_SECTION_XATTR];
+	struct snapshot_cursor rec;
+	gfarm_uint64_t inum, cached;
+	char *name;
+	int consistent = 1;
+
+	while (consistent && snapshot_get_record(&c, &rec)) {
+		if (!snapshot_get_uint64(&rec, &inum) ||
+		    !snapshot_get_bytes(&rec, &name, NULL))
+			return (0);
+		if (snapshot_get_uint64(&rec, &cached) && !cached &&
+		    gfarm_xattr_caching(name))
+			consistent = 0;
+		free(name);
+	}
+	return (consistent);
+}
+
+/*
+ * PREREQUISITE: boot_apply_db_journal()
+ * if the snapshot is up to date, snapshot_is_open() becomes true,
+ * and the *_init() functions of file system load it instead of the database.
+ */
+void
+snapshot_open(void)
+{
+	struct snapshot_header hdr;
+	struct stat sb;
+	void *addr;
+	int fd;
+	gfarm_uint64_t seqnum;
+	const char *reason;
+	char path[MAXPATHLEN + 1];
+
+	if (!snapshot_is_enabled())
+		return;
+	snapshot_path(path, sizeof(path), "");
+	if ((fd = open(path, O_RDONLY)) == -1) {
+		if (errno != ENOENT)
+			gflog_error(GFARM_MSG_UNFIXED,
+			    "snapshot %s: %s", path, strerror(errno));
+		return;
+	}
+	if (fstat(fd, &sb) == -1) {
+		gflog_error(GFARM_MSG_UNFIXED,
+		    "snapshot %s: fstat: %s", path, strerror(errno));
+		close(fd);
+		snapshot_close();
+		return;
+	}
+	if (sb.st_size < (off_t)sizeof(hdr)) {
+		gflog_warning(GFARM_MSG_UNFIXED,
+		    "snapshot %s: too short, ignored", path);
+		close(fd);
+		snapshot_close();
+		return;
+	}
+	addr = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED) {
+		gflog_error(GFARM_MSG_UNFIXED,
+		    "snapshot %s: mmap: %s", path, strerror(errno));
+		snapshot_close();
+		return;
+	}
+	snapshot_addr = addr;
+	snapshot_size = sb.st_size;
+
+	memcpy(&hdr, snapshot_addr, sizeof(hdr));
+	seqnum = db_journal_get_current_seqnum();
+	if (memcmp(hdr.magic, SNAPSHOT_MAGIC, sizeof(hdr.magic)) != 0)
+		reason = "not a snapshot";
+	else if (hdr.byte_order != SNAPSHOT_BYTE_ORDER ||
+	    hdr.version != SNAPSHOT_VERSION)
+		reason = "unsupported format";
+	else if (hdr.seqnum != seqnum)
+		reason = "out of date";
+	else if (!snapshot_sections_init())
+		reason = "broken";
+	else if (!snapshot_xattr_cache_is_consistent())
+		reason = "xattr_cache setting has been changed";
+	else {
+		gflog_info(GFARM_MSG_UNFIXED,
+		    "snapshot %s: seqnum %llu, loading", path,
+		    (unsigned long long)seqnum);
+		return;
+	}
+	gflog_warning(GFARM_MSG_UNFIXED,
+	    "snapshot %s: seqnum %llu, the database seqnum %llu: %s, ignored",
+	    path, (unsigned long long)hdr.seqnum,
+	    (unsigned long long)seqnum, reason);
+	snapshot_close();
+}
+
+int
+snapshot_is_open(void)
+{
+	return (snapshot_addr != NULL);
+}
+
+void
+snapshot_close(void)
+{
+	char path[MAXPATHLEN + 1];
+
+	if (!snapshot_is_enabled())
+		return;
+	if (snapshot_addr != NULL) {
+		munmap(snapshot_addr, snapshot_size);
+		snapshot_addr = NULL;
+		memset(snapshot_sections, 0, sizeof(snapshot_sections));
+	}
+	snapshot_path(path, sizeof(path), "");
+	if (unlink(path) == -1 && errno != ENOENT)
+		gflog_error(GFARM_MSG_UNFIXED,
+		    "snapshot %s: unlink: %s", path, strerror(errno));
+}
+
+gfarm_error_t
+snapshot_inode_load(void *closure,
+	void (*callback)(void *, struct gfs_stat *))
+{
+	struct snapshot_cursor c = snapshot_sections[SNAPSHOT_SECTION_INODE];
+	struct snapshot_cursor rec;
+	struct gfs_stat st;
+	gfarm_uint64_t v[11];
+	int i;
+
+	while (snapshot_get_record(&c, &rec)) {
+		for (i = 0; i < GFARM_ARRAY_LENGTH(v); i++) {
+			if (!snapshot_get_uint64(&rec, &v[i]))
+				return (snapshot_broken_record("inode"));
+		}
+		if (!snapshot_get_bytes(&rec, &st.st_user, NULL))
+			return (snapshot_broken_record("inode"));
+		if (!snapshot_get_bytes(&rec, &st.st_group, NULL)) {
+			free(st.st_user);
+			return (snapshot_broken_record("inode"));
+		}
+		st.st_ino = v[0];
+		st.st_gen = v[1];
+		st.st_mode = v[2];
+		st.st_nlink = v[3];
+		st.st_size = v[4];
+		st.st_ncopy = 0;
+		st.st_atimespec.tv_sec = v[5];
+		st.st_atimespec.tv_nsec = v[6];
+		st.st_mtimespec.tv_sec = v[7];
+		st.st_mtimespec.tv_nsec = v[8];
+		st.st_ctimespec.tv_sec = v[9];
+		st.st_ctimespec.tv_nsec = v[10];
+		(*callback)(closure, &st);
+	}
+	return (GFARM_ERR_NO_ERROR);
+}
+
+gfarm_error_t
+snapshot_inode_cksum_load(void *closure,
+	void (*callback)(void *, gfarm_ino_t, char *, size_t, char *))
+{
+	struct snapshot_cursor c =
+	    snapshot_sections[SNAPSHOT_SECTION_INODE_CKSUM];
+	struct snapshot_cursor rec;
+	gfarm_uint64_t inum;
+	char *type, *sum;
+	size_t len;
+
+	while (snapshot_get_record(&c, &rec)) {
+		if (!snapshot_get_uint64(&rec, &inum) ||
+		    !snapshot_get_bytes(&rec, &type, NULL))
+			return (snapshot_broken_record("inode_cksum"));
+		if (!snapshot_get_bytes(&rec, &sum, &len)) {
+			free(type);
+			return (snapshot_broken_record("inode_cksum"));
+		}
+		(*callback)(closure, inum, type, len, sum);
+	}
+	return (GFARM_ERR_NO_ERROR);
+}
+
+gfarm_error_t
+snapshot_filecopy_load(void *closure,
+	void (*callback)(void *, gfarm_ino_t, char *))
+{
+	struct snapshot_cursor c =
+	    snapshot_sections[SNAPSHOT_SECTION_FILECOPY];
+	struct snapshot_cursor rec;
+	gfarm_uint64_t inum;
+	char *hostname;
+
+	while (snapshot_get_record(&c, &rec)) {
+		if (!snapshot_get_uint64(&rec, &inum) ||
+		    !snapshot_get_bytes(&rec, &hostname, NULL))
+			return (snapshot_broken_record("filecopy"));
+		(*callback)(closure, inum, hostname);
+	}
+	return (GFARM_ERR_NO_ERROR);
+}
+
+gfarm_error_t
+snapshot_direntry_load(void *closure,
+	void (*callback)(void *, gfarm_ino_t, char *, int, gfarm_ino_t))
+{
+	struct snapshot_cursor c =
+	    snapshot_sections[SNAPSHOT_SECTION_DIRENTRY];
+	struct snapshot_cursor rec;
+	gfarm_uint64_t dir_inum, entry_inum;
+	char *name;
+	size_t len;
+
+	while (snapshot_get_record(&c, &rec)) {
+		if (!snapshot_get_uint64(&rec, &dir_inum) ||
+		    !snapshot_get_bytes(&rec, &name, &len))
+			return (snapshot_broken_record("direntry"));
+		if (!snapshot_get_uint64(&rec, &entry_inum)) {
+			free(name);
+			return (snapshot_broken_record("direntry"));
+		}
+		(*callback)(closure, dir_inum, name, len, entry_inum);
+	}
+	return (GFARM_ERR_NO_ERROR);
+}
+
+gfarm_error_t
+snapshot_symlink_load(void *closure,
+	void (*callback)(void *, gfarm_ino_t, char *))
+{
+	struct snapshot_cursor c =
+	    snapshot_sections[SNAPSHOT_SECTION_SYMLINK];
+	struct snapshot_cursor rec;
+	gfarm_uint64_t inum;
+	char *source_path;
+
+	while (snapshot_get_record(&c, &rec)) {
+		if (!snapshot_get_uint64(&rec, &inum) ||
+		    !snapshot_get_bytes(&rec, &source_path, NULL))
+			return (snapshot_broken_record("symlink"));
+		(*callback)(closure, inum, source_path);
+	}
+	return (GFARM_ERR_NO_ERROR);
+}
+
+/* `*closure' is xmlMode, like db_xattr_load() */
+gfarm_error_t
+snapshot_xattr_load(void *closure,
+	void (*callback)(void *, struct xattr_info *))
+{
+	int xmlMode = (closure != NULL) ? *(int *)closure : 0;
+	struct snapshot_cursor c = snapshot_sections[xmlMode ?
+	    SNAPSHOT_SECTION_XMLATTR : SNAPSHOT_SECTION_XATTR];
+	struct snapshot_cursor rec;
+	struct xattr_info info;
+	gfarm_uint64_t inum, cached;
+	char *value;
+	size_t namelen, size;
+	const char *diag = xmlMode ? "xmlattr" : "xattr";
+
+	while (snapshot_get_record(&c, &rec)) {
+		if (!snapshot_get_uint64(&rec, &inum) ||
+		    !snapshot_get_bytes(&rec, &info.attrname, &namelen))
+			return (snapshot_broken_record(diag));
+		if (!snapshot_get_uint64(&rec, &cached) ||
+		    !snapshot_get_bytes(&rec, &value, &size)) {
+			free(info.attrname);
+			return (snapshot_broken_record(diag));
+		}
+		info.inum = inum;
+		info.namelen = namelen;
+		if (cached) {
+			info.attrvalue = value;
+			info.attrsize = size;
+		} else {
+			info.attrvalue = NULL;
+			info.attrsize = 0;
+		}
+		(*callback)(closure, &info);
+		/* the memory owner is not changed, see xattr_add_one() */
+		free(info.attrname);
+		free(value);
+	}
+	return (GFARM_ERR_NO_ERROR);
+}
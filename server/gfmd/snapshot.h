@@ -0,0 +1,50 @@
+/*
+ * a snapshot of the in-memory file system metadata, which is loaded
+ * at the startup of gfmd instead of the backend database,
+ * if the journal sequence number of the snapshot is up to date.
+ */
+
+enum snapshot_section_type {
+	SNAPSHOT_SECTION_END,
+	SNAPSHOT_SECTION_INODE,
+	SNAPSHOT_SECTION_INODE_CKSUM,
+	SNAPSHOT_SECTION_FILECOPY,
+	SNAPSHOT_SECTION_DIRENTRY,
+	SNAPSHOT_SECTION_SYMLINK,
+	SNAPSHOT_SECTION_XATTR,
+	SNAPSHOT_SECTION_XMLATTR,
+
+	SNAPSHOT_SECTION_TYPES
+};
+
+struct snapshot;
+
+/* for writers of sections, see inode_snapshot_write() */
+void snapshot_section_begin(struct snapshot *, enum snapshot_section_type);
+void snapshot_section_end(struct snapshot *);
+void snapshot_put_uint64(struct snapshot *, gfarm_uint64_t);
+void snapshot_put_bytes(struct snapshot *, const void *, size_t);
+void snapshot_put_string(struct snapshot *, const char *);
+void snapshot_record_end(struct snapshot *);
+
+gfarm_error_t snapshot_save(void);
+
+void snapshot_open(void);
+int snapshot_is_open(void);
+void snapshot_close(void);
+
+/* same interface as the db_*_load() functions */
+struct gfs_stat;
+struct xattr_info;
+gfarm_error_t snapshot_inode_load(void *,
+	void (*)(void *, struct gfs_stat *));
+gfarm_error_t snapshot_inode_cksum_load(void *,
+	void (*)(void *, gfarm_ino_t, char *, size_t, char *));
+gfarm_error_t snapshot_filecopy_load(void *,
+	void (*)(void *, gfarm_ino_t, char *));
+gfarm_error_t snapshot_direntry_load(void *,
+	void (*)(void *, gfarm_ino_t, char *, int, gfarm_ino_t));
+gfarm_error_t snapshot_symlink_load(void *,
+	void (*)(void *, gfarm_ino_t, char *));
+gfarm_error_t snapshot_xattr_load(void *,
+	void (*)(void *, struct xattr_info *));
@@ -1,6 +1,8 @@
 #include <pthread.h>
 
+#include <sys/time.h>
 #include <assert.h>
+#include <errno.h>
 #include <stdarg.h>
 #include <string.h>
 #include <unistd.h>
@@ -19,31 +21,165 @@
 
 int debug_mode = 0;
 
-static pthread_mutex_t giant_mutex;
+/*
+ * the giant lock is a reader/writer lock.
+ * giant_lock() is exclusive, and it's what most of handlers use.
+ * giant_rdlock() is shared, and it's only for handlers which don't
+ * modify metadata, except a few things like atime, a directory cursor
+ * and a descriptor table of a process.  giant_rdlock() holders have to
+ * read and update them under giant_rdlock_update_lock(), because another
+ * holder may update them concurrently.
+ * a writer is preferred, otherwise a storm of read-only requests
+ * may starve it.
+ */
+static pthread_rwlock_t giant_rwlock;
+
+/* serializes updates by giant_rdlock() holders, including DB access */
+static pthread_mutex_t giant_rdlock_update_mutex;
+
+/* lock contention statistics, see giant_info() */
+static pthread_mutex_t giant_stat_mutex;
+static struct giant_stat {
+	unsigned long long acquired, contended;
+	double wait_time;
+} giant_wrstat, giant_rdstat;
+
+static const char giant_diag[] = "giant";
 
 void
 giant_init(void)
 {
-	gfarm_mutex_init(&giant_mutex, "giant_init", "giant");
+	pthread_rwlockattr_t attr;
+	int err;
+
+	if ((err = pthread_rwlockattr_init(&attr)) != 0)
+		gflog_fatal(GFARM_MSG_UNFIXED, "giant_init: rwlockattr: %s",
+		    strerror(err));
+#ifdef HAVE_PTHREAD_RWLOCKATTR_SETKIND_NP
+	if ((err = pthread_rwlockattr_setkind_np(&attr,
+	    PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP)) != 0)
+		gflog_fatal(GFARM_MSG_UNFIXED, "giant_init: setkind: %s",
+		    strerror(err));
+#endif
+	if ((err = pthread_rwlock_init(&giant_rwlock, &attr)) != 0)
+		gflog_fatal(GFARM_MSG_UNFIXED, "giant_init: rwlock init: %s",
+		    strerror(err));
+	pthread_rwlockattr_destroy(&attr);
+
+	gfarm_mutex_init(&giant_rdlock_update_mutex, "giant_init",
+	    "giant rdlock update");
+	gfarm_mutex_init(&giant_stat_mutex, "giant_init", "giant stat");
+}
+
+static void
+giant_lock_contended(int (*lock)(pthread_rwlock_t *),
+	struct giant_stat *stat, const char *diag)
+{
+	struct timeval t1, t2;
+	int err;
+
+	gettimeofday(&t1, NULL);
+	if ((err = (*lock)(&giant_rwlock)) != 0)
+		gflog_fatal(GFARM_MSG_UNFIXED, "%s: %s", diag, strerror(err));
+	gettimeofday(&t2, NULL);
+
+	gfarm_mutex_lock(&giant_stat_mutex, diag, "giant stat");
+	stat->contended++;
+	stat->wait_time += (t2.tv_sec - t1.tv_sec) +
+	    (t2.tv_usec - t1.tv_usec) * .000001;
+	gfarm_mutex_unlock(&giant_stat_mutex, diag, "giant stat");
 }
 
 void
 giant_lock(void)
 {
-	gfarm_mutex_lock(&giant_mutex, "giant_lock", "giant");
+	int err = pthread_rwlock_trywrlock(&giant_rwlock);
+
+	if (err == EBUSY)
+		giant_lock_contended(pthread_rwlock_wrlock, &giant_wrstat,
+		    "giant_lock");
+	else if (err != 0)
+		gflog_fatal(GFARM_MSG_UNFIXED, "giant_lock: %s",
+		    strerror(err));
+	giant_wrstat.acquired++; /* exclusive */
 }
 
 /* false: busy */
 int
 giant_trylock(void)
 {
-	return (gfarm_mutex_trylock(&giant_mutex, "giant_trylock", "giant"));
+	int err = pthread_rwlock_trywrlock(&giant_rwlock);
+
+	if (err != 0 && err != EBUSY)
+		gflog_fatal(GFARM_MSG_UNFIXED, "giant_trylock: %s",
+		    strerror(err));
+	if (err == 0)
+		giant_wrstat.acquired++; /* exclusive */
+	return (err == 0);
+}
+
+/* shared lock for read-only handlers */
+void
+giant_rdlock(void)
+{
+	int err = pthread_rwlock_tryrdlock(&giant_rwlock);
+
+	if (err == EBUSY)
+		giant_lock_contended(pthread_rwlock_rdlock, &giant_rdstat,
+		    "giant_rdlock");
+	else if (err != 0)
+		gflog_fatal(GFARM_MSG_UNFIXED, "giant_rdlock: %s",
+		    strerror(err));
+
+	/* shared, thus has to be protected unlike giant_wrstat */
+	gfarm_mutex_lock(&giant_stat_mutex, "giant_rdlock", "giant stat");
+	giant_rdstat.acquired++;
+	gfarm_mutex_unlock(&giant_stat_mutex, "giant_rdlock", "giant stat");
 }
 
+/* for both giant_lock() and giant_rdlock() */
 void
 giant_unlock(void)
 {
-	gfarm_mutex_unlock(&giant_mutex, "giant_unlock", "giant");
+	int err = pthread_rwlock_unlock(&giant_rwlock);
+
+	if (err != 0)
+		gflog_fatal(GFARM_MSG_UNFIXED, "giant_unlock: %s",
+		    strerror(err));
+}
+
+/* giant_rdlock() has to be held */
+void
+giant_rdlock_update_lock(void)
+{
+	gfarm_mutex_lock(&giant_rdlock_update_mutex,
+	    "giant_rdlock_update_lock", giant_diag);
+}
+
+void
+giant_rdlock_update_unlock(void)
+{
+	gfarm_mutex_unlock(&giant_rdlock_update_mutex,
+	    "giant_rdlock_update_unlock", giant_diag);
+}
+
+void
+giant_info(void)
+{
+	struct giant_stat w, r;
+	static const char diag[] = "giant_info";
+
+	gfarm_mutex_lock(&giant_stat_mutex, diag, "giant stat");
+	w = giant_wrstat; /* "acquired" may be inaccurate, but it's ok */
+	r = giant_rdstat;
+	gfarm_mutex_unlock(&giant_stat_mutex, diag, "giant stat");
+
+	gflog_info(GFARM_MSG_UNFIXED,
+	    "giant lock: exclusive: acquired %llu, contended %llu, "
+	    "wait %.3f sec; shared: acquired %llu, contended %llu, "
+	    "wait %.3f sec",
+	    w.acquired, w.contended, w.wait_time,
+	    r.acquired, r.contended, r.wait_time);
 }
 
 static void
@@ -3,7 +3,11 @@ extern int debug_mode;
 void giant_init(void);
 void giant_lock(void);
 int giant_trylock(void);
+void giant_rdlock(void);
 void giant_unlock(void);
+void giant_rdlock_update_lock(void);
+void giant_rdlock_update_unlock(void);
+void giant_info(void);
 
 gfarm_error_t create_detached_thread(void *(*)(void *), void *);
 
@@ -318,6 +318,13 @@ user_name(struct user *u)
 	    u->ui.username : REMOVED_USER_NAME);
 }
 
+/* the name is kept even after the user is removed */
+char *
+user_name_including_invalid(struct user *u)
+{
+	return (u != NULL ? u->ui.username : REMOVED_USER_NAME);
+}
+
 char *
 user_realname(struct user *u)
 {
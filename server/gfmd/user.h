@@ -6,6 +6,7 @@ struct user *user_lookup_or_enter_invalid(const char *);
 struct user *user_lookup(const char *);
 struct user *user_lookup_gsi_dn(const char *);
 char *user_name(struct user *);
+char *user_name_including_invalid(struct user *);
 char *user_realname(struct user *);
 char *user_gsi_dn(struct user *);
 int user_is_invalid(struct user *);
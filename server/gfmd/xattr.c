@@ -441,7 +441,7 @@ xattr_set(int xmlMode, struct inode *inode,
 		}
 	}
 	if (change_replica_spec)
-		replica_check_signal_update_xattr();
+		replica_check_signal_update_xattr(inode);
 
 	if (*addattr) {
 		e = db_xattr_add(xmlMode, inode_get_number(inode),
@@ -815,7 +815,7 @@ gfm_server_removexattr(
 
 		if (e == GFARM_ERR_NO_ERROR && !xmlMode &&
 		    strcmp("gfarm.ncopy", attrname) == 0)
-			replica_check_signal_update_xattr();
+			replica_check_signal_update_xattr(inode);
 	}
 
 	free(attrname);
@@ -1020,6 +1020,38 @@ inum_path_array_add_attrnames(void *en, int nfound, void *in)
 	return GFARM_ERR_NO_ERROR;
 }
 
+/*
+ * PREREQUISITE: giant_lock
+ * returns true if the entry is resolved by the in-memory index.
+ */
+static int
+findxmlattr_by_index(struct inum_path_array *array,
+	struct inum_path_entry *entry)
+{
+	gfarm_error_t e;
+	struct inode *inode = inode_lookup(entry->inum);
+	int nattrs;
+	char **attrnames;
+	static const char diag[] = "findxmlattr_by_index";
+
+	if (inode == NULL)
+		return (0);
+	e = inode_xmlattr_find_by_index(inode, array->expr,
+	    &nattrs, &attrnames);
+	if (e == GFARM_ERR_OPERATION_NOT_SUPPORTED)
+		return (0);
+
+	gfarm_mutex_lock(&array->lock, diag, inum_path_array_diag);
+	if (e == GFARM_ERR_NO_ERROR) {
+		entry->nattrs = nattrs;
+		entry->attrnames = attrnames;
+		array->nattrssum += nattrs;
+	}
+	entry->dberr = e;
+	gfarm_mutex_unlock(&array->lock, diag, inum_path_array_diag);
+	return (1);
+}
+
 static gfarm_error_t
 findxmlattr_dbq_enter(struct inum_path_array *array,
 	struct inum_path_entry *entry)
@@ -1027,7 +1059,9 @@ findxmlattr_dbq_enter(struct inum_path_array *array,
 	gfarm_error_t e;
 	int dbbusy = 0;
 
-	if (db_getfreenum() > MINIMUM_DBQ_FREE_NUM) {
+	if (findxmlattr_by_index(array, entry)) {
+		return (GFARM_ERR_NO_ERROR);
+	} else if (db_getfreenum() > MINIMUM_DBQ_FREE_NUM) {
 		e = db_xmlattr_find(entry->inum, array->expr,
 			inum_path_array_add_attrnames, entry,
 			db_findxmlattr_done, entry);
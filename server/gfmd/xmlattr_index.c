@@ -0,0 +1,346 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gfarm/gfarm.h>
+
+#include "xmlattr_index.h"
+
+#define XMLATTR_INDEX_DEPTH_MAX	64
+
+struct xmlattr_paths {
+	char *path; /* path of the current element */
+	size_t pathlen[XMLATTR_INDEX_DEPTH_MAX + 1], pathsize;
+	int depth;
+
+	char **paths;
+	int npaths, paths_size;
+};
+
+static int
+is_name_char(int c)
+{
+	return ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+	    (c >= '0' && c <= '9') || c == '_' || c == '-' || c == '.' ||
+	    (c & 0x80) != 0 /* UTF-8 */);
+}
+
+static int
+is_name_start_char(int c)
+{
+	return (is_name_char(c) &&
+	    !(c >= '0' && c <= '9') && c != '-' && c != '.');
+}
+
+/* returns the next of the string s in [p, end), or NULL */
+static const char *
+skip_to(const char *p, const char *end, const char *s)
+{
+	size_t len = strlen(s);
+
+	for (; p + len <= end; p++) {
+		if (memcmp(p, s, len) == 0)
+			return (p + len);
+	}
+	return (NULL);
+}
+
+static int
+xmlattr_paths_push(struct xmlattr_paths *xp, const char *name, size_t namelen)
+{
+	size_t len = xp->pathlen[xp->depth], size;
+	char *path, **paths;
+
+	if (xp->depth >= XMLATTR_INDEX_DEPTH_MAX)
+		return (0);
+	if (len + 1 + namelen + 1 > xp->pathsize) {
+		size = (len + 1 + namelen + 1) * 2;
+		if ((path = realloc(xp->path, size)) == NULL)
+			return (0);
+		xp->path = path;
+		xp->pathsize = size;
+	}
+	xp->path[len] = '/';
+	memcpy(&xp->path[len + 1], name, namelen);
+	len += 1 + namelen;
+	xp->path[len] = '\0';
+	xp->pathlen[++xp->depth] = len;
+
+	if (xp->npaths >= xp->paths_size) {
+		size = xp->paths_size == 0 ? 16 : xp->paths_size * 2;
+		GFARM_REALLOC_ARRAY(paths, xp->paths, size);
+		if (paths == NULL)
+			return (0);
+		xp->paths = paths;
+		xp->paths_size = size;
+	}
+	if ((xp->paths[xp->npaths] = strdup(xp->path)) == NULL)
+		return (0);
+	xp->npaths++;
+	return (1);
+}
+
+static int
+xmlattr_paths_pop(struct xmlattr_paths *xp)
+{
+	if (xp->depth <= 0)
+		return (0);
+	--xp->depth;
+	return (1);
+}
+
+/*
+ * parse a start tag after '<', and returns the next of it, or NULL.
+ * an element which has namespace is not indexed, because its name
+ * in XPath depends on the namespace mappings.
+ */
+static const char *
+xmlattr_paths_start_tag(struct xmlattr_paths *xp,
+	const char *p, const char *end)
+{
+	const char *name = p, *q;
+	int empty = 0;
+
+	while (p < end && is_name_char(*(const unsigned char *)p))
+		p++;
+	if (p == name || !is_name_start_char(*(const unsigned char *)name))
+		return (NULL);
+	if (p < end && *p == ':') /* namespace prefix */
+		return (NULL);
+	if (!xmlattr_paths_push(xp, name, p - name))
+		return (NULL);
+	for (; p < end; p++) {
+		switch (*p) {
+		case '"':
+		case '\'':
+			q = memchr(p + 1, *p, end - (p + 1));
+			if (q == NULL)
+				return (NULL);
+			p = q;
+			empty = 0;
+			break;
+		case 'x':
+			if (end - p >= 5 && memcmp(p, "xmlns", 5) == 0)
+				return (NULL);
+			empty = 0;
+			break;
+		case '/':
+			empty = 1;
+			break;
+		case '>':
+			if (empty && !xmlattr_paths_pop(xp))
+				return (NULL);
+			return (p + 1);
+		case ' ': case '\t': case '\r': case '\n':
+			break;
+		default:
+			empty = 0;
+			break;
+		}
+	}
+	return (NULL);
+}
+
+/*
+ * parse an end tag after "</", and returns the next of it, or NULL.
+ * the name must be same with the element which is closed by it.
+ */
+static const char *
+xmlattr_paths_end_tag(struct xmlattr_paths *xp,
+	const char *p, const char *end)
+{
+	const char *name = p;
+	size_t start;
+
+	if (xp->depth <= 0)
+		return (NULL);
+	while (p < end && is_name_char(*(const unsigned char *)p))
+		p++;
+	start = xp->pathlen[xp->depth - 1] + 1;
+	if ((size_t)(p - name) != xp->pathlen[xp->depth] - start ||
+	    memcmp(name, &xp->path[start], p - name) != 0)
+		return (NULL);
+	while (p < end &&
+	    (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+		p++;
+	if (p >= end || *p != '>' || !xmlattr_paths_pop(xp))
+		return (NULL);
+	return (p + 1);
+}
+
+/*
+ * skip a DOCTYPE after "<!", and returns the next of it, or NULL.
+ * a document with an internal DTD subset is not indexed, because
+ * its entities and default attributes may change the elements.
+ */
+static const char *
+xmlattr_paths_doctype(struct xmlattr_paths *xp,
+	const char *p, const char *end)
+{
+	const char *q;
+
+	if (xp->depth > 0 || (q = skip_to(p, end, ">")) == NULL)
+		return (NULL);
+	if (memchr(p, '[', q - p) != NULL) /* internal subset */
+		return (NULL);
+	return (q);
+}
+
+static int
+path_order(const void *a, const void *b)
+{
+	const char *const *p1 = a, *const *p2 = b;
+
+	return (strcmp(*p1, *p2));
+}
+
+static void
+xmlattr_paths_free(struct xmlattr_paths *xp)
+{
+	int i;
+
+	for (i = 0; i < xp->npaths; i++)
+		free(xp->paths[i]);
+	free(xp->paths);
+	free(xp->path);
+}
+
+/*
+ * returns the unique element paths in the XML document, which are packed
+ * like "/a\0/a/b\0\0", or NULL if the document cannot be indexed.
+ */
+char *
+xmlattr_index_paths(const void *value, size_t size)
+{
+	const char *p = value, *end = p + size, *q;
+	struct xmlattr_paths xp;
+	char *packed = NULL, *dst;
+	size_t len, packedsize;
+	int i, n;
+
+	if ((q = memchr(p, '\0', size)) != NULL)
+		end = q;
+	memset(&xp, 0, sizeof(xp));
+
+	while (p != NULL && p < end) {
+		if (*p != '<') {
+			if ((p = memchr(p, '<', end - p)) == NULL)
+				p = end;
+			continue;
+		}
+		p++;
+		if (end - p >= 3 && memcmp(p, "!--", 3) == 0)
+			p = skip_to(p + 3, end, "-->");
+		else if (end - p >= 8 && memcmp(p, "![CDATA[", 8) == 0)
+			p = skip_to(p + 8, end, "]]>");
+		else if (p < end && *p == '?')
+			p = skip_to(p + 1, end, "?>");
+		else if (p < end && *p == '!') /* DOCTYPE */
+			p = xmlattr_paths_doctype(&xp, p + 1, end);
+		else if (p < end && *p == '/')
+			p = xmlattr_paths_end_tag(&xp, p + 1, end);
+		else
+			p = xmlattr_paths_start_tag(&xp, p, end);
+	}
+	if (p == NULL || xp.depth != 0) {
+		xmlattr_paths_free(&xp);
+		return (NULL);
+	}
+
+	if (xp.npaths > 0)
+		qsort(xp.paths, xp.npaths, sizeof(*xp.paths), path_order);
+	packedsize = 1;
+	for (i = n = 0; i < xp.npaths; i++) {
+		if (n > 0 && strcmp(xp.paths[n - 1], xp.paths[i]) == 0) {
+			free(xp.paths[i]);
+			continue;
+		}
+		xp.paths[n++] = xp.paths[i];
+		packedsize += strlen(xp.paths[i]) + 1;
+	}
+	xp.npaths = n;
+	GFARM_MALLOC_ARRAY(packed, packedsize);
+	if (packed != NULL) {
+		for (i = 0, dst = packed; i < xp.npaths; i++) {
+			len = strlen(xp.paths[i]) + 1;
+			memcpy(dst, xp.paths[i], len);
+			dst += len;
+		}
+		packed[packedsize - 1] = '\0';
+	}
+	xmlattr_paths_free(&xp);
+	return (packed);
+}
+
+/*
+ * only location paths which consist of "/" or "//", and element names
+ * or "*" are supported.
+ */
+int
+xmlattr_index_expr_is_supported(const char *expr)
+{
+	const unsigned char *p = (const unsigned char *)expr;
+
+	if (*p == '\0')
+		return (0);
+	while (*p != '\0') {
+		if (*p++ != '/')
+			return (0);
+		if (*p == '/')
+			p++;
+		if (*p == '*') {
+			p++;
+			continue;
+		}
+		if (!is_name_start_char(*p))
+			return (0);
+		while (is_name_char(*p))
+			p++;
+	}
+	return (1);
+}
+
+/* expr and path are "" or begin with '/' */
+static int
+match_path(const char *expr, const char *path)
+{
+	const char *step, *name;
+	size_t steplen, namelen;
+
+	if (*expr == '\0')
+		return (*path == '\0');
+	if (expr[1] == '/') { /* "//": descendant-or-self */
+		for (; path != NULL && *path != '\0';
+		    path = strchr(path + 1, '/')) {
+			if (match_path(expr + 1, path))
+				return (1);
+		}
+		return (0);
+	}
+	if (*path == '\0')
+		return (0);
+	step = expr + 1;
+	steplen = strcspn(step, "/");
+	name = path + 1;
+	namelen = strcspn(name, "/");
+	if (!(steplen == 1 && *step == '*') &&
+	    (steplen != namelen || memcmp(step, name, namelen) != 0))
+		return (0);
+	return (match_path(step + steplen, name + namelen));
+}
+
+/*
+ * returns true if the XPath expression selects an element in the document.
+ * NOTE: the expression must be xmlattr_index_expr_is_supported()
+ */
+int
+xmlattr_index_match(const char *paths, const char *expr)
+{
+	const char *p;
+
+	for (p = paths; *p != '\0'; p += strlen(p) + 1) {
+		if (match_path(expr, p))
+			return (1);
+	}
+	return (0);
+}
@@ -0,0 +1,12 @@
+/*
+ * in-memory index of XML extended attributes for gffindxmlattr.
+ *
+ * the index of an XML document is the set of the element paths
+ * (e.g. "/a", "/a/b") in it, which is enough to evaluate XPath location
+ * paths without predicates, such as "/a/b", "//b" or "//a//b".
+ * other expressions are evaluated by the backend database.
+ */
+
+char *xmlattr_index_paths(const void *, size_t);
+int xmlattr_index_expr_is_supported(const char *);
+int xmlattr_index_match(const char *, const char *);
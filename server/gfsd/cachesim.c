@@ -0,0 +1,548 @@
+/*
+ * $Id$
+ */
+
+/*
+ * simulated page cache, to estimate the cache hit rate of clients.
+ *
+ * The cache is kept in an anonymous shared mapping which is created by
+ * the master gfsd before it forks, so that the state is resident across
+ * requests and shared by all gfsd children.  Every access is O(1):
+ * pages are found by a chained hash table, and are linked to the
+ * replacement lists of the policy by intrusive doubly linked lists.
+ * Nodes are addressed by index instead of pointer, and ghost entries
+ * of 2Q and ARC are kept in the same node pool.
+ *
+ * The policies are:
+ *	LRU:	least recently used
+ *	CLOCK:	second chance, i.e. LRU approximation by a reference bit
+ *	2Q:	Johnson and Shasha, "2Q: A Low Overhead High Performance
+ *		Buffer Management Replacement Algorithm", VLDB 1994
+ *	ARC:	Megiddo and Modha, "ARC: A Self-Tuning, Low Overhead
+ *		Replacement Cache", FAST 2003
+ */
+
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+
+#include <gfarm/gflog.h>
+#include <gfarm/error.h>
+#include <gfarm/gfarm_misc.h>
+#include <gfarm/gfs.h>
+
+#include "gfutil.h"
+#include "thrsubr.h"
+
+#include "cachesim.h"
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS	MAP_ANON
+#endif
+
+#define NIL	(-1)
+
+enum cachesim_list_id {
+	CACHESIM_FREE,
+	CACHESIM_RESIDENT,	/* LRU, CLOCK */
+	CACHESIM_A1IN,		/* 2Q */
+	CACHESIM_A1OUT,		/* 2Q, ghost */
+	CACHESIM_AM,		/* 2Q */
+	CACHESIM_T1,		/* ARC */
+	CACHESIM_T2,		/* ARC */
+	CACHESIM_B1,		/* ARC, ghost */
+	CACHESIM_B2,		/* ARC, ghost */
+	CACHESIM_NLISTS
+};
+
+struct cachesim_node {
+	gfarm_ino_t ino;
+	gfarm_uint64_t gen, page;
+	gfarm_int32_t hnext;		/* hash chain */
+	gfarm_int32_t prev, next;	/* replacement list */
+	unsigned char list;		/* enum cachesim_list_id */
+	unsigned char ref;		/* reference bit of CLOCK */
+};
+
+/* head is MRU, tail is LRU */
+struct cachesim_list {
+	gfarm_int32_t head, tail, n;
+};
+
+struct cachesim {
+	pthread_mutex_t mutex;		/* PTHREAD_PROCESS_SHARED */
+	enum gfsd_cachesim_policy policy;
+	gfarm_int32_t capacity;		/* # of resident pages */
+	gfarm_int32_t nnodes, nbuckets;
+	gfarm_int32_t arc_p;		/* ARC: target size of T1 */
+	struct cachesim_list lists[CACHESIM_NLISTS];
+	gfarm_int32_t *buckets;		/* [nbuckets] */
+	struct cachesim_node *nodes;	/* [nnodes] */
+};
+
+static struct {
+	enum gfsd_cachesim_policy policy;
+	const char *name;
+} cachesim_policies[] = {
+	{ GFSD_CACHESIM_LRU, "lru" },
+	{ GFSD_CACHESIM_CLOCK, "clock" },
+	{ GFSD_CACHESIM_2Q, "2q" },
+	{ GFSD_CACHESIM_ARC, "arc" },
+};
+
+static struct cachesim *cachesim;
+
+static const char diag_mutex[] = "cachesim mutex";
+
+gfarm_error_t
+gfsd_cachesim_policy_by_name(const char *name,
+	enum gfsd_cachesim_policy *policyp)
+{
+	int i;
+
+	for (i = 0; i < GFARM_ARRAY_LENGTH(cachesim_policies); i++) {
+		if (strcmp(name, cachesim_policies[i].name) == 0) {
+			*policyp = cachesim_policies[i].policy;
+			return (GFARM_ERR_NO_ERROR);
+		}
+	}
+	return (GFARM_ERR_INVALID_ARGUMENT);
+}
+
+const char *
+gfsd_cachesim_policy_name(enum gfsd_cachesim_policy policy)
+{
+	int i;
+
+	for (i = 0; i < GFARM_ARRAY_LENGTH(cachesim_policies); i++) {
+		if (policy == cachesim_policies[i].policy)
+			return (cachesim_policies[i].name);
+	}
+	return ("unknown");
+}
+
+/*
+ * list operations
+ */
+
+static void
+list_remove(struct cachesim *cs, gfarm_int32_t i)
+{
+	struct cachesim_node *n = &cs->nodes[i];
+	struct cachesim_list *l = &cs->lists[n->list];
+
+	if (n->prev == NIL)
+		l->head = n->next;
+	else
+		cs->nodes[n->prev].next = n->next;
+	if (n->next == NIL)
+		l->tail = n->prev;
+	else
+		cs->nodes[n->next].prev = n->prev;
+	l->n--;
+}
+
+static void
+list_push_head(struct cachesim *cs, enum cachesim_list_id id, gfarm_int32_t i)
+{
+	struct cachesim_node *n = &cs->nodes[i];
+	struct cachesim_list *l = &cs->lists[id];
+
+	n->list = id;
+	n->prev = NIL;
+	n->next = l->head;
+	if (l->head == NIL)
+		l->tail = i;
+	else
+		cs->nodes[l->head].prev = i;
+	l->head = i;
+	l->n++;
+}
+
+static void
+list_move_head(struct cachesim *cs, enum cachesim_list_id id, gfarm_int32_t i)
+{
+	list_remove(cs, i);
+	list_push_head(cs, id, i);
+}
+
+static gfarm_int32_t
+list_tail(struct cachesim *cs, enum cachesim_list_id id)
+{
+	return (cs->lists[id].tail);
+}
+
+static gfarm_int32_t
+list_size(struct cachesim *cs, enum cachesim_list_id id)
+{
+	return (cs->lists[id].n);
+}
+
+/*
+ * hash table operations
+ */
+
+static gfarm_int32_t
+hash_bucket(struct cachesim *cs,
+	gfarm_ino_t ino, gfarm_uint64_t gen, gfarm_uint64_t page)
+{
+	gfarm_uint64_t h;
+
+	h = (gfarm_uint64_t)ino * 0x9e3779b97f4a7c15ULL;
+	h ^= (gen + (h << 6) + (h >> 2)) * 0xc2b2ae3d27d4eb4fULL;
+	h ^= (page + (h << 6) + (h >> 2)) * 0x165667b19e3779f9ULL;
+	h ^= h >> 29;
+	return (h & (cs->nbuckets - 1));
+}
+
+static gfarm_int32_t
+hash_lookup(struct cachesim *cs,
+	gfarm_ino_t ino, gfarm_uint64_t gen, gfarm_uint64_t page)
+{
+	gfarm_int32_t i;
+	struct cachesim_node *n;
+
+	for (i = cs->buckets[hash_bucket(cs, ino, gen, page)]; i != NIL;
+	    i = n->hnext) {
+		n = &cs->nodes[i];
+		if (n->ino == ino && n->gen == gen && n->page == page)
+			return (i);
+	}
+	return (NIL);
+}
+
+static void
+hash_remove(struct cachesim *cs, gfarm_int32_t i)
+{
+	struct cachesim_node *n = &cs->nodes[i];
+	gfarm_int32_t *ip;
+
+	for (ip = &cs->buckets[hash_bucket(cs, n->ino, n->gen, n->page)];
+	    *ip != NIL; ip = &cs->nodes[*ip].hnext) {
+		if (*ip == i) {
+			*ip = n->hnext;
+			return;
+		}
+	}
+	gflog_fatal(GFARM_MSG_UNFIXED, "cachesim: node %d not in hash", i);
+}
+
+/*
+ * node allocation
+ */
+
+static gfarm_int32_t
+node_alloc(struct cachesim *cs, enum cachesim_list_id id,
+	gfarm_ino_t ino, gfarm_uint64_t gen, gfarm_uint64_t page)
+{
+	gfarm_int32_t i = list_tail(cs, CACHESIM_FREE), *bp;
+	struct cachesim_node *n;
+
+	if (i == NIL) /* shouldn't happen */
+		gflog_fatal(GFARM_MSG_UNFIXED, "cachesim: no free node");
+	n = &cs->nodes[i];
+	list_move_head(cs, id, i);
+	n->ino = ino;
+	n->gen = gen;
+	n->page = page;
+	n->ref = 0;
+	bp = &cs->buckets[hash_bucket(cs, ino, gen, page)];
+	n->hnext = *bp;
+	*bp = i;
+	return (i);
+}
+
+static void
+node_free(struct cachesim *cs, gfarm_int32_t i)
+{
+	hash_remove(cs, i);
+	list_move_head(cs, CACHESIM_FREE, i);
+}
+
+/* evict the LRU node of the list, if any */
+static void
+evict_tail(struct cachesim *cs, enum cachesim_list_id id)
+{
+	gfarm_int32_t i = list_tail(cs, id);
+
+	if (i != NIL)
+		node_free(cs, i);
+}
+
+/* move the LRU node of the list to MRU of another list, if any */
+static void
+demote_tail(struct cachesim *cs,
+	enum cachesim_list_id from, enum cachesim_list_id to)
+{
+	gfarm_int32_t i = list_tail(cs, from);
+
+	if (i != NIL)
+		list_move_head(cs, to, i);
+}
+
+/*
+ * replacement policies.
+ * each returns 1 on a cache hit, 0 on a miss.
+ */
+
+static int
+lru_access(struct cachesim *cs, gfarm_int32_t i,
+	gfarm_ino_t ino, gfarm_uint64_t gen, gfarm_uint64_t page)
+{
+	if (i != NIL) {
+		list_move_head(cs, CACHESIM_RESIDENT, i);
+		return (1);
+	}
+	if (list_size(cs, CACHESIM_RESIDENT) >= cs->capacity)
+		evict_tail(cs, CACHESIM_RESIDENT);
+	node_alloc(cs, CACHESIM_RESIDENT, ino, gen, page);
+	return (0);
+}
+
+static int
+clock_access(struct cachesim *cs, gfarm_int32_t i,
+	gfarm_ino_t ino, gfarm_uint64_t gen, gfarm_uint64_t page)
+{
+	if (i != NIL) {
+		cs->nodes[i].ref = 1;
+		return (1);
+	}
+	/* the tail is the clock hand, referenced pages get second chance */
+	while (list_size(cs, CACHESIM_RESIDENT) >= cs->capacity) {
+		i = list_tail(cs, CACHESIM_RESIDENT);
+		if (cs->nodes[i].ref) {
+			cs->nodes[i].ref = 0;
+			list_move_head(cs, CACHESIM_RESIDENT, i);
+		} else {
+			node_free(cs, i);
+		}
+	}
+	node_alloc(cs, CACHESIM_RESIDENT, ino, gen, page);
+	return (0);
+}
+
+#define TWOQ_KIN(cs)	((cs)->capacity / 4 > 0 ? (cs)->capacity / 4 : 1)
+#define TWOQ_KOUT(cs)	((cs)->capacity / 2 > 0 ? (cs)->capacity / 2 : 1)
+
+static void
+twoq_reclaim(struct cachesim *cs)
+{
+	if (list_size(cs, CACHESIM_A1IN) + list_size(cs, CACHESIM_AM) <
+	    cs->capacity)
+		return;
+	if (list_size(cs, CACHESIM_A1IN) > TWOQ_KIN(cs) ||
+	    list_size(cs, CACHESIM_AM) == 0) {
+		demote_tail(cs, CACHESIM_A1IN, CACHESIM_A1OUT);
+		if (list_size(cs, CACHESIM_A1OUT) > TWOQ_KOUT(cs))
+			evict_tail(cs, CACHESIM_A1OUT);
+	} else {
+		evict_tail(cs, CACHESIM_AM);
+	}
+}
+
+static int
+twoq_access(struct cachesim *cs, gfarm_int32_t i,
+	gfarm_ino_t ino, gfarm_uint64_t gen, gfarm_uint64_t page)
+{
+	if (i != NIL) {
+		switch (cs->nodes[i].list) {
+		case CACHESIM_AM:
+			list_move_head(cs, CACHESIM_AM, i);
+			return (1);
+		case CACHESIM_A1IN:
+			return (1);
+		default: /* CACHESIM_A1OUT */
+			/* detach from A1out not to be evicted by reclaim */
+			list_remove(cs, i);
+			twoq_reclaim(cs);
+			list_push_head(cs, CACHESIM_AM, i);
+			return (0);
+		}
+	}
+	twoq_reclaim(cs);
+	node_alloc(cs, CACHESIM_A1IN, ino, gen, page);
+	return (0);
+}
+
+static void
+arc_replace(struct cachesim *cs, int in_b2)
+{
+	gfarm_int32_t t1 = list_size(cs, CACHESIM_T1);
+
+	if (t1 > 0 &&
+	    (t1 > cs->arc_p || (in_b2 && t1 == cs->arc_p)))
+		demote_tail(cs, CACHESIM_T1, CACHESIM_B1);
+	else if (list_size(cs, CACHESIM_T2) > 0)
+		demote_tail(cs, CACHESIM_T2, CACHESIM_B2);
+	else
+		demote_tail(cs, CACHESIM_T1, CACHESIM_B1);
+}
+
+static int
+arc_access(struct cachesim *cs, gfarm_int32_t i,
+	gfarm_ino_t ino, gfarm_uint64_t gen, gfarm_uint64_t page)
+{
+	gfarm_int32_t c = cs->capacity, delta;
+	gfarm_int32_t t1, t2, b1, b2;
+
+	if (i != NIL) {
+		b1 = list_size(cs, CACHESIM_B1);
+		b2 = list_size(cs, CACHESIM_B2);
+		switch (cs->nodes[i].list) {
+		case CACHESIM_T1:
+		case CACHESIM_T2:
+			list_move_head(cs, CACHESIM_T2, i);
+			return (1);
+		case CACHESIM_B1:
+			delta = b2 > b1 ? b2 / b1 : 1;
+			cs->arc_p = cs->arc_p + delta < c ? cs->arc_p + delta : c;
+			arc_replace(cs, 0);
+			list_move_head(cs, CACHESIM_T2, i);
+			return (0);
+		default: /* CACHESIM_B2 */
+			delta = b1 > b2 ? b1 / b2 : 1;
+			cs->arc_p = cs->arc_p - delta > 0 ? cs->arc_p - delta : 0;
+			arc_replace(cs, 1);
+			list_move_head(cs, CACHESIM_T2, i);
+			return (0);
+		}
+	}
+
+	t1 = list_size(cs, CACHESIM_T1);
+	t2 = list_size(cs, CACHESIM_T2);
+	b1 = list_size(cs, CACHESIM_B1);
+	b2 = list_size(cs, CACHESIM_B2);
+	if (t1 + b1 >= c) {
+		if (t1 < c) {
+			evict_tail(cs, CACHESIM_B1);
+			arc_replace(cs, 0);
+		} else {
+			evict_tail(cs, CACHESIM_T1);
+		}
+	} else if (t1 + t2 + b1 + b2 >= c) {
+		if (t1 + t2 + b1 + b2 >= 2 * c)
+			evict_tail(cs, CACHESIM_B2);
+		arc_replace(cs, 0);
+	}
+	node_alloc(cs, CACHESIM_T1, ino, gen, page);
+	return (0);
+}
+
+static void
+cachesim_reset(struct cachesim *cs)
+{
+	gfarm_int32_t i;
+
+	for (i = 0; i < CACHESIM_NLISTS; i++) {
+		cs->lists[i].head = cs->lists[i].tail = NIL;
+		cs->lists[i].n = 0;
+	}
+	for (i = 0; i < cs->nbuckets; i++)
+		cs->buckets[i] = NIL;
+	for (i = 0; i < cs->nnodes; i++)
+		list_push_head(cs, CACHESIM_FREE, i);
+	cs->arc_p = 0;
+}
+
+gfarm_error_t
+gfsd_cachesim_init(enum gfsd_cachesim_policy policy, gfarm_int32_t capacity)
+{
+	struct cachesim *cs;
+	pthread_mutexattr_t attr;
+	gfarm_int32_t nnodes, nbuckets;
+	size_t size;
+	void *addr;
+	int err;
+
+	if (capacity <= 0 || capacity > INT_MAX / 4)
+		return (GFARM_ERR_INVALID_ARGUMENT);
+	/* ghost entries of 2Q and ARC need at most another capacity */
+	nnodes = capacity * 2;
+	for (nbuckets = 1; nbuckets < nnodes; nbuckets <<= 1)
+		;
+	size = sizeof(*cs) + sizeof(*cs->buckets) * nbuckets +
+	    sizeof(*cs->nodes) * nnodes;
+	addr = mmap(NULL, size, PROT_READ|PROT_WRITE,
+	    MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+	if (addr == MAP_FAILED) {
+		int save_errno = errno;
+
+		gflog_error(GFARM_MSG_UNFIXED, "cachesim: mmap %zu bytes: %s",
+		    size, strerror(save_errno));
+		return (gfarm_errno_to_error(save_errno));
+	}
+	cs = addr;
+	if ((err = pthread_mutexattr_init(&attr)) != 0 ||
+	    (err = pthread_mutexattr_setpshared(&attr,
+	    PTHREAD_PROCESS_SHARED)) != 0 ||
+	    (err = pthread_mutex_init(&cs->mutex, &attr)) != 0) {
+		gflog_error(GFARM_MSG_UNFIXED, "cachesim: mutex: %s",
+		    strerror(err));
+		munmap(addr, size);
+		return (gfarm_errno_to_error(err));
+	}
+	pthread_mutexattr_destroy(&attr);
+
+	cs->policy = policy;
+	cs->capacity = capacity;
+	cs->nnodes = nnodes;
+	cs->nbuckets = nbuckets;
+	cs->buckets = (gfarm_int32_t *)(cs + 1);
+	cs->nodes = (struct cachesim_node *)(cs->buckets + nbuckets);
+	cachesim_reset(cs);
+	cachesim = cs;
+
+	gflog_debug(GFARM_MSG_UNFIXED, "cachesim: %s, %d pages",
+	    gfsd_cachesim_policy_name(policy), capacity);
+	return (GFARM_ERR_NO_ERROR);
+}
+
+/* returns 1 if the page is in the simulated cache, and records the access */
+int
+gfsd_cachesim_access(gfarm_ino_t ino, gfarm_uint64_t gen, gfarm_uint64_t page)
+{
+	struct cachesim *cs = cachesim;
+	gfarm_int32_t i;
+	int hit;
+	static const char diag[] = "gfsd_cachesim_access";
+
+	if (cs == NULL)
+		return (0);
+
+	gfarm_mutex_lock(&cs->mutex, diag, diag_mutex);
+	i = hash_lookup(cs, ino, gen, page);
+	switch (cs->policy) {
+	case GFSD_CACHESIM_CLOCK:
+		hit = clock_access(cs, i, ino, gen, page);
+		break;
+	case GFSD_CACHESIM_2Q:
+		hit = twoq_access(cs, i, ino, gen, page);
+		break;
+	case GFSD_CACHESIM_ARC:
+		hit = arc_access(cs, i, ino, gen, page);
+		break;
+	default:
+		hit = lru_access(cs, i, ino, gen, page);
+		break;
+	}
+	gfarm_mutex_unlock(&cs->mutex, diag, diag_mutex);
+	return (hit);
+}
+
+void
+gfsd_cachesim_clear(void)
+{
+	struct cachesim *cs = cachesim;
+	static const char diag[] = "gfsd_cachesim_clear";
+
+	if (cs == NULL)
+		return;
+
+	gfarm_mutex_lock(&cs->mutex, diag, diag_mutex);
+	cachesim_reset(cs);
+	gfarm_mutex_unlock(&cs->mutex, diag, diag_mutex);
+}
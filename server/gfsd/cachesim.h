@@ -0,0 +1,19 @@
+/*
+ * simulated page cache shared among all gfsd processes,
+ * to estimate the cache hit rate of clients
+ */
+
+enum gfsd_cachesim_policy {
+	GFSD_CACHESIM_LRU,
+	GFSD_CACHESIM_CLOCK,
+	GFSD_CACHESIM_2Q,
+	GFSD_CACHESIM_ARC
+};
+
+gfarm_error_t gfsd_cachesim_policy_by_name(const char *,
+	enum gfsd_cachesim_policy *);
+const char *gfsd_cachesim_policy_name(enum gfsd_cachesim_policy);
+
+gfarm_error_t gfsd_cachesim_init(enum gfsd_cachesim_policy, gfarm_int32_t);
+int gfsd_cachesim_access(gfarm_ino_t, gfarm_uint64_t, gfarm_uint64_t);
+void gfsd_cachesim_clear(void);
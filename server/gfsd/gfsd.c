@@ -21,6 +21,7 @@
 #include <syslog.h>
 #include <stdarg.h>
 #include <signal.h>
+#include <setjmp.h>
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -28,7 +29,6 @@
 #include <time.h>
 #include <pwd.h>
 #include <libgen.h>
-#include <sqlite3.h>
 
 #if defined(SCM_RIGHTS) && \
 		(!defined(sun) || (!defined(__svr4__) && !defined(__SVR4)))
@@ -76,6 +76,9 @@
 #include "iostat.h"
 
 #include "gfsd_subr.h"
+#include "cachesim.h"
+#include "histgram.h"
+#include "gfsd_event.h"
 
 #define COMPAT_OLD_GFS_PROTOCOL
 
@@ -104,6 +107,9 @@
 #define GFMD_CONNECT_SLEEP_LOG_OMIT	11	/* log until 512 sec */
 #define GFMD_CONNECT_SLEEP_LOG_INTERVAL	86400	/* 1 day */
 
+#define HISTGRAM_WRITER_RESTART_INTVL_MIN	1	/* 1 sec */
+#define HISTGRAM_WRITER_RESTART_INTVL_MAX	64	/* about 1 min */
+
 #define fatal_errno(msg_no, ...) \
 	fatal_errno_full(msg_no, __FILE__, __LINE__, __func__, __VA_ARGS__)
 #define accepting_fatal(msg_no, ...) \
@@ -121,15 +127,17 @@ pid_t master_gfsd_pid;
 pid_t back_channel_gfsd_pid;
 uid_t gfsd_uid = -1;
 
-#define ATTACH_GFSD_DATABASE        "file:memdb1?mode=memory&cache=shared"
-#define READ_HISTGRAM_GRANULARITY   (1ULL * 1024 * 1024)
-//#define READ_HISTGRAM_GRANULARITY   (4ULL * 1024)
-#define ALLCLIENTS_CACHE_SIZE       (10ULL * 1024 * 1024 * 1024)
-sqlite3 *gfsd_db = NULL;
+pid_t histgram_writer_pid = -1;
+static time_t histgram_writer_start_time;
+static time_t histgram_writer_restart_time; /* 0: restart is not scheduled */
+static int histgram_writer_restart_intvl;
+pid_t event_server_pid = -1;
+/* the address of the client being served, for the histgram */
+static GFSD_CLIENT_STATE gfarm_uint32_t histgram_client;
 
-struct gfm_connection *gfm_server;
+GFSD_CLIENT_STATE struct gfm_connection *gfm_server;
 char *canonical_self_name;
-char *username; /* gfarm global user name */
+GFSD_CLIENT_STATE char *username; /* gfarm global user name */
 
 int gfarm_spool_root_len;
 
@@ -146,6 +154,12 @@ static struct gfarm_iostat_spec iostat_spec[] =  {
 	{ "rbytes", GFARM_IOSTAT_TYPE_TOTAL },
 	{ "wbytes", GFARM_IOSTAT_TYPE_TOTAL },
 };
+static struct gfarm_iostat_spec histgram_iostat_spec[] =  {
+	{ "queued", GFARM_IOSTAT_TYPE_CURRENT },
+	{ "dropped", GFARM_IOSTAT_TYPE_TOTAL },
+	{ "events", GFARM_IOSTAT_TYPE_TOTAL },
+	{ "flushed", GFARM_IOSTAT_TYPE_TOTAL },
+};
 static char *iostat_dirbuf;
 static int iostat_dirlen;
 
@@ -154,8 +168,22 @@ static volatile sig_atomic_t terminate_flag = 0;
 
 static char *listen_addrname = NULL;
 
-static int fd_usable_to_gfmd = 1;
-static int client_failover_count; /* may be use in the future implement */
+static GFSD_CLIENT_STATE int fd_usable_to_gfmd = 1;
+/* may be use in the future implement */
+static GFSD_CLIENT_STATE int client_failover_count;
+
+/*
+ * set while a session is served in the event-driven mode.
+ * fatal() terminates only the session, instead of the process.
+ */
+static GFSD_CLIENT_STATE jmp_buf *session_abort;
+/*
+ * an error of the connection to the client, which is set instead of
+ * calling fatal() after a request handler may have allocated something.
+ * server_request() closes the session by this, after the handler returns.
+ */
+static GFSD_CLIENT_STATE gfarm_error_t session_error = GFARM_ERR_NO_ERROR;
+static int in_event_server; /* set 1 in the event-driven server */
 
 static int shutting_down; /* set 1 at shutting down */
 
@@ -193,6 +221,8 @@ cleanup_iostat(void)
 		(void) unlink(iostat_dirbuf);
 		strcpy(&iostat_dirbuf[iostat_dirlen], "bcs");
 		(void) unlink(iostat_dirbuf);
+		strcpy(&iostat_dirbuf[iostat_dirlen], "histgram");
+		(void) unlink(iostat_dirbuf);
 		free(iostat_dirbuf);
 		iostat_dirbuf = NULL;
 	}
@@ -222,6 +252,15 @@ cleanup(int sighandler)
 		if (kill(back_channel_gfsd_pid, SIGTERM) == -1 && !sighandler)
 			gflog_warning_errno(GFARM_MSG_1002377,
 			    "kill(%ld)", (long)back_channel_gfsd_pid);
+		/* the histgram writer flushes the histgram, and exits */
+		if (histgram_writer_pid != -1 &&
+		    kill(histgram_writer_pid, SIGTERM) == -1 && !sighandler)
+			gflog_warning_errno(GFARM_MSG_UNFIXED,
+			    "kill(%ld)", (long)histgram_writer_pid);
+		if (event_server_pid != -1 &&
+		    kill(event_server_pid, SIGTERM) == -1 && !sighandler)
+			gflog_warning_errno(GFARM_MSG_UNFIXED,
+			    "kill(%ld)", (long)event_server_pid);
 		cleanup_iostat();
 	}
 
@@ -234,9 +273,6 @@ cleanup(int sighandler)
 		gflog_notice(GFARM_MSG_1000451, "disconnected");
 	}
 
-	if (gfsd_db) {
-		gfp_free_histgram(gfsd_db);
-	}
 }
 
 static void
@@ -261,6 +297,13 @@ fatal_full(int msg_no, const char *file, int line_no, const char *func,
 	gflog_vmessage(msg_no, LOG_ERR, file, line_no, func, format, ap);
 	va_end(ap);
 
+	if (session_abort != NULL && !kill_master_gfsd) {
+		jmp_buf *abort = session_abort;
+
+		session_abort = NULL;
+		longjmp(*abort, 1); /* see gfsd_session_serve() */
+	}
+
 	if (!shutting_down) {
 		shutting_down = 1;
 		cleanup(0);
@@ -546,12 +589,34 @@ gfs_server_get_request(struct gfp_xdr *client, size_t size, const char *diag,
 	e = gfp_xdr_vrecv_request_parameters(client, 0, &size, format, &ap);
 	va_end(ap);
 
-	/* XXX FIXME: should handle GFARM_ERR_NO_MEMORY gracefully */
+	/*
+	 * XXX FIXME: should handle GFARM_ERR_NO_MEMORY gracefully
+	 * this is called at the beginning of a request handler, and
+	 * parameters are freed by gfp_xdr_vrecv_request_parameters() on
+	 * error, thus fatal() in the event-driven mode doesn't leak memory.
+	 */
 	if (e != GFARM_ERR_NO_ERROR)
 		fatal(GFARM_MSG_1000455, "%s get request: %s",
 		    diag, gfarm_error_string(e));
 }
 
+/*
+ * fatal() for a failure to send a reply to the client.
+ * while a session is served in the event-driven mode, the session is
+ * closed after the request handler returns, so that it can free its memory.
+ */
+static void
+gfs_server_put_reply_fatal(const char *diag, gfarm_error_t e)
+{
+	if (session_abort == NULL)
+		fatal(GFARM_MSG_1000459, "%s put reply: %s",
+		    diag, gfarm_error_string(e));
+	gflog_error(GFARM_MSG_UNFIXED, "%s put reply: %s",
+	    diag, gfarm_error_string(e));
+	if (session_error == GFARM_ERR_NO_ERROR)
+		session_error = e;
+}
+
 void
 gfs_server_put_reply_common(struct gfp_xdr *client, gfp_xdr_xid_t xid,
 	const char *diag,
@@ -568,8 +633,7 @@ gfs_server_put_reply_common(struct gfp_xdr *client, gfp_xdr_xid_t xid,
 	if (e == GFARM_ERR_NO_ERROR)
 		e = gfp_xdr_flush(client);
 	if (e != GFARM_ERR_NO_ERROR)
-		fatal(GFARM_MSG_1000459, "%s put reply: %s",
-		    diag, gfarm_error_string(e));
+		gfs_server_put_reply_fatal(diag, e);
 
 	/* if input/output error occurs, die */
 	if (ecode == GFARM_ERR_INPUT_OUTPUT) {
@@ -834,7 +898,8 @@ gfs_server_process_reset(struct gfp_xdr *client, gfp_xdr_xid_t xid, size_t size)
 	gfs_server_put_reply(client, xid, diag, e, "");
 }
 
-int file_table_size = 0;
+static int file_table_limit = 0;
+GFSD_CLIENT_STATE int file_table_size = 0;
 
 struct file_entry {
 	off_t size;
@@ -855,7 +920,8 @@ struct file_entry {
 	unsigned nwrite, nread;
 	double write_time, read_time;
 	gfarm_off_t write_size, read_size;
-} *file_table;
+};
+static GFSD_CLIENT_STATE struct file_entry *file_table;
 
 static void
 file_entry_set_atime(struct file_entry *fe,
@@ -882,27 +948,59 @@ file_entry_set_size(struct file_entry *fe, gfarm_off_t size)
 	fe->size = size;
 }
 
+/*
+ * the table is grown on demand up to table_size entries,
+ * because most clients use only a few descriptors.
+ */
 void
 file_table_init(int table_size)
 {
-	int i;
+	file_table_limit = table_size;
+	file_table = NULL;
+	file_table_size = 0;
+}
 
-	GFARM_MALLOC_ARRAY(file_table, table_size);
-	if (file_table == NULL) {
-		errno = ENOMEM; fatal_errno(GFARM_MSG_1000462, "file table");
+static int
+file_table_grow(int min_size)
+{
+	struct file_entry *t;
+	int i, size = file_table_size * 2;
+
+	if (size < min_size)
+		size = min_size;
+	if (size < 16)
+		size = 16;
+	if (size > file_table_limit)
+		size = file_table_limit;
+	GFARM_REALLOC_ARRAY(t, file_table, size);
+	if (t == NULL) {
+		gflog_error(GFARM_MSG_UNFIXED,
+		    "file table: no memory for %d entries", size);
+		return (0);
 	}
-	for (i = 0; i < table_size; i++)
-		file_table[i].local_fd = -1;
-	file_table_size = table_size;
+	for (i = file_table_size; i < size; i++)
+		t[i].local_fd = -1;
+	file_table = t;
+	file_table_size = size;
+	return (1);
+}
+
+static void
+file_table_free(void)
+{
+	free(file_table);
+	file_table = NULL;
+	file_table_size = 0;
 }
 
 int
 file_table_is_available(gfarm_int32_t net_fd)
 {
-	if (0 <= net_fd && net_fd < file_table_size)
-		return (file_table[net_fd].local_fd == -1);
-	else
+	if (net_fd < 0 || net_fd >= file_table_limit)
+		return (0);
+	if (net_fd >= file_table_size && !file_table_grow(net_fd + 1))
 		return (0);
+	return (file_table[net_fd].local_fd == -1);
 }
 
 void
@@ -924,7 +1022,7 @@ file_table_add(gfarm_int32_t net_fd, int local_fd, int flags, gfarm_ino_t ino,
 		fe->flags |= FILE_FLAG_WRITTEN;
 	if ((flags & O_ACCMODE) != O_RDONLY) {
 		fe->flags |= FILE_FLAG_WRITABLE;
-		++write_open_count;
+		__sync_add_and_fetch(&write_open_count, 1);
 	}
 	fe->atime = st.st_atime;
 	fe->atimensec = gfarm_stat_atime_nsec(&st);
@@ -1001,8 +1099,8 @@ file_table_close(gfarm_int32_t net_fd)
 		    fe->nread, (long long)fe->read_size, fe->read_time));
 
 	if ((fe->flags & FILE_FLAG_WRITABLE) != 0) {
-		--write_open_count;
-		if (terminate_flag && write_open_count == 0) {
+		if (__sync_sub_and_fetch(&write_open_count, 1) == 0 &&
+		    terminate_flag && !in_event_server) {
 			gflog_debug(GFARM_MSG_1003432, "bye");
 			cleanup(0);
 			exit(2);
@@ -1115,12 +1213,10 @@ gfsd_local_path(gfarm_ino_t inum, gfarm_uint64_t gen, const char *diag,
 	char **pathp)
 {
 	char *p;
-	static int length = 0;
-	static char template[] = "/data/00112233/44/55/66/778899AABBCCDDEEFF";
+	static const char template[] =
+	    "/data/00112233/44/55/66/778899AABBCCDDEEFF";
 #define DIRLEVEL 5 /* there are 5 levels of directories in template[] */
-
-	if (length == 0)
-		length = gfarm_spool_root_len + sizeof(template);
+	int length = gfarm_spool_root_len + sizeof(template);
 
 	GFARM_MALLOC_ARRAY(p, length);
 	if (p == NULL) {
@@ -1915,7 +2011,7 @@ close_all_fd_for_process_reset(void)
 #define REPLICATION_LOCAL_FD_CLOSED	-1
 
 /* only 1 fd is usable for now */
-int replication_local_fd = REPLICATION_LOCAL_FD_CLOSED;
+GFSD_CLIENT_STATE int replication_local_fd = REPLICATION_LOCAL_FD_CLOSED;
 
 void
 gfs_server_close(struct gfp_xdr *client, gfp_xdr_xid_t xid, size_t size)
@@ -1945,14 +2041,82 @@ gfs_server_close(struct gfp_xdr *client, gfp_xdr_xid_t xid, size_t size)
 	gfs_server_put_reply(client, xid, diag, e, "");
 }
 
+/*
+ * send the reply of GFS_PROTO_PREAD without copying the data,
+ * if the connection is not encrypted.
+ * returns -1 and sets errno, if the reply has not been sent.
+ */
+static ssize_t
+gfs_server_pread_sendfile(struct gfp_xdr *client, gfp_xdr_xid_t xid,
+	int local_fd, gfarm_int32_t iosize, gfarm_int64_t offset)
+{
+	gfarm_error_t e;
+	struct stat st;
+	size_t size = 0, filled;
+	ssize_t len;
+	int flags;
+
+	if (iosize < 0 || offset < 0) {
+		errno = EINVAL;
+		return (-1);
+	}
+	/* errors have to be detected before sending the reply header */
+	if ((flags = fcntl(local_fd, F_GETFL)) == -1)
+		return (-1);
+	if ((flags & O_ACCMODE) == O_WRONLY) {
+		errno = EBADF;
+		return (-1);
+	}
+	if (fstat(local_fd, &st) == -1)
+		return (-1);
+	if (offset >= st.st_size)
+		len = 0;
+	else if (st.st_size - offset < iosize)
+		len = st.st_size - offset;
+	else
+		len = iosize;
+
+	/* same as gfs_server_put_reply(..., "b", len, buffer) */
+	e = gfp_xdr_send_size_add(&size, "ii", GFARM_ERR_NO_ERROR, len);
+	if (e == GFARM_ERR_NO_ERROR)
+		e = gfp_xdr_send_async_result_header(client, xid, size + len);
+	if (e == GFARM_ERR_NO_ERROR)
+		e = gfp_xdr_send(client, "ii", GFARM_ERR_NO_ERROR, len);
+	if (e == GFARM_ERR_NO_ERROR && len > 0) {
+		e = gfp_xdr_send_file_range(client, local_fd, offset, len,
+		    &filled);
+		/*
+		 * the file may be truncated concurrently after fstat(),
+		 * the rest is filled with zeros in that case.
+		 */
+		if (e == GFARM_ERR_NO_ERROR && filled < len) {
+			gflog_info(GFARM_MSG_UNFIXED,
+			    "pread: file shrank during read, "
+			    "%lld bytes at %lld are filled with zeros",
+			    (long long)(len - filled),
+			    (long long)(offset + filled));
+			len = filled;
+		}
+	}
+	if (e == GFARM_ERR_NO_ERROR)
+		e = gfp_xdr_flush(client);
+	/*
+	 * the reply may be partially sent, thus the connection is broken.
+	 * this only closes the connection to this client.
+	 */
+	if (e != GFARM_ERR_NO_ERROR)
+		gfs_server_put_reply_fatal("pread", e);
+	return (len);
+}
+
 void
 gfs_server_pread(struct gfp_xdr *client, gfp_xdr_xid_t xid, size_t size)
 {
-	static gfarm_uint64_t culm_iosize = 0;
+	static GFSD_CLIENT_STATE gfarm_uint64_t culm_iosize = 0;
 	gfarm_int32_t fd, iosize;
 	gfarm_int64_t offset;
 	ssize_t rv;
-	int local_fd, save_errno = 0;
+	int local_fd, save_errno = 0, replied = 0;
 	char buffer[GFS_PROTO_MAX_IOSIZE];
 	struct file_entry *fe;
 	gfarm_timerval_t t1, t2;
@@ -1977,18 +2141,22 @@ gfs_server_pread(struct gfp_xdr *client, gfp_xdr_xid_t xid, size_t size)
 	gflog_debug(GFARM_MSG_UNFIXED, 
 				"AAAAAAAAAAAAAAAA = %llu", culm_iosize);
 
-	fe = file_table_entry(fd);
-	gfp_count_client_cachehits_by_naive_lru(gfsd_db, client,
-	   fe->ino, fe->gen, offset, iosize, READ_HISTGRAM_GRANULARITY, ALLCLIENTS_CACHE_SIZE);
-
-	gfp_update_reads_histgram(gfsd_db, client, fe->ino, fe->gen,
-				  offset, iosize, READ_HISTGRAM_GRANULARITY);
-	
+	rv = 0;
+	if (gfarm_spool_server_sendfile) {
+		if ((rv = gfs_server_pread_sendfile(client, xid,
+		    local_fd, iosize, offset)) == -1) {
+			save_errno = errno;
+			rv = 0;
+		} else {
+			replied = 1;
+			if (fd != REPLICATION_REMOTE_FD)
+				file_table_set_read(fd);
+		}
+	}
 #if 0 /* XXX FIXME: pread(2) on NetBSD-3.0_BETA is broken */
-	if ((rv = pread(local_fd, buffer, iosize, offset)) == -1)
+	else if ((rv = pread(local_fd, buffer, iosize, offset)) == -1)
 #else
-	rv = 0;
-	if (lseek(local_fd, offset, SEEK_SET) == -1)
+	else if (lseek(local_fd, offset, SEEK_SET) == -1)
 		save_errno = errno;
 	else if ((rv = read(local_fd, buffer, iosize)) == -1)
 #endif
@@ -1999,6 +2167,10 @@ gfs_server_pread(struct gfp_xdr *client, gfp_xdr_xid_t xid, size_t size)
 	if (rv > 0) {
 		gfarm_iostat_local_add(GFARM_IOSTAT_IO_RCOUNT, 1);
 		gfarm_iostat_local_add(GFARM_IOSTAT_IO_RBYTES, rv);
+		if (fd != REPLICATION_REMOTE_FD &&
+		    (fe = file_table_entry(fd)) != NULL)
+			gfsd_histgram_enqueue_read(histgram_client,
+			    fe->ino, fe->gen, offset, rv);
 	}
 	gfs_profile(
 		gfarm_gettimerval(&t2);
@@ -2011,8 +2183,9 @@ gfs_server_pread(struct gfp_xdr *client, gfp_xdr_xid_t xid, size_t size)
 			}
 		});
 
-	gfs_server_put_reply_with_errno(client, xid, "pread", save_errno,
-	    "b", rv, buffer);
+	if (!replied)
+		gfs_server_put_reply_with_errno(client, xid, "pread",
+		    save_errno, "b", rv, buffer);
 }
 
 void
@@ -2269,25 +2442,29 @@ gfs_server_cksum_set(struct gfp_xdr *client, gfp_xdr_xid_t xid, size_t size)
 	gfs_server_put_reply(client, xid, diag, e, "");
 }
 
+/* set at startup, because worker threads of the event-driven mode use it */
+static char *readonly_config_path;
+
+static void
+readonly_mode_init(void)
+{
+	int length = gfarm_spool_root_len + 1 + sizeof(READONLY_CONFIG_FILE);
+	static const char diag[] = "readonly_mode_init";
+
+	GFARM_MALLOC_ARRAY(readonly_config_path, length);
+	if (readonly_config_path == NULL)
+		gflog_fatal(GFARM_MSG_1000503, "%s: no memory for %d bytes",
+		    diag, length);
+	snprintf(readonly_config_path, length, "%s/%s", gfarm_spool_root,
+	    READONLY_CONFIG_FILE);
+}
+
 static int
 is_readonly_mode(void)
 {
 	struct stat st;
-	int length;
-	static char *p = NULL;
-	static const char diag[] = "is_readonly_mode";
 
-	if (p == NULL) {
-		length = gfarm_spool_root_len + 1 +
-			sizeof(READONLY_CONFIG_FILE);
-		GFARM_MALLOC_ARRAY(p, length);
-		if (p == NULL)
-			fatal(GFARM_MSG_1000503, "%s: no memory for %d bytes",
-			    diag, length);
-		snprintf(p, length, "%s/%s", gfarm_spool_root,
-			 READONLY_CONFIG_FILE);
-	}		
-	return (stat(p, &st) == 0);
+	return (stat(readonly_config_path, &st) == 0);
 }
 
 void
@@ -2323,9 +2500,9 @@ gfs_server_statfs(struct gfp_xdr *client, gfp_xdr_xid_t xid, size_t size)
 void
 gfs_server_send_hitrates(struct gfp_xdr *client, gfp_xdr_xid_t xid, size_t size)
 {	
-	char *str;
+	gfarm_error_t e;
+	char *str = NULL;
 	int ret_size;
-	int save_errno = 0;
 	const char *diag = "sendhitrates";
 	
 	/*
@@ -2333,44 +2510,26 @@ gfs_server_send_hitrates(struct gfp_xdr *client, gfp_xdr_xid_t xid, size_t size)
 	 */
 	gflog_info(GFARM_MSG_UNFIXED, "send hitrate\n");
 	
-	save_errno = gfp_get_totalchit_and_total_read(gfsd_db, client,
-			diag, &str, &ret_size);
-	if (save_errno == GFARM_ERR_NO_ERROR) {
-		if (ret_size > 0) {
-			gfs_server_put_reply_with_errno(client, xid, diag, 
-			    save_errno, "s", str);
-			free(str);
-		} else {
-			char *nothing = "no clients";
-			gfs_server_put_reply_with_errno(client, xid, diag, 
-				save_errno, "s", nothing);
-		}
-	}
-	
+	e = gfsd_histgram_get_hitrates(&str, &ret_size);
+	if (e != GFARM_ERR_NO_ERROR)
+		gfs_server_put_reply(client, xid, diag, e, "");
+	else if (ret_size > 0)
+		gfs_server_put_reply(client, xid, diag, e, "s", str);
+	else
+		gfs_server_put_reply(client, xid, diag, e, "s", "no clients");
+	free(str);
 }
 
 /* Baysian */
 void
 gfs_server_clear_hitrates(struct gfp_xdr *client, gfp_xdr_xid_t xid, size_t size)
 {
-	char *dir;
-	int save_errno = 0;
-
-	/* save_errno = gfsd_statfs(gfarm_spool_root, &bsize, */
-	/*     &blocks, &bfree, &bavail, */
-	/*     &files, &ffree, &favail); */
-	/* free(dir); */
-
-	/* if (save_errno == 0 && is_readonly_mode()) { */
-	/* 	/\* pretend to be disk full, to make this gfsd read-only *\/ */
-	/* 	bavail -= bfree; */
-	/* 	bfree = 0; */
-	/* } */
-
+	gfsd_histgram_clear();
+	gfsd_cachesim_clear();
 	gflog_info(GFARM_MSG_UNFIXED, "hitrates was cleared\n");
 
-	save_errno = gfp_clear_totalchit_and_total_read(gfsd_db, client);
-	gfs_server_put_reply_with_errno(client, xid, "clearhitrates", save_errno, "");
+	gfs_server_put_reply(client, xid, "clearhitrates",
+	    GFARM_ERR_NO_ERROR, "");
 }
 
 static gfarm_error_t
@@ -2828,6 +2987,7 @@ struct replication_request {
 	gfp_xdr_xid_t xid;
 	gfarm_ino_t ino;
 	gfarm_int64_t gen;
+	gfarm_off_t size; /* -1, unless GFS_PROTO_REPLICATION_CHAIN_REQUEST */
 
 	/* the followings are only used when actual replication is ongoing */
 	struct gfs_connection *src_gfsd;
@@ -2908,8 +3068,14 @@ try_replication(struct gfp_xdr *conn, struct gfarm_hash_entry *q,
 			gfarm_iostat_set_local_ip(statp);
 		}
 		close(fds[0]);
-		e = gfs_client_replica_recv(src_gfsd, rep->ino, rep->gen,
-		    local_fd, &dst_err, &conn_err);
+		if (rep->size >= 0) /* the source may be still written */
+			e = gfs_client_replica_recv_chain(src_gfsd,
+			    rep->ino, rep->gen, rep->size,
+			    local_fd, &dst_err, &conn_err);
+		else
+			e = gfs_client_replica_recv(src_gfsd,
+			    rep->ino, rep->gen,
+			    local_fd, &dst_err, &conn_err);
 		if (e != GFARM_ERR_NO_ERROR) {
 			gflog_warning(GFARM_MSG_1003513,
 			    "%s: replica_recv %lld:%lld: %s",
@@ -3038,22 +3204,32 @@ start_replication(struct gfp_xdr *conn, struct gfarm_hash_entry *q)
 	return (GFARM_ERR_NO_ERROR); /* no gfmd_err */
 }
 
+/*
+ * GFS_PROTO_REPLICATION_CHAIN_REQUEST is same as
+ * GFS_PROTO_REPLICATION_REQUEST, except that the replica at the source
+ * may be still being replicated, and its final size is passed.
+ */
 gfarm_error_t
 gfs_async_server_replication_request(struct gfp_xdr *conn,
-	const char *user, gfp_xdr_xid_t xid, size_t size)
+	const char *user, gfp_xdr_xid_t xid, size_t size, int chain)
 {
 	gfarm_error_t e;
 	char *host;
 	gfarm_int32_t port;
 	gfarm_ino_t ino;
 	gfarm_uint64_t gen;
+	gfarm_off_t filesize = -1;
 	struct gfarm_hash_entry *q;
 	struct replication_queue_data *qd;
 	struct replication_request *rep;
 	static const char diag[] = "GFS_PROTO_REPLICATION_REQUEST";
 
-	e = gfs_async_server_get_request(conn, size, diag,
-	    "sill", &host, &port, &ino, &gen);
+	if (chain)
+		e = gfs_async_server_get_request(conn, size, diag,
+		    "silll", &host, &port, &ino, &gen, &filesize);
+	else
+		e = gfs_async_server_get_request(conn, size, diag,
+		    "sill", &host, &port, &ino, &gen);
 	if (e != GFARM_ERR_NO_ERROR)
 		return (e);
 
@@ -3076,6 +3252,7 @@ gfs_async_server_replication_request(struct gfp_xdr *conn,
 			rep->xid = xid;
 			rep->ino = ino;
 			rep->gen = gen;
+			rep->size = filesize;
 
 			/* not set yet, will be set in try_replication() */
 			rep->src_gfsd = NULL;
@@ -3690,6 +3867,9 @@ gfs_server_chdir(struct gfp_xdr *client)
 
 #endif /* not yet in gfarm v2 */
 
+static void start_event_server(void);
+static void histgram_writer_schedule_restart(void);
+
 static int got_sigchld;
 void
 sigchld_handler(int sig)
@@ -3707,26 +3887,47 @@ clear_child(void)
 		pid = waitpid(-1, &status, WNOHANG);
 		if (pid == -1 || pid == 0)
 			break;
+		if (pid == histgram_writer_pid) {
+			gflog_error(GFARM_MSG_UNFIXED,
+			    "histgram writer (pid %ld) exited, status 0x%x",
+			    (long)pid, status);
+			histgram_writer_pid = -1;
+			if (!shutting_down)
+				histgram_writer_schedule_restart();
+			continue;
+		}
 		gfarm_iostat_clear_id(pid, 0);
+		if (pid == event_server_pid) {
+			gflog_error(GFARM_MSG_UNFIXED,
+			    "event-driven server (pid %ld) exited, status 0x%x",
+			    (long)pid, status);
+			event_server_pid = -1;
+			if (!shutting_down)
+				start_event_server();
+		}
 	}
 }
 
-void
-server(int client_fd, char *client_name, struct sockaddr *client_addr)
+/*
+ * authorize a client.
+ * if set_aux is set, the client is recorded to the gflog auxiliary info,
+ * which is per process.
+ */
+static gfarm_error_t
+server_open(int client_fd, char *client_name, struct sockaddr *client_addr,
+	int set_aux, struct gfp_xdr **clientp,
+	enum gfarm_auth_id_type *peer_typep)
 {
 	gfarm_error_t e;
 	struct gfp_xdr *client;
-	int eof;
-	enum gfp_xdr_msg_type msg_type;
-	gfp_xdr_xid_t xid;
-	size_t size;
-	gfarm_int32_t request;
 	char *aux, addr_string[GFARM_SOCKADDR_STRLEN];
-	enum gfarm_auth_id_type peer_type;
 	enum gfarm_auth_method auth_method;
 
-	if ((e = connect_gfm_server()) != GFARM_ERR_NO_ERROR)
-		fatal(GFARM_MSG_1003361, "die");
+	if ((e = connect_gfm_server()) != GFARM_ERR_NO_ERROR) {
+		gflog_error(GFARM_MSG_1003361, "die");
+		close(client_fd);
+		return (e);
+	}
 
 	if (client_name == NULL) { /* i.e. not UNIX domain socket case */
 		char *s;
@@ -3739,9 +3940,12 @@ server(int client_fd, char *client_name, struct sockaddr *client_addr)
 			gflog_notice(GFARM_MSG_1000552, "%s: %s", addr_string,
 			    gfarm_error_string(e));
 			client_name = strdup(addr_string);
-			if (client_name == NULL)
-				fatal(GFARM_MSG_1000553, "%s: no memory",
-				    addr_string);
+			if (client_name == NULL) {
+				gflog_error(GFARM_MSG_1000553,
+				    "%s: no memory", addr_string);
+				close(client_fd);
+				return (GFARM_ERR_NO_MEMORY);
+			}
 		}
 		e = gfm_host_get_canonical_name(gfm_server, client_name,
 		    &s, &port);
@@ -3749,6 +3953,10 @@ server(int client_fd, char *client_name, struct sockaddr *client_addr)
 			free(client_name);
 			client_name = s;
 		}
+	} else if ((client_name = strdup(client_name)) == NULL) {
+		gflog_error(GFARM_MSG_UNFIXED, "no memory for client name");
+		close(client_fd);
+		return (GFARM_ERR_NO_MEMORY);
 	}
 
 #if 0 /* not yet in gfarm v2 */
@@ -3768,22 +3976,39 @@ server(int client_fd, char *client_name, struct sockaddr *client_addr)
 	e = gfp_xdr_new_socket(client_fd, &client);
 	if (e != GFARM_ERR_NO_ERROR) {
 		close(client_fd);
-		fatal(GFARM_MSG_1000554, "%s: gfp_xdr_new: %s",
+		gflog_error(GFARM_MSG_1000554, "%s: gfp_xdr_new: %s",
 		    client_name, gfarm_error_string(e));
+		free(client_name);
+		return (e);
 	}
 
 	e = gfarm_authorize(client, 0, GFS_SERVICE_TAG,
 	    client_name, client_addr,
 	    gfarm_auth_uid_to_global_username, gfm_server,
-	    &peer_type, &username, &auth_method);
-	if (e != GFARM_ERR_NO_ERROR)
-		fatal(GFARM_MSG_1000555, "%s: gfarm_authorize: %s",
+	    peer_typep, &username, &auth_method);
+	if (e != GFARM_ERR_NO_ERROR) {
+		gflog_error(GFARM_MSG_1000555, "%s: gfarm_authorize: %s",
 		    client_name, gfarm_error_string(e));
-	GFARM_MALLOC_ARRAY(aux, strlen(username)+1 + strlen(client_name)+1);
-	if (aux == NULL)
-		fatal(GFARM_MSG_1000556, "%s: no memory\n", client_name);
-	sprintf(aux, "%s@%s", username, client_name);
-	gflog_set_auxiliary_info(aux);
+		gfp_xdr_free(client);
+		free(client_name);
+		return (e);
+	}
+	if (set_aux) {
+		GFARM_MALLOC_ARRAY(aux,
+		    strlen(username)+1 + strlen(client_name)+1);
+		if (aux == NULL) {
+			gflog_error(GFARM_MSG_1000556, "%s: no memory\n",
+			    client_name);
+			gfp_xdr_free(client);
+			free(client_name);
+			return (GFARM_ERR_NO_MEMORY);
+		}
+		sprintf(aux, "%s@%s", username, client_name);
+		gflog_set_auxiliary_info(aux);
+	} else {
+		gflog_info(GFARM_MSG_UNFIXED, "%s@%s: connected",
+		    username, client_name);
+	}
 
 	/*
 	 * In GSI authentication, small packets are sent frequently,
@@ -3799,110 +4024,331 @@ server(int client_fd, char *client_name, struct sockaddr *client_addr)
 			    "specified, but fails: %s", gfarm_error_string(e));
 	}
 
-	//	gfp_record_client(gfsd_db, client, client_addr);
-	gfp_record_client_subquery(gfsd_db, client, client_addr);
+	histgram_client = (gfarm_uint32_t)
+	    ((struct sockaddr_in *)client_addr)->sin_addr.s_addr;
+	gfsd_histgram_record_client(histgram_client);
 
-	for (;;) {
-		e = gfp_xdr_recv_async_header(client, 0, 0,
-		    &msg_type, &xid, &size);
-		if (e != GFARM_ERR_NO_ERROR) {
-			if (e != GFARM_ERR_UNEXPECTED_EOF)
-				gflog_notice(GFARM_MSG_1004201,
-				    "receiving rpc header from a client: %s",
-				    gfarm_error_string(e));
-			/*
-			 * XXX FIXME update metadata of all opened
-			 * file descriptor before exit.
-			 */
-			cleanup(0);
-			exit(0);
-		}
-		if (msg_type != GFP_XDR_TYPE_REQUEST) {
-			fatal(GFARM_MSG_1004202,
-			    "receiving unexpected rpc header type: %d",
-			    (int)msg_type);
-		}
-		e = gfp_xdr_recv_sized(client, 0, 1, &size, &eof,
-		    "i", &request);
-		if (e != GFARM_ERR_NO_ERROR)
-			fatal(GFARM_MSG_1000557, "request number: %s",
+	free(client_name);
+	*clientp = client;
+	return (GFARM_ERR_NO_ERROR);
+}
+
+/*
+ * receive and serve one request.
+ * returns GFARM_ERR_UNEXPECTED_EOF if the client is disconnected,
+ * or another error if the connection cannot be used anymore.
+ */
+static gfarm_error_t
+server_request(struct gfp_xdr *client, enum gfarm_auth_id_type peer_type)
+{
+	gfarm_error_t e;
+	int eof;
+	enum gfp_xdr_msg_type msg_type;
+	gfp_xdr_xid_t xid;
+	size_t size;
+	gfarm_int32_t request;
+
+	/*
+	 * in the event-driven mode, a request is only received when it's
+	 * readable, and a client which stops sending in the middle of
+	 * a request shouldn't occupy a worker thread forever.
+	 */
+	e = gfp_xdr_recv_async_header(client, 0, in_event_server,
+	    &msg_type, &xid, &size);
+	if (e != GFARM_ERR_NO_ERROR) {
+		if (e != GFARM_ERR_UNEXPECTED_EOF)
+			gflog_notice(GFARM_MSG_1004201,
+			    "receiving rpc header from a client: %s",
 			    gfarm_error_string(e));
-		if (eof)
-			fatal(GFARM_MSG_1004203,
-			    "unexpected EOF while receiving request");
-		switch (request) {
-		case GFS_PROTO_PROCESS_SET:
-			gfs_server_process_set(client, xid, size); break;
-		case GFS_PROTO_PROCESS_RESET:
-			gfs_server_process_reset(client, xid, size); break;
-		case GFS_PROTO_OPEN_LOCAL:
-			gfs_server_open_local(client, xid, size); break;
-		case GFS_PROTO_OPEN:
-			gfs_server_open(client, xid, size); break;
-		case GFS_PROTO_CLOSE:
-			gfs_server_close(client, xid, size); break;
-		case GFS_PROTO_PREAD:
-			gfs_server_pread(client, xid, size); break;
-		case GFS_PROTO_PWRITE:
-			gfs_server_pwrite(client, xid, size); break;
-		case GFS_PROTO_WRITE:
-			gfs_server_write(client, xid, size); break;
-		case GFS_PROTO_FTRUNCATE:
-			gfs_server_ftruncate(client, xid, size); break;
-		case GFS_PROTO_FSYNC:
-			gfs_server_fsync(client, xid, size); break;
-		case GFS_PROTO_FSTAT:
-			gfs_server_fstat(client, xid, size); break;
-		case GFS_PROTO_CKSUM_SET:
-			gfs_server_cksum_set(client, xid, size); break;
-		case GFS_PROTO_STATFS:
-			gfs_server_statfs(client, xid, size); break;
-			/* for baysian hitrate */
-		case GFS_PROTO_HITRATES_GET:
-			gfs_server_send_hitrates(client, xid, size); break;
-		case GFS_PROTO_HITRATES_CLEAR:
-			gfs_server_clear_hitrates(client, xid, size); break;
+		return (GFARM_ERR_UNEXPECTED_EOF);
+	}
+	if (msg_type != GFP_XDR_TYPE_REQUEST) {
+		gflog_error(GFARM_MSG_1004202,
+		    "receiving unexpected rpc header type: %d",
+		    (int)msg_type);
+		return (GFARM_ERR_PROTOCOL);
+	}
+	e = gfp_xdr_recv_sized(client, 0, 1, &size, &eof,
+	    "i", &request);
+	if (e != GFARM_ERR_NO_ERROR) {
+		gflog_error(GFARM_MSG_1000557, "request number: %s",
+		    gfarm_error_string(e));
+		return (e);
+	}
+	if (eof) {
+		gflog_error(GFARM_MSG_1004203,
+		    "unexpected EOF while receiving request");
+		return (GFARM_ERR_PROTOCOL);
+	}
+	switch (request) {
+	case GFS_PROTO_PROCESS_SET:
+		gfs_server_process_set(client, xid, size); break;
+	case GFS_PROTO_PROCESS_RESET:
+		gfs_server_process_reset(client, xid, size); break;
+	case GFS_PROTO_OPEN_LOCAL:
+		gfs_server_open_local(client, xid, size); break;
+	case GFS_PROTO_OPEN:
+		gfs_server_open(client, xid, size); break;
+	case GFS_PROTO_CLOSE:
+		gfs_server_close(client, xid, size); break;
+	case GFS_PROTO_PREAD:
+		gfs_server_pread(client, xid, size); break;
+	case GFS_PROTO_PWRITE:
+		gfs_server_pwrite(client, xid, size); break;
+	case GFS_PROTO_WRITE:
+		gfs_server_write(client, xid, size); break;
+	case GFS_PROTO_FTRUNCATE:
+		gfs_server_ftruncate(client, xid, size); break;
+	case GFS_PROTO_FSYNC:
+		gfs_server_fsync(client, xid, size); break;
+	case GFS_PROTO_FSTAT:
+		gfs_server_fstat(client, xid, size); break;
+	case GFS_PROTO_CKSUM_SET:
+		gfs_server_cksum_set(client, xid, size); break;
+	case GFS_PROTO_STATFS:
+		gfs_server_statfs(client, xid, size); break;
+		/* for baysian hitrate */
+	case GFS_PROTO_HITRATES_GET:
+		gfs_server_send_hitrates(client, xid, size); break;
+	case GFS_PROTO_HITRATES_CLEAR:
+		gfs_server_clear_hitrates(client, xid, size); break;
 #if 0 /* not yet in gfarm v2 */
-		case GFS_PROTO_COMMAND:
-			if (credential_exported == NULL) {
-				e = gfp_xdr_export_credential(client);
-				if (e == GFARM_ERR_NO_ERROR)
-					credential_exported = client;
-				else
-					gflog_warning(GFARM_MSG_UNUSED,
-					    "export delegated credential: %s",
-					    gfarm_error_string(e));
-			}
-			gfs_server_command(client, xid, size,
-			    credential_exported == NULL ? NULL :
-			    gfp_xdr_env_for_credential(client));
-			break;
+	case GFS_PROTO_COMMAND:
+		if (credential_exported == NULL) {
+			e = gfp_xdr_export_credential(client);
+			if (e == GFARM_ERR_NO_ERROR)
+				credential_exported = client;
+			else
+				gflog_warning(GFARM_MSG_UNUSED,
+				    "export delegated credential: %s",
+				    gfarm_error_string(e));
+		}
+		gfs_server_command(client, xid, size,
+		    credential_exported == NULL ? NULL :
+		    gfp_xdr_env_for_credential(client));
+		break;
 #endif /* not yet in gfarm v2 */
-		case GFS_PROTO_REPLICA_ADD_FROM:
-			gfs_server_replica_add_from(client, xid, size); break;
+	case GFS_PROTO_REPLICA_ADD_FROM:
+		gfs_server_replica_add_from(client, xid, size); break;
 #if 1
-		case GFS_PROTO_FHOPEN:
-			gfs_server_fhopen(client, xid, size, peer_type);
-			break;
+	case GFS_PROTO_FHOPEN:
+		gfs_server_fhopen(client, xid, size, peer_type);
+		break;
 #else /* implementation until gfarm-2.X and before */
-		case GFS_PROTO_REPLICA_RECV:
-			gfs_server_replica_recv(client, xid, size, peer_type);
-			break;
+	case GFS_PROTO_REPLICA_RECV:
+		gfs_server_replica_recv(client, xid, size, peer_type);
+		break;
 #endif
-		default:
-			gflog_warning(GFARM_MSG_1000558, "unknown request %d",
-			    (int)request);
-			cleanup(0);
-			exit(1);
-		}
-		if (gfm_client_is_connection_error(
-		    gfp_xdr_flush(gfm_client_connection_conn(gfm_server)))) {
-			free_gfm_server();
-			if ((e = connect_gfm_server())
-			    != GFARM_ERR_NO_ERROR)
-				fatal(GFARM_MSG_1003362, "die");
+	default:
+		gflog_warning(GFARM_MSG_1000558, "unknown request %d",
+		    (int)request);
+		return (GFARM_ERR_PROTOCOL);
+	}
+	if ((e = session_error) != GFARM_ERR_NO_ERROR) {
+		session_error = GFARM_ERR_NO_ERROR;
+		return (e);
+	}
+	if (gfm_client_is_connection_error(
+	    gfp_xdr_flush(gfm_client_connection_conn(gfm_server)))) {
+		free_gfm_server();
+		if ((e = connect_gfm_server()) != GFARM_ERR_NO_ERROR) {
+			gflog_error(GFARM_MSG_1003362, "die");
+			return (e);
 		}
 	}
+	return (GFARM_ERR_NO_ERROR);
+}
+
+void
+server(int client_fd, char *client_name, struct sockaddr *client_addr)
+{
+	gfarm_error_t e;
+	struct gfp_xdr *client;
+	enum gfarm_auth_id_type peer_type;
+
+	if (server_open(client_fd, client_name, client_addr, 1,
+	    &client, &peer_type) != GFARM_ERR_NO_ERROR)
+		fatal(GFARM_MSG_UNFIXED, "die");
+
+	while ((e = server_request(client, peer_type)) == GFARM_ERR_NO_ERROR)
+		;
+	/*
+	 * XXX FIXME update metadata of all opened
+	 * file descriptor before exit.
+	 */
+	cleanup(0);
+	exit(e == GFARM_ERR_UNEXPECTED_EOF ? 0 : 1);
+}
+
+/*
+ * a client session in the event-driven mode.
+ * a worker thread switches the per-client (thread local) state
+ * to the session while it serves a request of the session.
+ */
+struct gfsd_session {
+	struct gfp_xdr *client;
+	enum gfarm_auth_id_type peer_type;
+
+	struct gfm_connection *gfm_server;
+	char *username;
+	struct file_entry *file_table;
+	int file_table_size;
+	gfarm_uint32_t histgram_client;
+	int fd_usable_to_gfmd;
+	int client_failover_count;
+	int replication_local_fd;
+};
+
+static void
+session_enter(struct gfsd_session *session)
+{
+	gfm_server = session->gfm_server;
+	username = session->username;
+	file_table = session->file_table;
+	file_table_size = session->file_table_size;
+	histgram_client = session->histgram_client;
+	fd_usable_to_gfmd = session->fd_usable_to_gfmd;
+	client_failover_count = session->client_failover_count;
+	replication_local_fd = session->replication_local_fd;
+}
+
+static void
+session_leave(struct gfsd_session *session)
+{
+	session->gfm_server = gfm_server;
+	session->username = username;
+	session->file_table = file_table;
+	session->file_table_size = file_table_size;
+	session->histgram_client = histgram_client;
+	session->fd_usable_to_gfmd = fd_usable_to_gfmd;
+	session->client_failover_count = client_failover_count;
+	session->replication_local_fd = replication_local_fd;
+}
+
+static void
+session_reset_state(void)
+{
+	gfm_server = NULL;
+	username = NULL;
+	file_table = NULL;
+	file_table_size = 0;
+	histgram_client = 0;
+	fd_usable_to_gfmd = 1;
+	client_failover_count = 0;
+	replication_local_fd = REPLICATION_LOCAL_FD_CLOSED;
+	session_error = GFARM_ERR_NO_ERROR;
+}
+
+/* called with the session state entered */
+static void
+session_close(struct gfsd_session *session)
+{
+	close_all_fd();
+	free_gfm_server();
+	if (session->client != NULL)
+		gfp_xdr_free(session->client);
+	file_table_free();
+	free(username);
+	session_reset_state();
+	free(session);
+}
+
+/* open_handler of gfsd_event_server() */
+static void *
+gfsd_session_open(int client_fd, struct sockaddr *client_addr,
+	socklen_t client_addr_size)
+{
+	struct gfsd_session *session;
+	struct timeval timeout;
+	jmp_buf abort_buf;
+	gfarm_error_t e;
+
+	GFARM_MALLOC(session);
+	if (session == NULL) {
+		gflog_error(GFARM_MSG_UNFIXED, "no memory for a session");
+		close(client_fd);
+		return (NULL);
+	}
+
+	/*
+	 * a client which doesn't receive replies shouldn't occupy
+	 * a worker thread forever, either.
+	 */
+	timeout.tv_sec = gfarm_ctxp->network_receive_timeout;
+	timeout.tv_usec = 0;
+	if (setsockopt(client_fd, SOL_SOCKET, SO_SNDTIMEO,
+	    &timeout, sizeof(timeout)) == -1)
+		gflog_warning_errno(GFARM_MSG_UNFIXED,
+		    "setsockopt(SO_SNDTIMEO)");
+
+	session->client = NULL;
+	session_reset_state();
+	if (setjmp(abort_buf) != 0) {
+		session_close(session);
+		return (NULL);
+	}
+	session_abort = &abort_buf;
+	e = server_open(client_fd, NULL, client_addr, 0,
+	    &session->client, &session->peer_type);
+	session_abort = NULL;
+	if (e != GFARM_ERR_NO_ERROR) {
+		session->client = NULL;
+		session_close(session);
+		return (NULL);
+	}
+	session_leave(session);
+	return (session);
+}
+
+/*
+ * serve_handler of gfsd_event_server().
+ * serves requests until no more request is buffered, so that
+ * the connection can be watched by the event queue again.
+ * fatal() in a request handler only closes this session.
+ * a handler doesn't call fatal() for an error of the client connection
+ * after it allocates memory, see gfs_server_put_reply_fatal().
+ */
+static int
+gfsd_session_serve(void *closure, int readable)
+{
+	struct gfsd_session *session = closure;
+	gfarm_error_t e = GFARM_ERR_NO_ERROR;
+	jmp_buf abort_buf;
+
+	session_enter(session);
+	if (setjmp(abort_buf) != 0) {
+		gflog_notice(GFARM_MSG_UNFIXED,
+		    "closing the session by the error above");
+		session_close(session);
+		return (-1);
+	}
+	session_abort = &abort_buf;
+	if (readable)
+		e = server_request(session->client, session->peer_type);
+	while (e == GFARM_ERR_NO_ERROR &&
+	    gfp_xdr_recv_is_ready(session->client))
+		e = server_request(session->client, session->peer_type);
+	session_abort = NULL;
+	if (e != GFARM_ERR_NO_ERROR) {
+		session_close(session);
+		return (-1);
+	}
+	session_leave(session);
+	session_reset_state();
+	return (0);
+}
+
+/*
+ * close_handler of gfsd_event_server().
+ * closes the descriptors of the session on gfmd, at termination.
+ */
+static void
+gfsd_session_terminate(void *closure)
+{
+	struct gfsd_session *session = closure;
+
+	session_enter(session);
+	session_close(session);
 }
 
 void
@@ -4394,7 +4840,12 @@ back_channel_server(void)
 			case GFS_PROTO_REPLICATION_REQUEST:
 				e = gfs_async_server_replication_request(
 				    bc_conn, gfm_client_username(back_channel),
-				    xid, size);
+				    xid, size, 0);
+				break;
+			case GFS_PROTO_REPLICATION_CHAIN_REQUEST:
+				e = gfs_async_server_replication_request(
+				    bc_conn, gfm_client_username(back_channel),
+				    xid, size, 1);
 				break;
 			default:
 				gflog_error(GFARM_MSG_1000566,
@@ -4453,6 +4904,182 @@ start_back_channel_server(void)
 	}
 }
 
+static void
+histgram_writer_stop_handler(int signo)
+{
+	gfsd_histgram_writer_stop();
+}
+
+/*
+ * the histgram writer drains read events queued by
+ * gfsd_histgram_enqueue_read(), so that neither the simulated cache
+ * nor SQLite is on the pread path.
+ */
+static void
+start_histgram_writer(void)
+{
+	gfarm_error_t e;
+	pid_t pid;
+	struct sigaction sa;
+	struct gfarm_iostat_items *statp;
+	int i;
+
+	pid = fork();
+	switch (pid) {
+	case 0:
+		histgram_writer_pid = getpid();
+		for (i = 0; i < accepting.local_socks_count; i++)
+			close(accepting.local_socks[i].sock);
+		close(accepting.tcp_sock);
+		for (i = 0; i < accepting.udp_socks_count; i++)
+			close(accepting.udp_socks[i]);
+
+		sa.sa_handler = histgram_writer_stop_handler;
+		sigemptyset(&sa.sa_mask);
+		sa.sa_flags = 0;
+		sigaction(SIGHUP, &sa, NULL);
+		sigaction(SIGINT, &sa, NULL);
+		sigaction(SIGTERM, &sa, NULL);
+
+		if (iostat_dirbuf) {
+			strcpy(&iostat_dirbuf[iostat_dirlen], "histgram");
+			e = gfarm_iostat_mmap(iostat_dirbuf,
+			    histgram_iostat_spec, GFARM_IOSTAT_HIST_NITEM, 1);
+			if (e != GFARM_ERR_NO_ERROR)
+				gflog_error(GFARM_MSG_UNFIXED,
+				    "gfarm_iostat_mmap(%s): %s",
+				    iostat_dirbuf, gfarm_error_string(e));
+			else if ((statp = gfarm_iostat_find_space(0)) != NULL) {
+				gfarm_iostat_set_id(statp,
+				    (gfarm_uint64_t)getpid());
+				gfarm_iostat_set_local_ip(statp);
+			}
+		}
+		gfsd_histgram_writer(gfarm_spool_histgram_db,
+		    gfarm_spool_histgram_flush_interval);
+		_exit(0);
+	case -1:
+		gflog_error_errno(GFARM_MSG_UNFIXED, "fork: histgram writer");
+		histgram_writer_schedule_restart();
+		break;
+	default:
+		histgram_writer_pid = pid;
+		histgram_writer_start_time = time(NULL);
+		break;
+	}
+}
+
+/*
+ * read events are dropped while the histgram writer is not running,
+ * thus it's restarted, but with exponential backoff, to avoid fork storm
+ * if it keeps dying.
+ */
+static void
+histgram_writer_schedule_restart(void)
+{
+	time_t now = time(NULL);
+
+	if (histgram_writer_restart_intvl == 0 ||
+	    now - histgram_writer_start_time >=
+	    HISTGRAM_WRITER_RESTART_INTVL_MAX)
+		histgram_writer_restart_intvl =
+		    HISTGRAM_WRITER_RESTART_INTVL_MIN;
+	else if (histgram_writer_restart_intvl <
+	    HISTGRAM_WRITER_RESTART_INTVL_MAX)
+		histgram_writer_restart_intvl *= 2;
+	histgram_writer_restart_time = now + histgram_writer_restart_intvl;
+	gflog_error(GFARM_MSG_UNFIXED,
+	    "read access histgram is not collected, "
+	    "until the histgram writer is restarted in %d seconds",
+	    histgram_writer_restart_intvl);
+}
+
+/*
+ * restarts the histgram writer, if it's time to do so.
+ * returns the timeout for select(2) until the next restart, or NULL.
+ */
+static struct timeval *
+histgram_writer_restart_if_necessary(struct timeval *timeout)
+{
+	time_t now;
+
+	if (histgram_writer_restart_time == 0)
+		return (NULL);
+	now = time(NULL);
+	if (now >= histgram_writer_restart_time) {
+		histgram_writer_restart_time = 0;
+		gflog_notice(GFARM_MSG_UNFIXED,
+		    "restarting the histgram writer");
+		start_histgram_writer();
+		if (histgram_writer_restart_time == 0)
+			return (NULL);
+	}
+	timeout->tv_sec = histgram_writer_restart_time - now;
+	timeout->tv_usec = 0;
+	return (timeout);
+}
+
+/*
+ * the event-driven server serves all TCP clients in one process,
+ * instead of forking a process for each client.
+ * the local sockets and the UDP sockets are still served by the master.
+ */
+static void
+event_server_stop_handler(int signo)
+{
+	terminate_flag = 1;
+	gfsd_event_server_stop();
+}
+
+static void
+start_event_server(void)
+{
+	pid_t pid;
+	struct gfarm_iostat_items *statp;
+	struct sigaction sa;
+	int i;
+
+	statp = gfarm_iostat_find_space(0);
+	pid = fork();
+	switch (pid) {
+	case 0:
+		if (statp) {
+			gfarm_iostat_set_id(statp, (gfarm_uint64_t)getpid());
+			gfarm_iostat_set_local_ip(statp);
+		}
+		for (i = 0; i < accepting.local_socks_count; i++)
+			close(accepting.local_socks[i].sock);
+		for (i = 0; i < accepting.udp_socks_count; i++)
+			close(accepting.udp_socks[i]);
+		in_event_server = 1;
+
+		/* close the descriptors of all sessions on gfmd, and exit */
+		sa.sa_handler = event_server_stop_handler;
+		sigemptyset(&sa.sa_mask);
+		sa.sa_flags = 0;
+		sigaction(SIGHUP, &sa, NULL);
+		sigaction(SIGINT, &sa, NULL);
+		sigaction(SIGTERM, &sa, NULL);
+
+		gfsd_event_server(accepting.tcp_sock,
+		    gfarm_spool_server_event_threads, gfsd_session_open,
+		    gfsd_session_serve, gfsd_session_terminate);
+		cleanup(0);
+		exit(0);
+	case -1:
+		gflog_error_errno(GFARM_MSG_UNFIXED,
+		    "fork: event-driven server");
+		if (statp)
+			gfarm_iostat_clear_ip(statp);
+		break;
+	default:
+		event_server_pid = pid;
+		if (statp)
+			gfarm_iostat_set_id(statp, (gfarm_uint64_t)pid);
+		break;
+	}
+}
+
 int
 open_accepting_tcp_socket(struct in_addr address, int port)
 {
@@ -4690,6 +5317,9 @@ main(int argc, char **argv)
 	int table_size, self_addresses_count, ch, i, nfound, max_fd, p;
 	struct sigaction sa;
 	fd_set requests;
+	struct timeval timeout;
+	enum gfsd_cachesim_policy cache_policy;
+	gfarm_off_t cache_pages;
 	struct stat sb;
 	int spool_check_level = 0;
 	int is_root = geteuid() == 0;
@@ -4815,6 +5445,7 @@ main(int argc, char **argv)
 	else if (!S_ISDIR(sb.st_mode))
 		gflog_fatal(GFARM_MSG_1000589, "%s: %s", gfarm_spool_root,
 		    gfarm_error_string(GFARM_ERR_NOT_A_DIRECTORY));
+	readonly_mode_init();
 
 	if (pid_file != NULL) {
 		/*
@@ -5047,18 +5678,50 @@ main(int argc, char **argv)
 		gflog_warning_errno(GFARM_MSG_1000599,
 		    "accepting TCP socket O_NONBLOCK");
 
-	gfp_create_histgram(&gfsd_db, ATTACH_GFSD_DATABASE);
+	/* must be created before fork(2), to be shared by all children */
+	e = gfsd_histgram_init(gfarm_spool_histgram_size,
+	    gfarm_spool_histgram_queue_length);
+	if (e != GFARM_ERR_NO_ERROR)
+		gflog_error(GFARM_MSG_UNFIXED,
+		    "read access histgram is disabled: %s",
+		    gfarm_error_string(e));
+	else {
+		if (gfarm_spool_histgram_cache_policy == NULL)
+			cache_policy = GFSD_CACHESIM_LRU;
+		else if (gfsd_cachesim_policy_by_name(
+		    gfarm_spool_histgram_cache_policy, &cache_policy) !=
+		    GFARM_ERR_NO_ERROR) {
+			gflog_error(GFARM_MSG_UNFIXED,
+			    "spool_histgram_cache_policy: unknown policy "
+			    "\"%s\", lru is used",
+			    gfarm_spool_histgram_cache_policy);
+			cache_policy = GFSD_CACHESIM_LRU;
+		}
+		cache_pages = gfarm_spool_histgram_cache_size /
+		    GFSD_HISTGRAM_PAGE_SIZE;
+		e = gfsd_cachesim_init(cache_policy,
+		    cache_pages > INT_MAX ? INT_MAX : cache_pages);
+		if (e != GFARM_ERR_NO_ERROR)
+			gflog_error(GFARM_MSG_UNFIXED,
+			    "simulated page cache is disabled: %s",
+			    gfarm_error_string(e));
+		start_histgram_writer();
+	}
 
-	gfp_init_semaphore();
+	if (gfarm_spool_server_event_threads > 0)
+		start_event_server();
 
 	for (;;) {
 		FD_ZERO(&requests);
-		FD_SET(accepting.tcp_sock, &requests);
+		/* TCP clients are served by the event-driven server */
+		if (event_server_pid == -1)
+			FD_SET(accepting.tcp_sock, &requests);
 		for (i = 0; i < accepting.local_socks_count; i++)
 			FD_SET(accepting.local_socks[i].sock, &requests);
 		for (i = 0; i < accepting.udp_socks_count; i++)
 			FD_SET(accepting.udp_socks[i], &requests);
-		nfound = select(max_fd + 1, &requests, NULL, NULL, NULL);
+		nfound = select(max_fd + 1, &requests, NULL, NULL,
+		    histgram_writer_restart_if_necessary(&timeout));
 		if (nfound <= 0) {
 			if (got_sigchld)
 				clear_child();
@@ -5067,7 +5730,8 @@ main(int argc, char **argv)
 			fatal_errno(GFARM_MSG_1000600, "select");
 		}
 
-		if (FD_ISSET(accepting.tcp_sock, &requests)) {
+		if (event_server_pid == -1 &&
+		    FD_ISSET(accepting.tcp_sock, &requests)) {
 			start_server(accepting.tcp_sock,
 			    (struct sockaddr*)&client_addr,sizeof(client_addr),
 			    (struct sockaddr*)&client_addr, NULL, &accepting);
@@ -0,0 +1,501 @@
+/*
+ * $Id$
+ */
+
+/*
+ * event-driven mode of gfsd.
+ *
+ * Instead of forking a process per client, one gfsd process waits for
+ * all client connections by a gfarm_eventqueue, and a readable
+ * connection is passed to a pool of worker threads.
+ * While a worker thread is serving a connection, the connection is not
+ * in the event queue, thus each connection is served by at most one
+ * thread at a time.  The worker passes the connection back to the event
+ * loop via a pipe, because the event queue is only touched by the event
+ * loop thread, like the watcher of gfmd.
+ *
+ * What a connection means is up to the caller:
+ *	open_handler(fd, addr, addrlen):
+ *		called by a worker thread for an accepted connection,
+ *		returns a closure, or NULL if the connection is closed.
+ *	serve_handler(closure, readable):
+ *		called by a worker thread, returns 0 if the connection
+ *		should be watched again, or -1 if it is closed.
+ *		"readable" is 0 just after open_handler().
+ *	close_handler(closure):
+ *		called by a worker thread for each open connection,
+ *		after gfsd_event_server_stop() is called.
+ *
+ * gfsd_event_server_stop() passes NULL to the event loop via the pipe,
+ * then the event loop stops accepting, and passes all watched
+ * connections to the workers to be closed.
+ * This is done outside of event callbacks, because a callback cannot
+ * safely remove other events from the event queue.
+ */
+
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include <gfarm/gflog.h>
+#include <gfarm/error.h>
+#include <gfarm/gfarm_misc.h>
+
+#include "gfutil.h"
+#include "gfevent.h"
+#include "thrsubr.h"
+
+#include "context.h"
+#include "gfs_proto.h"
+
+#include "gfsd_event.h"
+
+/* request handlers of gfsd have an I/O buffer on their stack */
+#define GFSD_EVENT_THREAD_STACK_SIZE	(4 * GFS_PROTO_MAX_IOSIZE)
+#define GFSD_EVENT_NDESC_HINT		1024
+#define GFSD_EVENT_REARM_MAX		64
+
+struct gfsd_event_conn {
+	struct gfsd_event_conn *next;	/* in gfsd_event_jobq */
+	struct gfsd_event_conn *all_next, *all_prev; /* all connections */
+	int fd;
+	struct sockaddr_storage addr;
+	socklen_t addrlen;
+	void *closure;		/* NULL until open_handler() succeeds */
+	struct gfarm_event *gev;
+	int watched;		/* only accessed by the event loop thread */
+};
+
+static struct gfsd_event_jobq {
+	pthread_mutex_t mutex;
+	pthread_cond_t nonempty, all_closed;
+	struct gfsd_event_conn *head, **tail;
+
+	/* the followings are also protected by the mutex */
+	struct gfsd_event_conn all;	/* list head */
+	int nconns;
+	int stopping;
+} gfsd_event_jobq = {
+	PTHREAD_MUTEX_INITIALIZER,
+	PTHREAD_COND_INITIALIZER,
+	PTHREAD_COND_INITIALIZER,
+	NULL, &gfsd_event_jobq.head,
+	{ NULL, &gfsd_event_jobq.all, &gfsd_event_jobq.all },
+	0,
+	0
+};
+
+static struct gfarm_eventqueue *gfsd_event_q;
+static struct gfarm_event *gfsd_event_accept_gev, *gfsd_event_rearm_gev;
+static int gfsd_event_accept_sock;
+static int gfsd_event_rearm_fds[2] = { -1, -1 }; /* [0]: loop, [1]: workers */
+static int gfsd_event_loop_stopping; /* only used by the event loop thread */
+
+static void *(*gfsd_event_open_handler)(int, struct sockaddr *, socklen_t);
+static int (*gfsd_event_serve_handler)(void *, int);
+static void (*gfsd_event_close_handler)(void *);
+
+static const char jobq_diag[] = "gfsd_event_jobq";
+
+/* must be called with the jobq mutex locked */
+static void
+gfsd_event_jobq_put_unlocked(struct gfsd_event_conn *conn)
+{
+	struct gfsd_event_jobq *q = &gfsd_event_jobq;
+
+	conn->next = NULL;
+	*q->tail = conn;
+	q->tail = &conn->next;
+	gfarm_cond_signal(&q->nonempty, jobq_diag, "nonempty");
+}
+
+static void
+gfsd_event_jobq_put(struct gfsd_event_conn *conn)
+{
+	struct gfsd_event_jobq *q = &gfsd_event_jobq;
+
+	gfarm_mutex_lock(&q->mutex, jobq_diag, "put");
+	gfsd_event_jobq_put_unlocked(conn);
+	gfarm_mutex_unlock(&q->mutex, jobq_diag, "put");
+}
+
+static struct gfsd_event_conn *
+gfsd_event_jobq_get(int *stoppingp)
+{
+	struct gfsd_event_jobq *q = &gfsd_event_jobq;
+	struct gfsd_event_conn *conn;
+
+	gfarm_mutex_lock(&q->mutex, jobq_diag, "get");
+	while (q->head == NULL)
+		gfarm_cond_wait(&q->nonempty, &q->mutex, jobq_diag,
+		    "nonempty");
+	conn = q->head;
+	if ((q->head = conn->next) == NULL)
+		q->tail = &q->head;
+	*stoppingp = q->stopping;
+	gfarm_mutex_unlock(&q->mutex, jobq_diag, "get");
+	return (conn);
+}
+
+static void
+gfsd_event_conn_free(struct gfsd_event_conn *conn)
+{
+	struct gfsd_event_jobq *q = &gfsd_event_jobq;
+
+	gfarm_mutex_lock(&q->mutex, jobq_diag, "free");
+	conn->all_prev->all_next = conn->all_next;
+	conn->all_next->all_prev = conn->all_prev;
+	if (--q->nconns == 0)
+		gfarm_cond_broadcast(&q->all_closed, jobq_diag, "all_closed");
+	gfarm_mutex_unlock(&q->mutex, jobq_diag, "free");
+
+	if (conn->gev != NULL)
+		gfarm_event_free(conn->gev);
+	free(conn);
+}
+
+/* closes a connection which is not served, after the server is stopped */
+static void
+gfsd_event_conn_close(struct gfsd_event_conn *conn)
+{
+	if (conn->closure != NULL)
+		(*gfsd_event_close_handler)(conn->closure);
+	else
+		close(conn->fd);
+	gfsd_event_conn_free(conn);
+}
+
+/* called by the event loop thread */
+static void
+gfsd_event_readable(int events, int fd, void *closure,
+	const struct timeval *t)
+{
+	struct gfsd_event_conn *conn = closure;
+
+	conn->watched = 0;
+	gfsd_event_jobq_put(conn);
+}
+
+static void
+gfsd_event_conn_link_and_put(struct gfsd_event_conn *conn)
+{
+	struct gfsd_event_jobq *q = &gfsd_event_jobq;
+
+	gfarm_mutex_lock(&q->mutex, jobq_diag, "link");
+	conn->all_next = &q->all;
+	conn->all_prev = q->all.all_prev;
+	q->all.all_prev->all_next = conn;
+	q->all.all_prev = conn;
+	q->nconns++;
+	gfsd_event_jobq_put_unlocked(conn);
+	gfarm_mutex_unlock(&q->mutex, jobq_diag, "link");
+}
+
+/* called by the event loop thread */
+static void
+gfsd_event_accept(int events, int fd, void *closure,
+	const struct timeval *t)
+{
+	struct gfsd_event_conn *conn;
+	int client_fd, err;
+
+	for (;;) {
+		GFARM_MALLOC(conn);
+		if (conn == NULL) {
+			gflog_error(GFARM_MSG_UNFIXED,
+			    "gfsd_event_accept: no memory");
+			break;
+		}
+		conn->addrlen = sizeof(conn->addr);
+		client_fd = accept(gfsd_event_accept_sock,
+		    (struct sockaddr *)&conn->addr, &conn->addrlen);
+		if (client_fd == -1) {
+			/* the socket is O_NONBLOCK, and shared with others */
+			if (errno != EAGAIN && errno != EWOULDBLOCK &&
+			    errno != EINTR && errno != ECONNABORTED)
+				gflog_warning_errno(GFARM_MSG_UNFIXED,
+				    "accept");
+			free(conn);
+			break;
+		}
+		conn->fd = client_fd;
+		conn->closure = NULL;
+		conn->watched = 0;
+		conn->gev = gfarm_fd_event_alloc(GFARM_EVENT_READ, client_fd,
+		    gfsd_event_readable, conn);
+		if (conn->gev == NULL) {
+			gflog_error(GFARM_MSG_UNFIXED,
+			    "gfsd_event_accept: no memory for event");
+			close(client_fd);
+			free(conn);
+			continue;
+		}
+		gfsd_event_conn_link_and_put(conn);
+	}
+
+	if ((err = gfarm_eventqueue_add_event(gfsd_event_q,
+	    gfsd_event_accept_gev, NULL)) != 0)
+		gflog_fatal(GFARM_MSG_UNFIXED,
+		    "gfsd_event_accept: add_event: %s", strerror(err));
+}
+
+/*
+ * called by the event loop thread.
+ * returns the number of connections read, and sets *stopp if NULL is read.
+ */
+static int
+gfsd_event_rearm_read(struct gfsd_event_conn **conns, int *stopp)
+{
+	ssize_t rv;
+	int i, n;
+
+	/* a pointer is written atomically, because it's less than PIPE_BUF */
+	rv = read(gfsd_event_rearm_fds[0], conns,
+	    sizeof(*conns) * GFSD_EVENT_REARM_MAX);
+	if (rv == -1) {
+		if (errno != EINTR && errno != EAGAIN)
+			gflog_fatal_errno(GFARM_MSG_UNFIXED,
+			    "gfsd_event_rearm: read");
+		return (0);
+	}
+	n = rv / sizeof(*conns);
+	for (i = 0; i < n; ) {
+		if (conns[i] == NULL) { /* gfsd_event_server_stop() */
+			*stopp = 1;
+			conns[i] = conns[--n];
+		} else {
+			i++;
+		}
+	}
+	return (n);
+}
+
+/*
+ * called by the event loop thread, outside of event callbacks.
+ * passes all connections which are not served to workers to be closed,
+ * and stops watching anything.
+ */
+static void
+gfsd_event_stop_serving(void)
+{
+	struct gfsd_event_jobq *q = &gfsd_event_jobq;
+	struct gfsd_event_conn *conns[GFSD_EVENT_REARM_MAX], *conn;
+	int i, n, stop = 0;
+
+	gfarm_mutex_lock(&q->mutex, jobq_diag, "stop");
+	q->stopping = 1;
+	gfarm_mutex_unlock(&q->mutex, jobq_diag, "stop");
+
+	(void)gfarm_eventqueue_delete_event(gfsd_event_q,
+	    gfsd_event_accept_gev);
+
+	/* workers write the pipe with the mutex locked, before stopping */
+	while ((n = gfsd_event_rearm_read(conns, &stop)) > 0 || stop) {
+		for (i = 0; i < n; i++)
+			gfsd_event_jobq_put(conns[i]);
+		stop = 0;
+	}
+
+	gfarm_mutex_lock(&q->mutex, jobq_diag, "stop");
+	for (conn = q->all.all_next; conn != &q->all; conn = conn->all_next) {
+		if (!conn->watched)
+			continue;
+		(void)gfarm_eventqueue_delete_event(gfsd_event_q, conn->gev);
+		conn->watched = 0;
+		gfsd_event_jobq_put_unlocked(conn);
+	}
+	gfarm_mutex_unlock(&q->mutex, jobq_diag, "stop");
+}
+
+/* called by the event loop thread */
+static void
+gfsd_event_rearm(int events, int fd, void *closure,
+	const struct timeval *t)
+{
+	struct gfsd_event_conn *conns[GFSD_EVENT_REARM_MAX];
+	int i, n, err, stop = 0;
+
+	n = gfsd_event_rearm_read(conns, &stop);
+	if (stop)
+		gfsd_event_loop_stopping = 1;
+	for (i = 0; i < n; i++) {
+		if ((err = gfarm_eventqueue_add_event(gfsd_event_q,
+		    conns[i]->gev, NULL)) != 0) {
+			gflog_error(GFARM_MSG_UNFIXED,
+			    "gfsd_event_rearm: add_event: %s", strerror(err));
+			/* let a worker find the error */
+			gfsd_event_jobq_put(conns[i]);
+		} else {
+			conns[i]->watched = 1;
+		}
+	}
+	if (gfsd_event_loop_stopping)
+		return; /* see gfsd_event_server() */
+
+	if ((err = gfarm_eventqueue_add_event(gfsd_event_q,
+	    gfsd_event_rearm_gev, NULL)) != 0)
+		gflog_fatal(GFARM_MSG_UNFIXED,
+		    "gfsd_event_rearm: add_event: %s", strerror(err));
+}
+
+/* returns -1, if the server is stopping */
+static int
+gfsd_event_rearm_request(struct gfsd_event_conn *conn)
+{
+	struct gfsd_event_jobq *q = &gfsd_event_jobq;
+	ssize_t rv;
+	int stopping;
+
+	gfarm_mutex_lock(&q->mutex, jobq_diag, "rearm");
+	if (!(stopping = q->stopping)) {
+		rv = write(gfsd_event_rearm_fds[1], &conn, sizeof(conn));
+		if (rv != sizeof(conn))
+			gflog_fatal_errno(GFARM_MSG_UNFIXED,
+			    "gfsd_event_worker: write: %d", (int)rv);
+	}
+	gfarm_mutex_unlock(&q->mutex, jobq_diag, "rearm");
+	return (stopping ? -1 : 0);
+}
+
+static void *
+gfsd_event_worker(void *arg)
+{
+	struct gfsd_event_conn *conn;
+	int readable, stopping;
+
+	for (;;) {
+		conn = gfsd_event_jobq_get(&stopping);
+
+		if (stopping) {
+			gfsd_event_conn_close(conn);
+			continue;
+		}
+		if (conn->closure == NULL) {
+			conn->closure = (*gfsd_event_open_handler)(conn->fd,
+			    (struct sockaddr *)&conn->addr, conn->addrlen);
+			if (conn->closure == NULL) {
+				gfsd_event_conn_free(conn);
+				continue;
+			}
+			readable = 0;
+		} else {
+			readable = 1;
+		}
+		if ((*gfsd_event_serve_handler)(conn->closure, readable)
+		    != 0) {
+			gfsd_event_conn_free(conn);
+			continue;
+		}
+
+		if (gfsd_event_rearm_request(conn) != 0)
+			gfsd_event_conn_close(conn);
+	}
+	/*NOTREACHED*/
+	return (NULL);
+}
+
+/* this is async-signal-safe */
+void
+gfsd_event_server_stop(void)
+{
+	static struct gfsd_event_conn *const stop = NULL;
+
+	if (gfsd_event_rearm_fds[1] != -1)
+		(void)write(gfsd_event_rearm_fds[1], &stop, sizeof(stop));
+}
+
+/*
+ * returns after gfsd_event_server_stop() is called, and all connections
+ * are closed, or network_receive_timeout passed.
+ * accepting_sock has to be O_NONBLOCK, because it may be shared with
+ * other processes.
+ */
+void
+gfsd_event_server(int accepting_sock, int nthreads,
+	void *(*open_handler)(int, struct sockaddr *, socklen_t),
+	int (*serve_handler)(void *, int),
+	void (*close_handler)(void *))
+{
+	struct gfsd_event_jobq *q = &gfsd_event_jobq;
+	pthread_attr_t attr;
+	pthread_t thread;
+	struct timeval now;
+	struct timespec timeout;
+	int i, err;
+
+	gfsd_event_accept_sock = accepting_sock;
+	gfsd_event_open_handler = open_handler;
+	gfsd_event_serve_handler = serve_handler;
+	gfsd_event_close_handler = close_handler;
+
+	if ((err = gfarm_eventqueue_alloc(GFSD_EVENT_NDESC_HINT,
+	    &gfsd_event_q)) != 0)
+		gflog_fatal(GFARM_MSG_UNFIXED,
+		    "gfarm_eventqueue_alloc: %s", strerror(err));
+	if (pipe(gfsd_event_rearm_fds) == -1)
+		gflog_fatal_errno(GFARM_MSG_UNFIXED, "pipe");
+	/* to drain the pipe at stop */
+	if (fcntl(gfsd_event_rearm_fds[0], F_SETFL, O_NONBLOCK) == -1)
+		gflog_fatal_errno(GFARM_MSG_UNFIXED, "fcntl(O_NONBLOCK)");
+	gfsd_event_accept_gev = gfarm_fd_event_alloc(GFARM_EVENT_READ,
+	    accepting_sock, gfsd_event_accept, NULL);
+	gfsd_event_rearm_gev = gfarm_fd_event_alloc(GFARM_EVENT_READ,
+	    gfsd_event_rearm_fds[0], gfsd_event_rearm, NULL);
+	if (gfsd_event_accept_gev == NULL || gfsd_event_rearm_gev == NULL)
+		gflog_fatal(GFARM_MSG_UNFIXED,
+		    "gfsd_event_server: no memory for event");
+	if ((err = gfarm_eventqueue_add_event(gfsd_event_q,
+	    gfsd_event_accept_gev, NULL)) != 0 ||
+	    (err = gfarm_eventqueue_add_event(gfsd_event_q,
+	    gfsd_event_rearm_gev, NULL)) != 0)
+		gflog_fatal(GFARM_MSG_UNFIXED,
+		    "gfsd_event_server: add_event: %s", strerror(err));
+
+	if ((err = pthread_attr_init(&attr)) != 0 ||
+	    (err = pthread_attr_setdetachstate(&attr,
+	    PTHREAD_CREATE_DETACHED)) != 0 ||
+	    (err = pthread_attr_setstacksize(&attr,
+	    GFSD_EVENT_THREAD_STACK_SIZE)) != 0)
+		gflog_fatal(GFARM_MSG_UNFIXED,
+		    "gfsd_event_server: pthread_attr: %s", strerror(err));
+	for (i = 0; i < nthreads; i++) {
+		if ((err = pthread_create(&thread, &attr,
+		    gfsd_event_worker, NULL)) != 0)
+			gflog_fatal(GFARM_MSG_UNFIXED,
+			    "gfsd_event_server: pthread_create: %s",
+			    strerror(err));
+	}
+	pthread_attr_destroy(&attr);
+	gflog_info(GFARM_MSG_UNFIXED,
+	    "event-driven mode with %d worker threads", nthreads);
+
+	while (!gfsd_event_loop_stopping) {
+		err = gfarm_eventqueue_turn(gfsd_event_q, NULL);
+		if (err != 0 && err != EINTR && err != EAGAIN)
+			gflog_fatal(GFARM_MSG_UNFIXED,
+			    "gfsd_event_server: %s", strerror(err));
+	}
+	gfsd_event_stop_serving();
+
+	gettimeofday(&now, NULL);
+	timeout.tv_sec = now.tv_sec + gfarm_ctxp->network_receive_timeout;
+	timeout.tv_nsec = now.tv_usec * 1000;
+	gfarm_mutex_lock(&q->mutex, jobq_diag, "wait");
+	while (q->nconns > 0) {
+		if (!gfarm_cond_timedwait(&q->all_closed, &q->mutex,
+		    &timeout, jobq_diag, "all_closed")) {
+			gflog_warning(GFARM_MSG_UNFIXED,
+			    "gfsd_event_server: %d connections are not closed",
+			    q->nconns);
+			break;
+		}
+	}
+	gfarm_mutex_unlock(&q->mutex, jobq_diag, "wait");
+}
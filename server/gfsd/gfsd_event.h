@@ -0,0 +1,11 @@
+/*
+ * event-driven mode of gfsd, which multiplexes client connections
+ * on an event queue, and serves requests by a pool of worker threads
+ */
+
+struct sockaddr;
+
+void gfsd_event_server(int, int,
+	void *(*)(int, struct sockaddr *, socklen_t),
+	int (*)(void *, int), void (*)(void *));
+void gfsd_event_server_stop(void);
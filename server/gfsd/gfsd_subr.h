@@ -1,7 +1,14 @@
 /* need #include <gfarm/gfarm_config.h> to see HAVE_GETLOADAVG */
 
+/*
+ * state of the client which is being served.
+ * thread-local, because a thread serves a client at a time
+ * in the event-driven mode.
+ */
+#define GFSD_CLIENT_STATE	__thread
+
 extern int debug_mode;
-extern struct gfm_connection *gfm_server;
+extern GFSD_CLIENT_STATE struct gfm_connection *gfm_server;
 extern const char READONLY_CONFIG_FILE[];
 extern int gfarm_spool_root_len;
 extern char *canonical_self_name;
@@ -0,0 +1,765 @@
+/*
+ * $Id$
+ */
+
+/*
+ * read access histgram and simulated cache hit rate, per gfsd host.
+ *
+ * All tables live in an anonymous shared mapping which is created by
+ * the master gfsd before it forks any child.
+ * The GFS_PROTO_PREAD path only puts a read event into a bounded
+ * lock-free queue by gfsd_histgram_enqueue_read(), and drops the event
+ * if the queue is full.  A dedicated histgram writer process drains
+ * the queue, updates the tables and the simulated cache, and writes
+ * the tables into the optional SQLite database periodically, by one
+ * transaction with prepared statements.
+ * The database is only available if gfsd is built with SQLite3.
+ *
+ * Each table is an open addressing hash table.  A slot is never removed,
+ * instead, gfsd_histgram_clear() increments the epoch of the whole
+ * histgram, and slots which belong to an old epoch are treated as empty.
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+
+#include <gfarm/gflog.h>
+#include <gfarm/error.h>
+#include <gfarm/gfarm_misc.h>
+#include <gfarm/gfs.h>
+#include <gfarm/gfarm_iostat.h>
+#ifdef HAVE_SQLITE3
+#include <sqlite3.h>
+#endif
+
+#include "gfutil.h"
+#include "hash.h"
+#include "nanosec.h"
+
+#include "iostat.h"
+
+#include "cachesim.h"
+#include "histgram.h"
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS	MAP_ANON
+#endif
+
+#define HISTGRAM_SLOT_EMPTY	0
+#define HISTGRAM_SLOT_BUSY	1
+#define HISTGRAM_SLOT_VALID	2
+#define HISTGRAM_SLOT_STATE_BITS	2
+#define HISTGRAM_SLOT_STATE_MASK	((1 << HISTGRAM_SLOT_STATE_BITS) - 1)
+
+#define HISTGRAM_SLOT(epoch, state) \
+	(((epoch) << HISTGRAM_SLOT_STATE_BITS) | (state))
+#define HISTGRAM_SLOT_EPOCH(st)	((st) >> HISTGRAM_SLOT_STATE_BITS)
+#define HISTGRAM_SLOT_STATE(st)	((st) & HISTGRAM_SLOT_STATE_MASK)
+
+#define HISTGRAM_PROBE_MAX	64
+/* a process which died while holding HISTGRAM_SLOT_BUSY shouldn't hang us */
+#define HISTGRAM_SPIN_MAX	100000
+#define HISTGRAM_CLIENTS	4096	/* must be power of 2 */
+
+#define HISTGRAM_DRAIN_BATCH	4096	/* events drained at once */
+#define HISTGRAM_IDLE_NSEC	(10 * GFARM_MILLISEC_BY_NANOSEC)
+/* a process which died while enqueueing shouldn't stop the writer */
+#define HISTGRAM_STALL_MAX	100	/* * HISTGRAM_IDLE_NSEC */
+
+struct histgram_key {
+	gfarm_uint64_t client, ino, gen, page;
+};
+
+struct histgram_slot {
+	volatile gfarm_uint64_t state;
+	struct histgram_key key;
+	volatile gfarm_uint64_t count;
+	gfarm_uint64_t flushed;		/* count already in DB, writer only */
+};
+
+struct histgram_client {
+	volatile gfarm_uint64_t state;
+	gfarm_uint64_t addr;
+	volatile gfarm_uint64_t reads, hits;
+};
+
+/*
+ * an element of the bounded multi-producer single-consumer queue.
+ * the element at position pos is free if seq == pos,
+ * and is filled if seq == pos + 1.
+ */
+struct histgram_event {
+	volatile gfarm_uint64_t seq;
+	gfarm_uint64_t client, ino, gen, offset, size;
+};
+
+struct histgram_head {
+	volatile gfarm_uint64_t epoch;
+	volatile gfarm_uint64_t dropped;	/* updates lost by full table */
+	gfarm_uint64_t nslots;			/* power of 2 */
+
+	volatile gfarm_uint64_t enqueue_pos;
+	volatile gfarm_uint64_t dequeue_pos;	/* only the writer updates */
+	volatile gfarm_uint64_t queue_dropped;	/* events lost by full queue */
+	gfarm_uint64_t queue_length;		/* power of 2 */
+};
+
+static struct histgram_head *histgram;
+static struct histgram_client *histgram_clients;
+static struct histgram_slot *histgram_reads; /* per client, ino, gen, page */
+static struct histgram_event *histgram_queue;
+
+/* the following is only used by the histgram writer */
+#ifdef HAVE_SQLITE3
+static gfarm_uint64_t histgram_flushed_epoch;
+#endif
+static volatile sig_atomic_t histgram_writer_stopping;
+
+gfarm_error_t
+gfsd_histgram_init(int nentries, int queue_length)
+{
+	gfarm_uint64_t nslots, qlen, i;
+	size_t size;
+	void *addr;
+	int overflow = 0;
+
+	for (nslots = 1; nslots < nentries; nslots <<= 1)
+		;
+	for (qlen = 1; qlen < queue_length; qlen <<= 1)
+		;
+	size = gfarm_size_add(&overflow, sizeof(*histgram),
+	    sizeof(*histgram_clients) * HISTGRAM_CLIENTS);
+	size = gfarm_size_add(&overflow, size,
+	    gfarm_size_mul(&overflow, sizeof(*histgram_reads), nslots));
+	size = gfarm_size_add(&overflow, size,
+	    gfarm_size_mul(&overflow, sizeof(*histgram_queue), qlen));
+	if (overflow) {
+		gflog_error(GFARM_MSG_UNFIXED,
+		    "histgram: too many entries: %d, queue length: %d",
+		    nentries, queue_length);
+		return (GFARM_ERR_RESULT_OUT_OF_RANGE);
+	}
+	addr = mmap(NULL, size, PROT_READ|PROT_WRITE,
+	    MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+	if (addr == MAP_FAILED) {
+		int save_errno = errno;
+
+		gflog_error(GFARM_MSG_UNFIXED, "histgram: mmap %zu bytes: %s",
+		    size, strerror(save_errno));
+		return (gfarm_errno_to_error(save_errno));
+	}
+	/* the mapping is zero-filled, i.e. every slot is empty at epoch 0 */
+	histgram = addr;
+	histgram->epoch = 1;
+	histgram->nslots = nslots;
+	histgram_clients = (struct histgram_client *)(histgram + 1);
+	histgram_reads = (struct histgram_slot *)
+	    (histgram_clients + HISTGRAM_CLIENTS);
+	histgram->queue_length = qlen;
+	histgram_queue = (struct histgram_event *)(histgram_reads + nslots);
+	for (i = 0; i < qlen; i++)
+		histgram_queue[i].seq = i;
+	return (GFARM_ERR_NO_ERROR);
+}
+
+/*
+ * returns 1, if the caller has claimed the slot and has to fill it,
+ * returns 0, if the slot is valid in the epoch and the caller has to
+ * compare the key,
+ * returns -1, if the slot is unusable.
+ */
+static int
+histgram_slot_acquire(volatile gfarm_uint64_t *statep, gfarm_uint64_t epoch)
+{
+	gfarm_uint64_t st;
+	int spin;
+
+	for (;;) {
+		st = *statep;
+		if (HISTGRAM_SLOT_EPOCH(st) != epoch ||
+		    HISTGRAM_SLOT_STATE(st) == HISTGRAM_SLOT_EMPTY) {
+			if (__sync_bool_compare_and_swap(statep, st,
+			    HISTGRAM_SLOT(epoch, HISTGRAM_SLOT_BUSY)))
+				return (1);
+			continue;
+		}
+		for (spin = 0; HISTGRAM_SLOT_STATE(st) == HISTGRAM_SLOT_BUSY;
+		    spin++) {
+			if (spin >= HISTGRAM_SPIN_MAX)
+				return (-1);
+			st = *statep;
+		}
+		if (HISTGRAM_SLOT_EPOCH(st) == epoch)
+			return (0);
+	}
+}
+
+static void
+histgram_slot_publish(volatile gfarm_uint64_t *statep, gfarm_uint64_t epoch)
+{
+	__sync_synchronize();
+	*statep = HISTGRAM_SLOT(epoch, HISTGRAM_SLOT_VALID);
+}
+
+static int
+histgram_slot_is_valid(gfarm_uint64_t st, gfarm_uint64_t epoch)
+{
+	return (st == HISTGRAM_SLOT(epoch, HISTGRAM_SLOT_VALID));
+}
+
+static struct histgram_slot *
+histgram_slot_enter(struct histgram_slot *table, struct histgram_key *key,
+	gfarm_uint64_t epoch)
+{
+	struct histgram_slot *slot;
+	gfarm_uint64_t mask = histgram->nslots - 1;
+	unsigned int h = gfarm_hash_default(key, sizeof(*key));
+	int i;
+
+	for (i = 0; i < HISTGRAM_PROBE_MAX; i++) {
+		slot = &table[(h + i) & mask];
+		switch (histgram_slot_acquire(&slot->state, epoch)) {
+		case 1:
+			slot->key = *key;
+			slot->count = 0;
+			slot->flushed = 0;
+			histgram_slot_publish(&slot->state, epoch);
+			return (slot);
+		case 0:
+			if (memcmp(&slot->key, key, sizeof(*key)) == 0)
+				return (slot);
+			break;
+		}
+	}
+	__sync_fetch_and_add(&histgram->dropped, 1);
+	return (NULL);
+}
+
+static struct histgram_client *
+histgram_client_enter(gfarm_uint32_t addr, gfarm_uint64_t epoch)
+{
+	struct histgram_client *client;
+	int i;
+
+	for (i = 0; i < HISTGRAM_CLIENTS; i++) {
+		client = &histgram_clients[(addr + i) & (HISTGRAM_CLIENTS - 1)];
+		switch (histgram_slot_acquire(&client->state, epoch)) {
+		case 1:
+			client->addr = addr;
+			client->reads = 0;
+			client->hits = 0;
+			histgram_slot_publish(&client->state, epoch);
+			return (client);
+		case 0:
+			if (client->addr == addr)
+				return (client);
+			break;
+		}
+	}
+	__sync_fetch_and_add(&histgram->dropped, 1);
+	return (NULL);
+}
+
+void
+gfsd_histgram_record_client(gfarm_uint32_t addr)
+{
+	if (histgram == NULL)
+		return;
+	(void)histgram_client_enter(addr, histgram->epoch);
+}
+
+/*
+ * called from the GFS_PROTO_PREAD path, thus this must not block.
+ */
+void
+gfsd_histgram_enqueue_read(gfarm_uint32_t addr,
+	gfarm_ino_t ino, gfarm_uint64_t gen, gfarm_off_t offset, size_t size)
+{
+	struct histgram_event *ev;
+	gfarm_uint64_t pos, seq;
+
+	if (histgram == NULL || size == 0)
+		return;
+
+	pos = histgram->enqueue_pos;
+	for (;;) {
+		ev = &histgram_queue[pos & (histgram->queue_length - 1)];
+		seq = ev->seq;
+		if (seq == pos) {
+			if (__sync_bool_compare_and_swap(
+			    &histgram->enqueue_pos, pos, pos + 1))
+				break;
+		} else if ((gfarm_int64_t)(seq - pos) < 0) {
+			/* the writer is behind by a whole queue */
+			__sync_fetch_and_add(&histgram->queue_dropped, 1);
+			return;
+		}
+		pos = histgram->enqueue_pos;
+	}
+	ev->client = addr;
+	ev->ino = ino;
+	ev->gen = gen;
+	ev->offset = offset;
+	ev->size = size;
+	__sync_synchronize();
+	ev->seq = pos + 1;
+}
+
+/*
+ * a page is regarded as a cache hit, if it is in the simulated cache
+ * shared by all clients, see cachesim.c
+ */
+static void
+histgram_count_read(gfarm_uint32_t addr,
+	gfarm_ino_t ino, gfarm_uint64_t gen, gfarm_off_t offset, size_t size)
+{
+	struct histgram_client *client;
+	struct histgram_slot *slot;
+	struct histgram_key key;
+	gfarm_uint64_t epoch, page, last;
+	gfarm_uint64_t reads = 0, hits = 0;
+
+	if (histgram == NULL || size == 0)
+		return;
+
+	epoch = histgram->epoch;
+	key.ino = ino;
+	key.gen = gen;
+	last = (offset + size - 1) / GFSD_HISTGRAM_PAGE_SIZE;
+	for (page = offset / GFSD_HISTGRAM_PAGE_SIZE; page <= last; page++) {
+		if (gfsd_cachesim_access(ino, gen, page))
+			hits++;
+
+		key.client = addr;
+		key.page = page;
+		if ((slot = histgram_slot_enter(histgram_reads, &key, epoch))
+		    != NULL)
+			__sync_fetch_and_add(&slot->count, 1);
+		reads++;
+	}
+
+	if ((client = histgram_client_enter(addr, epoch)) != NULL) {
+		__sync_fetch_and_add(&client->reads, reads);
+		__sync_fetch_and_add(&client->hits, hits);
+	}
+}
+
+gfarm_error_t
+gfsd_histgram_get_hitrates(char **resultp, int *lenp)
+{
+	struct histgram_client *client;
+	gfarm_uint64_t epoch;
+	char *s;
+	size_t size, len = 0;
+	int i, n;
+	/* "cliaddr:total_hits/total_reads\n" */
+	const size_t linemax = 10 + 1 + 20 + 1 + 20 + 1 + 1;
+
+	if (histgram == NULL) {
+		*resultp = NULL;
+		*lenp = 0;
+		return (GFARM_ERR_NO_ERROR);
+	}
+
+	size = linemax * HISTGRAM_CLIENTS;
+	GFARM_MALLOC_ARRAY(s, size);
+	if (s == NULL) {
+		gflog_debug(GFARM_MSG_UNFIXED,
+		    "histgram: no memory for hitrates of %d clients",
+		    HISTGRAM_CLIENTS);
+		return (GFARM_ERR_NO_MEMORY);
+	}
+	s[0] = '\0';
+
+	epoch = histgram->epoch;
+	for (i = 0, n = 0; i < HISTGRAM_CLIENTS; i++) {
+		client = &histgram_clients[i];
+		if (!histgram_slot_is_valid(client->state, epoch))
+			continue;
+		len += snprintf(s + len, size - len, "%u:%llu/%llu\n",
+		    (unsigned int)client->addr,
+		    (unsigned long long)client->hits,
+		    (unsigned long long)client->reads);
+		n++;
+	}
+	gflog_debug(GFARM_MSG_UNFIXED,
+	    "histgram: hitrates of %d clients, %llu updates dropped", n,
+	    (unsigned long long)histgram->dropped);
+
+	*resultp = s;
+	*lenp = len;
+	return (GFARM_ERR_NO_ERROR);
+}
+
+void
+gfsd_histgram_clear(void)
+{
+	if (histgram == NULL)
+		return;
+	__sync_fetch_and_add(&histgram->epoch, 1);
+	histgram->dropped = 0;
+}
+
+#ifdef HAVE_SQLITE3
+
+enum histgram_stmt_id {
+	HISTGRAM_STMT_BEGIN,
+	HISTGRAM_STMT_COMMIT,
+	HISTGRAM_STMT_ROLLBACK,
+	HISTGRAM_STMT_CLEAR_READS,
+	HISTGRAM_STMT_CLEAR_CLIENTS,
+	HISTGRAM_STMT_PUT_READ,
+	HISTGRAM_STMT_PUT_CLIENT,
+	HISTGRAM_STMT_NUMBER
+};
+
+static const char *const histgram_stmt_sql[HISTGRAM_STMT_NUMBER] = {
+	"BEGIN",
+	"COMMIT",
+	"ROLLBACK",
+	"DELETE FROM reads",
+	"DELETE FROM clients",
+	/* entry_id is unique, thus the row is replaced */
+	"INSERT INTO reads (entry_id, client_id, inum, gnum, pagenum, count) "
+	"VALUES (?, ?, ?, ?, ?, ?)",
+	/* cliaddr is unique, thus the row is replaced */
+	"INSERT INTO clients (cliaddr, total_reads, total_hits) "
+	"VALUES (?, ?, ?)",
+};
+
+static sqlite3_stmt *histgram_stmts[HISTGRAM_STMT_NUMBER];
+
+static const char *const histgram_table_sql[] = {
+	"CREATE TABLE clients ("
+	"id INTEGER NOT NULL PRIMARY KEY AUTOINCREMENT, "
+	"cliaddr INTEGER NOT NULL, "
+	"total_reads INTEGER NOT NULL, "
+	"total_hits INTEGER NOT NULL, "
+	"UNIQUE(cliaddr) ON CONFLICT REPLACE)",
+	"CREATE TABLE reads ("
+	"id INTEGER NOT NULL PRIMARY KEY AUTOINCREMENT, "
+	"entry_id INTEGER NOT NULL, "
+	"client_id INTEGER NOT NULL, "
+	"inum UINT8 NOT NULL, "
+	"gnum UINT8 NOT NULL, "
+	"pagenum UINT8 NOT NULL, "
+	"count INTEGER NOT NULL, "
+	"UNIQUE(entry_id) ON CONFLICT REPLACE)",
+};
+
+static const char *const histgram_table_names[] = { "clients", "reads" };
+
+static int
+histgram_exec(sqlite3 *db, const char *sql, const char *dbname)
+{
+	char *errmsg = NULL;
+	int rc;
+
+	rc = sqlite3_exec(db, sql, NULL, NULL, &errmsg);
+	if (rc != SQLITE_OK) {
+		gflog_debug(GFARM_MSG_UNFIXED, "histgram database %s: "
+		    "\"%s\": %s", dbname, sql, errmsg);
+		sqlite3_free(errmsg);
+	}
+	return (rc);
+}
+
+/*
+ * (re)creates the tables, because the histgram in the shared memory
+ * is always new at startup.
+ */
+static sqlite3 *
+histgram_db_open(const char *dbname)
+{
+	sqlite3 *db;
+	char sql[64];
+	int i;
+
+	if (sqlite3_open(dbname, &db) != SQLITE_OK) {
+		gflog_error(GFARM_MSG_UNFIXED,
+		    "histgram database %s: cannot open: %s",
+		    dbname, db == NULL ? "no memory" : sqlite3_errmsg(db));
+		sqlite3_close(db);
+		return (NULL);
+	}
+	for (i = 0; i < GFARM_ARRAY_LENGTH(histgram_table_sql); i++) {
+		if (histgram_exec(db, histgram_table_sql[i], dbname) ==
+		    SQLITE_OK)
+			continue;
+		snprintf(sql, sizeof(sql), "DROP TABLE %s",
+		    histgram_table_names[i]);
+		if (histgram_exec(db, sql, dbname) != SQLITE_OK ||
+		    histgram_exec(db, histgram_table_sql[i], dbname) !=
+		    SQLITE_OK) {
+			gflog_error(GFARM_MSG_UNFIXED,
+			    "histgram database %s: cannot create table %s: %s",
+			    dbname, histgram_table_names[i],
+			    sqlite3_errmsg(db));
+			sqlite3_close(db);
+			return (NULL);
+		}
+	}
+
+	/*
+	 * the histgram writer is the only writer, and readers
+	 * shouldn't block its batch transactions.
+	 */
+	if (histgram_exec(db, "PRAGMA journal_mode=WAL", dbname)
+	    != SQLITE_OK ||
+	    histgram_exec(db, "PRAGMA synchronous=NORMAL", dbname)
+	    != SQLITE_OK)
+		gflog_warning(GFARM_MSG_UNFIXED,
+		    "histgram database %s: %s", dbname, sqlite3_errmsg(db));
+	return (db);
+}
+
+static void
+histgram_stmts_finalize(void)
+{
+	int i;
+
+	for (i = 0; i < HISTGRAM_STMT_NUMBER; i++) {
+		if (histgram_stmts[i] != NULL)
+			sqlite3_finalize(histgram_stmts[i]);
+		histgram_stmts[i] = NULL;
+	}
+}
+
+static gfarm_error_t
+histgram_stmts_prepare(sqlite3 *db)
+{
+	int i;
+
+	for (i = 0; i < HISTGRAM_STMT_NUMBER; i++) {
+		if (sqlite3_prepare_v2(db, histgram_stmt_sql[i], -1,
+		    &histgram_stmts[i], NULL) != SQLITE_OK) {
+			gflog_error(GFARM_MSG_UNFIXED,
+			    "histgram: prepare \"%s\": %s",
+			    histgram_stmt_sql[i], sqlite3_errmsg(db));
+			histgram_stmts_finalize();
+			return (GFARM_ERR_SQL);
+		}
+	}
+	return (GFARM_ERR_NO_ERROR);
+}
+
+static int
+histgram_step(enum histgram_stmt_id id)
+{
+	sqlite3_stmt *stmt = histgram_stmts[id];
+	int rc;
+
+	rc = sqlite3_step(stmt);
+	sqlite3_reset(stmt);
+	sqlite3_clear_bindings(stmt);
+	if (rc != SQLITE_DONE) {
+		gflog_error(GFARM_MSG_UNFIXED, "histgram: \"%s\": %s",
+		    histgram_stmt_sql[id],
+		    sqlite3_errmsg(sqlite3_db_handle(stmt)));
+		return (rc);
+	}
+	return (SQLITE_OK);
+}
+
+static void
+histgram_flush_reset(void)
+{
+	gfarm_uint64_t i;
+
+	for (i = 0; i < histgram->nslots; i++)
+		histgram_reads[i].flushed = 0;
+	histgram_flushed_epoch = 0;
+}
+
+/*
+ * writes the histgram entries updated since the last flush into the DB
+ * opened by histgram_db_open(), by one transaction.
+ */
+static gfarm_error_t
+histgram_flush(gfarm_uint64_t *nflushedp)
+{
+	struct histgram_slot *slot;
+	struct histgram_client *client;
+	sqlite3_stmt *stmt;
+	gfarm_uint64_t i, epoch, count;
+	int rc, nflushed = 0;
+
+	if ((rc = histgram_step(HISTGRAM_STMT_BEGIN)) != SQLITE_OK)
+		return (GFARM_ERR_SQL);
+
+	epoch = histgram->epoch;
+	if (epoch != histgram_flushed_epoch) {
+		rc = histgram_step(HISTGRAM_STMT_CLEAR_READS);
+		if (rc == SQLITE_OK)
+			rc = histgram_step(HISTGRAM_STMT_CLEAR_CLIENTS);
+	}
+
+	stmt = histgram_stmts[HISTGRAM_STMT_PUT_READ];
+	for (i = 0; rc == SQLITE_OK && i < histgram->nslots; i++) {
+		slot = &histgram_reads[i];
+		if (!histgram_slot_is_valid(slot->state, epoch))
+			continue;
+		count = slot->count;
+		if (count == slot->flushed && epoch == histgram_flushed_epoch)
+			continue;
+		sqlite3_bind_int64(stmt, 1, i + 1);
+		sqlite3_bind_int64(stmt, 2, slot->key.client);
+		sqlite3_bind_int64(stmt, 3, slot->key.ino);
+		sqlite3_bind_int64(stmt, 4, slot->key.gen);
+		sqlite3_bind_int64(stmt, 5, slot->key.page);
+		sqlite3_bind_int64(stmt, 6, count);
+		rc = histgram_step(HISTGRAM_STMT_PUT_READ);
+		slot->flushed = count;
+		nflushed++;
+	}
+	stmt = histgram_stmts[HISTGRAM_STMT_PUT_CLIENT];
+	for (i = 0; rc == SQLITE_OK && i < HISTGRAM_CLIENTS; i++) {
+		client = &histgram_clients[i];
+		if (!histgram_slot_is_valid(client->state, epoch))
+			continue;
+		sqlite3_bind_int64(stmt, 1, client->addr);
+		sqlite3_bind_int64(stmt, 2, client->reads);
+		sqlite3_bind_int64(stmt, 3, client->hits);
+		rc = histgram_step(HISTGRAM_STMT_PUT_CLIENT);
+	}
+
+	if (rc == SQLITE_OK)
+		rc = histgram_step(HISTGRAM_STMT_COMMIT);
+	if (rc != SQLITE_OK) {
+		(void)histgram_step(HISTGRAM_STMT_ROLLBACK);
+		/* write everything again at next time */
+		histgram_flush_reset();
+		return (GFARM_ERR_SQL);
+	}
+	histgram_flushed_epoch = epoch;
+	*nflushedp += nflushed;
+	gflog_debug(GFARM_MSG_UNFIXED, "histgram: %d entries flushed",
+	    nflushed);
+	return (GFARM_ERR_NO_ERROR);
+}
+
+#endif /* HAVE_SQLITE3 */
+
+/*
+ * returns the number of events processed.
+ * *stallp counts how many times in a row the head of the queue
+ * has been claimed by a producer, but not filled yet.
+ */
+static int
+histgram_drain(int max, int *stallp)
+{
+	struct histgram_event *ev;
+	gfarm_uint64_t pos, seq, mask = histgram->queue_length - 1;
+	int n;
+
+	for (n = 0; n < max; n++) {
+		pos = histgram->dequeue_pos;
+		ev = &histgram_queue[pos & mask];
+		seq = ev->seq;
+		if (seq == pos + 1) {
+			__sync_synchronize();
+			histgram_count_read(ev->client,
+			    ev->ino, ev->gen, ev->offset, ev->size);
+		} else if (histgram->enqueue_pos == pos) {
+			break; /* empty */
+		} else if (++*stallp < HISTGRAM_STALL_MAX) {
+			break;
+		} else {
+			/*
+			 * the producer has most likely been killed.
+			 * if it's only slow, its event will be dropped
+			 * as if the queue is full, later.
+			 */
+			gflog_warning(GFARM_MSG_UNFIXED,
+			    "histgram: skipping an unfinished event at %llu",
+			    (unsigned long long)pos);
+		}
+		*stallp = 0;
+		__sync_synchronize();
+		ev->seq = pos + histgram->queue_length;
+		histgram->dequeue_pos = pos + 1;
+	}
+	return (n);
+}
+
+static void
+histgram_writer_report(gfarm_uint64_t events, gfarm_uint64_t flushed)
+{
+	gfarm_iostat_local_set(GFARM_IOSTAT_HIST_QUEUED,
+	    histgram->enqueue_pos - histgram->dequeue_pos);
+	gfarm_iostat_local_set(GFARM_IOSTAT_HIST_DROPPED,
+	    histgram->queue_dropped);
+	gfarm_iostat_local_set(GFARM_IOSTAT_HIST_EVENTS, events);
+	gfarm_iostat_local_set(GFARM_IOSTAT_HIST_FLUSHED, flushed);
+}
+
+/*
+ * the main loop of the histgram writer process.
+ * returns after gfsd_histgram_writer_stop() is called.
+ */
+void
+gfsd_histgram_writer(const char *dbname, int flush_interval)
+{
+	gfarm_uint64_t events = 0, flushed = 0;
+	time_t now, flush_time;
+	int n, stall = 0;
+#ifdef HAVE_SQLITE3
+	sqlite3 *db = NULL;
+#endif
+
+	if (histgram == NULL)
+		return;
+#ifdef HAVE_SQLITE3
+	if (dbname != NULL && flush_interval > 0 &&
+	    (db = histgram_db_open(dbname)) != NULL &&
+	    histgram_stmts_prepare(db) != GFARM_ERR_NO_ERROR) {
+		sqlite3_close(db);
+		db = NULL;
+	}
+#else
+	if (dbname != NULL)
+		gflog_warning(GFARM_MSG_UNFIXED,
+		    "spool_histgram_db %s is ignored, "
+		    "because gfsd is built without SQLite3", dbname);
+#endif
+
+	flush_time = time(NULL) + flush_interval;
+	while (!histgram_writer_stopping) {
+		n = histgram_drain(HISTGRAM_DRAIN_BATCH, &stall);
+		events += n;
+		if ((now = time(NULL)) >= flush_time) {
+#ifdef HAVE_SQLITE3
+			if (db != NULL)
+				(void)histgram_flush(&flushed);
+#endif
+			flush_time = now + flush_interval;
+		}
+		histgram_writer_report(events, flushed);
+		if (n < HISTGRAM_DRAIN_BATCH)
+			gfarm_nanosleep(HISTGRAM_IDLE_NSEC);
+	}
+
+	while ((n = histgram_drain(HISTGRAM_DRAIN_BATCH, &stall)) > 0)
+		events += n;
+#ifdef HAVE_SQLITE3
+	if (db != NULL) {
+		(void)histgram_flush(&flushed);
+		histgram_stmts_finalize();
+		sqlite3_close(db);
+	}
+#endif
+	histgram_writer_report(events, flushed);
+}
+
+/* this is async-signal-safe */
+void
+gfsd_histgram_writer_stop(void)
+{
+	histgram_writer_stopping = 1;
+}
@@ -0,0 +1,16 @@
+/*
+ * read access histgram and cache hit rate statistics,
+ * shared among all gfsd processes
+ */
+
+#define GFSD_HISTGRAM_PAGE_SIZE		(1ULL * 1024 * 1024)
+
+gfarm_error_t gfsd_histgram_init(int, int);
+void gfsd_histgram_record_client(gfarm_uint32_t);
+void gfsd_histgram_enqueue_read(gfarm_uint32_t,
+	gfarm_ino_t, gfarm_uint64_t, gfarm_off_t, size_t);
+gfarm_error_t gfsd_histgram_get_hitrates(char **, int *);
+void gfsd_histgram_clear(void);
+
+void gfsd_histgram_writer(const char *, int);
+void gfsd_histgram_writer_stop(void);
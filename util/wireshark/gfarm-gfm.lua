@@ -180,7 +180,9 @@ local gfm_command_names = {
    [289] = 'GFM_PROTO_METADB_SERVER_GET_ALL', 
    [290] = 'GFM_PROTO_METADB_SERVER_SET', 
    [291] = 'GFM_PROTO_METADB_SERVER_MODIFY', 
-   [292] = 'GFM_PROTO_METADB_SERVER_REMOVE',
+   [292] = 'GFM_PROTO_METADB_SERVER_REMOVE', 
+   [293] = 'GFM_PROTO_METADB_SERVER_SEQNUM_GET', 
+   [294] = 'GFM_PROTO_METADB_SERVER_READ_ONLY',
 }
 
 --
@@ -1556,7 +1558,7 @@ end
 function parse_gfm_reopen_response(tvb, pinfo, item, offset)
    -- OUT error_code
    --     (upon success) l:inode_number, l:generation, i:mode,
-   --                    i:flags, i:to_create
+   --                    i:flags, i:to_create
    local err
    offset, err = parse_xdr(tvb, item, "i", offset, "error_code", error_names)
    if err == 0 then
@@ -2124,7 +2126,7 @@ end
 -- Parse GFM_PROTO_PROCESS_SET.
 --
 function parse_gfm_process_set_request(tvb, pinfo, item, offset)
-   -- IN i:key_type, b:shared_key, l:pid
+   -- IN i:key_type, b:shared_key, l:pid
    offset = offset + 4
    offset = parse_xdr(tvb, item, "i", offset, "cookie")
    offset = parse_xdr(tvb, item, "b", offset, "shared_key")